@@ -40,6 +40,7 @@ G_BEGIN_DECLS
 #define RTCP_MIN_INTERVAL 500 /* ms */
 #define REMB_MAX_INTERVAL 200 /* ms */
 #define RTP_RTX_SIZE 512 /* packets */
+#define RTP_RTX_TIME 1000 /* ms */
 
 /* rtpbin pad names */
 #define RTPBIN_RECV_RTP_SINK "recv_rtp_sink_"
@@ -19,6 +19,7 @@
 #endif
 
 #include <string.h>
+#include <stdio.h>
 #include "kmsbasertpendpoint.h"
 #include "kmsbasertpsession.h"
 #include "rtpsync/kmsrtpsynchronizer.h"
@@ -33,6 +34,13 @@
 #include "sdpagent/kmssdpredundantext.h"
 #include "sdpagent/kmssdprtpavpfmediahandler.h"
 #include "kmsremb.h"
+#include "kmsjitterbuffercontrol.h"
+#include "kmsprotectioncontrol.h"
+#include "kmsrtxcache.h"
+#include "kmsrtppacer.h"
+#include "kmsrtprewriter.h"
+#include "kmsrtcpdispatcher.h"
+#include "kmsrtpvp8.h"
 #include "kmsrefstruct.h"
 
 #include <gst/rtp/gstrtpdefs.h>
@@ -101,12 +109,16 @@ struct _KmsRTPSessionStats
   GObject *rtp_session;
   GstSDPDirection direction;
   GSList *ssrcs;                /* list of all jitter buffers associated to a ssrc */
+  KmsJitterBufferControl *jb_control;
+  KmsProtectionControl *prot_control;   /* NULL if the media is not protected */
 };
 
 typedef struct _KmsBaseRTPStats KmsBaseRTPStats;
 struct _KmsBaseRTPStats
 {
   gboolean enabled;
+  /* Add RTP statistics to the structure returned by the stats signal */
+  gboolean rtc_structure;
   GHashTable *rtp_stats;
   GSList *probes;
   /* End-to-end average stream stats */
@@ -123,6 +135,7 @@ typedef struct _ExtData
 typedef struct _E2EProbeData
 {
   gchar *id;
+  GQuark quark;
   StreamE2EAvgStat *stat;
 } E2EProbeData;
 
@@ -209,6 +222,7 @@ struct _KmsBaseRtpEndpointPrivate
   KmsMediaState media_state;
 
   gboolean support_fec;
+  gboolean send_fec;
   gboolean rtcp_mux;
   gboolean rtcp_nack;
   gboolean rtcp_remb;
@@ -222,13 +236,26 @@ struct _KmsBaseRtpEndpointPrivate
   guint max_video_send_bw;
 
   /* Medias protected by ulpfec */
-  KmsList *prot_medias;
+  KmsQuarkMap *prot_medias;
 
   /* REMB */
   GstStructure *remb_params;
   KmsRembLocal *rl;
   KmsRembRemote *rm;
 
+  /* Jitter buffers latency */
+  KmsJitterBufferControl *jb_control;
+
+  /* FEC and RTX of the outgoing video */
+  KmsProtectionControl *prot_control;
+
+  /* Outgoing video is paced to the REMB estimation */
+  gboolean pacing;
+
+  /* Packets payloaded by the source are reused instead of payloading */
+  gboolean shared_packetization;
+  guint mtu;
+
   /* Port range */
   guint min_port;
   guint max_port;
@@ -244,6 +271,12 @@ struct _KmsBaseRtpEndpointPrivate
   KmsRtpSynchronizer *sync_audio;
   KmsRtpSynchronizer *sync_video;
   gboolean perform_video_sync;
+  /* SSRC of each jitterbuffer to its synchronizer, for the SRs */
+  GHashTable *sync_ssrcs;       /* <ssrc, SyncSsrc> */
+
+  /* Received RTCP, processed out of the streaming threads */
+  KmsRtcpDispatcher *rtcp_dispatcher;
+  guint rtcp_handler_id;
 };
 
 /* Signals and args */
@@ -264,6 +297,11 @@ static guint obj_signals[LAST_SIGNAL] = { 0 };
 #define DEFAULT_RTCP_NACK    FALSE
 #define DEFAULT_RTCP_REMB    FALSE
 #define DEFAULT_TARGET_BITRATE    0
+#define DEFAULT_RTC_STATS_STRUCTURE    TRUE
+#define DEFAULT_PACING    FALSE
+#define DEFAULT_SHARED_PACKETIZATION    FALSE
+#define DEFAULT_SEND_FEC    FALSE
+#define DEFAULT_MTU    1400     /* As the payloaders */
 #define MIN_VIDEO_RECV_BW_DEFAULT 0
 #define MIN_VIDEO_SEND_BW_DEFAULT 100
 #define MAX_VIDEO_SEND_BW_DEFAULT 500
@@ -283,6 +321,13 @@ enum
   PROP_MIN_PORT,
   PROP_MAX_PORT,
   PROP_SUPPORT_FEC,
+  PROP_SEND_FEC,
+  PROP_JITTER_BUFFER_PARAMS,
+  PROP_PROTECTION_PARAMS,
+  PROP_RTC_STATS_STRUCTURE,
+  PROP_PACING,
+  PROP_SHARED_PACKETIZATION,
+  PROP_MTU,
   PROP_LAST
 };
 
@@ -522,7 +567,8 @@ kms_base_rtp_configure_extensions (KmsBaseRtpEndpoint * self,
   ExtData *edata;
 
   edata = ext_data_new ();
-  kms_list_append (self->priv->prot_medias, g_strdup (media), edata);
+  kms_quark_map_insert (self->priv->prot_medias, g_quark_from_string (media),
+      edata);
 
   ulpfecext = kms_sdp_ulp_fec_ext_new ();
   redext = kms_sdp_redundant_ext_new ();
@@ -638,13 +684,16 @@ ssrc_stats_destroy (KmsSSRCStats * stats)
 }
 
 static KmsRTPSessionStats *
-rtp_session_stats_new (GObject * rtp_session, GstSDPDirection direction)
+rtp_session_stats_new (GObject * rtp_session, GstSDPDirection direction,
+    KmsJitterBufferControl * jb_control, KmsProtectionControl * prot_control)
 {
   KmsRTPSessionStats *stats;
 
   stats = g_slice_new0 (KmsRTPSessionStats);
   stats->rtp_session = g_object_ref (rtp_session);
   stats->direction = direction;
+  stats->jb_control = jb_control;
+  stats->prot_control = prot_control;
 
   return stats;
 }
@@ -716,7 +765,9 @@ kms_base_rtp_endpoint_create_rtp_session (KmsBaseRtpEndpoint * self,
       GUINT_TO_POINTER (session_id));
 
   if (rtp_stats == NULL) {
-    rtp_stats = rtp_session_stats_new (rtpsession, direction);
+    rtp_stats = rtp_session_stats_new (rtpsession, direction,
+        self->priv->jb_control, session_id == VIDEO_RTP_SESSION ?
+        self->priv->prot_control : NULL);
     g_hash_table_insert (self->priv->stats.rtp_stats,
         GUINT_TO_POINTER (session_id), rtp_stats);
   } else {
@@ -798,6 +849,11 @@ kms_base_rtp_endpoint_configure_rtp_media (KmsBaseRtpEndpoint * self,
   g_object_get (rtpsession, "internal-ssrc", &ssrc, NULL);
   /* HACK: force this SSRC in the payloader. */
   g_object_set (rtpsession, "internal-ssrc", ssrc, NULL);
+
+  if (session_id == VIDEO_RTP_SESSION) {
+    kms_protection_control_set_session (self->priv->prot_control, rtpsession);
+  }
+
   g_object_unref (rtpsession);
 
   str = g_strdup_printf ("%" G_GUINT32_FORMAT " cname:%s", ssrc, cname);
@@ -846,6 +902,7 @@ kms_base_rtp_endpoint_create_remb_managers (KmsBaseRtpSession * sess,
     KmsBaseRtpEndpoint * self)
 {
   GstElement *rtpbin = self->priv->rtpbin;
+  KmsRembRemote *rm;
   GObject *rtpsession;
   GstPad *pad;
   int max_recv_bw;
@@ -872,11 +929,16 @@ kms_base_rtp_endpoint_create_remb_managers (KmsBaseRtpSession * sess,
       sess->remote_video_ssrc);
 
   pad = gst_element_get_static_pad (rtpbin, VIDEO_RTPBIN_SEND_RTP_SINK);
-  self->priv->rm =
-      kms_remb_remote_create (rtpsession,
+  rm = kms_remb_remote_create (rtpsession,
       self->priv->video_config->local_ssrc, self->priv->min_video_send_bw,
       self->priv->max_video_send_bw, pad);
+  kms_remb_remote_set_protection_control (rm, self->priv->prot_control);
   g_object_unref (pad);
+
+  /* Read from the RTCP dispatcher */
+  KMS_ELEMENT_LOCK (self);
+  self->priv->rm = rm;
+  KMS_ELEMENT_UNLOCK (self);
   g_object_unref (rtpsession);
 
   if (self->priv->remb_params != NULL) {
@@ -961,19 +1023,25 @@ kms_base_rtp_endpoint_request_rtcp_sink (KmsIRtpSessionManager * manager,
   const gchar *media_str = gst_sdp_media_get_media (media);
   GstPad *pad;
 
+  guint session;
+
   if (g_strcmp0 (AUDIO_STREAM_NAME, media_str) == 0) {
     pad =
         gst_element_get_request_pad (self->priv->rtpbin,
         AUDIO_RTPBIN_RECV_RTCP_SINK);
+    session = AUDIO_RTP_SESSION;
   } else if (g_strcmp0 (VIDEO_STREAM_NAME, media_str) == 0) {
     pad =
         gst_element_get_request_pad (self->priv->rtpbin,
         VIDEO_RTPBIN_RECV_RTCP_SINK);
+    session = VIDEO_RTP_SESSION;
   } else {
     GST_ERROR_OBJECT (self, "'%s' not valid", media_str);
     return NULL;
   }
 
+  kms_rtcp_dispatcher_attach_pad (self->priv->rtcp_dispatcher, pad, session);
+
   return pad;
 }
 
@@ -1046,6 +1114,9 @@ kms_base_rtp_endpoint_start_transport_send (KmsBaseSdpEndpoint *
       kms_base_rtp_endpoint_create_remb_managers (base_rtp_sess, self);
     }
   }
+
+  kms_protection_control_set_nack (self->priv->prot_control,
+      kms_base_rtp_endpoint_is_video_rtcp_nack (self));
 }
 
 /* Start Transport Send end */
@@ -1170,6 +1241,22 @@ end:
   return payloader;
 }
 
+static GstElement *
+kms_base_rtp_endpoint_get_rtp_rewriter (KmsBaseRtpEndpoint * self,
+    const gchar * media_str, GstCaps * caps)
+{
+  guint32 ssrc;
+
+  if (g_strcmp0 (AUDIO_STREAM_NAME, media_str) == 0) {
+    ssrc = self->priv->audio_config->local_ssrc;
+  } else {
+    ssrc = self->priv->video_config->local_ssrc;
+  }
+
+  /* The source payloads once and this only rewrites the headers */
+  return GST_ELEMENT (kms_rtp_rewriter_new (caps, ssrc));
+}
+
 static GstElement *
 gst_base_rtp_get_depayloader_for_caps (GstCaps * caps)
 {
@@ -1216,19 +1303,19 @@ end:
 
 static void
 add_mark_data_cb (GstPad * pad, KmsMediaType type, GstClockTimeDiff t,
-    KmsList * meta_data, gpointer user_data)
+    KmsQuarkMap ** meta_data, gpointer user_data)
 {
   E2EProbeData *data = (E2EProbeData *) user_data;
   StreamE2EAvgStat *stat;
 
-  stat = kms_list_lookup (meta_data, data->id);
+  stat = kms_quark_map_lookup (*meta_data, data->quark);
 
   if (stat != NULL) {
     GST_WARNING_OBJECT (pad, "Can not mark buffer for e2e latency. "
         "Already used ID: %s", data->id);
   } else {
     /* add mark data to this meta */
-    kms_list_prepend (meta_data, g_strdup (data->id),
+    kms_buffer_latency_data_insert (meta_data, data->quark,
         kms_stats_stream_e2e_avg_stat_ref (data->stat));
   }
 }
@@ -1268,6 +1355,7 @@ kms_base_rtp_endpoint_configure_2e2_latency (KmsBaseRtpEndpoint * self,
 
   data = e2e_probe_data_new ();
   data->id = id;
+  data->quark = g_quark_from_string (id);
   data->stat = kms_stats_stream_e2e_avg_stat_ref (stat);
 
   KMS_ELEMENT_UNLOCK (self);
@@ -1353,7 +1441,26 @@ kms_base_rtp_endpoint_connect_payloader (KmsBaseRtpEndpoint * self,
 
   gst_element_sync_state_with_parent (payloader);
 
-  gst_element_link_pads (payloader, "src", rtpbin, rtpbin_pad_name);
+  if (type == KMS_ELEMENT_PAD_TYPE_VIDEO && self->priv->pacing) {
+    GstElement *pacer;
+    guint bitrate;
+
+    /* Until the first REMB arrives */
+    if (self->priv->target_bitrate > 0) {
+      bitrate = self->priv->target_bitrate;
+    } else {
+      bitrate = self->priv->max_video_send_bw * 1000;
+    }
+
+    pacer = GST_ELEMENT (kms_rtp_pacer_new (bitrate));
+    gst_bin_add (GST_BIN (self), pacer);
+    gst_element_sync_state_with_parent (pacer);
+
+    gst_element_link (payloader, pacer);
+    gst_element_link_pads (pacer, "src", rtpbin, rtpbin_pad_name);
+  } else {
+    gst_element_link_pads (payloader, "src", rtpbin, rtpbin_pad_name);
+  }
 
   kms_base_rtp_endpoint_connect_payloader_async (self, conn, payloader, type);
 }
@@ -1385,7 +1492,21 @@ kms_base_rtp_endpoint_set_media_payloader (KmsBaseRtpEndpoint * self,
 
   GST_DEBUG_OBJECT (self, "Found caps: %" GST_PTR_FORMAT, caps);
 
-  payloader = gst_base_rtp_get_payloader_for_caps (caps);
+  /* Payloaders of the sources always use the default MTU */
+  if (self->priv->shared_packetization && self->priv->mtu == DEFAULT_MTU) {
+    payloader = kms_base_rtp_endpoint_get_rtp_rewriter (self, media_str, caps);
+  } else {
+    if (self->priv->shared_packetization) {
+      GST_INFO_OBJECT (self, "MTU is %u, packets of '%s' are not shared",
+          self->priv->mtu, media_str);
+    }
+
+    payloader = gst_base_rtp_get_payloader_for_caps (caps);
+
+    if (payloader != NULL && self->priv->mtu != DEFAULT_MTU) {
+      g_object_set (payloader, "mtu", self->priv->mtu, NULL);
+    }
+  }
   gst_caps_unref (caps);
 
   if (payloader == NULL) {
@@ -1744,12 +1865,80 @@ kms_base_rtp_endpoint_update_stats (KmsBaseRtpEndpoint * self,
   KMS_ELEMENT_UNLOCK (self);
 }
 
+static gboolean
+kms_base_rtp_endpoint_caps_is_vp8 (const GstCaps * caps)
+{
+  const GstStructure *st;
+  const gchar *encoding;
+
+  if (caps == NULL || gst_caps_get_size (caps) == 0) {
+    return FALSE;
+  }
+
+  st = gst_caps_get_structure (caps, 0);
+  encoding = gst_structure_get_string (st, "encoding-name");
+
+  return encoding != NULL && g_ascii_strcasecmp (encoding, "VP8") == 0;
+}
+
+/* Pads of simulcast layers, other than the main video SSRC */
+static gboolean
+kms_base_rtp_endpoint_is_video_layer_pad (KmsBaseRtpEndpoint * self,
+    GstPad * pad)
+{
+  const gchar *name =
+      GST_OBJECT_NAME (pad) + strlen (VIDEO_RTPBIN_RECV_RTP_SRC);
+  GHashTable *sessions;
+  GHashTableIter iter;
+  gpointer sess;
+  gboolean ret = FALSE;
+  guint ssrc, pt;
+
+  if (sscanf (name, "_%u_%u", &ssrc, &pt) != 2) {
+    return FALSE;
+  }
+
+  KMS_ELEMENT_LOCK (self);
+  sessions = kms_base_sdp_endpoint_get_sessions (KMS_BASE_SDP_ENDPOINT (self));
+  g_hash_table_iter_init (&iter, sessions);
+  while (!ret && g_hash_table_iter_next (&iter, NULL, &sess)) {
+    ret = kms_base_rtp_session_is_remote_video_layer (KMS_BASE_RTP_SESSION
+        (sess), ssrc);
+  }
+  KMS_ELEMENT_UNLOCK (self);
+
+  return ret;
+}
+
+static void
+kms_base_rtp_endpoint_link_depayloader (GstElement * depayloader,
+    GstElement * agnostic, gboolean layer)
+{
+  GstPad *src, *sink;
+
+  if (!layer) {
+    gst_element_link_pads (depayloader, "src", agnostic, "sink");
+    return;
+  }
+
+  src = gst_element_get_static_pad (depayloader, "src");
+  sink = gst_element_get_request_pad (agnostic, "sink_layer_%u");
+
+  if (sink == NULL || gst_pad_link (src, sink) != GST_PAD_LINK_OK) {
+    GST_WARNING_OBJECT (depayloader, "Cannot link simulcast layer to %"
+        GST_PTR_FORMAT, agnostic);
+  }
+
+  g_clear_object (&sink);
+  g_object_unref (src);
+}
+
 static void
 kms_base_rtp_endpoint_rtpbin_pad_added (GstElement * rtpbin, GstPad * pad,
     KmsBaseRtpEndpoint * self)
 {
   GstElement *agnostic, *depayloader;
-  gboolean added = TRUE;
+  gboolean added = TRUE, layer = FALSE;
   KmsMediaType media;
   GstCaps *caps;
 
@@ -1762,8 +1951,12 @@ kms_base_rtp_endpoint_rtpbin_pad_added (GstElement * rtpbin, GstPad * pad,
           VIDEO_RTPBIN_RECV_RTP_SRC)) {
     agnostic = kms_element_get_video_agnosticbin (KMS_ELEMENT (self));
     media = KMS_MEDIA_TYPE_VIDEO;
+    layer = kms_base_rtp_endpoint_is_video_layer_pad (self, pad);
 
-    if (self->priv->rl != NULL) {
+    if (layer) {
+      /* Media already started with the main layer */
+      added = FALSE;
+    } else if (self->priv->rl != NULL) {
       self->priv->rl->event_manager = kms_utils_remb_event_manager_create (pad);
     }
   } else {
@@ -1777,13 +1970,18 @@ kms_base_rtp_endpoint_rtpbin_pad_added (GstElement * rtpbin, GstPad * pad,
       " with caps %" GST_PTR_FORMAT, pad, agnostic, caps);
 
   depayloader = gst_base_rtp_get_depayloader_for_caps (caps);
-  gst_caps_unref (caps);
 
   if (depayloader != NULL) {
     GST_DEBUG_OBJECT (self, "Found depayloader %" GST_PTR_FORMAT, depayloader);
     kms_base_rtp_endpoint_update_stats (self, depayloader, media);
+
+    if (media == KMS_MEDIA_TYPE_VIDEO
+        && kms_base_rtp_endpoint_caps_is_vp8 (caps)) {
+      kms_rtp_vp8_tag_temporal_layers (depayloader);
+    }
+
     gst_bin_add (GST_BIN (self), depayloader);
-    gst_element_link_pads (depayloader, "src", agnostic, "sink");
+    kms_base_rtp_endpoint_link_depayloader (depayloader, agnostic, layer);
     gst_element_link_pads (rtpbin, GST_OBJECT_NAME (pad), depayloader, "sink");
     gst_element_sync_state_with_parent (depayloader);
   } else {
@@ -1799,6 +1997,8 @@ kms_base_rtp_endpoint_rtpbin_pad_added (GstElement * rtpbin, GstPad * pad,
     gst_element_sync_state_with_parent (fake);
   }
 
+  gst_caps_unref (caps);
+
 end:
   GST_PAD_STREAM_UNLOCK (pad);
 
@@ -1820,75 +2020,128 @@ kms_base_rtp_endpoint_change_latency_probe (GstPad * pad,
   return GST_PAD_PROBE_REMOVE;
 }
 
-static gboolean
-kms_base_rtp_endpoint_calculate_new_pts_bufflist (GstBuffer ** buf, guint idx,
-    KmsRtpSynchronizer * sync)
-{
-  kms_rtp_synchronizer_process_rtp_buffer (sync, *buf, NULL);
-
-  return TRUE;
-}
-
+/*
+ * Lists are handled in case an upstream element pushes them, but udpsrc,
+ * the jitterbuffers and the depayloaders of the receive path only push
+ * single buffers, so this is where they are processed today.
+ */
 static GstPadProbeReturn
 timestamps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
 {
   KmsRtpSynchronizer *sync = user_data;
 
-  if (GST_PAD_PROBE_INFO_TYPE (info) | GST_PAD_PROBE_TYPE_BUFFER) {
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
     GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
 
     kms_rtp_synchronizer_process_rtp_buffer (sync, buffer, NULL);
   } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
     GstBufferList *bufflist = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
 
-    gst_buffer_list_foreach (bufflist,
-        (GstBufferListFunc) kms_base_rtp_endpoint_calculate_new_pts_bufflist,
-        sync);
+    kms_rtp_synchronizer_process_rtp_buffer_list (sync, bufflist, NULL);
   }
 
   return GST_PAD_PROBE_OK;
 }
 
+typedef struct _SyncSsrc
+{
+  KmsRtpSynchronizer *sync;
+  GWeakRef jitterbuffer;
+} SyncSsrc;
+
+static SyncSsrc *
+sync_ssrc_new (KmsRtpSynchronizer * sync, GstElement * jitterbuffer)
+{
+  SyncSsrc *entry = g_slice_new0 (SyncSsrc);
+
+  entry->sync = sync;
+  g_weak_ref_init (&entry->jitterbuffer, jitterbuffer);
+
+  return entry;
+}
+
+static void
+sync_ssrc_destroy (SyncSsrc * entry)
+{
+  g_weak_ref_clear (&entry->jitterbuffer);
+  g_slice_free (SyncSsrc, entry);
+}
+
 static gboolean
-kms_base_rtp_endpoint_process_rtcp_bufflist (GstBuffer ** buf, guint idx,
-    KmsRtpSynchronizer * sync)
+sync_ssrc_is_gone (gpointer key, SyncSsrc * entry, gpointer user_data)
 {
-  kms_rtp_synchronizer_process_rtcp_buffer (sync, *buf,
-      GST_BUFFER_DTS (*buf), NULL);
+  GstElement *jitterbuffer = g_weak_ref_get (&entry->jitterbuffer);
 
-  return TRUE;
+  if (jitterbuffer == NULL) {
+    return TRUE;
+  }
+
+  g_object_unref (jitterbuffer);
+
+  return FALSE;
 }
 
-static GstPadProbeReturn
-rtcp_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+/* Must be called with the element lock held */
+static KmsRtpSynchronizer *
+kms_base_rtp_endpoint_get_sync_for_ssrc (KmsBaseRtpEndpoint * self,
+    guint32 ssrc)
 {
-  KmsRtpSynchronizer *sync = user_data;
+  SyncSsrc *entry;
 
-  if (GST_PAD_PROBE_INFO_TYPE (info) | GST_PAD_PROBE_TYPE_BUFFER) {
-    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  entry = g_hash_table_lookup (self->priv->sync_ssrcs,
+      GUINT_TO_POINTER (ssrc));
 
-    kms_rtp_synchronizer_process_rtcp_buffer (sync, buffer,
-        GST_BUFFER_DTS (buffer), NULL);
-  } else {
-    GstBufferList *bufflist = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+  if (entry == NULL) {
+    return NULL;
+  }
 
-    gst_buffer_list_foreach (bufflist,
-        (GstBufferListFunc) kms_base_rtp_endpoint_process_rtcp_bufflist, sync);
+  if (sync_ssrc_is_gone (NULL, entry, NULL)) {
+    /* The stream timed out or said BYE */
+    g_hash_table_remove (self->priv->sync_ssrcs, GUINT_TO_POINTER (ssrc));
+    return NULL;
   }
 
-  return GST_PAD_PROBE_OK;
+  return entry->sync;
 }
 
 static void
-pad_added_jb (GstElement * jitterbuffer, GstPad * new_pad, gpointer sync)
+kms_base_rtp_endpoint_on_rtcp (const KmsRtcpCompound * compound,
+    KmsBaseRtpEndpoint * self)
 {
-  if (g_strcmp0 (GST_OBJECT_NAME (new_pad), "sink_rtcp") != 0) {
+  KmsRembRemote *rm;
+  guint i;
+
+  for (i = 0; i < compound->sender_reports->len; i++) {
+    KmsRtcpSenderReport *sr =
+        &g_array_index (compound->sender_reports, KmsRtcpSenderReport, i);
+    KmsRtpSynchronizer *sync;
+
+    KMS_ELEMENT_LOCK (self);
+    sync = kms_base_rtp_endpoint_get_sync_for_ssrc (self, sr->ssrc);
+    KMS_ELEMENT_UNLOCK (self);
+
+    if (sync != NULL) {
+      kms_rtp_synchronizer_process_rtcp_sr (sync, sr->ssrc, sr->ntp_time,
+          sr->rtp_time, compound->arrival);
+    }
+  }
+
+  if (compound->session != VIDEO_RTP_SESSION || compound->rembs->len == 0) {
     return;
   }
 
-  gst_pad_add_probe (new_pad,
-      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
-      rtcp_probe, sync, NULL);
+  KMS_ELEMENT_LOCK (self);
+  rm = self->priv->rm;
+  KMS_ELEMENT_UNLOCK (self);
+
+  if (rm == NULL) {
+    return;
+  }
+
+  for (i = 0; i < compound->rembs->len; i++) {
+    kms_remb_remote_process_remb (rm,
+        &g_array_index (compound->rembs, KmsRTCPPSFBAFBREMBPacket, i));
+  }
 }
 
 static void
@@ -1917,15 +2170,17 @@ kms_base_rtp_endpoint_rtpbin_new_jitterbuffer (GstElement * rtpbin,
       NULL);
   g_object_unref (src_pad);
 
+  KMS_ELEMENT_LOCK (self);
+
   if ((session == AUDIO_RTP_SESSION) || self->priv->perform_video_sync) {
-    g_signal_connect (jitterbuffer, "pad-added", G_CALLBACK (pad_added_jb),
-        GINT_TO_POINTER (session ==
-            VIDEO_RTP_SESSION ? self->priv->sync_video : self->
-            priv->sync_audio));
+    /* Forget the streams whose jitterbuffers were released */
+    g_hash_table_foreach_remove (self->priv->sync_ssrcs,
+        (GHRFunc) sync_ssrc_is_gone, NULL);
+    g_hash_table_insert (self->priv->sync_ssrcs, GUINT_TO_POINTER (ssrc),
+        sync_ssrc_new (session == VIDEO_RTP_SESSION ? self->priv->sync_video :
+            self->priv->sync_audio, jitterbuffer));
   }
 
-  KMS_ELEMENT_LOCK (self);
-
   rtp_stats =
       g_hash_table_lookup (self->priv->stats.rtp_stats,
       GUINT_TO_POINTER (session));
@@ -1933,6 +2188,12 @@ kms_base_rtp_endpoint_rtpbin_new_jitterbuffer (GstElement * rtpbin,
   if (rtp_stats != NULL) {
     ssrc_stats = ssrc_stats_new (ssrc, jitterbuffer);
     rtp_stats->ssrcs = g_slist_prepend (rtp_stats->ssrcs, ssrc_stats);
+
+    /* Synchronized audio and video must be delayed the same */
+    kms_jitter_buffer_control_add (rtp_stats->jb_control, jitterbuffer,
+        rtp_stats->rtp_session, ssrc, (session == VIDEO_RTP_SESSION
+            && !self->priv->perform_video_sync) ? VIDEO_RTP_SESSION :
+        AUDIO_RTP_SESSION);
   } else {
     GST_ERROR_OBJECT (self, "Session %u exists for SSRC %u", session, ssrc);
   }
@@ -1984,8 +2245,8 @@ kms_base_rtp_endpoint_stop_signal (KmsBaseRtpEndpoint * self, guint session,
 }
 
 static void
-ssrc_stats_add_jitter_stats (GstStructure * ssrc_stats,
-    GstElement * jitter_buffer)
+ssrc_stats_add_jitter_stats (KmsRTPSessionStats * rtp_stats,
+    GstStructure * ssrc_stats, GstElement * jitter_buffer)
 {
   GstStructure *jitter_stats;
   guint percent, latency;
@@ -1999,6 +2260,8 @@ ssrc_stats_add_jitter_stats (GstStructure * ssrc_stats,
   /* Append adition fields to the stats */
   gst_structure_set (jitter_stats, "latency", G_TYPE_UINT, latency, "percent",
       G_TYPE_UINT, percent, NULL);
+  kms_jitter_buffer_control_add_stats (rtp_stats->jb_control, jitter_buffer,
+      jitter_stats);
 
   /* Append jitter buffer stats to the ssrc stats */
   gst_structure_set (ssrc_stats, "jitter-buffer", GST_TYPE_STRUCTURE,
@@ -2154,7 +2417,7 @@ append_rtp_session_stats (gpointer * session, KmsRTPSessionStats * rtp_stats,
     jitter_buffer = rtp_session_stats_get_jitter_buffer (rtp_stats, ssrc);
 
     if (jitter_buffer != NULL) {
-      ssrc_stats_add_jitter_stats (ssrc_stats, jitter_buffer);
+      ssrc_stats_add_jitter_stats (rtp_stats, ssrc_stats, jitter_buffer);
     }
 
     gst_structure_set (session_stats, name, GST_TYPE_STRUCTURE, ssrc_stats,
@@ -2170,6 +2433,10 @@ append_rtp_session_stats (gpointer * session, KmsRTPSessionStats * rtp_stats,
     g_free (ssrc_id);
   }
 
+  if (rtp_stats->prot_control != NULL) {
+    kms_protection_control_add_stats (rtp_stats->prot_control, session_stats);
+  }
+
   g_value_array_free (arr);
 
   str_session = g_strdup_printf ("session-%u", GPOINTER_TO_UINT (session));
@@ -2292,6 +2559,37 @@ kms_base_rtp_endpoint_set_property (GObject * object, guint property_id,
         self->priv->remb_params = g_value_dup_boxed (value);
       }
       break;
+    case PROP_JITTER_BUFFER_PARAMS:{
+      GstStructure *params = g_value_get_boxed (value);
+
+      if (params != NULL) {
+        kms_jitter_buffer_control_set_params (self->priv->jb_control, params);
+      }
+      break;
+    }
+    case PROP_PROTECTION_PARAMS:{
+      GstStructure *params = g_value_get_boxed (value);
+
+      if (params != NULL) {
+        kms_protection_control_set_params (self->priv->prot_control, params);
+      }
+      break;
+    }
+    case PROP_RTC_STATS_STRUCTURE:
+      self->priv->stats.rtc_structure = g_value_get_boolean (value);
+      break;
+    case PROP_PACING:
+      self->priv->pacing = g_value_get_boolean (value);
+      break;
+    case PROP_SHARED_PACKETIZATION:
+      self->priv->shared_packetization = g_value_get_boolean (value);
+      break;
+    case PROP_MTU:
+      self->priv->mtu = g_value_get_uint (value);
+      break;
+    case PROP_SEND_FEC:
+      self->priv->send_fec = g_value_get_boolean (value);
+      break;
     case PROP_MIN_PORT:{
       guint v = g_value_get_uint (value);
 
@@ -2370,6 +2668,32 @@ kms_base_rtp_endpoint_get_property (GObject * object, guint property_id,
         g_value_set_boxed (value, self->priv->remb_params);
       }
       break;
+    case PROP_JITTER_BUFFER_PARAMS:{
+      GstStructure *params = gst_structure_new_empty ("jitter-buffer-params");
+
+      kms_jitter_buffer_control_get_params (self->priv->jb_control, &params);
+      g_value_take_boxed (value, params);
+      break;
+    }
+    case PROP_PROTECTION_PARAMS:{
+      GstStructure *params = gst_structure_new_empty ("protection-params");
+
+      kms_protection_control_get_params (self->priv->prot_control, &params);
+      g_value_take_boxed (value, params);
+      break;
+    }
+    case PROP_RTC_STATS_STRUCTURE:
+      g_value_set_boolean (value, self->priv->stats.rtc_structure);
+      break;
+    case PROP_PACING:
+      g_value_set_boolean (value, self->priv->pacing);
+      break;
+    case PROP_SHARED_PACKETIZATION:
+      g_value_set_boolean (value, self->priv->shared_packetization);
+      break;
+    case PROP_MTU:
+      g_value_set_uint (value, self->priv->mtu);
+      break;
     case PROP_MIN_PORT:
       g_value_set_uint (value, self->priv->min_port);
       break;
@@ -2379,6 +2703,9 @@ kms_base_rtp_endpoint_get_property (GObject * object, guint property_id,
     case PROP_SUPPORT_FEC:
       g_value_set_boolean (value, self->priv->support_fec);
       break;
+    case PROP_SEND_FEC:
+      g_value_set_boolean (value, self->priv->send_fec);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -2449,6 +2776,11 @@ kms_base_rtp_endpoint_finalize (GObject * gobject)
 
   GST_DEBUG_OBJECT (self, "finalize");
 
+  /* Waits for the RTCP being processed, it uses the objects freed below */
+  kms_rtcp_dispatcher_remove_handler (self->priv->rtcp_dispatcher,
+      self->priv->rtcp_handler_id);
+  g_clear_object (&self->priv->rtcp_dispatcher);
+
   kms_base_rtp_endpoint_destroy_stats (self);
 
   if (self->priv->remb_params != NULL) {
@@ -2456,11 +2788,13 @@ kms_base_rtp_endpoint_finalize (GObject * gobject)
   }
 
   if (self->priv->prot_medias != NULL) {
-    kms_list_unref (self->priv->prot_medias);
+    kms_quark_map_unref (self->priv->prot_medias);
   }
 
   kms_remb_local_destroy (self->priv->rl);
   kms_remb_remote_destroy (self->priv->rm);
+  kms_jitter_buffer_control_destroy (self->priv->jb_control);
+  kms_protection_control_destroy (self->priv->prot_control);
 
   sessions = kms_base_sdp_endpoint_get_sessions (base_endpoint);
   g_hash_table_foreach (sessions,
@@ -2470,6 +2804,7 @@ kms_base_rtp_endpoint_finalize (GObject * gobject)
     fclose (self->priv->stats_file);
   }
 
+  g_hash_table_unref (self->priv->sync_ssrcs);
   g_clear_object (&self->priv->sync_audio);
   g_clear_object (&self->priv->sync_video);
 
@@ -2609,6 +2944,230 @@ kms_element_get_e2e_latency_stats (KmsBaseRtpEndpoint * self, gchar * selector)
   return stats;
 }
 
+static guint
+remb_base_get_value (KmsRembBase * rb, guint ssrc)
+{
+  guint *value, remb = 0;
+
+  if (rb == NULL) {
+    return 0;
+  }
+
+  KMS_REMB_BASE_LOCK (rb);
+  value = g_hash_table_lookup (rb->remb_stats, GUINT_TO_POINTER (ssrc));
+  if (value != NULL) {
+    remb = *value;
+  }
+  KMS_REMB_BASE_UNLOCK (rb);
+
+  return remb;
+}
+
+static void
+ssrc_snapshot_fill_jitter_buffer (KmsRTPSessionStats * rtp_stats,
+    KmsRtpSsrcSnapshot * snapshot, GstElement * jitter_buffer)
+{
+  GstStructure *jitter_stats;
+
+  g_object_get (jitter_buffer, "percent", &snapshot->jb_percent, "latency",
+      &snapshot->jb_latency, "stats", &jitter_stats, NULL);
+
+  if (jitter_stats == NULL) {
+    return;
+  }
+
+  snapshot->has_jitter_buffer = TRUE;
+  gst_structure_get (jitter_stats, "num-pushed", G_TYPE_UINT64,
+      &snapshot->jb_num_pushed, "num-lost", G_TYPE_UINT64,
+      &snapshot->jb_num_lost, "num-late", G_TYPE_UINT64,
+      &snapshot->jb_num_late, "num-duplicates", G_TYPE_UINT64,
+      &snapshot->jb_num_duplicates, NULL);
+  gst_structure_free (jitter_stats);
+
+  kms_jitter_buffer_control_get_values (rtp_stats->jb_control, jitter_buffer,
+      &snapshot->jb_network_jitter, &snapshot->jb_target_latency);
+}
+
+static void
+ssrc_snapshot_fill (KmsRtpSsrcSnapshot * snapshot,
+    const GstStructure * ssrc_stats)
+{
+  if (snapshot->internal) {
+    gst_structure_get (ssrc_stats, "packets-sent", G_TYPE_UINT64,
+        &snapshot->packets_sent, "octets-sent", G_TYPE_UINT64,
+        &snapshot->octets_sent, "bitrate", G_TYPE_UINT64, &snapshot->bitrate,
+        NULL);
+    /* Only available with PLI and FIR statistics patches */
+    gst_structure_get (ssrc_stats, "recv-pli-count", G_TYPE_UINT,
+        &snapshot->recv_pli_count, "recv-fir-count", G_TYPE_UINT,
+        &snapshot->recv_fir_count, NULL);
+  } else {
+    gst_structure_get (ssrc_stats, "packets-received", G_TYPE_UINT64,
+        &snapshot->packets_received, "octets-received", G_TYPE_UINT64,
+        &snapshot->octets_received, "sent-rb-packetslost", G_TYPE_INT,
+        &snapshot->sent_rb_packetslost, "sent-rb-fractionlost", G_TYPE_UINT,
+        &snapshot->sent_rb_fractionlost, "clock-rate", G_TYPE_INT,
+        &snapshot->clock_rate, "jitter", G_TYPE_UINT, &snapshot->jitter, NULL);
+    gst_structure_get (ssrc_stats, "sent-pli-count", G_TYPE_UINT,
+        &snapshot->sent_pli_count, "sent-fir-count", G_TYPE_UINT,
+        &snapshot->sent_fir_count, NULL);
+  }
+}
+
+static void
+append_rtp_session_snapshot (KmsBaseRtpEndpoint * self, guint session,
+    KmsRTPSessionStats * rtp_stats, KmsRtpStatsSnapshot * snapshot)
+{
+  KmsRtpSessionSnapshot *session_snapshot;
+  KmsRtpSsrcSnapshot *internal_snapshot = NULL;
+  GstStructure *session_stats;
+  GValueArray *arr;
+  guint i, f_lost, rtt;
+  gint p_lost;
+
+  if (snapshot->n_sessions >= KMS_RTP_STATS_MAX_SESSIONS) {
+    return;
+  }
+
+  p_lost = f_lost = rtt = 0;
+
+  session_snapshot = &snapshot->sessions[snapshot->n_sessions];
+  memset (session_snapshot, 0, sizeof (KmsRtpSessionSnapshot));
+  session_snapshot->session = session;
+
+  g_object_get (rtp_stats->rtp_session, "stats", &session_stats, NULL);
+
+  if (session_stats == NULL) {
+    return;
+  }
+
+  gst_structure_get (session_stats, "sent-nack-count", G_TYPE_UINT,
+      &session_snapshot->sent_nack_count, "recv-nack-count", G_TYPE_UINT,
+      &session_snapshot->recv_nack_count, NULL);
+  gst_structure_free (session_stats);
+
+  snapshot->n_sessions++;
+
+  g_object_get (rtp_stats->rtp_session, "sources", &arr, NULL);
+
+  for (i = 0; i < arr->n_values; i++) {
+    KmsRtpSsrcSnapshot *ssrc_snapshot;
+    GstElement *jitter_buffer;
+    GstStructure *ssrc_stats;
+    gboolean internal;
+    GObject *source;
+    const gchar *id;
+    guint ssrc;
+
+    source = g_value_get_object (g_value_array_get_nth (arr, i));
+
+    g_object_get (source, "stats", &ssrc_stats, "ssrc", &ssrc, NULL);
+    gst_structure_get (ssrc_stats, "internal", G_TYPE_BOOLEAN, &internal, NULL);
+
+    if (!internal) {
+      /* Reception report about our stream sent by the remote peer */
+      gst_structure_get (ssrc_stats, "rb-round-trip", G_TYPE_UINT, &rtt,
+          "rb-fractionlost", G_TYPE_UINT, &f_lost, "rb-packetslost", G_TYPE_INT,
+          &p_lost, NULL);
+    }
+
+    if (filter_rtp_source (rtp_stats->direction, internal)) {
+      gst_structure_free (ssrc_stats);
+      continue;
+    }
+
+    if (session_snapshot->n_ssrcs >= KMS_RTP_STATS_MAX_SSRCS) {
+      GST_WARNING_OBJECT (self, "Too many sources in session %u, ignoring %u",
+          session, ssrc);
+      gst_structure_free (ssrc_stats);
+      continue;
+    }
+
+    ssrc_snapshot = &session_snapshot->ssrcs[session_snapshot->n_ssrcs++];
+    memset (ssrc_snapshot, 0, sizeof (KmsRtpSsrcSnapshot));
+    ssrc_snapshot->ssrc = ssrc;
+    ssrc_snapshot->internal = internal;
+
+    id = kms_utils_get_uuid (source);
+
+    if (id == NULL) {
+      kms_utils_set_uuid (source);
+      id = kms_utils_get_uuid (source);
+    }
+
+    g_strlcpy (ssrc_snapshot->id, id, KMS_RTP_STATS_ID_SIZE);
+
+    ssrc_snapshot_fill (ssrc_snapshot, ssrc_stats);
+    gst_structure_free (ssrc_stats);
+
+    if (internal) {
+      if (internal_snapshot == NULL) {
+        internal_snapshot = ssrc_snapshot;
+      } else {
+        GST_WARNING ("Session %u has more than 1 internal source", session);
+      }
+    }
+
+    if (session == VIDEO_RTP_SESSION) {
+      ssrc_snapshot->remb =
+          remb_base_get_value (KMS_REMB_BASE (self->priv->rl), ssrc);
+      if (ssrc_snapshot->remb == 0) {
+        ssrc_snapshot->remb =
+            remb_base_get_value (KMS_REMB_BASE (self->priv->rm), ssrc);
+      }
+    }
+
+    jitter_buffer = rtp_session_stats_get_jitter_buffer (rtp_stats, ssrc);
+
+    if (jitter_buffer != NULL) {
+      ssrc_snapshot_fill_jitter_buffer (rtp_stats, ssrc_snapshot,
+          jitter_buffer);
+    }
+  }
+
+  g_value_array_free (arr);
+
+  if (internal_snapshot != NULL) {
+    internal_snapshot->round_trip_time = rtt;
+    internal_snapshot->outbound_fraction_lost = f_lost;
+    internal_snapshot->outbound_packet_lost = p_lost;
+  }
+}
+
+void
+kms_base_rtp_endpoint_get_rtp_stats (KmsBaseRtpEndpoint * self,
+    const gchar * selector, KmsRtpStatsSnapshot * snapshot)
+{
+  KmsRTPSessionStats *rtp_stats;
+  guint session, first, last;
+
+  g_return_if_fail (KMS_IS_BASE_RTP_ENDPOINT (self));
+  g_return_if_fail (snapshot != NULL);
+
+  snapshot->n_sessions = 0;
+
+  if (selector == NULL) {
+    first = AUDIO_RTP_SESSION;
+    last = VIDEO_RTP_SESSION;
+  } else if (g_strcmp0 (selector, AUDIO_STREAM_NAME) == 0) {
+    first = last = AUDIO_RTP_SESSION;
+  } else if (g_strcmp0 (selector, VIDEO_STREAM_NAME) == 0) {
+    first = last = VIDEO_RTP_SESSION;
+  } else {
+    GST_WARNING_OBJECT (self, "Invalid selector provided: %s", selector);
+    return;
+  }
+
+  for (session = first; session <= last; session++) {
+    rtp_stats = g_hash_table_lookup (self->priv->stats.rtp_stats,
+        GUINT_TO_POINTER (session));
+
+    if (rtp_stats != NULL) {
+      append_rtp_session_snapshot (self, session, rtp_stats, snapshot);
+    }
+  }
+}
+
 static GstStructure *
 kms_base_rtp_endpoint_stats (KmsElement * obj, gchar * selector)
 {
@@ -2620,13 +3179,15 @@ kms_base_rtp_endpoint_stats (KmsElement * obj, gchar * selector)
       KMS_ELEMENT_CLASS (kms_base_rtp_endpoint_parent_class)->stats (obj,
       selector);
 
-  rtp_stats = gst_structure_new_empty (KMS_RTP_STRUCT_NAME);
-  kms_base_rtp_endpoint_add_rtp_stats (self, rtp_stats, selector);
-  kms_base_rtp_endpoint_append_remb_stats (self, rtp_stats, selector);
+  if (self->priv->stats.rtc_structure) {
+    rtp_stats = gst_structure_new_empty (KMS_RTP_STRUCT_NAME);
+    kms_base_rtp_endpoint_add_rtp_stats (self, rtp_stats, selector);
+    kms_base_rtp_endpoint_append_remb_stats (self, rtp_stats, selector);
 
-  gst_structure_set (stats, KMS_RTC_STATISTICS_FIELD, GST_TYPE_STRUCTURE,
-      rtp_stats, NULL);
-  gst_structure_free (rtp_stats);
+    gst_structure_set (stats, KMS_RTC_STATISTICS_FIELD, GST_TYPE_STRUCTURE,
+        rtp_stats, NULL);
+    gst_structure_free (rtp_stats);
+  }
 
   if (!self->priv->stats.enabled) {
     return stats;
@@ -2806,6 +3367,43 @@ kms_base_rtp_endpoint_class_init (KmsBaseRtpEndpointClass * klass)
           "Set parameters for REMB algorithm",
           GST_TYPE_STRUCTURE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_JITTER_BUFFER_PARAMS,
+      g_param_spec_boxed ("jitter-buffer-params", "Jitter buffer params",
+          "Set parameters for the adaptive latency of jitter buffers",
+          GST_TYPE_STRUCTURE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_PROTECTION_PARAMS,
+      g_param_spec_boxed ("protection-params", "Protection params",
+          "Set parameters for the adaptive FEC and RTX of outgoing video",
+          GST_TYPE_STRUCTURE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_RTC_STATS_STRUCTURE,
+      g_param_spec_boolean ("rtc-stats-structure", "RTC stats structure",
+          "Add RTP statistics to the stats signal result. Disable it when "
+          "they are read with kms_base_rtp_endpoint_get_rtp_stats",
+          DEFAULT_RTC_STATS_STRUCTURE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_PACING,
+      g_param_spec_boolean ("pacing", "Pacing",
+          "Spread the packets of outgoing video over time at a rate based "
+          "on the REMB estimation, so that key frames are not sent in a burst",
+          DEFAULT_PACING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SHARED_PACKETIZATION,
+      g_param_spec_boolean ("shared-packetization", "Shared packetization",
+          "Request RTP packets to the source, so that they are payloaded "
+          "once for all the endpoints using the same codec, and only adapt "
+          "their headers", DEFAULT_SHARED_PACKETIZATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_MTU,
+      g_param_spec_uint ("mtu", "MTU",
+          "Maximum size of the RTP packets sent. Packets are not shared "
+          "with other endpoints when it is not the default one",
+          28, G_MAXUINT, DEFAULT_MTU,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (object_class, PROP_MIN_PORT,
       g_param_spec_uint ("min-port",
           "Minimum port number to be used",
@@ -2825,6 +3423,13 @@ kms_base_rtp_endpoint_class_init (KmsBaseRtpEndpointClass * klass)
           "Forward error correction supported", FALSE,
           G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_SEND_FEC,
+      g_param_spec_boolean ("send-fec", "Send FEC",
+          "Generate FEC for the outgoing video when ulpfec is negotiated. "
+          "Some browsers fail to use the FEC packets generated, so it is "
+          "disabled by default", DEFAULT_SEND_FEC,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   /* set signals */
   obj_signals[GET_CONNECTION_STATE] =
       g_signal_new ("get-connection_state",
@@ -3129,7 +3734,7 @@ kms_base_rtp_endpoint_rtpbin_request_aux_receiver (GstElement * rtpbin,
 
   KMS_ELEMENT_LOCK (self);
 
-  edata = kms_list_lookup (self->priv->prot_medias, media_str);
+  edata = kms_quark_map_lookup_string (self->priv->prot_medias, media_str);
 
   if (edata != NULL) {
     receiver = kms_base_rtp_endpoint_create_aux_receiver (self, session, edata);
@@ -3146,12 +3751,15 @@ static GstElement *
 kms_base_rtp_endpoint_create_aux_sender (KmsBaseRtpEndpoint * self,
     guint session, ExtData * edata)
 {
+  GstElement *rtxcache, *fecenc = NULL;
   GSList *list = NULL;
+  gint fec_pt = 0;
   GstElement *e;
 
-  e = gst_element_factory_make ("rtprtxqueue", NULL);
-  g_object_set (e, "max-size-packets", RTP_RTX_SIZE, NULL);
-  list = g_slist_prepend (list, e);
+  rtxcache = GST_ELEMENT (kms_rtx_cache_new ());
+  g_object_set (rtxcache, "max-size-packets", RTP_RTX_SIZE, "max-size-time",
+      RTP_RTX_TIME, NULL);
+  list = g_slist_prepend (list, rtxcache);
 
   if (edata == NULL) {
     GST_DEBUG_OBJECT (self, "Session '%u' not protected", session);
@@ -3165,14 +3773,22 @@ kms_base_rtp_endpoint_create_aux_sender (KmsBaseRtpEndpoint * self,
   }
 
   if (edata->ulpfec_pt != 0) {
-    e = gst_element_factory_make ("ulpfecenc", NULL);
-    /* FIXME: Chrome does not seem to work well with FEC packages generated */
-    /* in our side. Uncomment this when this issue is fixed.                */
-//    g_object_set (e, "pt", edata->ulpfec_pt, NULL);
-    list = g_slist_prepend (list, e);
+    fecenc = gst_element_factory_make ("ulpfecenc", NULL);
+    /* Chrome does not seem to work well with FEC packets generated in our */
+    /* side, ulpfecenc does not generate them until it gets a payload type */
+    if (self->priv->send_fec) {
+      g_object_set (fecenc, "pt", edata->ulpfec_pt, NULL);
+      fec_pt = edata->ulpfec_pt;
+    }
+    list = g_slist_prepend (list, fecenc);
   }
 
 end:
+  if (session == VIDEO_RTP_SESSION) {
+    kms_protection_control_set_elements (self->priv->prot_control, rtxcache,
+        fecenc, fec_pt);
+  }
+
   e = kms_base_rtp_endpoint_create_aux_element (self, session, list);
 
   g_slist_free (list);
@@ -3200,7 +3816,7 @@ kms_base_rtp_endpoint_rtpbin_request_aux_sender (GstElement * rtpbin,
 
   KMS_ELEMENT_LOCK (self);
 
-  edata = kms_list_lookup (self->priv->prot_medias, media_str);
+  edata = kms_quark_map_lookup_string (self->priv->prot_medias, media_str);
 
   sender = kms_base_rtp_endpoint_create_aux_sender (self, session, edata);
 
@@ -3213,6 +3829,7 @@ static void
 kms_base_rtp_endpoint_init_stats (KmsBaseRtpEndpoint * self)
 {
   self->priv->stats.enabled = FALSE;
+  self->priv->stats.rtc_structure = DEFAULT_RTC_STATS_STRUCTURE;
   self->priv->stats.rtp_stats = g_hash_table_new_full (g_direct_hash,
       g_direct_equal, NULL, (GDestroyNotify) rtp_session_stats_destroy);
   self->priv->stats.avg_e2e = g_hash_table_new_full (g_str_hash, g_str_equal,
@@ -3240,8 +3857,12 @@ kms_base_rtp_endpoint_init (KmsBaseRtpEndpoint * self)
   self->priv = KMS_BASE_RTP_ENDPOINT_GET_PRIVATE (self);
 
   self->priv->support_fec = is_fec_supported ();
+  self->priv->send_fec = DEFAULT_SEND_FEC;
+  self->priv->pacing = DEFAULT_PACING;
+  self->priv->shared_packetization = DEFAULT_SHARED_PACKETIZATION;
+  self->priv->mtu = DEFAULT_MTU;
 
-  self->priv->prot_medias = kms_list_new_full (g_str_equal, g_free,
+  self->priv->prot_medias = kms_quark_map_new_full (NULL,
       (GDestroyNotify) kms_ref_struct_unref);
 
   self->priv->rtcp_mux = DEFAULT_RTCP_MUX;
@@ -3252,6 +3873,16 @@ kms_base_rtp_endpoint_init (KmsBaseRtpEndpoint * self)
   self->priv->min_video_send_bw = MIN_VIDEO_SEND_BW_DEFAULT;
   self->priv->max_video_send_bw = MAX_VIDEO_SEND_BW_DEFAULT;
 
+  self->priv->jb_control = kms_jitter_buffer_control_new ();
+  self->priv->prot_control = kms_protection_control_new ();
+
+  self->priv->sync_ssrcs = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, (GDestroyNotify) sync_ssrc_destroy);
+  self->priv->rtcp_dispatcher = kms_rtcp_dispatcher_new ();
+  self->priv->rtcp_handler_id =
+      kms_rtcp_dispatcher_add_handler (self->priv->rtcp_dispatcher,
+      (KmsRtcpHandlerFunc) kms_base_rtp_endpoint_on_rtcp, self, NULL);
+
   self->priv->rtpbin = gst_element_factory_make ("rtpbin", NULL);
 
   g_signal_connect (self->priv->rtpbin, "request-pt-map",
@@ -72,5 +72,78 @@ struct _KmsBaseRtpEndpointClass
 
 GType kms_base_rtp_endpoint_get_type (void);
 
+#define KMS_RTP_STATS_MAX_SESSIONS 2
+#define KMS_RTP_STATS_MAX_SSRCS 8
+#define KMS_RTP_STATS_ID_SIZE 40
+
+typedef struct _KmsRtpSsrcSnapshot KmsRtpSsrcSnapshot;
+typedef struct _KmsRtpSessionSnapshot KmsRtpSessionSnapshot;
+typedef struct _KmsRtpStatsSnapshot KmsRtpStatsSnapshot;
+
+struct _KmsRtpSsrcSnapshot
+{
+  gchar id[KMS_RTP_STATS_ID_SIZE];
+  guint ssrc;
+  gboolean internal;
+
+  /* Internal (sent) sources */
+  guint64 packets_sent;
+  guint64 octets_sent;
+  guint64 bitrate;
+  guint recv_pli_count;
+  guint recv_fir_count;
+  guint round_trip_time;        /* NTP short format, 16.16 fixed point */
+  guint outbound_fraction_lost;
+  gint outbound_packet_lost;
+
+  /* Remote (received) sources */
+  guint64 packets_received;
+  guint64 octets_received;
+  gint clock_rate;
+  guint jitter;                 /* In timestamp units */
+  gint sent_rb_packetslost;
+  guint sent_rb_fractionlost;
+  guint sent_pli_count;
+  guint sent_fir_count;
+
+  /* Last REMB sent or received for this source, in bps */
+  guint remb;
+
+  gboolean has_jitter_buffer;
+  guint jb_latency;             /* ms */
+  guint jb_percent;
+  guint64 jb_num_pushed;
+  guint64 jb_num_lost;
+  guint64 jb_num_late;
+  guint64 jb_num_duplicates;
+  guint jb_network_jitter;      /* ms */
+  guint jb_target_latency;      /* ms */
+};
+
+struct _KmsRtpSessionSnapshot
+{
+  guint session;
+  guint sent_nack_count;
+  guint recv_nack_count;
+
+  guint n_ssrcs;
+  KmsRtpSsrcSnapshot ssrcs[KMS_RTP_STATS_MAX_SSRCS];
+};
+
+struct _KmsRtpStatsSnapshot
+{
+  guint n_sessions;
+  KmsRtpSessionSnapshot sessions[KMS_RTP_STATS_MAX_SESSIONS];
+};
+
+/*
+ * Fills @snapshot with the counters of the RTP sessions selected by
+ * @selector ("audio", "video" or NULL for all of them) in one pass and
+ * without building intermediate structures. Storage is provided by the
+ * caller, sources over KMS_RTP_STATS_MAX_SSRCS per session are skipped.
+ */
+void kms_base_rtp_endpoint_get_rtp_stats (KmsBaseRtpEndpoint * self,
+  const gchar * selector, KmsRtpStatsSnapshot * snapshot);
+
 G_END_DECLS
 #endif /* __KMS_BASE_RTP_ENDPOINT_H__ */
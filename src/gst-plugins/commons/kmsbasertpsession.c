@@ -190,18 +190,19 @@ kms_base_rtp_session_create_bundle_connection_default (KmsBaseRtpSession *
 
 static void
 kms_base_rtp_session_e2e_latency_cb (GstPad * pad, KmsMediaType type,
-    GstClockTimeDiff t, KmsList * mdata, gpointer user_data)
+    GstClockTimeDiff t, KmsQuarkMap ** mdata, gpointer user_data)
 {
   KmsBaseRtpSession *self = KMS_BASE_RTP_SESSION (user_data);
-  KmsListIter iter;
-  gpointer key, value;
+  KmsQuarkMapIter iter;
+  gpointer value;
+  GQuark key;
   gchar *name;
 
   name = gst_element_get_name (KMS_SDP_SESSION (self)->ep);
 
-  kms_list_iter_init (&iter, mdata);
-  while (kms_list_iter_next (&iter, &key, &value)) {
-    gchar *id = (gchar *) key;
+  kms_quark_map_iter_init (&iter, *mdata);
+  while (kms_quark_map_iter_next (&iter, &key, &value)) {
+    const gchar *id = g_quark_to_string (key);
     StreamE2EAvgStat *stat;
 
     if (!g_str_has_prefix (id, name)) {
@@ -212,6 +213,8 @@ kms_base_rtp_session_e2e_latency_cb (GstPad * pad, KmsMediaType type,
     stat = (StreamE2EAvgStat *) value;
     stat->avg = KMS_STATS_CALCULATE_LATENCY_AVG (t, stat->avg);
   }
+
+  g_free (name);
 }
 
 static void
@@ -303,6 +306,62 @@ kms_base_rtp_session_link_pads (GstPad * src, GstPad * sink)
   }
 }
 
+/* Should be called with the session lock held */
+static gboolean
+kms_base_rtp_session_is_remote_video_layer_unlocked (KmsBaseRtpSession * self,
+    guint32 ssrc)
+{
+  guint i;
+
+  for (i = 0; i < self->remote_video_layer_ssrcs->len; i++) {
+    if (g_array_index (self->remote_video_layer_ssrcs, guint32, i) == ssrc) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+gboolean
+kms_base_rtp_session_is_remote_video_layer (KmsBaseRtpSession * self,
+    guint32 ssrc)
+{
+  gboolean ret;
+
+  KMS_SDP_SESSION_LOCK (self);
+  ret = kms_base_rtp_session_is_remote_video_layer_unlocked (self, ssrc);
+  KMS_SDP_SESSION_UNLOCK (self);
+
+  return ret;
+}
+
+/*
+ * Returns a new sink pad of @funnel, which is created and linked to the
+ * @sink requested from the manager the first time.
+ * Should be called with the session lock held.
+ */
+static GstPad *
+kms_base_rtp_session_request_funnel_sink (KmsBaseRtpSession * self,
+    GstElement ** funnel, GstPad * (*request_sink) (KmsIRtpSessionManager *,
+        KmsBaseRtpSession *, const GstSDPMedia *))
+{
+  if (*funnel == NULL) {
+    GstPad *src, *sink;
+
+    *funnel = gst_element_factory_make ("funnel", NULL);
+    gst_bin_add (GST_BIN (self), *funnel);
+    gst_element_sync_state_with_parent_target_state (*funnel);
+
+    src = gst_element_get_static_pad (*funnel, "src");
+    sink = request_sink (self->manager, self, self->video_neg);
+    kms_base_rtp_session_link_pads (src, sink);
+    g_object_unref (src);
+    g_object_unref (sink);
+  }
+
+  return gst_element_get_request_pad (*funnel, "sink_%u");
+}
+
 static void
 rtp_ssrc_demux_new_ssrc_pad (GstElement * ssrcdemux, guint ssrc, GstPad * pad,
     KmsBaseRtpSession * self)
@@ -321,7 +380,8 @@ rtp_ssrc_demux_new_ssrc_pad (GstElement * ssrcdemux, guint ssrc, GstPad * pad,
       || ssrcs_are_mapped (ssrcdemux, self->local_audio_ssrc, ssrc)) {
     media = self->audio_neg;
   } else if (self->remote_video_ssrc == ssrc
-      || ssrcs_are_mapped (ssrcdemux, self->local_video_ssrc, ssrc)) {
+      || ssrcs_are_mapped (ssrcdemux, self->local_video_ssrc, ssrc)
+      || kms_base_rtp_session_is_remote_video_layer_unlocked (self, ssrc)) {
     media = self->video_neg;
   } else {
     if (!kms_i_rtp_session_manager_custom_ssrc_management (self->manager, self,
@@ -331,9 +391,16 @@ rtp_ssrc_demux_new_ssrc_pad (GstElement * ssrcdemux, guint ssrc, GstPad * pad,
     goto end;
   }
 
+  if (media == self->video_neg && self->remote_video_layer_ssrcs->len > 0) {
+    /* Every layer goes to the same session, rtpbin demuxes them again */
+    sink = kms_base_rtp_session_request_funnel_sink (self,
+        &self->video_rtp_funnel, kms_i_rtp_session_manager_request_rtp_sink);
+  } else {
+    sink =
+        kms_i_rtp_session_manager_request_rtp_sink (self->manager, self, media);
+  }
+
   /* RTP */
-  sink =
-      kms_i_rtp_session_manager_request_rtp_sink (self->manager, self, media);
   kms_base_rtp_session_link_pads (pad, sink);
   g_object_unref (sink);
 
@@ -341,8 +408,16 @@ rtp_ssrc_demux_new_ssrc_pad (GstElement * ssrcdemux, guint ssrc, GstPad * pad,
   rtcp_pad_name = g_strconcat ("rtcp_", rtp_pad_name, NULL);
   src = gst_element_get_static_pad (ssrcdemux, rtcp_pad_name);
   g_free (rtcp_pad_name);
-  sink =
-      kms_i_rtp_session_manager_request_rtcp_sink (self->manager, self, media);
+
+  if (media == self->video_neg && self->remote_video_layer_ssrcs->len > 0) {
+    sink = kms_base_rtp_session_request_funnel_sink (self,
+        &self->video_rtcp_funnel, kms_i_rtp_session_manager_request_rtcp_sink);
+  } else {
+    sink =
+        kms_i_rtp_session_manager_request_rtcp_sink (self->manager, self,
+        media);
+  }
+
   kms_base_rtp_session_link_pads (src, sink);
   g_object_unref (src);
   g_object_unref (sink);
@@ -551,8 +626,21 @@ kms_base_rtp_session_process_remote_ssrc (KmsBaseRtpSession * self,
 
     return AUDIO_RTP_SESSION_STR;
   } else if (g_strcmp0 (VIDEO_STREAM_NAME, media_str) == 0) {
+    guint32 layer;
+    guint i;
+
     GST_DEBUG_OBJECT (self, "Add remote video ssrc: %u", ssrc);
     self->remote_video_ssrc = ssrc;
+
+    g_array_set_size (self->remote_video_layer_ssrcs, 0);
+    for (i = 0; (layer = sdp_utils_media_get_sim_ssrc (remote_media, i)) != 0;
+        i++) {
+      if (layer != ssrc) {
+        GST_DEBUG_OBJECT (self, "Add remote video layer ssrc: %u", layer);
+        g_array_append_val (self->remote_video_layer_ssrcs, layer);
+      }
+    }
+
     if (self->video_neg != NULL) {
       gst_sdp_media_free (self->video_neg);
     }
@@ -791,6 +879,7 @@ kms_base_rtp_session_finalize (GObject * object)
   }
 
   g_hash_table_destroy (self->conns);
+  g_array_free (self->remote_video_layer_ssrcs, TRUE);
 
   /* chain up */
   G_OBJECT_CLASS (kms_base_rtp_session_parent_class)->finalize (object);
@@ -812,6 +901,7 @@ kms_base_rtp_session_init (KmsBaseRtpSession * self)
 {
   self->conns =
       g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->remote_video_layer_ssrcs = g_array_new (FALSE, FALSE, sizeof (guint32));
 
   self->stats_enabled = FALSE;
 }
@@ -60,6 +60,11 @@ struct _KmsBaseRtpSession
   GstSDPMedia *video_neg;
   guint32 local_video_ssrc;
   guint32 remote_video_ssrc;
+  GArray *remote_video_layer_ssrcs; /* guint32, other simulcast layers */
+
+  /* Merge the RTP and RTCP of every simulcast layer into the video session */
+  GstElement *video_rtp_funnel;
+  GstElement *video_rtcp_funnel;
 
   gboolean stats_enabled;
 };
@@ -88,6 +93,8 @@ KmsIRtpConnection * kms_base_rtp_session_create_connection (KmsBaseRtpSession *
 
 void kms_base_rtp_session_start_transport_send (KmsBaseRtpSession * self, gboolean offerer);
 
+gboolean kms_base_rtp_session_is_remote_video_layer (KmsBaseRtpSession * self, guint32 ssrc);
+
 void kms_base_rtp_session_enable_connections_stats (KmsBaseRtpSession * self);
 void kms_base_rtp_session_disable_connections_stats (KmsBaseRtpSession * self);
 
@@ -18,6 +18,46 @@
 #include "kmsrefstruct.h"
 #include "kmsbufferlacentymeta.h"
 
+#define DATA_LOCKS 16
+
+/* Statically allocated mutexes do not need to be initialized */
+static GRecMutex data_locks[DATA_LOCKS];
+
+static GRecMutex *
+get_data_lock (KmsBufferLatencyMeta * meta)
+{
+  return &data_locks[(GPOINTER_TO_SIZE (meta) >> 4) % DATA_LOCKS];
+}
+
+void
+kms_buffer_latency_meta_data_lock (KmsBufferLatencyMeta * meta)
+{
+  g_rec_mutex_lock (get_data_lock (meta));
+}
+
+void
+kms_buffer_latency_meta_data_unlock (KmsBufferLatencyMeta * meta)
+{
+  g_rec_mutex_unlock (get_data_lock (meta));
+}
+
+void
+kms_buffer_latency_data_insert (KmsQuarkMap ** data, GQuark key,
+    gpointer value)
+{
+  g_return_if_fail (data != NULL);
+
+  if (*data == NULL) {
+    *data = kms_quark_map_new_full ((GBoxedCopyFunc) kms_ref_struct_ref,
+        (GDestroyNotify) kms_ref_struct_unref);
+  } else {
+    /* Data may be shared with copies of this buffer */
+    *data = kms_quark_map_make_writable (*data);
+  }
+
+  kms_quark_map_insert (*data, key, value);
+}
+
 GType
 kms_buffer_latency_meta_api_get_type (void)
 {
@@ -41,10 +81,7 @@ kms_buffer_latency_meta_init (GstMeta * meta, gpointer params,
 
   lmeta->ts = GST_CLOCK_TIME_NONE;
   lmeta->valid = FALSE;
-
-  g_rec_mutex_init (&lmeta->datamutex);
-  lmeta->data = kms_list_new_full (g_str_equal, g_free,
-      (GDestroyNotify) kms_ref_struct_unref);
+  lmeta->data = NULL;
 
   return TRUE;
 }
@@ -68,12 +105,11 @@ kms_buffer_latency_meta_transform (GstBuffer * transbuf, GstMeta * meta,
     return FALSE;
   }
 
-  if (new_meta->data != NULL) {
-    kms_list_unref (new_meta->data);
-  }
-
+  /* Data is shared until one of the metas gets modified */
   KMS_BUFFER_LATENCY_DATA_LOCK (lmeta);
-  new_meta->data = kms_list_ref (lmeta->data);
+  if (lmeta->data != NULL) {
+    new_meta->data = kms_quark_map_ref (lmeta->data);
+  }
   KMS_BUFFER_LATENCY_DATA_UNLOCK (lmeta);
 
   return TRUE;
@@ -84,11 +120,9 @@ kms_buffer_latency_meta_free (GstMeta * meta, GstBuffer * buffer)
 {
   KmsBufferLatencyMeta *lmeta = (KmsBufferLatencyMeta *) meta;
 
-  KMS_BUFFER_LATENCY_DATA_LOCK (lmeta);
-  kms_list_unref (lmeta->data);
-  KMS_BUFFER_LATENCY_DATA_UNLOCK (lmeta);
-
-  g_rec_mutex_clear (&lmeta->datamutex);
+  if (lmeta->data != NULL) {
+    kms_quark_map_unref (lmeta->data);
+  }
 }
 
 const GstMetaInfo *
@@ -21,7 +21,7 @@
 #include <gst/gst.h>
 
 #include "kmsmediatype.h"
-#include "kmslist.h"
+#include "kmsquarkmap.h"
 
 G_BEGIN_DECLS
 
@@ -42,14 +42,22 @@ struct _KmsBufferLatencyMeta {
   KmsMediaType type;
   gboolean valid;
 
-  GRecMutex datamutex;
-  KmsList *data; /* <string, refstruct> */
+  /* <quark, refstruct>, NULL until the first mark is added */
+  KmsQuarkMap *data;
 };
 
+/* Metas do not own a mutex, a shared lock is selected by meta address */
+void kms_buffer_latency_meta_data_lock (KmsBufferLatencyMeta *meta);
+void kms_buffer_latency_meta_data_unlock (KmsBufferLatencyMeta *meta);
+
 #define KMS_BUFFER_LATENCY_DATA_LOCK(mdata) \
-  (g_rec_mutex_lock (&((KmsBufferLatencyMeta *)mdata)->datamutex))
+  (kms_buffer_latency_meta_data_lock ((KmsBufferLatencyMeta *)mdata))
 #define KMS_BUFFER_LATENCY_DATA_UNLOCK(mdata) \
-  (g_rec_mutex_unlock (&((KmsBufferLatencyMeta *)mdata)->datamutex))
+  (kms_buffer_latency_meta_data_unlock ((KmsBufferLatencyMeta *)mdata))
+
+/* Takes ownership of @value, @data is created or copied when needed */
+void kms_buffer_latency_data_insert (KmsQuarkMap **data, GQuark key,
+  gpointer value);
 
 GType kms_buffer_latency_meta_api_get_type (void);
 #define KMS_BUFFER_LATENCY_META_API_TYPE \
@@ -0,0 +1,557 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmsencoderpool.h"
+
+#define GST_DEFAULT_NAME "encoderpool"
+#define GST_CAT_DEFAULT kms_encoder_pool_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define KMS_ENCODER_POOL_ACTIVE "kms-encoder-pool-active"
+G_DEFINE_QUARK (KMS_ENCODER_POOL_ACTIVE, kms_encoder_pool_active);
+
+/* Input caps fields that determine the context kept by an idle encoder */
+static const gchar *context_fields[] = {
+  "width", "height", "framerate", "rate", "channels", NULL
+};
+
+typedef struct _KmsEncoderPool
+{
+  GMutex mutex;
+  GHashTable *idle;             /* key -> GQueue of GstElement */
+  GThreadPool *workers;
+  guint size;
+
+  guint active;
+  guint max_active;
+
+  guint64 hits;
+  guint64 standby;
+  guint64 misses;
+  guint64 recycled;
+  guint64 discarded;
+  guint64 rejected;
+} KmsEncoderPool;
+
+typedef struct _KmsEncoderPoolTask
+{
+  gchar *key;
+  GstElementFactory *factory;
+  GstElement *encoder;
+  gboolean keep_context;
+} KmsEncoderPoolTask;
+
+static void
+kms_encoder_pool_task_destroy (KmsEncoderPoolTask * task)
+{
+  g_free (task->key);
+
+  if (task->factory != NULL) {
+    g_object_unref (task->factory);
+  }
+
+  g_slice_free (KmsEncoderPoolTask, task);
+}
+
+static void
+idle_queue_destroy (GQueue * queue)
+{
+  g_queue_free_full (queue, g_object_unref);
+}
+
+/* Should be called with the pool mutex held */
+static GQueue *
+kms_encoder_pool_get_queue (KmsEncoderPool * pool, const gchar * key)
+{
+  GQueue *queue = g_hash_table_lookup (pool->idle, key);
+
+  if (queue == NULL) {
+    queue = g_queue_new ();
+    g_hash_table_insert (pool->idle, g_strdup (key), queue);
+  }
+
+  return queue;
+}
+
+static void
+kms_encoder_pool_reset_properties (GstElement * encoder)
+{
+  guint n_props = 0, i;
+  GParamSpec **props;
+
+  props =
+      g_object_class_list_properties (G_OBJECT_GET_CLASS (encoder), &n_props);
+
+  for (i = 0; i < n_props; i++) {
+    GValue value = G_VALUE_INIT;
+
+    if (!(props[i]->flags & G_PARAM_WRITABLE) ||
+        (props[i]->flags & G_PARAM_CONSTRUCT_ONLY) ||
+        props[i]->owner_type == GST_TYPE_OBJECT) {
+      /* Keep name and parent */
+      continue;
+    }
+
+    g_value_init (&value, props[i]->value_type);
+    g_param_value_set_default (props[i], &value);
+    g_object_set_property (G_OBJECT (encoder), props[i]->name, &value);
+    g_value_unset (&value);
+  }
+
+  g_free (props);
+}
+
+/*
+ * A negotiated encoder stays in PAUSED, so its codec context survives until
+ * it is linked again to a stream with the same caps. Flushing only drops
+ * the frames still pending from the previous stream.
+ */
+static void
+kms_encoder_pool_recycle (KmsEncoderPool * pool, KmsEncoderPoolTask * task)
+{
+  GstElement *encoder = task->encoder;
+  GQueue *queue;
+
+  if (task->keep_context) {
+    GstPad *sink = gst_element_get_static_pad (encoder, "sink");
+
+    gst_element_set_state (encoder, GST_STATE_PAUSED);
+    gst_pad_send_event (sink, gst_event_new_flush_start ());
+    gst_pad_send_event (sink, gst_event_new_flush_stop (TRUE));
+    g_object_unref (sink);
+    kms_encoder_pool_reset_properties (encoder);
+  } else {
+    gst_element_set_state (encoder, GST_STATE_NULL);
+    kms_encoder_pool_reset_properties (encoder);
+    gst_element_set_state (encoder, GST_STATE_READY);
+  }
+
+  g_mutex_lock (&pool->mutex);
+  queue = kms_encoder_pool_get_queue (pool, task->key);
+
+  if (g_queue_get_length (queue) < pool->size) {
+    g_queue_push_tail (queue, encoder);
+    pool->recycled++;
+    encoder = NULL;
+  } else {
+    pool->discarded++;
+  }
+  g_mutex_unlock (&pool->mutex);
+
+  if (encoder != NULL) {
+    gst_element_set_state (encoder, GST_STATE_NULL);
+    g_object_unref (encoder);
+  }
+}
+
+static void
+kms_encoder_pool_refill (KmsEncoderPool * pool, KmsEncoderPoolTask * task)
+{
+  for (;;) {
+    GstElement *encoder;
+    GQueue *queue;
+    gboolean full;
+
+    g_mutex_lock (&pool->mutex);
+    queue = kms_encoder_pool_get_queue (pool, task->key);
+    full = g_queue_get_length (queue) >= pool->size;
+    g_mutex_unlock (&pool->mutex);
+
+    if (full) {
+      return;
+    }
+
+    encoder = gst_element_factory_create (task->factory, NULL);
+
+    if (encoder == NULL) {
+      GST_WARNING ("Cannot create encoder %s", task->key);
+      return;
+    }
+
+    gst_object_ref_sink (encoder);
+
+    /* Let the element allocate its resources out of the critical path */
+    gst_element_set_state (encoder, GST_STATE_READY);
+
+    g_mutex_lock (&pool->mutex);
+    queue = kms_encoder_pool_get_queue (pool, task->key);
+    full = g_queue_get_length (queue) >= pool->size;
+    if (!full) {
+      GST_DEBUG ("Adding standby encoder %" GST_PTR_FORMAT " to %s", encoder,
+          task->key);
+      g_queue_push_tail (queue, encoder);
+    }
+    g_mutex_unlock (&pool->mutex);
+
+    if (full) {
+      gst_element_set_state (encoder, GST_STATE_NULL);
+      g_object_unref (encoder);
+      return;
+    }
+  }
+}
+
+static void
+kms_encoder_pool_worker (gpointer data, gpointer user_data)
+{
+  KmsEncoderPoolTask *task = data;
+  KmsEncoderPool *pool = user_data;
+
+  if (task->encoder != NULL) {
+    kms_encoder_pool_recycle (pool, task);
+  } else {
+    kms_encoder_pool_refill (pool, task);
+  }
+
+  kms_encoder_pool_task_destroy (task);
+}
+
+static KmsEncoderPool *
+kms_encoder_pool_get (void)
+{
+  static KmsEncoderPool pool;
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    const gchar *size = g_getenv (KMS_ENCODER_POOL_SIZE_ENV);
+
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+        GST_DEFAULT_NAME);
+
+    g_mutex_init (&pool.mutex);
+    pool.idle = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) idle_queue_destroy);
+    pool.workers =
+        g_thread_pool_new (kms_encoder_pool_worker, &pool, 1, FALSE, NULL);
+
+    if (size != NULL) {
+      pool.size = g_ascii_strtoull (size, NULL, 10);
+    }
+
+    GST_INFO ("Encoder pool size: %u", pool.size);
+
+    g_once_init_leave (&initialized, 1);
+  }
+
+  return &pool;
+}
+
+static void
+kms_encoder_pool_deactivate (KmsEncoderPool * pool)
+{
+  g_mutex_lock (&pool->mutex);
+  pool->active--;
+  g_mutex_unlock (&pool->mutex);
+}
+
+static gchar *
+kms_encoder_pool_get_any_key (GstElementFactory * factory)
+{
+  return g_strdup_printf ("%s-any", GST_OBJECT_NAME (factory));
+}
+
+/*
+ * Encoders fed with the same width, height, framerate, rate and channels
+ * can keep their context. Format is left out, converters adapt it before
+ * the encoder.
+ */
+static gchar *
+kms_encoder_pool_get_key (GstElementFactory * factory, const GstCaps * caps)
+{
+  GstStructure *st, *context;
+  gchar *desc, *key;
+  guint i;
+
+  if (caps == NULL || !gst_caps_is_fixed (caps)) {
+    return kms_encoder_pool_get_any_key (factory);
+  }
+
+  st = gst_caps_get_structure (caps, 0);
+  context = gst_structure_new_empty (gst_structure_get_name (st));
+
+  for (i = 0; context_fields[i] != NULL; i++) {
+    const GValue *value = gst_structure_get_value (st, context_fields[i]);
+
+    if (value != NULL) {
+      gst_structure_set_value (context, context_fields[i], value);
+    }
+  }
+
+  desc = gst_structure_to_string (context);
+  key = g_strdup_printf ("%s-%s", GST_OBJECT_NAME (factory), desc);
+  gst_structure_free (context);
+  g_free (desc);
+
+  return key;
+}
+
+/* Should be called with the pool mutex held */
+static GstElement *
+kms_encoder_pool_pop (KmsEncoderPool * pool, const gchar * key)
+{
+  GQueue *queue = g_hash_table_lookup (pool->idle, key);
+
+  if (queue == NULL) {
+    return NULL;
+  }
+
+  return g_queue_pop_head (queue);
+}
+
+/**
+ * kms_encoder_pool_acquire:
+ * @factory: Factory of the required encoder
+ * @input_caps: (allow-none): Caps the encoder is expected to be fed with
+ *
+ * An idle encoder that was negotiated with the same @input_caps is returned
+ * in PAUSED state, keeping its context. Otherwise a standby or new encoder
+ * in NULL or READY state is returned.
+ *
+ * Returns: (transfer floating): An encoder with its properties set to
+ * default values, or NULL if it cannot be created or the maximum number of
+ * active encoders has been reached.
+ */
+GstElement *
+kms_encoder_pool_acquire (GstElementFactory * factory,
+    const GstCaps * input_caps)
+{
+  KmsEncoderPool *pool = kms_encoder_pool_get ();
+  GstElement *encoder = NULL;
+  gchar *key, *any_key;
+  guint size;
+
+  key = kms_encoder_pool_get_key (factory, input_caps);
+  any_key = kms_encoder_pool_get_any_key (factory);
+
+  g_mutex_lock (&pool->mutex);
+  if (pool->max_active > 0 && pool->active >= pool->max_active) {
+    pool->rejected++;
+    g_mutex_unlock (&pool->mutex);
+    GST_WARNING ("Rejecting encoder %s, %u encoders already active", key,
+        pool->max_active);
+    g_free (key);
+    g_free (any_key);
+    return NULL;
+  }
+
+  /* Reserve it now so concurrent callers cannot exceed the limit */
+  pool->active++;
+  size = pool->size;
+
+  if (g_strcmp0 (key, any_key) != 0) {
+    encoder = kms_encoder_pool_pop (pool, key);
+  }
+
+  if (encoder != NULL) {
+    pool->hits++;
+  } else {
+    encoder = kms_encoder_pool_pop (pool, any_key);
+
+    if (encoder != NULL) {
+      pool->standby++;
+    } else if (size > 0) {
+      pool->misses++;
+    }
+  }
+  g_mutex_unlock (&pool->mutex);
+
+  if (encoder != NULL) {
+    GST_DEBUG ("Reusing encoder %" GST_PTR_FORMAT " from %s", encoder, key);
+    /* Pool reference is transferred to the caller */
+    g_object_force_floating (G_OBJECT (encoder));
+  } else {
+    encoder = gst_element_factory_create (factory, NULL);
+
+    if (encoder == NULL) {
+      kms_encoder_pool_deactivate (pool);
+      g_free (key);
+      g_free (any_key);
+      return NULL;
+    }
+  }
+
+  g_free (key);
+
+  /* Released or destroyed encoders are not active anymore */
+  g_object_set_qdata_full (G_OBJECT (encoder),
+      kms_encoder_pool_active_quark (), pool,
+      (GDestroyNotify) kms_encoder_pool_deactivate);
+
+  if (size > 0) {
+    KmsEncoderPoolTask *task = g_slice_new0 (KmsEncoderPoolTask);
+
+    /* Standby encoders have no context, they can serve any caps */
+    task->key = any_key;
+    task->factory = g_object_ref (factory);
+    g_thread_pool_push (pool->workers, task, NULL);
+  } else {
+    g_free (any_key);
+  }
+
+  return encoder;
+}
+
+/**
+ * kms_encoder_pool_release:
+ * @encoder: (transfer full): An encoder returned by kms_encoder_pool_acquire
+ * that is not inside any bin.
+ *
+ * The encoder is kept under the caps it negotiated on its sink pad.
+ */
+void
+kms_encoder_pool_release (GstElement * encoder)
+{
+  KmsEncoderPool *pool = kms_encoder_pool_get ();
+  GstElementFactory *factory;
+  KmsEncoderPoolTask *task;
+  GstCaps *caps = NULL;
+  GstPad *sink;
+  guint size;
+
+  g_return_if_fail (GST_OBJECT_PARENT (encoder) == NULL);
+
+  g_object_set_qdata (G_OBJECT (encoder), kms_encoder_pool_active_quark (),
+      NULL);
+
+  factory = gst_element_get_factory (encoder);
+
+  g_mutex_lock (&pool->mutex);
+  size = pool->size;
+  g_mutex_unlock (&pool->mutex);
+
+  if (factory == NULL || size == 0) {
+    gst_element_set_state (encoder, GST_STATE_NULL);
+    g_object_unref (encoder);
+    return;
+  }
+
+  sink = gst_element_get_static_pad (encoder, "sink");
+  if (sink != NULL) {
+    caps = gst_pad_get_current_caps (sink);
+    g_object_unref (sink);
+  }
+
+  task = g_slice_new0 (KmsEncoderPoolTask);
+  task->key = kms_encoder_pool_get_key (factory, caps);
+  task->keep_context = caps != NULL && gst_caps_is_fixed (caps);
+  task->encoder = encoder;
+  g_thread_pool_push (pool->workers, task, NULL);
+
+  if (caps != NULL) {
+    gst_caps_unref (caps);
+  }
+}
+
+static void
+trim_queue (gpointer key, gpointer value, gpointer size)
+{
+  GQueue *queue = value;
+
+  while (g_queue_get_length (queue) > GPOINTER_TO_UINT (size)) {
+    GstElement *encoder = g_queue_pop_tail (queue);
+
+    gst_element_set_state (encoder, GST_STATE_NULL);
+    g_object_unref (encoder);
+  }
+}
+
+void
+kms_encoder_pool_set_size (guint size)
+{
+  KmsEncoderPool *pool = kms_encoder_pool_get ();
+
+  g_mutex_lock (&pool->mutex);
+  pool->size = size;
+  g_hash_table_foreach (pool->idle, trim_queue, GUINT_TO_POINTER (size));
+  g_mutex_unlock (&pool->mutex);
+}
+
+guint
+kms_encoder_pool_get_size (void)
+{
+  KmsEncoderPool *pool = kms_encoder_pool_get ();
+  guint size;
+
+  g_mutex_lock (&pool->mutex);
+  size = pool->size;
+  g_mutex_unlock (&pool->mutex);
+
+  return size;
+}
+
+void
+kms_encoder_pool_set_max_active (guint max_active)
+{
+  KmsEncoderPool *pool = kms_encoder_pool_get ();
+
+  g_mutex_lock (&pool->mutex);
+  pool->max_active = max_active;
+  g_mutex_unlock (&pool->mutex);
+}
+
+guint
+kms_encoder_pool_get_active (void)
+{
+  KmsEncoderPool *pool = kms_encoder_pool_get ();
+  guint active;
+
+  g_mutex_lock (&pool->mutex);
+  active = pool->active;
+  g_mutex_unlock (&pool->mutex);
+
+  return active;
+}
+
+static void
+count_idle (gpointer key, gpointer value, gpointer idle)
+{
+  *(guint *) idle += g_queue_get_length (value);
+}
+
+/**
+ * kms_encoder_pool_get_stats:
+ *
+ * Returns: (transfer full): A #GstStructure with the reuse statistics
+ */
+GstStructure *
+kms_encoder_pool_get_stats (void)
+{
+  KmsEncoderPool *pool = kms_encoder_pool_get ();
+  GstStructure *stats;
+  guint idle = 0;
+
+  g_mutex_lock (&pool->mutex);
+  g_hash_table_foreach (pool->idle, count_idle, &idle);
+  stats = gst_structure_new ("encoder-pool",
+      "size", G_TYPE_UINT, pool->size,
+      "idle", G_TYPE_UINT, idle,
+      "active", G_TYPE_UINT, pool->active,
+      "max-active", G_TYPE_UINT, pool->max_active,
+      "hits", G_TYPE_UINT64, pool->hits,
+      "standby", G_TYPE_UINT64, pool->standby,
+      "misses", G_TYPE_UINT64, pool->misses,
+      "recycled", G_TYPE_UINT64, pool->recycled,
+      "discarded", G_TYPE_UINT64, pool->discarded,
+      "rejected", G_TYPE_UINT64, pool->rejected, NULL);
+  g_mutex_unlock (&pool->mutex);
+
+  return stats;
+}
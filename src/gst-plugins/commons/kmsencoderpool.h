@@ -0,0 +1,42 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_ENCODER_POOL_H__
+#define __KMS_ENCODER_POOL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Idle encoders kept per (factory, negotiated caps), 0 disables the pool */
+#define KMS_ENCODER_POOL_SIZE_ENV "KURENTO_ENCODER_POOL_SIZE"
+
+GstElement * kms_encoder_pool_acquire (GstElementFactory * factory, const GstCaps * input_caps);
+void kms_encoder_pool_release (GstElement * encoder);
+
+void kms_encoder_pool_set_size (guint size);
+guint kms_encoder_pool_get_size (void);
+
+/* Maximum number of encoders in use at the same time, 0 means no limit */
+void kms_encoder_pool_set_max_active (guint max_active);
+guint kms_encoder_pool_get_active (void);
+
+GstStructure * kms_encoder_pool_get_stats (void);
+
+G_END_DECLS
+
+#endif /* __KMS_ENCODER_POOL_H__ */
@@ -20,7 +20,9 @@
 #endif
 
 #include "kmsenctreebin.h"
+#include "kmsencoderpool.h"
 #include "kmsutils.h"
+#include "kmsmetrics.h"
 
 #define GST_DEFAULT_NAME "enctreebin"
 #define GST_CAT_DEFAULT kms_enc_tree_bin_debug
@@ -37,6 +39,8 @@ G_DEFINE_TYPE (KmsEncTreeBin, kms_enc_tree_bin, KMS_TYPE_TREE_BIN);
   )                                         \
 )
 
+static KmsMetric *transcoders_metric;
+
 #define KMS_ENC_TREE_BIN_LIMIT(obj, value) \
   MAX((obj)->priv->min_bitrate,MIN((obj)->priv->max_bitrate, (value)))
 
@@ -55,6 +59,7 @@ struct _KmsEncTreeBinPrivate
   GstElement *enc;
   EncoderType enc_type;
   RembEventManager *remb_manager;
+  gulong tag_probe_id;
 
   gint remb_bitrate;
   gint tag_bitrate;
@@ -216,7 +221,8 @@ kms_enc_tree_bin_set_encoder_type (KmsEncTreeBin * self)
 
 static void
 kms_enc_tree_bin_create_encoder_for_caps (KmsEncTreeBin * self,
-    const GstCaps * caps, gint target_bitrate, GstStructure * codec_configs)
+    const GstCaps * caps, const GstCaps * input_caps, gint target_bitrate,
+    GstStructure * codec_configs)
 {
   GList *encoder_list, *filtered_list, *l;
   GstElementFactory *encoder_factory = NULL;
@@ -247,7 +253,10 @@ kms_enc_tree_bin_create_encoder_for_caps (KmsEncTreeBin * self,
   }
 
   if (encoder_factory != NULL) {
-    self->priv->enc = gst_element_factory_create (encoder_factory, NULL);
+    self->priv->enc = kms_encoder_pool_acquire (encoder_factory, input_caps);
+  }
+
+  if (self->priv->enc != NULL) {
     kms_enc_tree_bin_set_encoder_type (self);
     configure_encoder (self->priv->enc, self->priv->enc_type, target_bitrate,
         codec_configs);
@@ -285,7 +294,8 @@ kms_enc_tree_bin_set_target_bitrate (KmsEncTreeBin * self)
 {
   gint target_bitrate = kms_enc_tree_bin_get_bitrate (self);
 
-  if (target_bitrate <= 0) {
+  if (target_bitrate <= 0 || self->priv->enc == NULL) {
+    /* Encoder may be already back in the pool */
     return;
   }
 
@@ -448,15 +458,16 @@ check_caps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
 
 static gboolean
 kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
-    gint target_bitrate, GstStructure * codec_configs)
+    const GstCaps * input_caps, gint target_bitrate,
+    GstStructure * codec_configs)
 {
   KmsTreeBin *tree_bin = KMS_TREE_BIN (self);
   GstElement *rate, *convert, *mediator, *output_tee, *capsfilter = NULL;
 
   self->priv->current_bitrate = target_bitrate;
 
-  kms_enc_tree_bin_create_encoder_for_caps (self, caps, target_bitrate,
-      codec_configs);
+  kms_enc_tree_bin_create_encoder_for_caps (self, caps, input_caps,
+      target_bitrate, codec_configs);
 
   if (self->priv->enc == NULL) {
     GST_WARNING_OBJECT (self, "Invalid encoder for caps: %" GST_PTR_FORMAT,
@@ -471,8 +482,9 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
       kms_utils_remb_event_manager_create (self->priv->enc_sink);
   kms_utils_remb_event_manager_set_callback (self->priv->remb_manager,
       bitrate_callback, self, NULL);
-  gst_pad_add_probe (self->priv->enc_sink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
-      tag_event_probe, self, NULL);
+  self->priv->tag_probe_id =
+      gst_pad_add_probe (self->priv->enc_sink,
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, tag_event_probe, self, NULL);
 
   rate = kms_utils_create_rate_for_caps (caps);
   convert = kms_utils_create_convert_for_caps (caps);
@@ -528,9 +540,16 @@ kms_enc_tree_bin_configure (KmsEncTreeBin * self, const GstCaps * caps,
   return TRUE;
 }
 
+/**
+ * kms_enc_tree_bin_new:
+ * @caps: Caps to be produced
+ * @input_caps: (allow-none): Raw caps the bin is going to be fed with, if
+ * already known, so that an encoder negotiated for them can be reused
+ */
 KmsEncTreeBin *
-kms_enc_tree_bin_new (const GstCaps * caps, gint target_bitrate,
-    gint min_bitrate, gint max_bitrate, GstStructure * codec_configs)
+kms_enc_tree_bin_new (const GstCaps * caps, const GstCaps * input_caps,
+    gint target_bitrate, gint min_bitrate, gint max_bitrate,
+    GstStructure * codec_configs)
 {
   KmsEncTreeBin *enc;
 
@@ -539,7 +558,8 @@ kms_enc_tree_bin_new (const GstCaps * caps, gint target_bitrate,
   enc->priv->min_bitrate = min_bitrate;
 
   target_bitrate = KMS_ENC_TREE_BIN_LIMIT (enc, target_bitrate);
-  if (!kms_enc_tree_bin_configure (enc, caps, target_bitrate, codec_configs)) {
+  if (!kms_enc_tree_bin_configure (enc, caps, input_caps, target_bitrate,
+          codec_configs)) {
     g_object_unref (enc);
     return NULL;
   }
@@ -547,6 +567,9 @@ kms_enc_tree_bin_new (const GstCaps * caps, gint target_bitrate,
   return enc;
 }
 
+static void kms_enc_tree_bin_parent_changed (GObject * object,
+    GParamSpec * pspec, gpointer user_data);
+
 static void
 kms_enc_tree_bin_init (KmsEncTreeBin * self)
 {
@@ -560,23 +583,76 @@ kms_enc_tree_bin_init (KmsEncTreeBin * self)
 
   self->priv->max_bitrate = G_MAXINT;
   self->priv->min_bitrate = 0;
+
+  g_signal_connect (self, "notify::parent",
+      G_CALLBACK (kms_enc_tree_bin_parent_changed), NULL);
+
+  kms_metric_add (transcoders_metric, 1);
 }
 
 static void
-kms_enc_tree_bin_dispose (GObject * object)
+kms_enc_tree_bin_finalize (GObject * object)
 {
-  KmsEncTreeBin *self = KMS_ENC_TREE_BIN (object);
+  kms_metric_add (transcoders_metric, -1);
 
-  GST_DEBUG_OBJECT (object, "dispose");
-  if (self->priv->enc_sink) {
-    g_clear_object (&self->priv->enc_sink);
-  }
+  /* chain up */
+  G_OBJECT_CLASS (kms_enc_tree_bin_parent_class)->finalize (object);
+}
 
+static void
+kms_enc_tree_bin_release_encoder (KmsEncTreeBin * self)
+{
   if (self->priv->remb_manager) {
     kms_utils_remb_event_manager_destroy (self->priv->remb_manager);
     self->priv->remb_manager = NULL;
   }
 
+  if (self->priv->enc_sink) {
+    if (self->priv->tag_probe_id != 0) {
+      gst_pad_remove_probe (self->priv->enc_sink, self->priv->tag_probe_id);
+      self->priv->tag_probe_id = 0;
+    }
+    g_clear_object (&self->priv->enc_sink);
+  }
+
+  if (self->priv->enc != NULL) {
+    GstElement *enc = self->priv->enc;
+
+    self->priv->enc = NULL;
+
+    if (GST_OBJECT_PARENT (enc) == GST_OBJECT (self)) {
+      /* Give the encoder back to the pool instead of destroying it */
+      g_object_ref (enc);
+      gst_bin_remove (GST_BIN (self), enc);
+      kms_encoder_pool_release (enc);
+    }
+  }
+}
+
+static void
+kms_enc_tree_bin_parent_changed (GObject * object, GParamSpec * pspec,
+    gpointer user_data)
+{
+  KmsEncTreeBin *self = KMS_ENC_TREE_BIN (object);
+
+  if (GST_OBJECT_PARENT (self) != NULL) {
+    return;
+  }
+
+  /* The bin is removed before it is stopped, so the encoder still keeps its
+   * negotiated context when it is given back to the pool */
+  kms_enc_tree_bin_release_encoder (self);
+}
+
+static void
+kms_enc_tree_bin_dispose (GObject * object)
+{
+  KmsEncTreeBin *self = KMS_ENC_TREE_BIN (object);
+
+  GST_DEBUG_OBJECT (object, "dispose");
+
+  kms_enc_tree_bin_release_encoder (self);
+
   /* chain up */
   G_OBJECT_CLASS (kms_enc_tree_bin_parent_class)->dispose (object);
 }
@@ -597,6 +673,10 @@ kms_enc_tree_bin_class_init (KmsEncTreeBinClass * klass)
       GST_DEFAULT_NAME);
 
   gobject_class->dispose = kms_enc_tree_bin_dispose;
+  gobject_class->finalize = kms_enc_tree_bin_finalize;
+
+  transcoders_metric = kms_metrics_get_gauge ("kms_transcoders",
+      "Encoding branches created to transcode media");
 
   g_type_class_add_private (klass, sizeof (KmsEncTreeBinPrivate));
 }
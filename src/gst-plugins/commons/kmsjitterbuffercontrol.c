@@ -0,0 +1,461 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "kmsjitterbuffercontrol.h"
+#include "kmsrefstruct.h"
+#include "kmsmetrics.h"
+
+#define GST_CAT_DEFAULT kms_jitter_buffer_control_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsjitterbuffercontrol"
+
+#define DEFAULT_ADAPTIVE TRUE
+#define DEFAULT_MIN_LATENCY 20  /* ms */
+#define DEFAULT_MAX_LATENCY 1000        /* ms */
+
+#define UPDATE_INTERVAL (1 * GST_SECOND)
+
+/* Latency covering this many times the interarrival jitter plus a margin */
+#define JITTER_FACTOR 4
+#define JITTER_MARGIN 10        /* ms */
+
+/* Late packets increase latency by a quarter at least */
+#define LATE_INCREASE_DIV 4
+
+/* Intervals without late packets before latency is reduced, a quarter */
+/* of the excess every time */
+#define STABLE_INTERVALS 5
+#define DECREASE_DIV 4
+
+/* Changing latency reconfigures the latency of the whole pipeline, so */
+/* small changes are not worth it */
+#define MIN_LATENCY_CHANGE 10   /* ms */
+
+typedef struct _KmsJitterBufferEntry
+{
+  /* Not owned, entries are removed once their jitter buffer is gone */
+  GWeakRef jitterbuffer;
+  GObject *rtpsession;
+  guint ssrc;
+  guint group;
+
+  guint64 last_late;
+  guint64 last_lost;
+  guint latency;
+  guint jitter;
+  guint target;
+  guint stable;
+  gboolean running;
+} KmsJitterBufferEntry;
+
+struct _KmsJitterBufferControl
+{
+  KmsRefStruct ref;
+
+  GMutex mutex;
+  GSList *entries;
+  GstClockID clock_id;
+
+  gboolean adaptive;
+  guint min_latency;
+  guint max_latency;
+};
+
+static KmsMetric *lost_metric;
+static KmsMetric *late_metric;
+
+static void
+kms_jitter_buffer_entry_destroy (KmsJitterBufferEntry * entry)
+{
+  g_weak_ref_clear (&entry->jitterbuffer);
+  g_clear_object (&entry->rtpsession);
+
+  g_slice_free (KmsJitterBufferEntry, entry);
+}
+
+static void
+kms_jitter_buffer_control_free (KmsJitterBufferControl * self)
+{
+  g_slist_free_full (self->entries,
+      (GDestroyNotify) kms_jitter_buffer_entry_destroy);
+  g_mutex_clear (&self->mutex);
+
+  g_slice_free (KmsJitterBufferControl, self);
+}
+
+static void
+kms_jitter_buffer_control_unref (KmsJitterBufferControl * self)
+{
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (self));
+}
+
+static guint
+kms_jitter_buffer_entry_get_jitter (KmsJitterBufferEntry * entry)
+{
+  GstStructure *stats;
+  GObject *source = NULL;
+  guint jitter = 0;
+  gint clock_rate = 0;
+
+  g_signal_emit_by_name (entry->rtpsession, "get-source-by-ssrc", entry->ssrc,
+      &source);
+
+  if (source == NULL) {
+    return entry->jitter;
+  }
+
+  g_object_get (source, "stats", &stats, NULL);
+  g_object_unref (source);
+
+  if (stats == NULL) {
+    return entry->jitter;
+  }
+
+  /* Interarrival jitter is given in timestamp units */
+  gst_structure_get (stats, "jitter", G_TYPE_UINT, &jitter, "clock-rate",
+      G_TYPE_INT, &clock_rate, NULL);
+  gst_structure_free (stats);
+
+  if (clock_rate <= 0) {
+    return entry->jitter;
+  }
+
+  return (guint) ((guint64) jitter * 1000 / clock_rate);
+}
+
+guint
+kms_jitter_buffer_control_get_target (KmsJitterBufferControl * self,
+    guint latency, guint jitter, gboolean late, guint * stable)
+{
+  guint required = JITTER_FACTOR * jitter + JITTER_MARGIN;
+  guint target;
+
+  if (late) {
+    target = MAX (required, latency + latency / LATE_INCREASE_DIV);
+    *stable = 0;
+  } else if (required > latency) {
+    target = required;
+    *stable = 0;
+  } else if (++*stable >= STABLE_INTERVALS) {
+    target = latency - (latency - required) / DECREASE_DIV;
+  } else {
+    target = latency;
+  }
+
+  return CLAMP (target, self->min_latency, self->max_latency);
+}
+
+gboolean
+kms_jitter_buffer_control_needs_change (KmsJitterBufferControl * self,
+    guint latency, guint target)
+{
+  if (latency < self->min_latency || latency > self->max_latency) {
+    return TRUE;
+  }
+
+  return ABS ((gint) target - (gint) latency) >= MIN_LATENCY_CHANGE;
+}
+
+static void
+kms_jitter_buffer_entry_update (KmsJitterBufferControl * self,
+    KmsJitterBufferEntry * entry, GstElement * jitterbuffer)
+{
+  GstStructure *stats;
+  guint64 pushed = 0, late = 0, lost = 0;
+
+  g_object_get (jitterbuffer, "stats", &stats, "latency", &entry->latency,
+      NULL);
+
+  if (stats != NULL) {
+    gst_structure_get (stats, "num-pushed", G_TYPE_UINT64, &pushed,
+        "num-late", G_TYPE_UINT64, &late, "num-lost", G_TYPE_UINT64, &lost,
+        NULL);
+    gst_structure_free (stats);
+  }
+
+  /* Initial latency is still used until media is flowing */
+  entry->running = pushed > 0;
+  entry->jitter = kms_jitter_buffer_entry_get_jitter (entry);
+  entry->target = kms_jitter_buffer_control_get_target (self, entry->latency,
+      entry->jitter, late > entry->last_late, &entry->stable);
+
+  if (late > entry->last_late) {
+    kms_metric_add (late_metric, late - entry->last_late);
+  }
+  if (lost > entry->last_lost) {
+    kms_metric_add (lost_metric, lost - entry->last_lost);
+  }
+
+  entry->last_late = late;
+  entry->last_lost = lost;
+}
+
+static guint
+kms_jitter_buffer_control_get_group_target (KmsJitterBufferControl * self,
+    guint group)
+{
+  guint target = 0;
+  GSList *l;
+
+  for (l = self->entries; l != NULL; l = l->next) {
+    KmsJitterBufferEntry *entry = l->data;
+
+    if (entry->group == group && entry->running) {
+      target = MAX (target, entry->target);
+    }
+  }
+
+  return target;
+}
+
+static gboolean
+kms_jitter_buffer_control_update (GstClock * clock, GstClockTime time,
+    GstClockID id, KmsJitterBufferControl * self)
+{
+  GSList *l, *next;
+
+  g_mutex_lock (&self->mutex);
+
+  for (l = self->entries; l != NULL; l = next) {
+    KmsJitterBufferEntry *entry = l->data;
+    GstElement *jitterbuffer = g_weak_ref_get (&entry->jitterbuffer);
+
+    next = l->next;
+
+    if (jitterbuffer == NULL) {
+      self->entries = g_slist_delete_link (self->entries, l);
+      kms_jitter_buffer_entry_destroy (entry);
+      continue;
+    }
+
+    kms_jitter_buffer_entry_update (self, entry, jitterbuffer);
+    g_object_unref (jitterbuffer);
+  }
+
+  if (!self->adaptive) {
+    goto end;
+  }
+
+  for (l = self->entries; l != NULL; l = l->next) {
+    KmsJitterBufferEntry *entry = l->data;
+    GstElement *jitterbuffer;
+    guint target;
+
+    if (!entry->running) {
+      continue;
+    }
+
+    target = kms_jitter_buffer_control_get_group_target (self, entry->group);
+
+    if (!kms_jitter_buffer_control_needs_change (self, entry->latency, target)) {
+      continue;
+    }
+
+    jitterbuffer = g_weak_ref_get (&entry->jitterbuffer);
+
+    if (jitterbuffer == NULL) {
+      continue;
+    }
+
+    GST_DEBUG_OBJECT (jitterbuffer, "Jitter %u ms, latency %u -> %u ms",
+        entry->jitter, entry->latency, target);
+
+    g_object_set (jitterbuffer, "latency", target, NULL);
+    g_object_unref (jitterbuffer);
+    entry->latency = target;
+  }
+
+end:
+  g_mutex_unlock (&self->mutex);
+
+  return TRUE;
+}
+
+static void
+kms_jitter_buffer_control_start (KmsJitterBufferControl * self)
+{
+  GstClock *clock;
+
+  if (self->clock_id != NULL) {
+    return;
+  }
+
+  clock = gst_system_clock_obtain ();
+  self->clock_id = gst_clock_new_periodic_id (clock,
+      gst_clock_get_time (clock) + UPDATE_INTERVAL, UPDATE_INTERVAL);
+  g_object_unref (clock);
+
+  kms_ref_struct_ref (KMS_REF_STRUCT_CAST (self));
+  gst_clock_id_wait_async (self->clock_id,
+      (GstClockCallback) kms_jitter_buffer_control_update, self,
+      (GDestroyNotify) kms_jitter_buffer_control_unref);
+}
+
+KmsJitterBufferControl *
+kms_jitter_buffer_control_new (void)
+{
+  KmsJitterBufferControl *self;
+
+  self = g_slice_new0 (KmsJitterBufferControl);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (self),
+      (GDestroyNotify) kms_jitter_buffer_control_free);
+
+  g_mutex_init (&self->mutex);
+  self->adaptive = DEFAULT_ADAPTIVE;
+  self->min_latency = DEFAULT_MIN_LATENCY;
+  self->max_latency = DEFAULT_MAX_LATENCY;
+
+  return self;
+}
+
+void
+kms_jitter_buffer_control_destroy (KmsJitterBufferControl * self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->clock_id != NULL) {
+    gst_clock_id_unschedule (self->clock_id);
+    gst_clock_id_unref (self->clock_id);
+    self->clock_id = NULL;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  kms_jitter_buffer_control_unref (self);
+}
+
+void
+kms_jitter_buffer_control_add (KmsJitterBufferControl * self,
+    GstElement * jitterbuffer, GObject * rtpsession, guint ssrc, guint group)
+{
+  KmsJitterBufferEntry *entry;
+
+  g_return_if_fail (self != NULL);
+
+  entry = g_slice_new0 (KmsJitterBufferEntry);
+  g_weak_ref_init (&entry->jitterbuffer, jitterbuffer);
+  entry->rtpsession = g_object_ref (rtpsession);
+  entry->ssrc = ssrc;
+  entry->group = group;
+
+  g_mutex_lock (&self->mutex);
+  self->entries = g_slist_prepend (self->entries, entry);
+  kms_jitter_buffer_control_start (self);
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_jitter_buffer_control_set_params (KmsJitterBufferControl * self,
+    const GstStructure * params)
+{
+  gint min_latency, max_latency;
+
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  min_latency = self->min_latency;
+  max_latency = self->max_latency;
+
+  gst_structure_get (params, "adaptive", G_TYPE_BOOLEAN, &self->adaptive,
+      NULL);
+  gst_structure_get (params, "min-latency", G_TYPE_INT, &min_latency, NULL);
+  gst_structure_get (params, "max-latency", G_TYPE_INT, &max_latency, NULL);
+
+  if (min_latency < 0 || max_latency < min_latency) {
+    GST_WARNING ("Invalid latency range [%d, %d] ms", min_latency,
+        max_latency);
+  } else {
+    self->min_latency = min_latency;
+    self->max_latency = max_latency;
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_jitter_buffer_control_get_params (KmsJitterBufferControl * self,
+    GstStructure ** params)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  gst_structure_set (*params, "adaptive", G_TYPE_BOOLEAN, self->adaptive,
+      "min-latency", G_TYPE_INT, self->min_latency, "max-latency", G_TYPE_INT,
+      self->max_latency, NULL);
+  g_mutex_unlock (&self->mutex);
+}
+
+gboolean
+kms_jitter_buffer_control_get_values (KmsJitterBufferControl * self,
+    GstElement * jitterbuffer, guint * network_jitter, guint * target_latency)
+{
+  gboolean found = FALSE;
+  GSList *l;
+
+  g_return_val_if_fail (self != NULL, FALSE);
+
+  g_mutex_lock (&self->mutex);
+
+  for (l = self->entries; l != NULL; l = l->next) {
+    KmsJitterBufferEntry *entry = l->data;
+    GstElement *element = g_weak_ref_get (&entry->jitterbuffer);
+    gboolean match = element == jitterbuffer;
+
+    g_clear_object (&element);
+
+    if (match) {
+      *network_jitter = entry->jitter;
+      *target_latency = entry->target;
+      found = TRUE;
+      break;
+    }
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  return found;
+}
+
+void
+kms_jitter_buffer_control_add_stats (KmsJitterBufferControl * self,
+    GstElement * jitterbuffer, GstStructure * stats)
+{
+  guint jitter, target;
+
+  if (kms_jitter_buffer_control_get_values (self, jitterbuffer, &jitter,
+          &target)) {
+    gst_structure_set (stats, "network-jitter", G_TYPE_UINT, jitter,
+        "target-latency", G_TYPE_UINT, target, NULL);
+  }
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+
+  lost_metric = kms_metrics_get_counter ("kms_jitterbuffer_lost_packets",
+      "Packets considered lost by the jitter buffers");
+  late_metric = kms_metrics_get_counter ("kms_jitterbuffer_late_packets",
+      "Packets dropped by the jitter buffers because they arrived too late");
+}
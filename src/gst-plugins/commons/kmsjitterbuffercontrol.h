@@ -0,0 +1,66 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_JITTER_BUFFER_CONTROL_H__
+#define __KMS_JITTER_BUFFER_CONTROL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KmsJitterBufferControl KmsJitterBufferControl;
+
+/*
+ * Periodically moves the latency of the jitter buffers of an endpoint to
+ * the jitter measured on their RTP sources, within the configured bounds.
+ * Latency grows as soon as packets arrive too late and shrinks slowly while
+ * the network is stable. Jitter buffers in the same group are kept with the
+ * same latency, so streams synchronized between them move together.
+ */
+KmsJitterBufferControl * kms_jitter_buffer_control_new (void);
+void kms_jitter_buffer_control_destroy (KmsJitterBufferControl * self);
+
+void kms_jitter_buffer_control_add (KmsJitterBufferControl * self,
+  GstElement * jitterbuffer, GObject * rtpsession, guint ssrc, guint group);
+
+/* Fields: "adaptive" (boolean), "min-latency" and "max-latency" (int, ms) */
+void kms_jitter_buffer_control_set_params (KmsJitterBufferControl * self,
+  const GstStructure * params);
+void kms_jitter_buffer_control_get_params (KmsJitterBufferControl * self,
+  GstStructure ** params);
+
+/* Appends "network-jitter" and "target-latency" (ms) to @stats */
+void kms_jitter_buffer_control_add_stats (KmsJitterBufferControl * self,
+  GstElement * jitterbuffer, GstStructure * stats);
+gboolean kms_jitter_buffer_control_get_values (KmsJitterBufferControl * self,
+  GstElement * jitterbuffer, guint * network_jitter, guint * target_latency);
+
+/*
+ * Control law applied to each jitter buffer on every update. @latency and
+ * @jitter are in ms, @late tells if packets arrived too late since the
+ * previous update and @stable counts the updates without that happening.
+ * Returns the latency (ms) the jitter buffer should move to.
+ */
+guint kms_jitter_buffer_control_get_target (KmsJitterBufferControl * self,
+  guint latency, guint jitter, gboolean late, guint * stable);
+/* Whether moving from @latency to @target is worth reconfiguring */
+gboolean kms_jitter_buffer_control_needs_change (KmsJitterBufferControl * self,
+  guint latency, guint target);
+
+G_END_DECLS
+
+#endif /* __KMS_JITTER_BUFFER_CONTROL_H__ */
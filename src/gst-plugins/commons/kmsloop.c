@@ -48,8 +48,24 @@ struct _KmsLoopPrivate
   GCond cond;
   GMutex mutex;
   gboolean initialized;
+
+  /* Only used when running in a shared thread */
+  gboolean shared;
+  GPtrArray *sources;
+  gboolean flushed;
 };
 
+typedef struct _KmsLoopThread
+{
+  GThread *thread;
+  GMainLoop *loop;
+  GMainContext *context;
+} KmsLoopThread;
+
+static KmsLoopThread *shared_threads = NULL;
+static guint shared_threads_len = 0;
+static gint shared_threads_next = 0;
+
 #define KMS_LOOP_LOCK(elem) \
   (g_rec_mutex_lock (&KMS_LOOP ((elem))->priv->rmutex))
 #define KMS_LOOP_UNLOCK(elem) \
@@ -112,6 +128,131 @@ end:
   return NULL;
 }
 
+static gpointer
+shared_thread_run (gpointer data)
+{
+  KmsLoopThread *t = data;
+
+  if (!g_main_context_acquire (t->context)) {
+    GST_ERROR ("Can not acquire context");
+    return NULL;
+  }
+
+  GST_DEBUG ("Running shared main loop");
+  g_main_loop_run (t->loop);
+  g_main_context_release (t->context);
+
+  return NULL;
+}
+
+static gpointer
+shared_threads_init (gpointer data)
+{
+  const gchar *size = g_getenv (KMS_LOOP_POOL_SIZE_ENV);
+  guint i, n = 0;
+
+  if (size != NULL) {
+    n = g_ascii_strtoull (size, NULL, 10);
+  }
+
+  GST_INFO ("Loop pool size: %u", n);
+
+  if (n == 0) {
+    return NULL;
+  }
+
+  /* Shared threads live as long as the process */
+  shared_threads = g_new0 (KmsLoopThread, n);
+
+  for (i = 0; i < n; i++) {
+    KmsLoopThread *t = &shared_threads[i];
+
+    t->context = g_main_context_new ();
+    t->loop = g_main_loop_new (t->context, FALSE);
+    t->thread = g_thread_new ("KmsLoopPool", shared_thread_run, t);
+  }
+
+  shared_threads_len = n;
+
+  return NULL;
+}
+
+static KmsLoopThread *
+kms_loop_get_shared_thread (void)
+{
+  static GOnce once = G_ONCE_INIT;
+  guint next;
+
+  g_once (&once, shared_threads_init, NULL);
+
+  if (shared_threads_len == 0) {
+    return NULL;
+  }
+
+  next = (guint) g_atomic_int_add (&shared_threads_next, 1);
+
+  return &shared_threads[next % shared_threads_len];
+}
+
+static gboolean
+signal_flushed (KmsLoop * self)
+{
+  g_mutex_lock (&self->priv->mutex);
+  self->priv->flushed = TRUE;
+  g_cond_signal (&self->priv->cond);
+  g_mutex_unlock (&self->priv->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Equivalent to stopping a dedicated thread: sources of this instance are
+ * destroyed and, unless called from the loop thread, waits for a callback
+ * that may be running to finish.
+ */
+static void
+kms_loop_detach_shared (KmsLoop * self)
+{
+  GSource *source;
+  gboolean current;
+
+  KMS_LOOP_LOCK (self);
+
+  if (self->priv->thread == NULL) {
+    KMS_LOOP_UNLOCK (self);
+    return;
+  }
+
+  current = g_thread_self () == self->priv->thread;
+  self->priv->thread = NULL;
+
+  while (self->priv->sources->len > 0) {
+    source = g_ptr_array_index (self->priv->sources, 0);
+    g_source_destroy (source);
+    g_ptr_array_remove_index_fast (self->priv->sources, 0);
+  }
+
+  KMS_LOOP_UNLOCK (self);
+
+  if (current) {
+    return;
+  }
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_HIGH);
+  g_source_set_callback (source, (GSourceFunc) signal_flushed, self, NULL);
+  g_source_attach (source, self->priv->context);
+  g_source_unref (source);
+
+  g_mutex_lock (&self->priv->mutex);
+
+  while (!self->priv->flushed) {
+    g_cond_wait (&self->priv->cond, &self->priv->mutex);
+  }
+
+  g_mutex_unlock (&self->priv->mutex);
+}
+
 static void
 kms_loop_get_property (GObject * object, guint property_id, GValue * value,
     GParamSpec * pspec)
@@ -139,6 +280,11 @@ kms_loop_dispose (GObject * obj)
 
   GST_DEBUG_OBJECT (obj, "Dispose");
 
+  if (self->priv->shared) {
+    kms_loop_detach_shared (self);
+    goto end;
+  }
+
   KMS_LOOP_LOCK (self);
 
   if (self->priv->thread != NULL) {
@@ -160,6 +306,7 @@ kms_loop_dispose (GObject * obj)
 
   KMS_LOOP_UNLOCK (self);
 
+end:
   G_OBJECT_CLASS (kms_loop_parent_class)->dispose (obj);
 }
 
@@ -178,6 +325,10 @@ kms_loop_finalize (GObject * obj)
     g_main_loop_unref (self->priv->loop);
   }
 
+  if (self->priv->sources != NULL) {
+    g_ptr_array_unref (self->priv->sources);
+  }
+
   g_rec_mutex_clear (&self->priv->rmutex);
   g_mutex_clear (&self->priv->mutex);
   g_cond_clear (&self->priv->cond);
@@ -209,6 +360,8 @@ kms_loop_class_init (KmsLoopClass * klass)
 static void
 kms_loop_init (KmsLoop * self)
 {
+  KmsLoopThread *shared;
+
   self->priv = KMS_LOOP_GET_PRIVATE (self);
   self->priv->context = NULL;
   self->priv->loop = NULL;
@@ -216,6 +369,18 @@ kms_loop_init (KmsLoop * self)
   g_cond_init (&self->priv->cond);
   g_mutex_init (&self->priv->mutex);
 
+  shared = kms_loop_get_shared_thread ();
+
+  if (shared != NULL) {
+    self->priv->shared = TRUE;
+    self->priv->thread = shared->thread;
+    self->priv->context = g_main_context_ref (shared->context);
+    self->priv->loop = g_main_loop_ref (shared->loop);
+    self->priv->sources =
+        g_ptr_array_new_with_free_func ((GDestroyNotify) g_source_unref);
+    return;
+  }
+
   self->priv->thread = g_thread_new ("KmsLoop", loop_thread_init, self);
 
   g_mutex_lock (&self->priv->mutex);
@@ -254,6 +419,21 @@ kms_loop_attach (KmsLoop * self, GSource * source, gint priority,
   g_source_set_callback (source, function, data, notify);
   id = g_source_attach (source, self->priv->context);
 
+  if (self->priv->shared) {
+    guint i = 0;
+
+    /* Forget sources already finished before tracking the new one */
+    while (i < self->priv->sources->len) {
+      if (g_source_is_destroyed (g_ptr_array_index (self->priv->sources, i))) {
+        g_ptr_array_remove_index_fast (self->priv->sources, i);
+      } else {
+        i++;
+      }
+    }
+
+    g_ptr_array_add (self->priv->sources, g_source_ref (source));
+  }
+
   KMS_LOOP_UNLOCK (self);
 
   return id;
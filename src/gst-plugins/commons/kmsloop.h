@@ -48,6 +48,10 @@ G_BEGIN_DECLS
     KmsLoopClass                           \
   )                                        \
 )
+
+/* Loop threads shared by all the instances, 0 gives each loop its own thread */
+#define KMS_LOOP_POOL_SIZE_ENV "KURENTO_LOOP_POOL_SIZE"
+
 typedef struct _KmsLoop KmsLoop;
 typedef struct _KmsLoopClass KmsLoopClass;
 typedef struct _KmsLoopPrivate KmsLoopPrivate;
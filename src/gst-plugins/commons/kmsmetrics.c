@@ -0,0 +1,234 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "kmsmetrics.h"
+
+#include <string.h>
+
+/* GLib only provides atomic operations on 32 bits integers */
+#define ATOMIC_ADD(ptr, val) __atomic_fetch_add ((ptr), (val), __ATOMIC_RELAXED)
+#define ATOMIC_SET(ptr, val) __atomic_store_n ((ptr), (val), __ATOMIC_RELAXED)
+#define ATOMIC_GET(ptr) __atomic_load_n ((ptr), __ATOMIC_RELAXED)
+
+typedef enum
+{
+  KMS_METRIC_COUNTER,
+  KMS_METRIC_GAUGE,
+  KMS_METRIC_HISTOGRAM
+} KmsMetricType;
+
+typedef union
+{
+  gint64 bits;
+  gdouble value;
+} KmsMetricDouble;
+
+struct _KmsMetric
+{
+  KmsMetricType type;
+  gchar *name;
+  gchar *help;
+
+  gint64 value;
+
+  /* Histograms only, buckets are not cumulative */
+  guint n_bounds;
+  gdouble *bounds;
+  gint64 *buckets;              /* n_bounds + 1, last one is +Inf */
+  gint64 sum;                   /* KmsMetricDouble bits */
+};
+
+static GMutex mutex;
+static GHashTable *metrics_by_name;
+static GPtrArray *metrics;
+
+static KmsMetric *
+kms_metrics_get (KmsMetricType type, const gchar * name, const gchar * help,
+    const gdouble * bounds, guint n_bounds)
+{
+  KmsMetric *metric;
+
+  g_mutex_lock (&mutex);
+
+  if (metrics_by_name == NULL) {
+    metrics_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+    metrics = g_ptr_array_new ();
+  }
+
+  metric = g_hash_table_lookup (metrics_by_name, name);
+
+  if (metric != NULL) {
+    if (metric->type != type) {
+      g_warning ("Metric %s already registered with a different type", name);
+    }
+    goto end;
+  }
+
+  metric = g_new0 (KmsMetric, 1);
+  metric->type = type;
+  metric->name = g_strdup (name);
+  metric->help = g_strdup (help);
+
+  if (type == KMS_METRIC_HISTOGRAM) {
+    metric->n_bounds = n_bounds;
+    metric->bounds = g_new (gdouble, n_bounds);
+    memcpy (metric->bounds, bounds, n_bounds * sizeof (gdouble));
+    metric->buckets = g_new0 (gint64, n_bounds + 1);
+  }
+
+  g_hash_table_insert (metrics_by_name, metric->name, metric);
+  g_ptr_array_add (metrics, metric);
+
+end:
+  g_mutex_unlock (&mutex);
+
+  return metric;
+}
+
+KmsMetric *
+kms_metrics_get_counter (const gchar * name, const gchar * help)
+{
+  return kms_metrics_get (KMS_METRIC_COUNTER, name, help, NULL, 0);
+}
+
+KmsMetric *
+kms_metrics_get_gauge (const gchar * name, const gchar * help)
+{
+  return kms_metrics_get (KMS_METRIC_GAUGE, name, help, NULL, 0);
+}
+
+KmsMetric *
+kms_metrics_get_histogram (const gchar * name, const gchar * help,
+    const gdouble * bounds, guint n_bounds)
+{
+  return kms_metrics_get (KMS_METRIC_HISTOGRAM, name, help, bounds, n_bounds);
+}
+
+void
+kms_metric_add (KmsMetric * metric, gint64 value)
+{
+  g_return_if_fail (metric != NULL && metric->type != KMS_METRIC_HISTOGRAM);
+
+  ATOMIC_ADD (&metric->value, value);
+}
+
+void
+kms_metric_set (KmsMetric * metric, gint64 value)
+{
+  g_return_if_fail (metric != NULL && metric->type == KMS_METRIC_GAUGE);
+
+  ATOMIC_SET (&metric->value, value);
+}
+
+gint64
+kms_metric_get (KmsMetric * metric)
+{
+  g_return_val_if_fail (metric != NULL, 0);
+
+  return ATOMIC_GET (&metric->value);
+}
+
+void
+kms_metric_observe (KmsMetric * metric, gdouble value)
+{
+  KmsMetricDouble old, new;
+  guint i;
+
+  g_return_if_fail (metric != NULL && metric->type == KMS_METRIC_HISTOGRAM);
+
+  for (i = 0; i < metric->n_bounds && value > metric->bounds[i]; i++);
+
+  ATOMIC_ADD (&metric->buckets[i], 1);
+
+  old.bits = ATOMIC_GET (&metric->sum);
+  do {
+    new.value = old.value + value;
+  } while (!__atomic_compare_exchange_n (&metric->sum, &old.bits, new.bits,
+          TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void
+append_double (GString * str, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  g_string_append (str, g_ascii_dtostr (buf, sizeof (buf), value));
+}
+
+static void
+render_histogram (GString * str, KmsMetric * metric)
+{
+  KmsMetricDouble sum;
+  gint64 count = 0;
+  guint i;
+
+  for (i = 0; i <= metric->n_bounds; i++) {
+    count += ATOMIC_GET (&metric->buckets[i]);
+
+    g_string_append_printf (str, "%s_bucket{le=\"", metric->name);
+    if (i < metric->n_bounds) {
+      append_double (str, metric->bounds[i]);
+    } else {
+      g_string_append (str, "+Inf");
+    }
+    g_string_append_printf (str, "\"} %" G_GINT64_FORMAT "\n", count);
+  }
+
+  sum.bits = ATOMIC_GET (&metric->sum);
+  g_string_append_printf (str, "%s_count %" G_GINT64_FORMAT "\n%s_sum ",
+      metric->name, count, metric->name);
+  append_double (str, sum.value);
+  g_string_append_c (str, '\n');
+}
+
+gchar *
+kms_metrics_render (void)
+{
+  GString *str = g_string_new (NULL);
+  guint i;
+
+  g_mutex_lock (&mutex);
+
+  for (i = 0; metrics != NULL && i < metrics->len; i++) {
+    KmsMetric *metric = g_ptr_array_index (metrics, i);
+
+    g_string_append_printf (str, "# HELP %s %s\n", metric->name, metric->help);
+
+    switch (metric->type) {
+      case KMS_METRIC_COUNTER:
+        g_string_append_printf (str, "# TYPE %s counter\n"
+            "%s_total %" G_GINT64_FORMAT "\n", metric->name, metric->name,
+            ATOMIC_GET (&metric->value));
+        break;
+      case KMS_METRIC_GAUGE:
+        g_string_append_printf (str, "# TYPE %s gauge\n"
+            "%s %" G_GINT64_FORMAT "\n", metric->name, metric->name,
+            ATOMIC_GET (&metric->value));
+        break;
+      case KMS_METRIC_HISTOGRAM:
+        g_string_append_printf (str, "# TYPE %s histogram\n", metric->name);
+        render_histogram (str, metric);
+        break;
+    }
+  }
+
+  g_mutex_unlock (&mutex);
+
+  g_string_append (str, "# EOF\n");
+
+  return g_string_free (str, FALSE);
+}
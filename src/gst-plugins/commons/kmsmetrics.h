@@ -0,0 +1,52 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_METRICS_H__
+#define __KMS_METRICS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KmsMetric KmsMetric;
+
+/*
+ * Process wide registry of counters, gauges and histograms. Metrics are
+ * looked up by name only when they are obtained and live until the process
+ * exits, so callers keep the pointer and updating them never takes a lock.
+ * Getting an already registered name returns the same metric.
+ */
+KmsMetric * kms_metrics_get_counter (const gchar * name, const gchar * help);
+KmsMetric * kms_metrics_get_gauge (const gchar * name, const gchar * help);
+/* @bounds are the upper bounds of the buckets, in increasing order */
+KmsMetric * kms_metrics_get_histogram (const gchar * name, const gchar * help,
+  const gdouble * bounds, guint n_bounds);
+
+/* Counters and gauges */
+void kms_metric_add (KmsMetric * metric, gint64 value);
+/* Gauges */
+void kms_metric_set (KmsMetric * metric, gint64 value);
+gint64 kms_metric_get (KmsMetric * metric);
+/* Histograms */
+void kms_metric_observe (KmsMetric * metric, gdouble value);
+
+/* All the registered metrics in OpenMetrics text format, free with g_free */
+gchar * kms_metrics_render (void);
+
+G_END_DECLS
+
+#endif /* __KMS_METRICS_H__ */
@@ -87,68 +87,89 @@ difference_over_threshold (guint a, guint b, float th)
   return (a > b ? (a - b) > (a * th) : (b - a) > (b * th));
 }
 
-static GstPadProbeReturn
-bitrate_calculation_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+static void
+update_bitrate (KmsParseTreeBin * self, GstPad * pad, gsize size,
+    GstClockTime pts, GstClockTime dts)
 {
-  KmsParseTreeBin *self = data;
+  GstClockTime timediff = GST_CLOCK_TIME_NONE;
+  guint bitrate;
+
+  if (GST_CLOCK_TIME_IS_VALID (dts)
+      && GST_CLOCK_TIME_IS_VALID (self->priv->last_buffer_dts)) {
+    timediff = dts - self->priv->last_buffer_dts;
+  } else if (GST_CLOCK_TIME_IS_VALID (pts)
+      && GST_CLOCK_TIME_IS_VALID (self->priv->last_buffer_pts)) {
+    timediff = pts - self->priv->last_buffer_pts;
+  }
 
-  if (GST_PAD_PROBE_INFO_TYPE (info) | GST_PAD_PROBE_TYPE_BUFFER) {
-    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
-    GstClockTime timediff = GST_CLOCK_TIME_NONE;
-    guint bitrate;
-
-    if (GST_CLOCK_TIME_IS_VALID (buffer->dts)
-        && GST_CLOCK_TIME_IS_VALID (self->priv->last_buffer_dts)) {
-      timediff = buffer->dts - self->priv->last_buffer_dts;
-    } else if (GST_CLOCK_TIME_IS_VALID (buffer->pts)
-        && GST_CLOCK_TIME_IS_VALID (self->priv->last_buffer_pts)) {
-      timediff = buffer->pts - self->priv->last_buffer_pts;
-    }
+  if (timediff > 0) {
+    bitrate = (size * GST_SECOND * 8) / timediff;
 
-    if (timediff > 0) {
-      bitrate = (gst_buffer_get_size (buffer) * GST_SECOND * 8) / timediff;
+    self->priv->bitrate_mean = (self->priv->bitrate_mean * 7 + bitrate) / 8;
 
-      self->priv->bitrate_mean = (self->priv->bitrate_mean * 7 + bitrate) / 8;
+    if (self->priv->last_pushed_bitrate == 0
+        || difference_over_threshold (self->priv->bitrate_mean,
+            self->priv->last_pushed_bitrate, BITRATE_THRESHOLD)) {
+      GstTagList *taglist = NULL;
+      GstEvent *previous_tag_event;
 
-      if (self->priv->last_pushed_bitrate == 0
-          || difference_over_threshold (self->priv->bitrate_mean,
-              self->priv->last_pushed_bitrate, BITRATE_THRESHOLD)) {
-        GstTagList *taglist = NULL;
-        GstEvent *previous_tag_event;
+      GST_TRACE_OBJECT (self, "Bitrate: %u", bitrate);
+      GST_TRACE_OBJECT (self, "Bitrate_mean:\t\t%u", self->priv->bitrate_mean);
 
-        GST_TRACE_OBJECT (self, "Bitrate: %u", bitrate);
-        GST_TRACE_OBJECT (self, "Bitrate_mean:\t\t%u",
-            self->priv->bitrate_mean);
+      previous_tag_event = gst_pad_get_sticky_event (pad, GST_EVENT_TAG, 0);
 
-        previous_tag_event = gst_pad_get_sticky_event (pad, GST_EVENT_TAG, 0);
+      if (previous_tag_event) {
+        GST_TRACE_OBJECT (self, "Previous tag event: %" GST_PTR_FORMAT,
+            previous_tag_event);
+        gst_event_parse_tag (previous_tag_event, &taglist);
 
-        if (previous_tag_event) {
-          GST_TRACE_OBJECT (self, "Previous tag event: %" GST_PTR_FORMAT,
-              previous_tag_event);
-          gst_event_parse_tag (previous_tag_event, &taglist);
+        taglist = gst_tag_list_copy (taglist);
+        gst_tag_list_add (taglist, GST_TAG_MERGE_REPLACE, "bitrate",
+            self->priv->bitrate_mean, NULL);
 
-          taglist = gst_tag_list_copy (taglist);
-          gst_tag_list_add (taglist, GST_TAG_MERGE_REPLACE, "bitrate",
-              self->priv->bitrate_mean, NULL);
+        gst_event_unref (previous_tag_event);
+      }
 
-          gst_event_unref (previous_tag_event);
-        }
+      if (!taglist) {
+        taglist = gst_tag_list_new ("bitrate", self->priv->bitrate_mean, NULL);
+      }
 
-        if (!taglist) {
-          taglist =
-              gst_tag_list_new ("bitrate", self->priv->bitrate_mean, NULL);
-        }
+      gst_pad_send_event (pad, gst_event_new_tag (taglist));
+      self->priv->last_pushed_bitrate = self->priv->bitrate_mean;
+    }
+  }
 
-        gst_pad_send_event (pad, gst_event_new_tag (taglist));
-        self->priv->last_pushed_bitrate = self->priv->bitrate_mean;
-      }
+  self->priv->last_buffer_pts = pts;
+  self->priv->last_buffer_dts = dts;
+}
+
+static GstPadProbeReturn
+bitrate_calculation_probe (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  KmsParseTreeBin *self = data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+
+    update_bitrate (self, pad, gst_buffer_get_size (buffer), buffer->pts,
+        buffer->dts);
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+    GstBuffer *buffer = NULL;
+    gsize size = 0;
+    guint i, len;
+
+    /* The whole list is accounted as a single chunk of data */
+    len = gst_buffer_list_length (list);
+
+    for (i = 0; i < len; i++) {
+      buffer = gst_buffer_list_get (list, i);
+      size += gst_buffer_get_size (buffer);
     }
 
-    self->priv->last_buffer_pts = buffer->pts;
-    self->priv->last_buffer_dts = buffer->dts;
-  } else if (GST_PAD_PROBE_INFO_TYPE (info) | GST_PAD_PROBE_TYPE_BUFFER_LIST) {
-    GST_WARNING_OBJECT (self,
-        "Bufferlist is not supported yet for bitrate calculation");
+    if (buffer != NULL) {
+      update_bitrate (self, pad, size, buffer->pts, buffer->dts);
+    }
   }
 
   return GST_PAD_PROBE_OK;
@@ -196,6 +217,12 @@ kms_parse_tree_bin_get_parser (KmsParseTreeBin * self)
   return self->priv->parser;
 }
 
+guint
+kms_parse_tree_bin_get_bitrate (KmsParseTreeBin * self)
+{
+  return g_atomic_int_get (&self->priv->bitrate_mean);
+}
+
 static void
 kms_parse_tree_bin_init (KmsParseTreeBin * self)
 {
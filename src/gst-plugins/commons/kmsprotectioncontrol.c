@@ -0,0 +1,400 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "kmsprotectioncontrol.h"
+#include "kmsrefstruct.h"
+
+#define GST_CAT_DEFAULT kms_protection_control_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsprotectioncontrol"
+
+#define DEFAULT_ADAPTIVE TRUE
+#define DEFAULT_MAX_FEC_PERCENTAGE 50
+#define DEFAULT_RTX_MAX_RTT 150 /* ms */
+
+#define UPDATE_INTERVAL (1 * GST_SECOND)
+
+/* Losses grow at once and decay a quarter of the difference every update */
+#define LOSS_DECREASE_DIV 4
+
+/* Losses over this percentage are too high for retransmissions alone, */
+/* as retransmitted packets are lost as well */
+#define RTX_MAX_LOSS 10
+
+/* FEC needs more redundancy than the losses to recover them */
+#define FEC_LOSS_FACTOR 2
+#define MIN_FEC_PERCENTAGE 5
+
+struct _KmsProtectionControl
+{
+  KmsRefStruct ref;
+
+  GMutex mutex;
+  GstClockID clock_id;
+
+  GObject *rtpsession;
+  GstElement *rtxcache;
+  GstElement *fecenc;
+  gint fec_pt;
+  gboolean nack;
+
+  gboolean adaptive;
+  guint max_fec_percentage;
+  guint rtx_max_rtt;
+
+  guint loss;                   /* % */
+  guint rtt;                    /* ms */
+  guint fec_percentage;
+  gboolean rtx;
+  guint overhead;
+};
+
+static void
+kms_protection_control_free (KmsProtectionControl * self)
+{
+  g_clear_object (&self->rtpsession);
+  g_clear_object (&self->rtxcache);
+  g_clear_object (&self->fecenc);
+  g_mutex_clear (&self->mutex);
+
+  g_slice_free (KmsProtectionControl, self);
+}
+
+static void
+kms_protection_control_unref (KmsProtectionControl * self)
+{
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (self));
+}
+
+/* Worst reception report among the remote sources, FALSE if none */
+static gboolean
+kms_protection_control_get_reports (KmsProtectionControl * self,
+    guint * fraction_lost, guint * rtt)
+{
+  gboolean found = FALSE;
+  GValueArray *arr;
+  guint i;
+
+  *fraction_lost = *rtt = 0;
+
+  g_object_get (self->rtpsession, "sources", &arr, NULL);
+
+  for (i = 0; i < arr->n_values; i++) {
+    GObject *source = g_value_get_object (g_value_array_get_nth (arr, i));
+    gboolean internal = FALSE, have_rb = FALSE;
+    guint f_lost = 0, round_trip = 0;
+    GstStructure *stats;
+
+    g_object_get (source, "stats", &stats, NULL);
+
+    if (stats == NULL) {
+      continue;
+    }
+
+    gst_structure_get (stats, "internal", G_TYPE_BOOLEAN, &internal,
+        "have-rb", G_TYPE_BOOLEAN, &have_rb, NULL);
+
+    if (!internal && have_rb) {
+      gst_structure_get (stats, "rb-fractionlost", G_TYPE_UINT, &f_lost,
+          "rb-round-trip", G_TYPE_UINT, &round_trip, NULL);
+
+      *fraction_lost = MAX (*fraction_lost, f_lost);
+      *rtt = MAX (*rtt, round_trip);
+      found = TRUE;
+    }
+
+    gst_structure_free (stats);
+  }
+
+  g_value_array_free (arr);
+
+  return found;
+}
+
+static void
+kms_protection_control_apply (KmsProtectionControl * self,
+    guint fec_percentage, gboolean rtx)
+{
+  if (self->fecenc != NULL && fec_percentage != self->fec_percentage) {
+    g_object_set (self->fecenc, "percentage", fec_percentage, NULL);
+  }
+
+  /* Bypassed, so the aux sender does not need to be relinked */
+  if (self->rtxcache != NULL && rtx != self->rtx) {
+    g_object_set (self->rtxcache, "bypass", !rtx, NULL);
+  }
+
+  if (fec_percentage != self->fec_percentage || rtx != self->rtx) {
+    GST_DEBUG ("Loss %u%%, RTT %u ms: FEC %u%% -> %u%%, RTX %d -> %d",
+        self->loss, self->rtt, self->fec_percentage, fec_percentage, self->rtx,
+        rtx);
+  }
+
+  self->fec_percentage = fec_percentage;
+  self->rtx = rtx;
+}
+
+static gboolean
+kms_protection_control_update (GstClock * clock, GstClockTime time,
+    GstClockID id, KmsProtectionControl * self)
+{
+  gboolean fec_available;
+  guint fraction_lost, rtt, loss, fec_percentage;
+  gboolean rtx;
+
+  g_mutex_lock (&self->mutex);
+
+  if (!self->adaptive || self->rtpsession == NULL ||
+      !kms_protection_control_get_reports (self, &fraction_lost, &rtt)) {
+    goto end;
+  }
+
+  loss = fraction_lost * 100 / 256;
+  self->rtt = (guint) (((guint64) rtt * 1000) >> 16);
+
+  if (loss >= self->loss) {
+    self->loss = loss;
+  } else {
+    self->loss -= (self->loss - loss + LOSS_DECREASE_DIV - 1) /
+        LOSS_DECREASE_DIV;
+  }
+
+  fec_available = self->fecenc != NULL && self->fec_pt != 0;
+
+  /* Without FEC, retransmissions are the only protection left */
+  rtx = self->nack && (self->rtt <= self->rtx_max_rtt || !fec_available);
+
+  if (!fec_available || self->loss == 0) {
+    fec_percentage = 0;
+  } else if (rtx) {
+    fec_percentage = self->loss >= RTX_MAX_LOSS ? self->loss : 0;
+  } else {
+    fec_percentage = MAX (MIN_FEC_PERCENTAGE, self->loss * FEC_LOSS_FACTOR);
+  }
+
+  fec_percentage = MIN (fec_percentage, self->max_fec_percentage);
+
+  kms_protection_control_apply (self, fec_percentage, rtx);
+
+  /* Each lost packet is sent twice when retransmissions are used */
+  self->overhead = self->fec_percentage + (self->rtx ? self->loss : 0);
+
+end:
+  g_mutex_unlock (&self->mutex);
+
+  return TRUE;
+}
+
+static void
+kms_protection_control_start (KmsProtectionControl * self)
+{
+  GstClock *clock;
+
+  if (self->clock_id != NULL || self->rtpsession == NULL) {
+    return;
+  }
+
+  clock = gst_system_clock_obtain ();
+  self->clock_id = gst_clock_new_periodic_id (clock,
+      gst_clock_get_time (clock) + UPDATE_INTERVAL, UPDATE_INTERVAL);
+  g_object_unref (clock);
+
+  kms_ref_struct_ref (KMS_REF_STRUCT_CAST (self));
+  gst_clock_id_wait_async (self->clock_id,
+      (GstClockCallback) kms_protection_control_update, self,
+      (GDestroyNotify) kms_protection_control_unref);
+}
+
+KmsProtectionControl *
+kms_protection_control_new (void)
+{
+  KmsProtectionControl *self;
+
+  self = g_slice_new0 (KmsProtectionControl);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (self),
+      (GDestroyNotify) kms_protection_control_free);
+
+  g_mutex_init (&self->mutex);
+  self->adaptive = DEFAULT_ADAPTIVE;
+  self->max_fec_percentage = DEFAULT_MAX_FEC_PERCENTAGE;
+  self->rtx_max_rtt = DEFAULT_RTX_MAX_RTT;
+  self->rtx = TRUE;
+
+  return self;
+}
+
+void
+kms_protection_control_destroy (KmsProtectionControl * self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->clock_id != NULL) {
+    gst_clock_id_unschedule (self->clock_id);
+    gst_clock_id_unref (self->clock_id);
+    self->clock_id = NULL;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  kms_protection_control_unref (self);
+}
+
+void
+kms_protection_control_set_session (KmsProtectionControl * self,
+    GObject * rtpsession)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->rtpsession == NULL) {
+    self->rtpsession = g_object_ref (rtpsession);
+    kms_protection_control_start (self);
+  } else if (self->rtpsession != rtpsession) {
+    GST_WARNING ("Only one session can be controlled");
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_protection_control_set_nack (KmsProtectionControl * self, gboolean nack)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  self->nack = nack;
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_protection_control_set_elements (KmsProtectionControl * self,
+    GstElement * rtxcache, GstElement * fecenc, gint fec_pt)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  g_clear_object (&self->rtxcache);
+  g_clear_object (&self->fecenc);
+
+  if (rtxcache != NULL) {
+    self->rtxcache = gst_object_ref (rtxcache);
+  }
+
+  if (fecenc != NULL) {
+    self->fecenc = gst_object_ref (fecenc);
+  }
+
+  self->fec_pt = fec_pt;
+  self->fec_percentage = 0;
+  self->rtx = TRUE;
+
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_protection_control_set_params (KmsProtectionControl * self,
+    const GstStructure * params)
+{
+  gboolean adaptive;
+  gint auxi;
+
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  adaptive = self->adaptive;
+  gst_structure_get (params, "adaptive", G_TYPE_BOOLEAN, &adaptive, NULL);
+
+  if (gst_structure_get (params, "max-fec-percentage", G_TYPE_INT, &auxi,
+          NULL)) {
+    if (auxi < 0 || auxi > 100) {
+      GST_WARNING ("Invalid max FEC percentage %d", auxi);
+    } else {
+      self->max_fec_percentage = auxi;
+    }
+  }
+
+  if (gst_structure_get (params, "rtx-max-rtt", G_TYPE_INT, &auxi, NULL)) {
+    if (auxi < 0) {
+      GST_WARNING ("Invalid RTX max RTT %d", auxi);
+    } else {
+      self->rtx_max_rtt = auxi;
+    }
+  }
+
+  if (self->adaptive && !adaptive) {
+    /* Back to the initial configuration */
+    kms_protection_control_apply (self, 0, TRUE);
+    self->overhead = 0;
+  }
+
+  self->adaptive = adaptive;
+
+  g_mutex_unlock (&self->mutex);
+}
+
+void
+kms_protection_control_get_params (KmsProtectionControl * self,
+    GstStructure ** params)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  gst_structure_set (*params, "adaptive", G_TYPE_BOOLEAN, self->adaptive,
+      "max-fec-percentage", G_TYPE_INT, self->max_fec_percentage,
+      "rtx-max-rtt", G_TYPE_INT, self->rtx_max_rtt, NULL);
+  g_mutex_unlock (&self->mutex);
+}
+
+guint
+kms_protection_control_get_overhead (KmsProtectionControl * self)
+{
+  guint overhead;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  g_mutex_lock (&self->mutex);
+  overhead = self->overhead;
+  g_mutex_unlock (&self->mutex);
+
+  return overhead;
+}
+
+void
+kms_protection_control_add_stats (KmsProtectionControl * self,
+    GstStructure * stats)
+{
+  g_return_if_fail (self != NULL);
+
+  g_mutex_lock (&self->mutex);
+  gst_structure_set (stats, "fec-percentage", G_TYPE_UINT,
+      self->fec_percentage, "rtx", G_TYPE_BOOLEAN, self->rtx, NULL);
+  g_mutex_unlock (&self->mutex);
+}
+
+static void init_debug (void) __attribute__ ((constructor));
+
+static void
+init_debug (void)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+}
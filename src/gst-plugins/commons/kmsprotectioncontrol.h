@@ -0,0 +1,64 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_PROTECTION_CONTROL_H__
+#define __KMS_PROTECTION_CONTROL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KmsProtectionControl KmsProtectionControl;
+
+/*
+ * Periodically tunes the loss protection of an outgoing stream from the
+ * reception reports sent by the remote peer. Retransmissions are preferred
+ * while the round trip time allows them to arrive in time, FEC is used when
+ * it does not or when losses are too high for retransmissions alone. The
+ * bitrate spent in protection is reported as an overhead percentage, to be
+ * subtracted from the bandwidth estimation given to the encoder.
+ */
+KmsProtectionControl * kms_protection_control_new (void);
+void kms_protection_control_destroy (KmsProtectionControl * self);
+
+/* Session where reception reports about the stream are received */
+void kms_protection_control_set_session (KmsProtectionControl * self,
+  GObject * rtpsession);
+/* @nack tells if the remote peer requests retransmissions */
+void kms_protection_control_set_nack (KmsProtectionControl * self,
+  gboolean nack);
+/* @rtxcache is a KmsRtxCache, bypassed to turn retransmissions off. */
+/* @fecenc can be NULL, it is only used when @fec_pt is not 0 */
+void kms_protection_control_set_elements (KmsProtectionControl * self,
+  GstElement * rtxcache, GstElement * fecenc, gint fec_pt);
+
+/* Fields: "adaptive" (boolean), "max-fec-percentage" (int), */
+/* "rtx-max-rtt" (int, ms) */
+void kms_protection_control_set_params (KmsProtectionControl * self,
+  const GstStructure * params);
+void kms_protection_control_get_params (KmsProtectionControl * self,
+  GstStructure ** params);
+
+/* Percentage of the media bitrate currently spent in protection */
+guint kms_protection_control_get_overhead (KmsProtectionControl * self);
+/* Appends "fec-percentage" (uint) and "rtx" (boolean) to @stats */
+void kms_protection_control_add_stats (KmsProtectionControl * self,
+  GstStructure * stats);
+
+G_END_DECLS
+
+#endif /* __KMS_PROTECTION_CONTROL_H__ */
@@ -0,0 +1,280 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <string.h>
+
+#include "kmsquarkmap.h"
+
+typedef struct _KmsQuarkMapEntry
+{
+  GQuark key;
+  gpointer value;
+} KmsQuarkMapEntry;
+
+struct _KmsQuarkMap
+{
+  gint refcount;
+  GBoxedCopyFunc value_copy_func;
+  GDestroyNotify value_destroy_func;
+
+  guint len;
+  guint size;
+  KmsQuarkMapEntry *entries;
+  KmsQuarkMapEntry inline_entries[KMS_QUARK_MAP_INLINE_SIZE];
+};
+
+KmsQuarkMap *
+kms_quark_map_new_full (GBoxedCopyFunc value_copy_func,
+    GDestroyNotify value_destroy_func)
+{
+  KmsQuarkMap *map;
+
+  map = g_slice_new0 (KmsQuarkMap);
+  map->refcount = 1;
+  map->value_copy_func = value_copy_func;
+  map->value_destroy_func = value_destroy_func;
+  map->size = KMS_QUARK_MAP_INLINE_SIZE;
+  map->entries = map->inline_entries;
+
+  return map;
+}
+
+KmsQuarkMap *
+kms_quark_map_ref (KmsQuarkMap * map)
+{
+  g_return_val_if_fail (map != NULL, NULL);
+
+  g_atomic_int_inc (&map->refcount);
+
+  return map;
+}
+
+static void
+kms_quark_map_destroy (KmsQuarkMap * map)
+{
+  guint i;
+
+  if (map->value_destroy_func != NULL) {
+    for (i = 0; i < map->len; i++) {
+      map->value_destroy_func (map->entries[i].value);
+    }
+  }
+
+  if (map->entries != map->inline_entries) {
+    g_free (map->entries);
+  }
+
+  g_slice_free (KmsQuarkMap, map);
+}
+
+void
+kms_quark_map_unref (KmsQuarkMap * map)
+{
+  g_return_if_fail (map != NULL);
+
+  if (g_atomic_int_dec_and_test (&map->refcount)) {
+    kms_quark_map_destroy (map);
+  }
+}
+
+gboolean
+kms_quark_map_is_writable (KmsQuarkMap * map)
+{
+  g_return_val_if_fail (map != NULL, FALSE);
+
+  return g_atomic_int_get (&map->refcount) == 1;
+}
+
+static void
+kms_quark_map_reserve (KmsQuarkMap * map, guint size)
+{
+  if (size <= map->size) {
+    return;
+  }
+
+  if (map->entries == map->inline_entries) {
+    map->entries = g_new (KmsQuarkMapEntry, size);
+    memcpy (map->entries, map->inline_entries,
+        map->len * sizeof (KmsQuarkMapEntry));
+  } else {
+    map->entries = g_renew (KmsQuarkMapEntry, map->entries, size);
+  }
+
+  map->size = size;
+}
+
+/* Returns @map if it is writable or a writable copy of it otherwise. The */
+/* reference held by the caller on @map is transferred to the result. */
+KmsQuarkMap *
+kms_quark_map_make_writable (KmsQuarkMap * map)
+{
+  KmsQuarkMap *copy;
+  guint i;
+
+  g_return_val_if_fail (map != NULL, NULL);
+
+  if (kms_quark_map_is_writable (map)) {
+    return map;
+  }
+
+  copy = kms_quark_map_new_full (map->value_copy_func,
+      map->value_destroy_func);
+  kms_quark_map_reserve (copy, map->len);
+
+  for (i = 0; i < map->len; i++) {
+    copy->entries[i].key = map->entries[i].key;
+    copy->entries[i].value = (map->value_copy_func != NULL) ?
+        map->value_copy_func (map->entries[i].value) : map->entries[i].value;
+  }
+
+  copy->len = map->len;
+
+  kms_quark_map_unref (map);
+
+  return copy;
+}
+
+guint
+kms_quark_map_length (KmsQuarkMap * map)
+{
+  g_return_val_if_fail (map != NULL, 0);
+
+  return map->len;
+}
+
+static gint
+kms_quark_map_find (KmsQuarkMap * map, GQuark key)
+{
+  guint i;
+
+  for (i = 0; i < map->len; i++) {
+    if (map->entries[i].key == key) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+void
+kms_quark_map_insert (KmsQuarkMap * map, GQuark key, gpointer value)
+{
+  gint pos;
+
+  g_return_if_fail (map != NULL);
+  g_return_if_fail (key != 0);
+  g_return_if_fail (kms_quark_map_is_writable (map));
+
+  pos = kms_quark_map_find (map, key);
+
+  if (pos >= 0) {
+    if (map->value_destroy_func != NULL) {
+      map->value_destroy_func (map->entries[pos].value);
+    }
+
+    map->entries[pos].value = value;
+    return;
+  }
+
+  if (map->len == map->size) {
+    kms_quark_map_reserve (map, map->size * 2);
+  }
+
+  map->entries[map->len].key = key;
+  map->entries[map->len].value = value;
+  map->len++;
+}
+
+gboolean
+kms_quark_map_remove (KmsQuarkMap * map, GQuark key)
+{
+  gint pos;
+
+  g_return_val_if_fail (map != NULL, FALSE);
+  g_return_val_if_fail (kms_quark_map_is_writable (map), FALSE);
+
+  pos = kms_quark_map_find (map, key);
+
+  if (pos < 0) {
+    return FALSE;
+  }
+
+  if (map->value_destroy_func != NULL) {
+    map->value_destroy_func (map->entries[pos].value);
+  }
+
+  map->len--;
+  memmove (&map->entries[pos], &map->entries[pos + 1],
+      (map->len - pos) * sizeof (KmsQuarkMapEntry));
+
+  return TRUE;
+}
+
+gpointer
+kms_quark_map_lookup (KmsQuarkMap * map, GQuark key)
+{
+  gint pos;
+
+  if (map == NULL || key == 0) {
+    return NULL;
+  }
+
+  pos = kms_quark_map_find (map, key);
+
+  return (pos >= 0) ? map->entries[pos].value : NULL;
+}
+
+gpointer
+kms_quark_map_lookup_string (KmsQuarkMap * map, const gchar * key)
+{
+  /* Do not intern strings that have never been used as a key */
+  return kms_quark_map_lookup (map, g_quark_try_string (key));
+}
+
+void
+kms_quark_map_iter_init (KmsQuarkMapIter * iter, KmsQuarkMap * map)
+{
+  g_return_if_fail (iter != NULL);
+
+  iter->map = map;
+  iter->index = 0;
+}
+
+gboolean
+kms_quark_map_iter_next (KmsQuarkMapIter * iter, GQuark * key,
+    gpointer * value)
+{
+  KmsQuarkMapEntry *entry;
+
+  g_return_val_if_fail (iter != NULL, FALSE);
+
+  if (iter->map == NULL || iter->index >= iter->map->len) {
+    return FALSE;
+  }
+
+  entry = &iter->map->entries[iter->index++];
+
+  if (key != NULL) {
+    *key = entry->key;
+  }
+
+  if (value != NULL) {
+    *value = entry->value;
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,67 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_QUARK_MAP_H__
+#define __KMS_QUARK_MAP_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Number of entries stored without any extra allocation */
+#define KMS_QUARK_MAP_INLINE_SIZE 4
+
+typedef struct _KmsQuarkMap KmsQuarkMap;
+#define KMS_QUARK_MAP_CAST(obj) ((KmsQuarkMap *) obj)
+
+/*
+ * Small map keyed by interned strings. Maps are reference counted and
+ * only modifiable while the caller holds the only reference, so they can
+ * be shared between threads without locking. Use
+ * kms_quark_map_make_writable() before modifying a shared map.
+ */
+KmsQuarkMap * kms_quark_map_new_full (GBoxedCopyFunc value_copy_func,
+                      GDestroyNotify value_destroy_func);
+
+KmsQuarkMap * kms_quark_map_ref (KmsQuarkMap *map);
+void kms_quark_map_unref (KmsQuarkMap *map);
+
+gboolean kms_quark_map_is_writable (KmsQuarkMap *map);
+KmsQuarkMap * kms_quark_map_make_writable (KmsQuarkMap *map);
+
+guint kms_quark_map_length (KmsQuarkMap *map);
+
+void kms_quark_map_insert (KmsQuarkMap *map, GQuark key, gpointer value);
+gboolean kms_quark_map_remove (KmsQuarkMap *map, GQuark key);
+
+gpointer kms_quark_map_lookup (KmsQuarkMap *map, GQuark key);
+gpointer kms_quark_map_lookup_string (KmsQuarkMap *map, const gchar *key);
+
+typedef struct _KmsQuarkMapIter KmsQuarkMapIter;
+void kms_quark_map_iter_init (KmsQuarkMapIter *iter, KmsQuarkMap *map);
+gboolean kms_quark_map_iter_next (KmsQuarkMapIter *iter, GQuark *key, gpointer *value);
+
+struct _KmsQuarkMapIter
+{
+  /*< private >*/
+  KmsQuarkMap *map;
+  guint index;
+};
+
+G_END_DECLS
+
+#endif /* __KMS_QUARK_MAP_H__ */
@@ -18,6 +18,7 @@
 #include "kmsremb.h"
 #include "kmsrtcp.h"
 #include "constants.h"
+#include "kmsmetrics.h"
 
 #define GST_CAT_DEFAULT kmsutils
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -26,9 +27,6 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define REMB_MIN 30000          /* bps */
 #define REMB_MAX 2000000        /* bps */
 
-#define KMS_REMB_REMOTE "kms-remb-remote"
-G_DEFINE_QUARK (KMS_REMB_REMOTE, kms_remb_remote);
-
 #define KMS_REMB_LOCAL "kms-remb-local"
 G_DEFINE_QUARK (KMS_REMB_LOCAL, kms_remb_local);
 
@@ -42,13 +40,19 @@ G_DEFINE_QUARK (KMS_REMB_LOCAL, kms_remb_local);
 
 #define REMB_MAX_FACTOR_INPUT_BR 2
 
+static const gdouble remb_metric_bounds[] =
+    { 100000, 250000, 500000, 1000000, 1500000, 2000000, 5000000 };
+static KmsMetric *remb_sent_metric;
+static KmsMetric *remb_received_metric;
+
 static void
 kms_remb_base_destroy (KmsRembBase * rb)
 {
-  g_signal_handler_disconnect (rb->rtpsess, rb->signal_id);
-  rb->signal_id = 0;
+  if (rb->signal_id != 0) {
+    g_signal_handler_disconnect (rb->rtpsess, rb->signal_id);
+    rb->signal_id = 0;
+  }
   g_object_set_qdata (rb->rtpsess, kms_remb_local_quark (), NULL);
-  g_object_set_qdata (rb->rtpsess, kms_remb_remote_quark (), NULL);
   g_clear_object (&rb->rtpsess);
   g_rec_mutex_clear (&rb->mutex);
   g_hash_table_unref (rb->remb_stats);
@@ -357,6 +361,7 @@ add_ssrcs (KmsRlRemoteSession * rlrs, AddSsrcsData * data)
       ", ssrc: %" G_GUINT32_FORMAT ")", data->remb_packet->bitrate, rlrs->ssrc);
 
   kms_remb_base_update_stats (rb, rlrs->ssrc, data->remb_packet->bitrate);
+  kms_metric_observe (remb_sent_metric, data->remb_packet->bitrate);
 }
 
 static void
@@ -581,6 +586,12 @@ send_remb_event (KmsRembRemote * rm, guint bitrate, guint ssrc)
 
   br = bitrate;
 
+  if (rm->prot_control != NULL) {
+    guint overhead = kms_protection_control_get_overhead (rm->prot_control);
+
+    br = (guint64) br * 100 / (100 + overhead);
+  }
+
   if (rm->min_bw > 0) {
     min = rm->min_bw * 1000;
     br = MAX (br, min);
@@ -658,73 +669,16 @@ kms_remb_remote_update_target_ssrcs_stats (KmsRembRemote * rm,
     kms_remb_base_update_stats (KMS_REMB_BASE (rm), remb_packet->ssrcs[i],
         remb_packet->bitrate);
   }
-}
-
-static void
-process_psfb_afb (GObject * sess, guint ssrc, GstBuffer * fci_buffer)
-{
-  KmsRembRemote *rm;
-  KmsRTCPPSFBAFBBuffer afb_buffer = { NULL, };
-  KmsRTCPPSFBAFBPacket afb_packet;
-  KmsRTCPPSFBAFBREMBPacket remb_packet;
-  KmsRTCPPSFBAFBType type;
-
-  if (!G_IS_OBJECT (sess)) {
-    GST_WARNING ("Invalid session object");
-    return;
-  }
 
-  rm = g_object_get_qdata (sess, kms_remb_remote_quark ());
-
-  if (!rm) {
-    GST_WARNING ("Invalid RembRemote");
-    return;
-  }
-
-  if (!kms_rtcp_psfb_afb_buffer_map (fci_buffer, GST_MAP_READ, &afb_buffer)) {
-    GST_WARNING_OBJECT (fci_buffer, "Buffer cannot be mapped");
-    return;
-  }
-
-  if (!kms_rtcp_psfb_afb_get_packet (&afb_buffer, &afb_packet)) {
-    GST_WARNING_OBJECT (fci_buffer, "Cannot get RTCP PSFB AFB packet");
-    goto end;
-  }
-
-  type = kms_rtcp_psfb_afb_packet_get_type (&afb_packet);
-  switch (type) {
-    case KMS_RTCP_PSFB_AFB_TYPE_REMB:
-      kms_rtcp_psfb_afb_remb_get_packet (&afb_packet, &remb_packet);
-      kms_remb_remote_update (rm, &remb_packet);
-      kms_remb_remote_update_target_ssrcs_stats (rm, &remb_packet);
-      break;
-    default:
-      break;
-  }
-
-end:
-  kms_rtcp_psfb_afb_buffer_unmap (&afb_buffer);
+  kms_metric_observe (remb_received_metric, remb_packet->bitrate);
 }
 
-static void
-on_feedback_rtcp (GObject * sess, guint type, guint fbtype,
-    guint sender_ssrc, guint media_ssrc, GstBuffer * fci)
+void
+kms_remb_remote_process_remb (KmsRembRemote * rm,
+    KmsRTCPPSFBAFBREMBPacket * remb_packet)
 {
-  switch (type) {
-    case GST_RTCP_TYPE_RTPFB:
-      break;
-    case GST_RTCP_TYPE_PSFB:
-      switch (fbtype) {
-        case GST_RTCP_PSFB_TYPE_AFB:
-          process_psfb_afb (sess, sender_ssrc, fci);
-          break;
-        default:
-          break;
-      }
-      break;
-    default:
-      break;
-  }
+  kms_remb_remote_update (rm, remb_packet);
+  kms_remb_remote_update_target_ssrcs_stats (rm, remb_packet);
 }
 
 void
@@ -749,10 +703,6 @@ kms_remb_remote_create (GObject * rtpsess, guint local_ssrc,
 {
   KmsRembRemote *rm = g_slice_new0 (KmsRembRemote);
 
-  g_object_set_qdata (rtpsess, kms_remb_remote_quark (), rm);
-  rm->base.signal_id = g_signal_connect (rtpsess, "on-feedback-rtcp",
-      G_CALLBACK (on_feedback_rtcp), NULL);
-
   kms_remb_base_create (KMS_REMB_BASE (rm), rtpsess);
 
   rm->local_ssrc = local_ssrc;
@@ -788,6 +738,13 @@ kms_remb_remote_get_params (KmsRembRemote * rm, GstStructure ** params)
       "remb-on-connect", G_TYPE_INT, rm->remb_on_connect, NULL);
 }
 
+void
+kms_remb_remote_set_protection_control (KmsRembRemote * rm,
+    KmsProtectionControl * prot_control)
+{
+  rm->prot_control = prot_control;
+}
+
 /* KmsRembRemote end */
 
 static void init_debug (void) __attribute__ ((constructor));
@@ -797,4 +754,11 @@ init_debug (void)
 {
   GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
       GST_DEFAULT_NAME);
+
+  remb_sent_metric = kms_metrics_get_histogram ("kms_remb_sent_bps",
+      "Bitrate estimations sent in REMB packets",
+      remb_metric_bounds, G_N_ELEMENTS (remb_metric_bounds));
+  remb_received_metric = kms_metrics_get_histogram ("kms_remb_received_bps",
+      "Bitrate estimations received in REMB packets",
+      remb_metric_bounds, G_N_ELEMENTS (remb_metric_bounds));
 }
@@ -19,6 +19,8 @@
 #define __KMS_REMB_H__
 
 #include "kmsutils.h" /* TODO: must be not needed */
+#include "kmsprotectioncontrol.h"
+#include "kmsrtcp.h"
 
 G_BEGIN_DECLS
 
@@ -96,6 +98,9 @@ struct _KmsRembRemote
   guint remb;
   gboolean probed;
   GstPad *pad_event;
+
+  /* Owned by the endpoint, which outlives this */
+  KmsProtectionControl *prot_control;
 };
 
 KmsRembRemote * kms_remb_remote_create (GObject *rtpsess,
@@ -103,6 +108,12 @@ KmsRembRemote * kms_remb_remote_create (GObject *rtpsess,
 void kms_remb_remote_destroy (KmsRembRemote *rm);
 void kms_remb_remote_set_params (KmsRembRemote *rm, GstStructure *params);
 void kms_remb_remote_get_params (KmsRembRemote *rm, GstStructure **params);
+/* REMB packets are not received by itself, they are passed decoded */
+void kms_remb_remote_process_remb (KmsRembRemote *rm,
+  KmsRTCPPSFBAFBREMBPacket *remb_packet);
+/* Bitrate spent in protection is subtracted from the estimations */
+void kms_remb_remote_set_protection_control (KmsRembRemote *rm,
+  KmsProtectionControl *prot_control);
 /* KmsRembRemote end */
 
 G_END_DECLS
@@ -0,0 +1,605 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmsrtcpdispatcher.h"
+#include "kmsloop.h"
+#include "kmsmetrics.h"
+
+#include <gst/rtp/gstrtcpbuffer.h>
+
+#define GST_DEFAULT_NAME "rtcpdispatcher"
+#define GST_CAT_DEFAULT kms_rtcp_dispatcher_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define kms_rtcp_dispatcher_parent_class parent_class
+G_DEFINE_TYPE (KmsRtcpDispatcher, kms_rtcp_dispatcher, G_TYPE_OBJECT);
+
+#define KMS_RTCP_DISPATCHER_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (                \
+    (obj),                                     \
+    KMS_TYPE_RTCP_DISPATCHER,                  \
+    KmsRtcpDispatcherPrivate                   \
+  )                                            \
+)
+
+/* RTCP waiting to be dispatched, older RTCP is dropped beyond this */
+#define MAX_QUEUED_BUFFERS 256
+
+/* Threads shared by all the dispatchers of the process */
+#define N_LOOPS 4
+
+#define NACK_FCI_SIZE 4
+#define FIR_FCI_SIZE 8
+
+typedef struct _KmsRtcpDispatcherItem
+{
+  guint session;
+  GstBuffer *buffer;
+} KmsRtcpDispatcherItem;
+
+typedef struct _KmsRtcpDispatcherHandler
+{
+  guint id;
+  KmsRtcpHandlerFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+  gboolean removed;
+} KmsRtcpDispatcherHandler;
+
+typedef struct _KmsRtcpDispatcherTap
+{
+  KmsRtcpDispatcher *dispatcher;
+  guint session;
+} KmsRtcpDispatcherTap;
+
+struct _KmsRtcpDispatcherPrivate
+{
+  KmsLoop *loop;
+
+  /* Protects the queue, taken from the streaming threads */
+  GMutex mutex;
+  GQueue queue;
+  gboolean scheduled;
+
+  /* Held while dispatching, so handlers can be removed safely */
+  GRecMutex dispatch_mutex;
+  GSList *handlers;
+  guint last_handler_id;
+  gboolean dispatching;
+
+  /* Only used from the loop thread */
+  KmsRtcpCompound compound;
+};
+
+static GMutex loops_mutex;
+static KmsLoop *loops[N_LOOPS];
+static guint next_loop;
+
+static KmsMetric *dropped_metric;
+static KmsMetric *nacks_metric;
+static KmsMetric *key_frame_requests_metric;
+
+static void
+kms_rtcp_dispatcher_item_destroy (KmsRtcpDispatcherItem * item)
+{
+  gst_buffer_unref (item->buffer);
+  g_slice_free (KmsRtcpDispatcherItem, item);
+}
+
+static void
+kms_rtcp_dispatcher_handler_destroy (KmsRtcpDispatcherHandler * handler)
+{
+  if (handler->notify != NULL) {
+    handler->notify (handler->user_data);
+  }
+
+  g_slice_free (KmsRtcpDispatcherHandler, handler);
+}
+
+/* Each dispatcher always uses the same thread, so its RTCP stays ordered */
+static KmsLoop *
+kms_rtcp_dispatcher_get_loop (void)
+{
+  KmsLoop *loop;
+
+  g_mutex_lock (&loops_mutex);
+
+  if (loops[next_loop] == NULL) {
+    loops[next_loop] = kms_loop_new ();
+  }
+
+  loop = g_object_ref (loops[next_loop]);
+  next_loop = (next_loop + 1) % N_LOOPS;
+
+  g_mutex_unlock (&loops_mutex);
+
+  return loop;
+}
+
+static void
+kms_rtcp_dispatcher_decode_report_blocks (KmsRtcpCompound * compound,
+    GstRTCPPacket * packet, guint32 sender_ssrc)
+{
+  guint i, count;
+
+  count = gst_rtcp_packet_get_rb_count (packet);
+
+  for (i = 0; i < count; i++) {
+    KmsRtcpReportBlock rb;
+
+    rb.sender_ssrc = sender_ssrc;
+    gst_rtcp_packet_get_rb (packet, i, &rb.ssrc, &rb.fraction_lost,
+        &rb.packets_lost, &rb.ext_highest_seq, &rb.jitter, &rb.lsr, &rb.dlsr);
+    g_array_append_val (compound->report_blocks, rb);
+  }
+}
+
+static void
+kms_rtcp_dispatcher_decode_rtpfb (KmsRtcpCompound * compound,
+    GstRTCPPacket * packet)
+{
+  KmsRtcpNack nack;
+  guint8 *fci;
+  guint i, len;
+
+  if (gst_rtcp_packet_fb_get_type (packet) != GST_RTCP_RTPFB_TYPE_NACK) {
+    return;
+  }
+
+  nack.sender_ssrc = gst_rtcp_packet_fb_get_sender_ssrc (packet);
+  nack.media_ssrc = gst_rtcp_packet_fb_get_media_ssrc (packet);
+  fci = gst_rtcp_packet_fb_get_fci (packet);
+  len = gst_rtcp_packet_fb_get_fci_length (packet) * 4 / NACK_FCI_SIZE;
+
+  for (i = 0; i < len; i++) {
+    nack.pid = GST_READ_UINT16_BE (fci + i * NACK_FCI_SIZE);
+    nack.blp = GST_READ_UINT16_BE (fci + i * NACK_FCI_SIZE + 2);
+    g_array_append_val (compound->nacks, nack);
+  }
+}
+
+static void
+kms_rtcp_dispatcher_decode_afb (KmsRtcpCompound * compound, guint8 * fci,
+    gsize size)
+{
+  KmsRTCPPSFBAFBBuffer afb_buffer = { NULL, };
+  KmsRTCPPSFBAFBPacket afb_packet;
+  KmsRTCPPSFBAFBREMBPacket remb_packet;
+  GstBuffer *fci_buffer;
+
+  /* The FCI is not copied, the compound buffer is mapped meanwhile */
+  fci_buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, fci,
+      size, 0, size, NULL, NULL);
+
+  if (!kms_rtcp_psfb_afb_buffer_map (fci_buffer, GST_MAP_READ, &afb_buffer)) {
+    GST_WARNING ("FCI buffer cannot be mapped");
+    goto end;
+  }
+
+  if (kms_rtcp_psfb_afb_get_packet (&afb_buffer, &afb_packet)
+      && kms_rtcp_psfb_afb_packet_get_type (&afb_packet) ==
+      KMS_RTCP_PSFB_AFB_TYPE_REMB
+      && kms_rtcp_psfb_afb_remb_get_packet (&afb_packet, &remb_packet)) {
+    g_array_append_val (compound->rembs, remb_packet);
+  }
+
+  kms_rtcp_psfb_afb_buffer_unmap (&afb_buffer);
+
+end:
+  gst_buffer_unref (fci_buffer);
+}
+
+static void
+kms_rtcp_dispatcher_decode_psfb (KmsRtcpCompound * compound,
+    GstRTCPPacket * packet)
+{
+  KmsRtcpKeyFrameRequest request;
+  guint8 *fci;
+  guint i, len;
+
+  request.sender_ssrc = gst_rtcp_packet_fb_get_sender_ssrc (packet);
+  fci = gst_rtcp_packet_fb_get_fci (packet);
+  len = gst_rtcp_packet_fb_get_fci_length (packet) * 4;
+
+  switch (gst_rtcp_packet_fb_get_type (packet)) {
+    case GST_RTCP_PSFB_TYPE_PLI:
+      request.media_ssrc = gst_rtcp_packet_fb_get_media_ssrc (packet);
+      request.fir = FALSE;
+      g_array_append_val (compound->key_frame_requests, request);
+      break;
+    case GST_RTCP_PSFB_TYPE_FIR:
+      /* The media SSRC of FIR goes in each FCI entry */
+      request.fir = TRUE;
+
+      for (i = 0; i + FIR_FCI_SIZE <= len; i += FIR_FCI_SIZE) {
+        request.media_ssrc = GST_READ_UINT32_BE (fci + i);
+        g_array_append_val (compound->key_frame_requests, request);
+      }
+      break;
+    case GST_RTCP_PSFB_TYPE_AFB:
+      if (len > 0) {
+        kms_rtcp_dispatcher_decode_afb (compound, fci, len);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static gboolean
+kms_rtcp_dispatcher_decode (KmsRtcpDispatcher * self,
+    KmsRtcpDispatcherItem * item)
+{
+  KmsRtcpCompound *compound = &self->priv->compound;
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+  gboolean more;
+
+  if (!gst_rtcp_buffer_validate_reduced (item->buffer)) {
+    GST_DEBUG_OBJECT (self, "Invalid RTCP buffer %" GST_PTR_FORMAT,
+        item->buffer);
+    return FALSE;
+  }
+
+  compound->session = item->session;
+  compound->arrival = GST_BUFFER_DTS (item->buffer);
+  g_array_set_size (compound->sender_reports, 0);
+  g_array_set_size (compound->report_blocks, 0);
+  g_array_set_size (compound->rembs, 0);
+  g_array_set_size (compound->nacks, 0);
+  g_array_set_size (compound->key_frame_requests, 0);
+
+  if (!gst_rtcp_buffer_map (item->buffer, GST_MAP_READ, &rtcp)) {
+    GST_WARNING_OBJECT (self, "Buffer cannot be mapped as RTCP");
+    return FALSE;
+  }
+
+  for (more = gst_rtcp_buffer_get_first_packet (&rtcp, &packet); more;
+      more = gst_rtcp_packet_move_to_next (&packet)) {
+    KmsRtcpSenderReport sr;
+
+    switch (gst_rtcp_packet_get_type (&packet)) {
+      case GST_RTCP_TYPE_SR:
+        gst_rtcp_packet_sr_get_sender_info (&packet, &sr.ssrc, &sr.ntp_time,
+            &sr.rtp_time, &sr.packet_count, &sr.octet_count);
+        g_array_append_val (compound->sender_reports, sr);
+        kms_rtcp_dispatcher_decode_report_blocks (compound, &packet, sr.ssrc);
+        break;
+      case GST_RTCP_TYPE_RR:
+        kms_rtcp_dispatcher_decode_report_blocks (compound, &packet,
+            gst_rtcp_packet_rr_get_ssrc (&packet));
+        break;
+      case GST_RTCP_TYPE_RTPFB:
+        kms_rtcp_dispatcher_decode_rtpfb (compound, &packet);
+        break;
+      case GST_RTCP_TYPE_PSFB:
+        kms_rtcp_dispatcher_decode_psfb (compound, &packet);
+        break;
+      default:
+        break;
+    }
+  }
+
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  kms_metric_add (nacks_metric, compound->nacks->len);
+  kms_metric_add (key_frame_requests_metric,
+      compound->key_frame_requests->len);
+
+  return TRUE;
+}
+
+/* Must be called with the dispatch mutex */
+static void
+kms_rtcp_dispatcher_sweep_handlers (KmsRtcpDispatcher * self)
+{
+  GSList *l = self->priv->handlers;
+
+  while (l != NULL) {
+    KmsRtcpDispatcherHandler *handler = l->data;
+    GSList *next = l->next;
+
+    if (handler->removed) {
+      self->priv->handlers = g_slist_delete_link (self->priv->handlers, l);
+      kms_rtcp_dispatcher_handler_destroy (handler);
+    }
+
+    l = next;
+  }
+}
+
+static gboolean
+kms_rtcp_dispatcher_dispatch (KmsRtcpDispatcher * self)
+{
+  KmsRtcpDispatcherItem *item;
+  GQueue pending = G_QUEUE_INIT;
+  GSList *l;
+
+  g_rec_mutex_lock (&self->priv->dispatch_mutex);
+
+  g_mutex_lock (&self->priv->mutex);
+  pending = self->priv->queue;
+  g_queue_init (&self->priv->queue);
+  self->priv->scheduled = FALSE;
+  g_mutex_unlock (&self->priv->mutex);
+
+  /* Handlers removed from a handler are only flagged until the end */
+  self->priv->dispatching = TRUE;
+
+  while ((item = g_queue_pop_head (&pending)) != NULL) {
+    if (kms_rtcp_dispatcher_decode (self, item)) {
+      for (l = self->priv->handlers; l != NULL; l = l->next) {
+        KmsRtcpDispatcherHandler *handler = l->data;
+
+        if (!handler->removed) {
+          handler->func (&self->priv->compound, handler->user_data);
+        }
+      }
+    }
+
+    kms_rtcp_dispatcher_item_destroy (item);
+  }
+
+  self->priv->dispatching = FALSE;
+  kms_rtcp_dispatcher_sweep_handlers (self);
+
+  g_rec_mutex_unlock (&self->priv->dispatch_mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+kms_rtcp_dispatcher_push (KmsRtcpDispatcher * self, guint session,
+    GstBuffer * buffer)
+{
+  KmsRtcpDispatcherItem *item, *dropped = NULL;
+
+  g_return_if_fail (KMS_IS_RTCP_DISPATCHER (self));
+
+  item = g_slice_new (KmsRtcpDispatcherItem);
+  item->session = session;
+  item->buffer = gst_buffer_ref (buffer);
+
+  g_mutex_lock (&self->priv->mutex);
+
+  if (self->priv->queue.length >= MAX_QUEUED_BUFFERS) {
+    dropped = g_queue_pop_head (&self->priv->queue);
+  }
+
+  g_queue_push_tail (&self->priv->queue, item);
+
+  if (!self->priv->scheduled && self->priv->loop != NULL) {
+    /* The source keeps the dispatcher alive until it runs */
+    self->priv->scheduled = TRUE;
+    kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
+        (GSourceFunc) kms_rtcp_dispatcher_dispatch, g_object_ref (self),
+        g_object_unref);
+  }
+
+  g_mutex_unlock (&self->priv->mutex);
+
+  if (dropped != NULL) {
+    GST_DEBUG_OBJECT (self, "Queue full, dropping RTCP");
+    kms_rtcp_dispatcher_item_destroy (dropped);
+    kms_metric_add (dropped_metric, 1);
+  }
+}
+
+static GstPadProbeReturn
+kms_rtcp_dispatcher_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  KmsRtcpDispatcherTap *tap = user_data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    kms_rtcp_dispatcher_push (tap->dispatcher, tap->session,
+        GST_PAD_PROBE_INFO_BUFFER (info));
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint i, len;
+
+    len = gst_buffer_list_length (list);
+
+    for (i = 0; i < len; i++) {
+      kms_rtcp_dispatcher_push (tap->dispatcher, tap->session,
+          gst_buffer_list_get (list, i));
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+kms_rtcp_dispatcher_tap_destroy (KmsRtcpDispatcherTap * tap)
+{
+  g_slice_free (KmsRtcpDispatcherTap, tap);
+}
+
+void
+kms_rtcp_dispatcher_attach_pad (KmsRtcpDispatcher * self, GstPad * pad,
+    guint session)
+{
+  KmsRtcpDispatcherTap *tap;
+
+  g_return_if_fail (KMS_IS_RTCP_DISPATCHER (self));
+
+  tap = g_slice_new (KmsRtcpDispatcherTap);
+  tap->dispatcher = self;
+  tap->session = session;
+
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      kms_rtcp_dispatcher_probe, tap,
+      (GDestroyNotify) kms_rtcp_dispatcher_tap_destroy);
+}
+
+guint
+kms_rtcp_dispatcher_add_handler (KmsRtcpDispatcher * self,
+    KmsRtcpHandlerFunc func, gpointer user_data, GDestroyNotify notify)
+{
+  KmsRtcpDispatcherHandler *handler;
+
+  g_return_val_if_fail (KMS_IS_RTCP_DISPATCHER (self), 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  handler = g_slice_new (KmsRtcpDispatcherHandler);
+  handler->func = func;
+  handler->user_data = user_data;
+  handler->notify = notify;
+
+  g_rec_mutex_lock (&self->priv->dispatch_mutex);
+  handler->id = ++self->priv->last_handler_id;
+  self->priv->handlers = g_slist_append (self->priv->handlers, handler);
+  g_rec_mutex_unlock (&self->priv->dispatch_mutex);
+
+  return handler->id;
+}
+
+void
+kms_rtcp_dispatcher_remove_handler (KmsRtcpDispatcher * self,
+    guint handler_id)
+{
+  KmsRtcpDispatcherHandler *handler = NULL;
+  GSList *l;
+
+  g_return_if_fail (KMS_IS_RTCP_DISPATCHER (self));
+
+  g_rec_mutex_lock (&self->priv->dispatch_mutex);
+
+  for (l = self->priv->handlers; l != NULL; l = l->next) {
+    KmsRtcpDispatcherHandler *h = l->data;
+
+    if (h->id == handler_id && !h->removed) {
+      handler = h;
+      break;
+    }
+  }
+
+  if (handler == NULL) {
+    g_rec_mutex_unlock (&self->priv->dispatch_mutex);
+    GST_WARNING_OBJECT (self, "No handler with id %u", handler_id);
+    return;
+  }
+
+  if (self->priv->dispatching) {
+    /* Called from a handler, the list is being iterated */
+    handler->removed = TRUE;
+    g_rec_mutex_unlock (&self->priv->dispatch_mutex);
+    return;
+  }
+
+  self->priv->handlers = g_slist_remove (self->priv->handlers, handler);
+  g_rec_mutex_unlock (&self->priv->dispatch_mutex);
+
+  kms_rtcp_dispatcher_handler_destroy (handler);
+}
+
+static void
+kms_rtcp_dispatcher_dispose (GObject * object)
+{
+  KmsRtcpDispatcher *self = KMS_RTCP_DISPATCHER (object);
+
+  GST_DEBUG_OBJECT (self, "dispose");
+
+  /* Not running, pending dispatches hold a reference */
+  g_clear_object (&self->priv->loop);
+
+  G_OBJECT_CLASS (parent_class)->dispose (object);
+}
+
+static void
+kms_rtcp_dispatcher_finalize (GObject * object)
+{
+  KmsRtcpDispatcher *self = KMS_RTCP_DISPATCHER (object);
+  KmsRtcpCompound *compound = &self->priv->compound;
+
+  GST_DEBUG_OBJECT (self, "finalize");
+
+  g_queue_foreach (&self->priv->queue,
+      (GFunc) kms_rtcp_dispatcher_item_destroy, NULL);
+  g_queue_clear (&self->priv->queue);
+  g_slist_free_full (self->priv->handlers,
+      (GDestroyNotify) kms_rtcp_dispatcher_handler_destroy);
+
+  g_array_unref (compound->sender_reports);
+  g_array_unref (compound->report_blocks);
+  g_array_unref (compound->rembs);
+  g_array_unref (compound->nacks);
+  g_array_unref (compound->key_frame_requests);
+
+  g_mutex_clear (&self->priv->mutex);
+  g_rec_mutex_clear (&self->priv->dispatch_mutex);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+kms_rtcp_dispatcher_class_init (KmsRtcpDispatcherClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+
+  gobject_class->dispose = kms_rtcp_dispatcher_dispose;
+  gobject_class->finalize = kms_rtcp_dispatcher_finalize;
+
+  dropped_metric = kms_metrics_get_counter ("kms_rtcp_dropped_packets",
+      "Received RTCP packets dropped because dispatching fell behind");
+  nacks_metric = kms_metrics_get_counter ("kms_rtcp_received_nacks",
+      "Generic NACK entries received");
+  key_frame_requests_metric =
+      kms_metrics_get_counter ("kms_rtcp_received_key_frame_requests",
+      "PLI and FIR requests received");
+
+  g_type_class_add_private (klass, sizeof (KmsRtcpDispatcherPrivate));
+}
+
+static void
+kms_rtcp_dispatcher_init (KmsRtcpDispatcher * self)
+{
+  KmsRtcpCompound *compound;
+
+  self->priv = KMS_RTCP_DISPATCHER_GET_PRIVATE (self);
+  compound = &self->priv->compound;
+
+  g_mutex_init (&self->priv->mutex);
+  g_rec_mutex_init (&self->priv->dispatch_mutex);
+  g_queue_init (&self->priv->queue);
+
+  compound->sender_reports =
+      g_array_new (FALSE, FALSE, sizeof (KmsRtcpSenderReport));
+  compound->report_blocks =
+      g_array_new (FALSE, FALSE, sizeof (KmsRtcpReportBlock));
+  compound->rembs =
+      g_array_new (FALSE, FALSE, sizeof (KmsRTCPPSFBAFBREMBPacket));
+  compound->nacks = g_array_new (FALSE, FALSE, sizeof (KmsRtcpNack));
+  compound->key_frame_requests =
+      g_array_new (FALSE, FALSE, sizeof (KmsRtcpKeyFrameRequest));
+
+  self->priv->loop = kms_rtcp_dispatcher_get_loop ();
+}
+
+KmsRtcpDispatcher *
+kms_rtcp_dispatcher_new (void)
+{
+  return g_object_new (KMS_TYPE_RTCP_DISPATCHER, NULL);
+}
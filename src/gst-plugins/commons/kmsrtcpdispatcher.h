@@ -0,0 +1,159 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_RTCP_DISPATCHER_H__
+#define __KMS_RTCP_DISPATCHER_H__
+
+#include <gst/gst.h>
+#include "kmsrtcp.h"
+
+G_BEGIN_DECLS
+#define KMS_TYPE_RTCP_DISPATCHER \
+  (kms_rtcp_dispatcher_get_type())
+#define KMS_RTCP_DISPATCHER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),KMS_TYPE_RTCP_DISPATCHER,KmsRtcpDispatcher))
+#define KMS_RTCP_DISPATCHER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),KMS_TYPE_RTCP_DISPATCHER,KmsRtcpDispatcherClass))
+#define KMS_IS_RTCP_DISPATCHER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),KMS_TYPE_RTCP_DISPATCHER))
+#define KMS_IS_RTCP_DISPATCHER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),KMS_TYPE_RTCP_DISPATCHER))
+#define KMS_RTCP_DISPATCHER_CAST(obj) ((KmsRtcpDispatcher*)(obj))
+
+typedef struct _KmsRtcpDispatcher KmsRtcpDispatcher;
+typedef struct _KmsRtcpDispatcherClass KmsRtcpDispatcherClass;
+typedef struct _KmsRtcpDispatcherPrivate KmsRtcpDispatcherPrivate;
+
+typedef struct _KmsRtcpSenderReport KmsRtcpSenderReport;
+typedef struct _KmsRtcpReportBlock KmsRtcpReportBlock;
+typedef struct _KmsRtcpNack KmsRtcpNack;
+typedef struct _KmsRtcpKeyFrameRequest KmsRtcpKeyFrameRequest;
+typedef struct _KmsRtcpCompound KmsRtcpCompound;
+
+struct _KmsRtcpSenderReport
+{
+  guint32 ssrc;
+  guint64 ntp_time;
+  guint32 rtp_time;
+  guint32 packet_count;
+  guint32 octet_count;
+};
+
+/* Report blocks of both SR and RR packets */
+struct _KmsRtcpReportBlock
+{
+  guint32 sender_ssrc;
+  guint32 ssrc;
+  guint8 fraction_lost;
+  gint32 packets_lost;
+  guint32 ext_highest_seq;
+  guint32 jitter;
+  guint32 lsr;
+  guint32 dlsr;
+};
+
+/* One FCI entry of a Generic NACK, @blp flags the 16 packets after @pid */
+struct _KmsRtcpNack
+{
+  guint32 sender_ssrc;
+  guint32 media_ssrc;
+  guint16 pid;
+  guint16 blp;
+};
+
+/* PLI or FIR */
+struct _KmsRtcpKeyFrameRequest
+{
+  guint32 sender_ssrc;
+  guint32 media_ssrc;
+  gboolean fir;
+};
+
+/**
+ * KmsRtcpCompound:
+ * @session: session given when the buffer was pushed
+ * @arrival: DTS of the buffer, the time it was received
+ * @sender_reports: (element-type KmsRtcpSenderReport)
+ * @report_blocks: (element-type KmsRtcpReportBlock)
+ * @rembs: (element-type KmsRTCPPSFBAFBREMBPacket)
+ * @nacks: (element-type KmsRtcpNack)
+ * @key_frame_requests: (element-type KmsRtcpKeyFrameRequest)
+ *
+ * A compound RTCP packet decoded once for all the handlers. It is only
+ * valid during the handler invocation.
+ */
+struct _KmsRtcpCompound
+{
+  guint session;
+  GstClockTime arrival;
+
+  GArray *sender_reports;
+  GArray *report_blocks;
+  GArray *rembs;
+  GArray *nacks;
+  GArray *key_frame_requests;
+};
+
+typedef void (*KmsRtcpHandlerFunc) (const KmsRtcpCompound * compound,
+    gpointer user_data);
+
+/*
+ * Takes the RTCP received by an endpoint out of the streaming threads. Pads
+ * attached to the dispatcher only queue the buffers, which are decoded and
+ * passed to the handlers from a small pool of threads shared by all the
+ * dispatchers, so RTP forwarding never waits for the RTCP bookkeeping. Each
+ * dispatcher always runs in the same thread. The queue is bounded, the
+ * oldest RTCP is dropped when it is full.
+ *
+ * NACKs and key frame requests are decoded for the handlers and counted,
+ * but they are still answered by rtpbin and the RTX caches, which receive
+ * them as upstream events.
+ */
+struct _KmsRtcpDispatcher
+{
+  GObject parent;
+
+  KmsRtcpDispatcherPrivate *priv;
+};
+
+struct _KmsRtcpDispatcherClass
+{
+  GObjectClass parent_class;
+};
+
+GType kms_rtcp_dispatcher_get_type (void);
+
+KmsRtcpDispatcher * kms_rtcp_dispatcher_new (void);
+
+/* Queues @buffer, it is not modified */
+void kms_rtcp_dispatcher_push (KmsRtcpDispatcher * self, guint session,
+    GstBuffer * buffer);
+
+/* Queues the RTCP going through @pad. @self must outlive the data flow */
+void kms_rtcp_dispatcher_attach_pad (KmsRtcpDispatcher * self, GstPad * pad,
+    guint session);
+
+guint kms_rtcp_dispatcher_add_handler (KmsRtcpDispatcher * self,
+    KmsRtcpHandlerFunc func, gpointer user_data, GDestroyNotify notify);
+
+/* Waits for the handler to finish if it is running in other thread. It can
+ * be called from a handler, which is then not called again */
+void kms_rtcp_dispatcher_remove_handler (KmsRtcpDispatcher * self,
+    guint handler_id);
+
+G_END_DECLS
+#endif /* __KMS_RTCP_DISPATCHER_H__ */
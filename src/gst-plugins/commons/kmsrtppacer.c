@@ -0,0 +1,626 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmsrtppacer.h"
+#include "kmsutils.h"
+#include "kmsmetrics.h"
+
+#define GST_DEFAULT_NAME "rtppacer"
+#define GST_CAT_DEFAULT kms_rtp_pacer_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define kms_rtp_pacer_parent_class parent_class
+G_DEFINE_TYPE (KmsRtpPacer, kms_rtp_pacer, GST_TYPE_ELEMENT);
+
+#define KMS_RTP_PACER_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (          \
+    (obj),                               \
+    KMS_TYPE_RTP_PACER,                  \
+    KmsRtpPacerPrivate                   \
+  )                                      \
+)
+
+#define DEFAULT_BITRATE 0       /* bps */
+#define DEFAULT_PACING_FACTOR 250       /* % */
+
+/* Interval of the shared timer */
+#define TICK_INTERVAL (5 * G_TIME_SPAN_MILLISECOND)
+/* Traffic allowed in a burst, so that small frames are not delayed */
+#define BURST_TIME 10           /* ms */
+#define MIN_BURST_SIZE 1500     /* bytes */
+/* Queued packets are never delayed more than this, the rate is raised */
+#define MAX_QUEUE_TIME 250      /* ms */
+
+enum
+{
+  PROP_0,
+  PROP_BITRATE,
+  PROP_PACING_FACTOR,
+  PROP_STATS,
+  N_PROPERTIES
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+struct _KmsRtpPacerPrivate
+{
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  /* Protected by the object lock */
+  guint bitrate;
+  guint pacing_factor;
+  GQueue queue;                 /* Buffers and serialized events */
+  gsize queued_bytes;
+  guint in_flight;              /* Taken by the timer, not pushed yet */
+  gint64 tokens;                /* bytes, negative after a big packet */
+  gint64 last_refill;           /* monotonic, us */
+  gboolean flushing;
+  GstFlowReturn last_ret;
+  guint64 paced;
+  guint64 max_delay;            /* us */
+
+  /* Protected by the scheduler mutex */
+  gboolean scheduled;
+};
+
+typedef struct _KmsRtpPacerItem
+{
+  GstMiniObject *obj;
+  gint64 time;                  /* monotonic, us */
+} KmsRtpPacerItem;
+
+/* Timer thread shared by all the pacers */
+static GMutex scheduler_mutex;
+static GCond scheduler_cond;
+static GThread *scheduler_thread;
+static GList *scheduled;        /* Pacers with queued packets, referenced */
+
+static const gdouble delay_metric_bounds[] = { 5, 10, 25, 50, 100, 250 };
+static KmsMetric *paced_metric;
+static KmsMetric *delay_metric;
+
+static void
+kms_rtp_pacer_item_destroy (KmsRtpPacerItem * item)
+{
+  gst_mini_object_unref (item->obj);
+  g_slice_free (KmsRtpPacerItem, item);
+}
+
+static gsize
+kms_rtp_pacer_item_size (KmsRtpPacerItem * item)
+{
+  if (GST_IS_BUFFER (item->obj)) {
+    return gst_buffer_get_size (GST_BUFFER_CAST (item->obj));
+  }
+
+  return 0;
+}
+
+/* Must be called with the object lock held */
+static void
+kms_rtp_pacer_clear (KmsRtpPacer * self)
+{
+  g_queue_foreach (&self->priv->queue, (GFunc) kms_rtp_pacer_item_destroy,
+      NULL);
+  g_queue_clear (&self->priv->queue);
+  self->priv->queued_bytes = 0;
+}
+
+/* Must be called with the object lock held */
+static void
+kms_rtp_pacer_refill (KmsRtpPacer * self, gint64 now)
+{
+  gint64 rate, burst, elapsed;
+
+  rate = (gint64) self->priv->bitrate * self->priv->pacing_factor / 100;
+
+  /* Drain the queue in time when the estimation is below the stream rate */
+  rate = MAX (rate,
+      (gint64) self->priv->queued_bytes * 8 * 1000 / MAX_QUEUE_TIME);
+
+  /* The bucket is full after a second idle, also when just created */
+  elapsed = MIN (now - self->priv->last_refill, G_USEC_PER_SEC);
+  self->priv->last_refill = now;
+
+  self->priv->tokens += rate * elapsed / (8 * G_USEC_PER_SEC);
+
+  burst = MAX (rate * BURST_TIME / (8 * 1000), MIN_BURST_SIZE);
+  self->priv->tokens = MIN (self->priv->tokens, burst);
+}
+
+/* Must be called with the object lock held */
+static gboolean
+kms_rtp_pacer_is_paced (KmsRtpPacer * self)
+{
+  return self->priv->bitrate > 0;
+}
+
+static void
+kms_rtp_pacer_schedule (KmsRtpPacer * self)
+{
+  g_mutex_lock (&scheduler_mutex);
+
+  if (!self->priv->scheduled) {
+    self->priv->scheduled = TRUE;
+    scheduled = g_list_append (scheduled, gst_object_ref (self));
+    g_cond_signal (&scheduler_cond);
+  }
+
+  g_mutex_unlock (&scheduler_mutex);
+}
+
+/* Takes the items the bucket allows to send now */
+static GQueue *
+kms_rtp_pacer_take (KmsRtpPacer * self, gint64 now)
+{
+  GQueue *items = g_queue_new ();
+  gint64 delay = 0;
+
+  GST_OBJECT_LOCK (self);
+
+  kms_rtp_pacer_refill (self, now);
+
+  while (!g_queue_is_empty (&self->priv->queue)) {
+    KmsRtpPacerItem *item = g_queue_peek_head (&self->priv->queue);
+    gsize size = kms_rtp_pacer_item_size (item);
+
+    if (size > 0 && self->priv->tokens <= 0 && kms_rtp_pacer_is_paced (self)) {
+      break;
+    }
+
+    g_queue_pop_head (&self->priv->queue);
+    g_queue_push_tail (items, item);
+    self->priv->tokens -= size;
+    self->priv->queued_bytes -= size;
+
+    if (size > 0) {
+      delay = now - item->time;
+      self->priv->paced++;
+    }
+  }
+
+  self->priv->in_flight += items->length;
+  self->priv->max_delay = MAX (self->priv->max_delay, delay);
+
+  GST_OBJECT_UNLOCK (self);
+
+  if (delay > 0) {
+    kms_metric_observe (delay_metric,
+        (gdouble) delay / G_TIME_SPAN_MILLISECOND);
+  }
+
+  return items;
+}
+
+/* EOS and errors stop the stream, the rest are reported once */
+static gboolean
+kms_rtp_pacer_is_fatal (GstFlowReturn ret)
+{
+  return ret == GST_FLOW_EOS || ret <= GST_FLOW_NOT_NEGOTIATED;
+}
+
+static void
+kms_rtp_pacer_push_items (KmsRtpPacer * self, GQueue * items)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint pushed = 0, buffers = 0;
+
+  while (!g_queue_is_empty (items)) {
+    KmsRtpPacerItem *item = g_queue_pop_head (items);
+    GstMiniObject *obj = gst_mini_object_ref (item->obj);
+
+    kms_rtp_pacer_item_destroy (item);
+    pushed++;
+
+    if (GST_IS_BUFFER (obj)) {
+      buffers++;
+
+      if (ret == GST_FLOW_OK) {
+        ret = gst_pad_push (self->priv->srcpad, GST_BUFFER_CAST (obj));
+      } else {
+        gst_mini_object_unref (obj);
+      }
+    } else {
+      gst_pad_push_event (self->priv->srcpad, GST_EVENT_CAST (obj));
+    }
+  }
+
+  g_queue_free (items);
+
+  if (buffers > 0) {
+    kms_metric_add (paced_metric, buffers);
+  }
+
+  GST_OBJECT_LOCK (self);
+  self->priv->in_flight -= pushed;
+  if (ret != GST_FLOW_OK && !self->priv->flushing) {
+    GST_DEBUG_OBJECT (self, "Push returned %s", gst_flow_get_name (ret));
+    self->priv->last_ret = ret;
+  } else if (buffers > 0 && !kms_rtp_pacer_is_fatal (self->priv->last_ret)) {
+    /* Downstream was linked again */
+    self->priv->last_ret = GST_FLOW_OK;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static gpointer
+kms_rtp_pacer_scheduler_loop (gpointer data)
+{
+  g_mutex_lock (&scheduler_mutex);
+
+  while (TRUE) {
+    gint64 end_time;
+    GList *pacers, *l;
+
+    if (scheduled == NULL) {
+      g_cond_wait (&scheduler_cond, &scheduler_mutex);
+      continue;
+    }
+
+    end_time = g_get_monotonic_time () + TICK_INTERVAL;
+    pacers = g_list_copy_deep (scheduled, (GCopyFunc) gst_object_ref, NULL);
+
+    g_mutex_unlock (&scheduler_mutex);
+
+    for (l = pacers; l != NULL; l = l->next) {
+      KmsRtpPacer *self = l->data;
+
+      kms_rtp_pacer_push_items (self,
+          kms_rtp_pacer_take (self, g_get_monotonic_time ()));
+    }
+
+    g_mutex_lock (&scheduler_mutex);
+
+    /* Pacers enqueueing again after this will be scheduled again */
+    for (l = pacers; l != NULL; l = l->next) {
+      KmsRtpPacer *self = l->data;
+      gboolean empty;
+
+      GST_OBJECT_LOCK (self);
+      empty = g_queue_is_empty (&self->priv->queue);
+      GST_OBJECT_UNLOCK (self);
+
+      if (empty && self->priv->scheduled) {
+        self->priv->scheduled = FALSE;
+        scheduled = g_list_remove (scheduled, self);
+        gst_object_unref (self);
+      }
+    }
+
+    g_mutex_unlock (&scheduler_mutex);
+    g_list_free_full (pacers, gst_object_unref);
+    g_mutex_lock (&scheduler_mutex);
+
+    /* Wake ups before the next tick are ignored */
+    while (scheduled != NULL && g_get_monotonic_time () < end_time) {
+      g_cond_wait_until (&scheduler_cond, &scheduler_mutex, end_time);
+    }
+  }
+
+  return NULL;
+}
+
+static GstFlowReturn
+kms_rtp_pacer_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  KmsRtpPacer *self = KMS_RTP_PACER (parent);
+  gsize size = gst_buffer_get_size (buffer);
+  KmsRtpPacerItem *item;
+  GstFlowReturn ret;
+
+  GST_OBJECT_LOCK (self);
+
+  if (self->priv->flushing) {
+    GST_OBJECT_UNLOCK (self);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_FLUSHING;
+  }
+
+  ret = self->priv->last_ret;
+  if (ret != GST_FLOW_OK) {
+    if (!kms_rtp_pacer_is_fatal (ret)) {
+      /* Upstream knows now, try again with the next buffer */
+      self->priv->last_ret = GST_FLOW_OK;
+    }
+    GST_OBJECT_UNLOCK (self);
+    gst_buffer_unref (buffer);
+    return ret;
+  }
+
+  if (g_queue_is_empty (&self->priv->queue) && self->priv->in_flight == 0) {
+    kms_rtp_pacer_refill (self, g_get_monotonic_time ());
+
+    if (!kms_rtp_pacer_is_paced (self) || self->priv->tokens > 0) {
+      /* Nothing waiting and room in the bucket, no need to delay it */
+      self->priv->tokens -= size;
+      GST_OBJECT_UNLOCK (self);
+
+      return gst_pad_push (self->priv->srcpad, buffer);
+    }
+  }
+
+  item = g_slice_new (KmsRtpPacerItem);
+  item->obj = GST_MINI_OBJECT_CAST (buffer);
+  item->time = g_get_monotonic_time ();
+  g_queue_push_tail (&self->priv->queue, item);
+  self->priv->queued_bytes += size;
+
+  GST_OBJECT_UNLOCK (self);
+
+  kms_rtp_pacer_schedule (self);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+kms_rtp_pacer_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  KmsRtpPacer *self = KMS_RTP_PACER (parent);
+  KmsRtpPacerItem *item;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      GST_OBJECT_LOCK (self);
+      self->priv->flushing = TRUE;
+      kms_rtp_pacer_clear (self);
+      GST_OBJECT_UNLOCK (self);
+      return gst_pad_event_default (pad, parent, event);
+    case GST_EVENT_FLUSH_STOP:
+      GST_OBJECT_LOCK (self);
+      self->priv->flushing = FALSE;
+      self->priv->last_ret = GST_FLOW_OK;
+      GST_OBJECT_UNLOCK (self);
+      return gst_pad_event_default (pad, parent, event);
+    default:
+      break;
+  }
+
+  if (!GST_EVENT_IS_SERIALIZED (event)) {
+    return gst_pad_event_default (pad, parent, event);
+  }
+
+  GST_OBJECT_LOCK (self);
+
+  if (g_queue_is_empty (&self->priv->queue) && self->priv->in_flight == 0) {
+    GST_OBJECT_UNLOCK (self);
+    return gst_pad_event_default (pad, parent, event);
+  }
+
+  /* Keep the order with the queued buffers */
+  item = g_slice_new (KmsRtpPacerItem);
+  item->obj = GST_MINI_OBJECT_CAST (event);
+  item->time = g_get_monotonic_time ();
+  g_queue_push_tail (&self->priv->queue, item);
+
+  GST_OBJECT_UNLOCK (self);
+
+  kms_rtp_pacer_schedule (self);
+
+  return TRUE;
+}
+
+static gboolean
+kms_rtp_pacer_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  KmsRtpPacer *self = KMS_RTP_PACER (parent);
+  guint bitrate, ssrc;
+
+  if (kms_utils_is_remb_event_upstream (event) &&
+      kms_utils_remb_event_upstream_parse (event, &bitrate, &ssrc)) {
+    GST_TRACE_OBJECT (self, "Pacing to %u bps", bitrate);
+
+    GST_OBJECT_LOCK (self);
+    self->priv->bitrate = bitrate;
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static GstStateChangeReturn
+kms_rtp_pacer_change_state (GstElement * element, GstStateChange transition)
+{
+  KmsRtpPacer *self = KMS_RTP_PACER (element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    GST_OBJECT_LOCK (self);
+    self->priv->flushing = TRUE;
+    kms_rtp_pacer_clear (self);
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    GST_OBJECT_LOCK (self);
+    self->priv->flushing = FALSE;
+    self->priv->last_ret = GST_FLOW_OK;
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  return ret;
+}
+
+static void
+kms_rtp_pacer_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsRtpPacer *self = KMS_RTP_PACER (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_BITRATE:
+      self->priv->bitrate = g_value_get_uint (value);
+      break;
+    case PROP_PACING_FACTOR:
+      self->priv->pacing_factor = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_rtp_pacer_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsRtpPacer *self = KMS_RTP_PACER (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_BITRATE:
+      g_value_set_uint (value, self->priv->bitrate);
+      break;
+    case PROP_PACING_FACTOR:
+      g_value_set_uint (value, self->priv->pacing_factor);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_structure_new ("rtp-pacer-stats",
+              "paced", G_TYPE_UINT64, self->priv->paced,
+              "max-delay", G_TYPE_UINT64,
+              self->priv->max_delay * GST_USECOND,
+              "queued-bytes", G_TYPE_UINT64,
+              (guint64) self->priv->queued_bytes, NULL));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_rtp_pacer_finalize (GObject * object)
+{
+  KmsRtpPacer *self = KMS_RTP_PACER (object);
+
+  kms_rtp_pacer_clear (self);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+kms_rtp_pacer_class_init (KmsRtpPacerClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_set_details_simple (gstelement_class,
+      "RtpPacer",
+      "Generic",
+      "Spreads bursts of outgoing RTP packets over time",
+      "Kurento <kurento@googlegroups.com>");
+
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+
+  gobject_class->set_property = kms_rtp_pacer_set_property;
+  gobject_class->get_property = kms_rtp_pacer_get_property;
+  gobject_class->finalize = kms_rtp_pacer_finalize;
+
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (kms_rtp_pacer_change_state);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_template));
+
+  g_object_class_install_property (gobject_class, PROP_BITRATE,
+      g_param_spec_uint ("bitrate", "Bitrate",
+          "Estimated bitrate of the path (bps), updated from REMB events "
+          "(0 = not paced)", 0, G_MAXUINT, DEFAULT_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PACING_FACTOR,
+      g_param_spec_uint ("pacing-factor", "Pacing factor",
+          "Percentage of the bitrate packets are sent at", 100, G_MAXUINT,
+          DEFAULT_PACING_FACTOR, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Stats",
+          "Packets delayed (paced), highest delay (max-delay) and bytes "
+          "waiting (queued-bytes)",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  paced_metric = kms_metrics_get_counter ("kms_rtp_pacer_paced_packets",
+      "RTP packets delayed by the pacers");
+  delay_metric = kms_metrics_get_histogram ("kms_rtp_pacer_delay_ms",
+      "Time RTP packets are delayed by the pacers",
+      delay_metric_bounds, G_N_ELEMENTS (delay_metric_bounds));
+
+  scheduler_thread = g_thread_new ("rtp-pacer", kms_rtp_pacer_scheduler_loop,
+      NULL);
+
+  g_type_class_add_private (klass, sizeof (KmsRtpPacerPrivate));
+}
+
+static void
+kms_rtp_pacer_init (KmsRtpPacer * self)
+{
+  self->priv = KMS_RTP_PACER_GET_PRIVATE (self);
+
+  g_queue_init (&self->priv->queue);
+  self->priv->bitrate = DEFAULT_BITRATE;
+  self->priv->pacing_factor = DEFAULT_PACING_FACTOR;
+  self->priv->last_ret = GST_FLOW_OK;
+
+  self->priv->sinkpad = gst_pad_new_from_static_template (&sink_template,
+      "sink");
+  gst_pad_set_chain_function (self->priv->sinkpad,
+      GST_DEBUG_FUNCPTR (kms_rtp_pacer_chain));
+  gst_pad_set_event_function (self->priv->sinkpad,
+      GST_DEBUG_FUNCPTR (kms_rtp_pacer_sink_event));
+  GST_PAD_SET_PROXY_CAPS (self->priv->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->priv->sinkpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->priv->sinkpad);
+
+  self->priv->srcpad = gst_pad_new_from_static_template (&src_template, "src");
+  gst_pad_set_event_function (self->priv->srcpad,
+      GST_DEBUG_FUNCPTR (kms_rtp_pacer_src_event));
+  GST_PAD_SET_PROXY_CAPS (self->priv->srcpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->priv->srcpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->priv->srcpad);
+}
+
+KmsRtpPacer *
+kms_rtp_pacer_new (guint bitrate)
+{
+  return g_object_new (KMS_TYPE_RTP_PACER, "bitrate", bitrate, NULL);
+}
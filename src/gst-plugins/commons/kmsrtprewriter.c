@@ -0,0 +1,531 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmsrtprewriter.h"
+#include "kmsmetrics.h"
+
+#include <gst/rtp/gstrtpbuffer.h>
+
+#define GST_DEFAULT_NAME "rtprewriter"
+#define GST_CAT_DEFAULT kms_rtp_rewriter_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define kms_rtp_rewriter_parent_class parent_class
+G_DEFINE_TYPE (KmsRtpRewriter, kms_rtp_rewriter, GST_TYPE_ELEMENT);
+
+#define KMS_RTP_REWRITER_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (             \
+    (obj),                                  \
+    KMS_TYPE_RTP_REWRITER,                  \
+    KmsRtpRewriterPrivate                   \
+  )                                         \
+)
+
+#define DEFAULT_SSRC 0
+#define DEFAULT_PT 96
+#define DEFAULT_MTU 1400
+
+enum
+{
+  PROP_0,
+  PROP_SSRC,
+  PROP_PT,
+  PROP_MTU,
+  N_PROPERTIES
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+struct _KmsRtpRewriterPrivate
+{
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  /* Protected by the object lock */
+  guint32 ssrc;
+  guint pt;
+  guint mtu;
+  GstCaps *sink_caps;
+
+  /* Only used from the streaming thread */
+  gboolean is_video;
+  gint clock_rate;
+  gboolean wait_frame;
+  gboolean started;
+  gboolean oversized;
+  guint32 in_ssrc;
+  guint16 seq_offset;
+  guint32 ts_offset;
+  guint16 last_seq;
+  guint32 last_ts;
+  GstClockTime last_pts;
+};
+
+static KmsMetric *shared_metric;
+
+/* Input sequence numbers and timestamps are mapped so that the output */
+/* ones continue from the last packet sent */
+static void
+kms_rtp_rewriter_resync (KmsRtpRewriter * self, GstBuffer * buffer,
+    guint32 ssrc, guint16 seq, guint32 ts)
+{
+  KmsRtpRewriterPrivate *priv = self->priv;
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+  guint32 out_ts;
+
+  if (!priv->started) {
+    priv->seq_offset = g_random_int () - seq;
+    priv->ts_offset = g_random_int () - ts;
+    priv->started = TRUE;
+  } else {
+    out_ts = priv->last_ts + 1;
+
+    if (priv->clock_rate > 0 && GST_CLOCK_TIME_IS_VALID (pts) &&
+        GST_CLOCK_TIME_IS_VALID (priv->last_pts) && pts > priv->last_pts) {
+      out_ts = priv->last_ts + gst_util_uint64_scale_int (pts - priv->last_pts,
+          priv->clock_rate, GST_SECOND);
+    }
+
+    priv->seq_offset = priv->last_seq + 1 - seq;
+    priv->ts_offset = out_ts - ts;
+  }
+
+  GST_DEBUG_OBJECT (self, "Input SSRC %u mapped to %u", ssrc, priv->ssrc);
+  priv->in_ssrc = ssrc;
+}
+
+/* Returns the packet to send, or NULL if it has to be dropped */
+static GstBuffer *
+kms_rtp_rewriter_rewrite (KmsRtpRewriter * self, GstBuffer * buffer)
+{
+  KmsRtpRewriterPrivate *priv = self->priv;
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstMemory *header;
+  GstMapInfo info;
+  GstBuffer *out;
+  guint32 ssrc, ts;
+  guint16 seq;
+  gboolean marker;
+  guint header_len, mtu;
+  gsize size;
+  guint8 pt;
+
+  GST_OBJECT_LOCK (self);
+  mtu = priv->mtu;
+  GST_OBJECT_UNLOCK (self);
+
+  size = gst_buffer_get_size (buffer);
+
+  if (size > mtu) {
+    /* The source payloader is not configured as this endpoint expects, */
+    /* the loss is reported by the receiver so that it recovers */
+    if (!priv->oversized) {
+      GST_ELEMENT_WARNING (self, STREAM, FAILED,
+          ("Shared RTP packets exceed the MTU"),
+          ("Packet of %" G_GSIZE_FORMAT " bytes, MTU %u", size, mtu));
+      priv->oversized = TRUE;
+    }
+
+    return NULL;
+  }
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    GST_WARNING_OBJECT (self, "Not an RTP buffer, dropped");
+    return NULL;
+  }
+
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  seq = gst_rtp_buffer_get_seq (&rtp);
+  ts = gst_rtp_buffer_get_timestamp (&rtp);
+  marker = gst_rtp_buffer_get_marker (&rtp);
+  header_len = gst_rtp_buffer_get_header_len (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  if (!priv->started || ssrc != priv->in_ssrc) {
+    kms_rtp_rewriter_resync (self, buffer, ssrc, seq, ts);
+  }
+
+  if (priv->wait_frame) {
+    /* Joined in the middle of a frame, start with the next one */
+    priv->wait_frame = !marker;
+    priv->seq_offset--;
+    return NULL;
+  }
+
+  priv->last_seq = seq + priv->seq_offset;
+  priv->last_ts = ts + priv->ts_offset;
+  priv->last_pts = GST_BUFFER_PTS (buffer);
+
+  GST_OBJECT_LOCK (self);
+  ssrc = priv->ssrc;
+  pt = priv->pt;
+  GST_OBJECT_UNLOCK (self);
+
+  header = gst_allocator_alloc (NULL, header_len, NULL);
+  gst_memory_map (header, &info, GST_MAP_WRITE);
+  gst_buffer_extract (buffer, 0, info.data, header_len);
+  info.data[1] = (marker ? 0x80 : 0) | (pt & 0x7f);
+  GST_WRITE_UINT16_BE (info.data + 2, priv->last_seq);
+  GST_WRITE_UINT32_BE (info.data + 4, priv->last_ts);
+  GST_WRITE_UINT32_BE (info.data + 8, ssrc);
+  gst_memory_unmap (header, &info);
+
+  out = gst_buffer_new ();
+  gst_buffer_copy_into (out, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
+  gst_buffer_append_memory (out, header);
+
+  if (gst_buffer_get_size (buffer) > header_len) {
+    gst_buffer_copy_into (out, buffer, GST_BUFFER_COPY_MEMORY, header_len, -1);
+  }
+
+  return out;
+}
+
+static GstFlowReturn
+kms_rtp_rewriter_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  KmsRtpRewriter *self = KMS_RTP_REWRITER (parent);
+  GstBuffer *out;
+
+  out = kms_rtp_rewriter_rewrite (self, buffer);
+  gst_buffer_unref (buffer);
+
+  if (out == NULL) {
+    return GST_FLOW_OK;
+  }
+
+  kms_metric_add (shared_metric, 1);
+
+  return gst_pad_push (self->priv->srcpad, out);
+}
+
+static GstFlowReturn
+kms_rtp_rewriter_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list)
+{
+  KmsRtpRewriter *self = KMS_RTP_REWRITER (parent);
+  GstBufferList *out_list;
+  guint i, len;
+
+  len = gst_buffer_list_length (list);
+  out_list = gst_buffer_list_new_sized (len);
+
+  for (i = 0; i < len; i++) {
+    GstBuffer *out;
+
+    out = kms_rtp_rewriter_rewrite (self, gst_buffer_list_get (list, i));
+
+    if (out != NULL) {
+      gst_buffer_list_add (out_list, out);
+    }
+  }
+
+  gst_buffer_list_unref (list);
+
+  len = gst_buffer_list_length (out_list);
+
+  if (len == 0) {
+    gst_buffer_list_unref (out_list);
+    return GST_FLOW_OK;
+  }
+
+  kms_metric_add (shared_metric, len);
+
+  return gst_pad_push_list (self->priv->srcpad, out_list);
+}
+
+static GstCaps *
+kms_rtp_rewriter_get_src_caps (KmsRtpRewriter * self, GstCaps * caps)
+{
+  GstStructure *st;
+
+  caps = gst_caps_copy (caps);
+  st = gst_caps_get_structure (caps, 0);
+
+  gst_structure_get_int (st, "clock-rate", &self->priv->clock_rate);
+  gst_structure_remove_fields (st, "seqnum-offset", "timestamp-offset", NULL);
+
+  GST_OBJECT_LOCK (self);
+  gst_structure_set (st, "payload", G_TYPE_INT, self->priv->pt, "ssrc",
+      G_TYPE_UINT, self->priv->ssrc, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  return caps;
+}
+
+static gboolean
+kms_rtp_rewriter_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  KmsRtpRewriter *self = KMS_RTP_REWRITER (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:{
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      caps = kms_rtp_rewriter_get_src_caps (self, caps);
+      gst_event_unref (event);
+
+      event = gst_event_new_caps (caps);
+      gst_caps_unref (caps);
+      break;
+    }
+    case GST_EVENT_FLUSH_STOP:
+      self->priv->wait_frame = self->priv->is_video;
+      break;
+    default:
+      break;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+kms_rtp_rewriter_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  KmsRtpRewriter *self = KMS_RTP_REWRITER (parent);
+  GstCaps *caps, *filter;
+  gboolean ret;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+      gst_query_parse_caps (query, &filter);
+
+      GST_OBJECT_LOCK (self);
+      if (filter != NULL) {
+        caps = gst_caps_intersect_full (filter, self->priv->sink_caps,
+            GST_CAPS_INTERSECT_FIRST);
+      } else {
+        caps = gst_caps_ref (self->priv->sink_caps);
+      }
+      GST_OBJECT_UNLOCK (self);
+
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    case GST_QUERY_ACCEPT_CAPS:
+      gst_query_parse_accept_caps (query, &caps);
+
+      GST_OBJECT_LOCK (self);
+      ret = gst_caps_can_intersect (caps, self->priv->sink_caps);
+      GST_OBJECT_UNLOCK (self);
+
+      gst_query_set_accept_caps_result (query, ret);
+      return TRUE;
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static GstStateChangeReturn
+kms_rtp_rewriter_change_state (GstElement * element, GstStateChange transition)
+{
+  KmsRtpRewriter *self = KMS_RTP_REWRITER (element);
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    self->priv->wait_frame = self->priv->is_video;
+    self->priv->started = FALSE;
+    self->priv->last_pts = GST_CLOCK_TIME_NONE;
+  }
+
+  return GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+}
+
+static void
+kms_rtp_rewriter_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsRtpRewriter *self = KMS_RTP_REWRITER (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_SSRC:
+      self->priv->ssrc = g_value_get_uint (value);
+      break;
+    case PROP_PT:
+      self->priv->pt = g_value_get_uint (value);
+      break;
+    case PROP_MTU:
+      self->priv->mtu = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_rtp_rewriter_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsRtpRewriter *self = KMS_RTP_REWRITER (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_SSRC:
+      g_value_set_uint (value, self->priv->ssrc);
+      break;
+    case PROP_PT:
+      g_value_set_uint (value, self->priv->pt);
+      break;
+    case PROP_MTU:
+      g_value_set_uint (value, self->priv->mtu);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_rtp_rewriter_finalize (GObject * object)
+{
+  KmsRtpRewriter *self = KMS_RTP_REWRITER (object);
+
+  gst_caps_unref (self->priv->sink_caps);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+kms_rtp_rewriter_class_init (KmsRtpRewriterClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_set_details_simple (gstelement_class,
+      "RtpRewriter",
+      "Generic",
+      "Adapts RTP packets payloaded once to each of their receivers",
+      "Kurento <kurento@googlegroups.com>");
+
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+
+  gobject_class->set_property = kms_rtp_rewriter_set_property;
+  gobject_class->get_property = kms_rtp_rewriter_get_property;
+  gobject_class->finalize = kms_rtp_rewriter_finalize;
+
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (kms_rtp_rewriter_change_state);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_template));
+
+  g_object_class_install_property (gobject_class, PROP_SSRC,
+      g_param_spec_uint ("ssrc", "SSRC", "SSRC of the output packets",
+          0, G_MAXUINT32, DEFAULT_SSRC,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PT,
+      g_param_spec_uint ("pt", "Payload type",
+          "Payload type of the output packets", 0, 0x7f, DEFAULT_PT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MTU,
+      g_param_spec_uint ("mtu", "MTU",
+          "Bigger packets are dropped, as they cannot be payloaded again",
+          28, G_MAXUINT, DEFAULT_MTU,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  shared_metric = kms_metrics_get_counter ("kms_rtp_shared_packets",
+      "RTP packets sent without payloading them again for each endpoint");
+
+  g_type_class_add_private (klass, sizeof (KmsRtpRewriterPrivate));
+}
+
+static void
+kms_rtp_rewriter_init (KmsRtpRewriter * self)
+{
+  self->priv = KMS_RTP_REWRITER_GET_PRIVATE (self);
+
+  self->priv->ssrc = DEFAULT_SSRC;
+  self->priv->pt = DEFAULT_PT;
+  self->priv->mtu = DEFAULT_MTU;
+  self->priv->sink_caps = gst_static_pad_template_get_caps (&sink_template);
+  self->priv->last_pts = GST_CLOCK_TIME_NONE;
+
+  self->priv->sinkpad = gst_pad_new_from_static_template (&sink_template,
+      "sink");
+  gst_pad_set_chain_function (self->priv->sinkpad,
+      GST_DEBUG_FUNCPTR (kms_rtp_rewriter_chain));
+  gst_pad_set_chain_list_function (self->priv->sinkpad,
+      GST_DEBUG_FUNCPTR (kms_rtp_rewriter_chain_list));
+  gst_pad_set_event_function (self->priv->sinkpad,
+      GST_DEBUG_FUNCPTR (kms_rtp_rewriter_sink_event));
+  gst_pad_set_query_function (self->priv->sinkpad,
+      GST_DEBUG_FUNCPTR (kms_rtp_rewriter_sink_query));
+  gst_element_add_pad (GST_ELEMENT (self), self->priv->sinkpad);
+
+  self->priv->srcpad = gst_pad_new_from_static_template (&src_template, "src");
+  gst_element_add_pad (GST_ELEMENT (self), self->priv->srcpad);
+}
+
+KmsRtpRewriter *
+kms_rtp_rewriter_new (const GstCaps * caps, guint32 ssrc)
+{
+  KmsRtpRewriter *self;
+  GstCaps *sink_caps;
+  GstStructure *st;
+  gint pt;
+
+  self = g_object_new (KMS_TYPE_RTP_REWRITER, "ssrc", ssrc, NULL);
+
+  sink_caps = gst_caps_copy (caps);
+  st = gst_caps_get_structure (sink_caps, 0);
+
+  if (gst_structure_get_int (st, "payload", &pt)) {
+    self->priv->pt = pt;
+  }
+
+  /* Any payload type, it is rewritten */
+  gst_structure_remove_field (st, "payload");
+
+  /* Audio packets are complete frames */
+  self->priv->is_video =
+      g_strcmp0 (gst_structure_get_string (st, "media"), "video") == 0;
+  self->priv->wait_frame = self->priv->is_video;
+
+  gst_caps_unref (self->priv->sink_caps);
+  self->priv->sink_caps = sink_caps;
+
+  return self;
+}
@@ -0,0 +1,67 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_RTP_REWRITER_H__
+#define __KMS_RTP_REWRITER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+#define KMS_TYPE_RTP_REWRITER \
+  (kms_rtp_rewriter_get_type())
+#define KMS_RTP_REWRITER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),KMS_TYPE_RTP_REWRITER,KmsRtpRewriter))
+#define KMS_RTP_REWRITER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),KMS_TYPE_RTP_REWRITER,KmsRtpRewriterClass))
+#define KMS_IS_RTP_REWRITER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),KMS_TYPE_RTP_REWRITER))
+#define KMS_IS_RTP_REWRITER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),KMS_TYPE_RTP_REWRITER))
+#define KMS_RTP_REWRITER_CAST(obj) ((KmsRtpRewriter*)(obj))
+
+typedef struct _KmsRtpRewriter KmsRtpRewriter;
+typedef struct _KmsRtpRewriterClass KmsRtpRewriterClass;
+typedef struct _KmsRtpRewriterPrivate KmsRtpRewriterPrivate;
+
+/*
+ * Makes the RTP packets produced by a payloader shared by several endpoints
+ * look like they were payloaded for this one: SSRC, payload type, sequence
+ * numbers and timestamps are rewritten. Only the RTP header is copied, the
+ * payload memory is shared with the input packets. The sink pad accepts the
+ * codec of @caps with any payload type, so that the agnosticbin of the
+ * source gives the same packets to all the endpoints using that codec.
+ * Packets bigger than the "mtu" property are dropped with a warning.
+ */
+struct _KmsRtpRewriter
+{
+  GstElement parent;
+
+  KmsRtpRewriterPrivate *priv;
+};
+
+struct _KmsRtpRewriterClass
+{
+  GstElementClass parent_class;
+};
+
+GType kms_rtp_rewriter_get_type (void);
+
+/* @caps as the ones of the payloader it replaces, including the payload */
+KmsRtpRewriter * kms_rtp_rewriter_new (const GstCaps * caps, guint32 ssrc);
+
+G_END_DECLS
+#endif /* __KMS_RTP_REWRITER_H__ */
@@ -0,0 +1,315 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmsrtpvp8.h"
+#include "kmstemporallayermeta.h"
+
+#define GST_DEFAULT_NAME "rtpvp8"
+#define GST_CAT_DEFAULT kms_rtp_vp8_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define VP8_DESC_X 0x80
+#define VP8_DESC_S 0x10
+#define VP8_DESC_PID 0x07
+#define VP8_DESC_I 0x80
+#define VP8_DESC_L 0x40
+#define VP8_DESC_T 0x20
+#define VP8_DESC_K 0x10
+#define VP8_DESC_M 0x80
+#define VP8_DESC_Y 0x20
+
+/* Completed frames waiting to be pushed, bounds the state if the
+ * depayloader drops a frame after its last packet */
+#define TEMPORAL_LAYERS_MAX_PENDING 16
+
+typedef struct _TemporalLayersData
+{
+  /* Descriptor of the first packet of the frame being received */
+  KmsRtpVp8Descriptor current;
+  gboolean started;
+  guint16 last_seq;
+  gboolean has_seq;
+  /* Descriptors of the frames whose last packet was received, in order */
+  GQueue complete;
+} TemporalLayersData;
+
+static void
+init_debug (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+        GST_DEFAULT_NAME);
+    g_once_init_leave (&initialized, 1);
+  }
+}
+
+gboolean
+kms_rtp_vp8_parse_descriptor (GstRTPBuffer * rtp, KmsRtpVp8Descriptor * desc)
+{
+  guint8 *data = gst_rtp_buffer_get_payload (rtp);
+  guint size = gst_rtp_buffer_get_payload_len (rtp);
+  guint offset = 1;
+  guint8 ext;
+
+  desc->picture_id = -1;
+  desc->tl0picidx = -1;
+  desc->tid = -1;
+  desc->layer_sync = FALSE;
+
+  if (size < 1) {
+    return FALSE;
+  }
+
+  desc->start_of_partition = (data[0] & VP8_DESC_S) != 0;
+  desc->partition_id = data[0] & VP8_DESC_PID;
+
+  if (!(data[0] & VP8_DESC_X)) {
+    return TRUE;
+  }
+
+  if (size < offset + 1) {
+    return FALSE;
+  }
+
+  ext = data[offset++];
+
+  if (ext & VP8_DESC_I) {
+    if (size < offset + 1) {
+      return FALSE;
+    }
+
+    if (data[offset] & VP8_DESC_M) {
+      if (size < offset + 2) {
+        return FALSE;
+      }
+      desc->picture_id = ((data[offset] & 0x7f) << 8) | data[offset + 1];
+      offset += 2;
+    } else {
+      desc->picture_id = data[offset] & 0x7f;
+      offset++;
+    }
+  }
+
+  if (ext & VP8_DESC_L) {
+    if (size < offset + 1) {
+      return FALSE;
+    }
+    desc->tl0picidx = data[offset++];
+  }
+
+  if (ext & (VP8_DESC_T | VP8_DESC_K)) {
+    if (size < offset + 1) {
+      return FALSE;
+    }
+
+    if (ext & VP8_DESC_T) {
+      desc->tid = data[offset] >> 6;
+      desc->layer_sync = (data[offset] & VP8_DESC_Y) != 0;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+temporal_layers_descriptor_free (KmsRtpVp8Descriptor * desc)
+{
+  g_slice_free (KmsRtpVp8Descriptor, desc);
+}
+
+static void
+temporal_layers_clear_complete (TemporalLayersData * data)
+{
+  g_queue_foreach (&data->complete, (GFunc) temporal_layers_descriptor_free,
+      NULL);
+  g_queue_clear (&data->complete);
+}
+
+static void
+temporal_layers_store (TemporalLayersData * data, GstBuffer * buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  KmsRtpVp8Descriptor desc;
+  guint16 seq;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    return;
+  }
+
+  seq = gst_rtp_buffer_get_seq (&rtp);
+
+  if (GST_BUFFER_IS_DISCONT (buffer) || (data->has_seq
+          && seq != (guint16) (data->last_seq + 1))) {
+    /* The depayloader also discards the frame being received on gaps */
+    data->started = FALSE;
+  }
+
+  data->last_seq = seq;
+  data->has_seq = TRUE;
+
+  if (!kms_rtp_vp8_parse_descriptor (&rtp, &desc)) {
+    goto end;
+  }
+
+  if (desc.start_of_partition && desc.partition_id == 0) {
+    data->current = desc;
+    data->started = TRUE;
+  }
+
+  if (gst_rtp_buffer_get_marker (&rtp) && data->started) {
+    /* The depayloader pushes the frame when its last packet arrives */
+    g_queue_push_tail (&data->complete,
+        g_slice_dup (KmsRtpVp8Descriptor, &data->current));
+    data->started = FALSE;
+
+    if (g_queue_get_length (&data->complete) > TEMPORAL_LAYERS_MAX_PENDING) {
+      temporal_layers_descriptor_free (g_queue_pop_head (&data->complete));
+    }
+  }
+
+end:
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+static gboolean
+temporal_layers_store_list (GstBuffer ** buffer, guint idx, gpointer data)
+{
+  temporal_layers_store (data, *buffer);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+temporal_layers_sink_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  TemporalLayersData *data = user_data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    /* Previous frames were pushed while chaining their last packet, those
+     * still queued were discarded by the depayloader */
+    temporal_layers_clear_complete (data);
+    temporal_layers_store (data, gst_pad_probe_info_get_buffer (info));
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    gst_buffer_list_foreach (gst_pad_probe_info_get_buffer_list (info),
+        temporal_layers_store_list, data);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstBuffer *
+temporal_layers_tag (TemporalLayersData * data, GstBuffer * buffer)
+{
+  KmsRtpVp8Descriptor *desc = g_queue_pop_head (&data->complete);
+
+  if (desc == NULL) {
+    GST_WARNING ("No descriptor for frame %" GST_PTR_FORMAT, buffer);
+    return buffer;
+  }
+
+  if (desc->tid >= 0) {
+    GST_TRACE ("Temporal layer %d%s, frame %" GST_PTR_FORMAT, desc->tid,
+        desc->layer_sync ? " (sync)" : "", buffer);
+
+    buffer = gst_buffer_make_writable (buffer);
+    kms_buffer_add_temporal_layer_meta (buffer, desc->tid, desc->layer_sync);
+  }
+
+  temporal_layers_descriptor_free (desc);
+
+  return buffer;
+}
+
+static gboolean
+temporal_layers_tag_list (GstBuffer ** buffer, guint idx, gpointer data)
+{
+  *buffer = temporal_layers_tag (data, *buffer);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+temporal_layers_src_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  TemporalLayersData *data = user_data;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GST_PAD_PROBE_INFO_DATA (info) =
+        temporal_layers_tag (data, gst_pad_probe_info_get_buffer (info));
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+
+    list = gst_buffer_list_make_writable (list);
+    gst_buffer_list_foreach (list, temporal_layers_tag_list, data);
+    GST_PAD_PROBE_INFO_DATA (info) = list;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+temporal_layers_data_destroy (TemporalLayersData * data)
+{
+  temporal_layers_clear_complete (data);
+  g_slice_free (TemporalLayersData, data);
+}
+
+/*
+ * The descriptor is lost when depayloading. The depayloader pushes each
+ * frame when its last packet is received, so descriptors are queued in
+ * the same order on its input and attached to the frames on its output.
+ */
+void
+kms_rtp_vp8_tag_temporal_layers (GstElement * depayloader)
+{
+  TemporalLayersData *data;
+  GstPad *sink, *src;
+
+  init_debug ();
+
+  sink = gst_element_get_static_pad (depayloader, "sink");
+  src = gst_element_get_static_pad (depayloader, "src");
+
+  if (sink == NULL || src == NULL) {
+    GST_WARNING_OBJECT (depayloader, "Cannot tag temporal layers");
+    goto end;
+  }
+
+  data = g_slice_new0 (TemporalLayersData);
+  g_queue_init (&data->complete);
+
+  gst_pad_add_probe (sink,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      temporal_layers_sink_probe, data, NULL);
+  /* Both probes run in the depayloader streaming thread */
+  gst_pad_add_probe (src,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      temporal_layers_src_probe, data,
+      (GDestroyNotify) temporal_layers_data_destroy);
+
+end:
+  g_clear_object (&sink);
+  g_clear_object (&src);
+}
@@ -0,0 +1,44 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_RTP_VP8_H__
+#define __KMS_RTP_VP8_H__
+
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+G_BEGIN_DECLS
+
+/* VP8 payload descriptor, RFC 7741 section 4.2 */
+typedef struct _KmsRtpVp8Descriptor
+{
+  gboolean start_of_partition;
+  guint partition_id;
+  gint picture_id;              /* -1 if not present */
+  gint tl0picidx;               /* -1 if not present */
+  gint tid;                     /* -1 if not present */
+  gboolean layer_sync;
+} KmsRtpVp8Descriptor;
+
+gboolean kms_rtp_vp8_parse_descriptor (GstRTPBuffer * rtp, KmsRtpVp8Descriptor * desc);
+
+/* Attaches a KmsTemporalLayerMeta to the depayloaded frames */
+void kms_rtp_vp8_tag_temporal_layers (GstElement * depayloader);
+
+G_END_DECLS
+
+#endif /* __KMS_RTP_VP8_H__ */
@@ -0,0 +1,860 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "kmsrtxcache.h"
+#include "kmsmetrics.h"
+
+#include <gst/rtp/gstrtpbuffer.h>
+
+#define GST_DEFAULT_NAME "rtxcache"
+#define GST_CAT_DEFAULT kms_rtx_cache_debug
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+
+#define kms_rtx_cache_parent_class parent_class
+G_DEFINE_TYPE (KmsRtxCache, kms_rtx_cache, GST_TYPE_ELEMENT);
+
+#define KMS_RTX_CACHE_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (          \
+    (obj),                               \
+    KMS_TYPE_RTX_CACHE,                  \
+    KmsRtxCachePrivate                   \
+  )                                      \
+)
+
+#define DEFAULT_MAX_SIZE_TIME 0 /* ms */
+#define DEFAULT_MAX_SIZE_PACKETS 100
+#define DEFAULT_MEMORY_LIMIT (64 * 1024 * 1024)
+#define DEFAULT_BYPASS FALSE
+
+/* Rings grow on demand, so their size follows the packet rate */
+#define RING_INITIAL_CAPACITY 64
+
+/* Rings of SSRCs that sent nothing for this time are removed */
+#define RING_STALE_TIME (10 * G_TIME_SPAN_SECOND)
+#define RING_PURGE_INTERVAL G_TIME_SPAN_SECOND
+
+/* Memories are accounted in shards, so caches do not contend on one lock */
+#define MEMORY_SHARDS 16
+
+#define ATOMIC_ADD(ptr, val) __atomic_add_fetch ((ptr), (val), __ATOMIC_RELAXED)
+#define ATOMIC_SET(ptr, val) __atomic_store_n ((ptr), (val), __ATOMIC_RELAXED)
+#define ATOMIC_GET(ptr) __atomic_load_n ((ptr), __ATOMIC_RELAXED)
+
+enum
+{
+  PROP_0,
+  PROP_MAX_SIZE_TIME,
+  PROP_MAX_SIZE_PACKETS,
+  PROP_BYPASS,
+  PROP_STATS,
+  N_PROPERTIES
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+typedef struct _KmsRtxEntry
+{
+  GstBuffer *buffer;
+  guint16 seqnum;
+  gint64 time;                  /* monotonic, us */
+} KmsRtxEntry;
+
+typedef struct _KmsRtxRing
+{
+  /* Taken by the global eviction too, after memory_mutex */
+  GMutex mutex;
+  KmsRtxEntry *entries;
+  guint capacity;
+  guint head;
+  guint count;
+
+  /* Time of the oldest packet that can be evicted, atomic */
+  gint64 evictable;
+  /* Time of the last packet stored, protected by the cache lock */
+  gint64 newest;
+} KmsRtxRing;
+
+struct _KmsRtxCachePrivate
+{
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  /* Protected by the object lock */
+  GHashTable *rings;            /* <ssrc, KmsRtxRing> */
+  GList *pending;
+  guint max_size_time;
+  guint max_size_packets;
+  gboolean bypass;
+  gint64 last_purge;
+  guint64 hits;
+  guint64 misses;
+};
+
+typedef struct _KmsRtxMemoryShard
+{
+  GMutex mutex;
+  GHashTable *refs;             /* <root GstMemory, references> */
+} KmsRtxMemoryShard;
+
+/* Memory accounting shared by all the caches */
+static KmsRtxMemoryShard shards[MEMORY_SHARDS];
+static gsize memory_used;
+static gsize memory_limit = DEFAULT_MEMORY_LIMIT;
+
+/* Only taken to evict packets and to register rings */
+static GMutex memory_mutex;
+static GList *all_rings;
+
+static KmsMetric *hits_metric;
+static KmsMetric *misses_metric;
+static KmsMetric *memory_metric;
+
+static void kms_rtx_cache_evict (void);
+
+void
+kms_rtx_cache_set_memory_limit (gsize bytes)
+{
+  ATOMIC_SET (&memory_limit, bytes);
+  kms_rtx_cache_evict ();
+}
+
+gsize
+kms_rtx_cache_get_memory_used (void)
+{
+  return ATOMIC_GET (&memory_used);
+}
+
+static gboolean
+memory_exceeded (void)
+{
+  gsize limit = ATOMIC_GET (&memory_limit);
+
+  return limit > 0 && ATOMIC_GET (&memory_used) > limit;
+}
+
+/* Payloaders share the memory of the encoded frames with their output, */
+/* so memories are accounted by the root of the ones they were shared from */
+static GstMemory *
+get_root_memory (GstMemory * mem)
+{
+  while (mem->parent != NULL) {
+    mem = mem->parent;
+  }
+
+  return mem;
+}
+
+/* Returns TRUE if the memory limit is exceeded */
+static gboolean
+account_buffer (GstBuffer * buffer, gboolean add)
+{
+  guint i, n;
+
+  n = gst_buffer_n_memory (buffer);
+
+  for (i = 0; i < n; i++) {
+    GstMemory *mem = get_root_memory (gst_buffer_peek_memory (buffer, i));
+    KmsRtxMemoryShard *shard;
+    guint refs;
+
+    shard = &shards[(GPOINTER_TO_SIZE (mem) >> 4) % MEMORY_SHARDS];
+
+    g_mutex_lock (&shard->mutex);
+
+    if (shard->refs == NULL) {
+      shard->refs = g_hash_table_new (g_direct_hash, g_direct_equal);
+    }
+
+    refs = GPOINTER_TO_UINT (g_hash_table_lookup (shard->refs, mem));
+
+    if (add) {
+      if (refs++ == 0) {
+        ATOMIC_ADD (&memory_used, mem->maxsize);
+      }
+    } else if (--refs == 0) {
+      ATOMIC_ADD (&memory_used, -mem->maxsize);
+    }
+
+    if (refs == 0) {
+      g_hash_table_remove (shard->refs, mem);
+    } else {
+      g_hash_table_insert (shard->refs, mem, GUINT_TO_POINTER (refs));
+    }
+
+    g_mutex_unlock (&shard->mutex);
+  }
+
+  kms_metric_set (memory_metric, ATOMIC_GET (&memory_used));
+
+  return memory_exceeded ();
+}
+
+static KmsRtxEntry *
+kms_rtx_ring_get (KmsRtxRing * ring, guint index)
+{
+  return &ring->entries[(ring->head + index) % ring->capacity];
+}
+
+/* The last packet of a ring is never evicted */
+static void
+kms_rtx_ring_update_evictable (KmsRtxRing * ring)
+{
+  ATOMIC_SET (&ring->evictable, ring->count > 1 ?
+      ring->entries[ring->head].time : G_MAXINT64);
+}
+
+static KmsRtxRing *
+kms_rtx_ring_new (void)
+{
+  KmsRtxRing *ring = g_slice_new0 (KmsRtxRing);
+
+  g_mutex_init (&ring->mutex);
+  ring->capacity = RING_INITIAL_CAPACITY;
+  ring->entries = g_new0 (KmsRtxEntry, ring->capacity);
+  ring->evictable = G_MAXINT64;
+
+  g_mutex_lock (&memory_mutex);
+  all_rings = g_list_prepend (all_rings, ring);
+  g_mutex_unlock (&memory_mutex);
+
+  return ring;
+}
+
+/* Must be called with the ring mutex */
+static void
+kms_rtx_ring_pop (KmsRtxRing * ring)
+{
+  KmsRtxEntry *entry = &ring->entries[ring->head];
+
+  account_buffer (entry->buffer, FALSE);
+  gst_buffer_unref (entry->buffer);
+  entry->buffer = NULL;
+
+  ring->head = (ring->head + 1) % ring->capacity;
+  ring->count--;
+
+  kms_rtx_ring_update_evictable (ring);
+}
+
+static void
+kms_rtx_ring_destroy (KmsRtxRing * ring)
+{
+  /* Not reachable by the eviction anymore */
+  g_mutex_lock (&memory_mutex);
+  all_rings = g_list_remove (all_rings, ring);
+  g_mutex_unlock (&memory_mutex);
+
+  while (ring->count > 0) {
+    kms_rtx_ring_pop (ring);
+  }
+
+  g_mutex_clear (&ring->mutex);
+  g_free (ring->entries);
+  g_slice_free (KmsRtxRing, ring);
+}
+
+static void
+kms_rtx_ring_grow (KmsRtxRing * ring)
+{
+  KmsRtxEntry *entries;
+  guint i;
+
+  entries = g_new0 (KmsRtxEntry, ring->capacity * 2);
+
+  for (i = 0; i < ring->count; i++) {
+    entries[i] = *kms_rtx_ring_get (ring, i);
+  }
+
+  g_free (ring->entries);
+  ring->entries = entries;
+  ring->capacity *= 2;
+  ring->head = 0;
+}
+
+/* Returns TRUE if the memory limit is exceeded */
+static gboolean
+kms_rtx_ring_push (KmsRtxCache * self, KmsRtxRing * ring, GstBuffer * buffer,
+    guint16 seqnum, gint64 now)
+{
+  KmsRtxEntry *entry;
+  gboolean exceeded;
+  gint64 max_age =
+      (gint64) self->priv->max_size_time * G_TIME_SPAN_MILLISECOND;
+
+  g_mutex_lock (&ring->mutex);
+
+  while (ring->count > 0 && self->priv->max_size_time > 0 &&
+      now - ring->entries[ring->head].time > max_age) {
+    kms_rtx_ring_pop (ring);
+  }
+
+  while (ring->count > 0 && self->priv->max_size_packets > 0 &&
+      ring->count >= self->priv->max_size_packets) {
+    kms_rtx_ring_pop (ring);
+  }
+
+  if (ring->count == ring->capacity) {
+    kms_rtx_ring_grow (ring);
+  }
+
+  entry = kms_rtx_ring_get (ring, ring->count);
+  entry->buffer = gst_buffer_ref (buffer);
+  entry->seqnum = seqnum;
+  entry->time = now;
+  ring->count++;
+  ring->newest = now;
+
+  exceeded = account_buffer (buffer, TRUE);
+  kms_rtx_ring_update_evictable (ring);
+
+  g_mutex_unlock (&ring->mutex);
+
+  return exceeded;
+}
+
+/* Must be called with the ring mutex */
+static KmsRtxEntry *
+kms_rtx_ring_find (KmsRtxRing * ring, guint16 seqnum)
+{
+  KmsRtxEntry *entry;
+  guint16 offset;
+  guint low, high;
+
+  if (ring->count == 0) {
+    return NULL;
+  }
+
+  /* Direct hit when no sequence numbers are missing */
+  offset = seqnum - ring->entries[ring->head].seqnum;
+
+  if (offset < ring->count) {
+    entry = kms_rtx_ring_get (ring, offset);
+
+    if (entry->seqnum == seqnum) {
+      return entry;
+    }
+  }
+
+  /* Packets are still in sequence order, but with gaps */
+  low = 0;
+  high = ring->count;
+
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+    gint16 diff;
+
+    entry = kms_rtx_ring_get (ring, mid);
+    diff = (gint16) (entry->seqnum - seqnum);
+
+    if (diff == 0) {
+      return entry;
+    } else if (diff < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return NULL;
+}
+
+static GstBuffer *
+kms_rtx_ring_lookup (KmsRtxCache * self, KmsRtxRing * ring, guint16 seqnum)
+{
+  GstBuffer *buffer = NULL;
+  KmsRtxEntry *entry;
+
+  g_mutex_lock (&ring->mutex);
+
+  entry = kms_rtx_ring_find (ring, seqnum);
+
+  if (entry != NULL && (self->priv->max_size_time == 0 ||
+          g_get_monotonic_time () - entry->time <=
+          (gint64) self->priv->max_size_time * G_TIME_SPAN_MILLISECOND)) {
+    buffer = gst_buffer_ref (entry->buffer);
+  }
+
+  g_mutex_unlock (&ring->mutex);
+
+  return buffer;
+}
+
+/*
+ * Releases the oldest packets of all the caches until memory is under the
+ * limit, so a busy stream does not lose its window while idle ones keep
+ * theirs. Must not be called with any ring mutex.
+ */
+static void
+kms_rtx_cache_evict (void)
+{
+  g_mutex_lock (&memory_mutex);
+
+  while (memory_exceeded ()) {
+    KmsRtxRing *oldest = NULL;
+    gint64 oldest_time = G_MAXINT64;
+    GList *l;
+
+    for (l = all_rings; l != NULL; l = l->next) {
+      KmsRtxRing *ring = l->data;
+      gint64 time = ATOMIC_GET (&ring->evictable);
+
+      if (time < oldest_time) {
+        oldest = ring;
+        oldest_time = time;
+      }
+    }
+
+    if (oldest == NULL) {
+      /* Only the last packet of each ring is left */
+      break;
+    }
+
+    g_mutex_lock (&oldest->mutex);
+
+    if (oldest->count > 1) {
+      kms_rtx_ring_pop (oldest);
+    }
+
+    g_mutex_unlock (&oldest->mutex);
+  }
+
+  g_mutex_unlock (&memory_mutex);
+}
+
+static gboolean
+kms_rtx_ring_is_stale (gpointer key, KmsRtxRing * ring, gint64 * now)
+{
+  return *now - ring->newest > RING_STALE_TIME;
+}
+
+/* Must be called with the object lock, returns TRUE if memory is exceeded */
+static gboolean
+kms_rtx_cache_store (KmsRtxCache * self, GstBuffer * buffer, gint64 now)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  KmsRtxRing *ring;
+  guint32 ssrc;
+  guint16 seqnum;
+
+  if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    GST_WARNING_OBJECT (self, "Not an RTP buffer, not cached");
+    return FALSE;
+  }
+
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  seqnum = gst_rtp_buffer_get_seq (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  ring = g_hash_table_lookup (self->priv->rings, GUINT_TO_POINTER (ssrc));
+
+  if (ring == NULL) {
+    ring = kms_rtx_ring_new ();
+    g_hash_table_insert (self->priv->rings, GUINT_TO_POINTER (ssrc), ring);
+  }
+
+  return kms_rtx_ring_push (self, ring, buffer, seqnum, now);
+}
+
+/* Must be called with the object lock */
+static GList *
+kms_rtx_cache_take_pending (KmsRtxCache * self, gint64 now)
+{
+  GList *pending;
+
+  if (now - self->priv->last_purge > RING_PURGE_INTERVAL) {
+    self->priv->last_purge = now;
+    g_hash_table_foreach_remove (self->priv->rings,
+        (GHRFunc) kms_rtx_ring_is_stale, &now);
+  }
+
+  pending = g_list_reverse (self->priv->pending);
+  self->priv->pending = NULL;
+
+  return pending;
+}
+
+/* Retransmissions are sent from the streaming thread, like rtprtxqueue */
+static GstFlowReturn
+kms_rtx_cache_push_pending (KmsRtxCache * self, GList * pending)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  while (pending != NULL) {
+    GstBuffer *rtx = pending->data;
+
+    pending = g_list_delete_link (pending, pending);
+
+    if (ret == GST_FLOW_OK) {
+      ret = gst_pad_push (self->priv->srcpad, rtx);
+    } else {
+      gst_buffer_unref (rtx);
+    }
+  }
+
+  return ret;
+}
+
+static GstFlowReturn
+kms_rtx_cache_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (parent);
+  gint64 now = g_get_monotonic_time ();
+  gboolean exceeded;
+  GstFlowReturn ret;
+  GList *pending;
+
+  if (g_atomic_int_get (&self->priv->bypass)) {
+    return gst_pad_push (self->priv->srcpad, buffer);
+  }
+
+  GST_OBJECT_LOCK (self);
+  exceeded = kms_rtx_cache_store (self, buffer, now);
+  pending = kms_rtx_cache_take_pending (self, now);
+  GST_OBJECT_UNLOCK (self);
+
+  if (exceeded) {
+    kms_rtx_cache_evict ();
+  }
+
+  ret = kms_rtx_cache_push_pending (self, pending);
+
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (buffer);
+    return ret;
+  }
+
+  return gst_pad_push (self->priv->srcpad, buffer);
+}
+
+static GstFlowReturn
+kms_rtx_cache_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (parent);
+  gint64 now = g_get_monotonic_time ();
+  gboolean exceeded = FALSE;
+  GstFlowReturn ret;
+  GList *pending;
+  guint i, len;
+
+  if (g_atomic_int_get (&self->priv->bypass)) {
+    return gst_pad_push_list (self->priv->srcpad, list);
+  }
+
+  len = gst_buffer_list_length (list);
+
+  GST_OBJECT_LOCK (self);
+
+  for (i = 0; i < len; i++) {
+    exceeded |= kms_rtx_cache_store (self, gst_buffer_list_get (list, i), now);
+  }
+
+  pending = kms_rtx_cache_take_pending (self, now);
+
+  GST_OBJECT_UNLOCK (self);
+
+  if (exceeded) {
+    kms_rtx_cache_evict ();
+  }
+
+  ret = kms_rtx_cache_push_pending (self, pending);
+
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_list_unref (list);
+    return ret;
+  }
+
+  return gst_pad_push_list (self->priv->srcpad, list);
+}
+
+static gboolean
+kms_rtx_cache_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (parent);
+  const GstStructure *s;
+  guint seqnum, ssrc;
+  GstBuffer *buffer = NULL;
+  KmsRtxRing *ring;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CUSTOM_UPSTREAM ||
+      !gst_event_has_name (event, "GstRTPRetransmissionRequest")) {
+    return gst_pad_event_default (pad, parent, event);
+  }
+
+  if (g_atomic_int_get (&self->priv->bypass)) {
+    /* Retransmissions are disabled */
+    gst_event_unref (event);
+    return FALSE;
+  }
+
+  s = gst_event_get_structure (event);
+
+  if (!gst_structure_get_uint (s, "seqnum", &seqnum) ||
+      !gst_structure_get_uint (s, "ssrc", &ssrc)) {
+    gst_event_unref (event);
+    return FALSE;
+  }
+
+  GST_OBJECT_LOCK (self);
+
+  ring = g_hash_table_lookup (self->priv->rings, GUINT_TO_POINTER (ssrc));
+
+  if (ring != NULL) {
+    buffer = kms_rtx_ring_lookup (self, ring, seqnum);
+  }
+
+  if (buffer != NULL) {
+    self->priv->pending = g_list_prepend (self->priv->pending, buffer);
+    self->priv->hits++;
+  } else {
+    self->priv->misses++;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  if (buffer != NULL) {
+    kms_metric_add (hits_metric, 1);
+  } else {
+    GST_DEBUG_OBJECT (self, "Packet %u of SSRC %u not cached", seqnum, ssrc);
+    kms_metric_add (misses_metric, 1);
+  }
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static gboolean
+kms_rtx_cache_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (parent);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+    GST_OBJECT_LOCK (self);
+    g_hash_table_remove_all (self->priv->rings);
+    g_list_free_full (self->priv->pending, (GDestroyNotify) gst_buffer_unref);
+    self->priv->pending = NULL;
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static GstStateChangeReturn
+kms_rtx_cache_change_state (GstElement * element, GstStateChange transition)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (element);
+  GstStateChangeReturn ret;
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    GST_OBJECT_LOCK (self);
+    g_hash_table_remove_all (self->priv->rings);
+    g_list_free_full (self->priv->pending, (GDestroyNotify) gst_buffer_unref);
+    self->priv->pending = NULL;
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  return ret;
+}
+
+static void
+kms_rtx_cache_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_MAX_SIZE_TIME:
+      self->priv->max_size_time = g_value_get_uint (value);
+      break;
+    case PROP_MAX_SIZE_PACKETS:
+      self->priv->max_size_packets = g_value_get_uint (value);
+      break;
+    case PROP_BYPASS:
+      g_atomic_int_set (&self->priv->bypass, g_value_get_boolean (value));
+
+      if (self->priv->bypass) {
+        /* Nothing will be retransmitted, release the memory at once */
+        g_hash_table_remove_all (self->priv->rings);
+        g_list_free_full (self->priv->pending,
+            (GDestroyNotify) gst_buffer_unref);
+        self->priv->pending = NULL;
+      }
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_rtx_cache_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (property_id) {
+    case PROP_MAX_SIZE_TIME:
+      g_value_set_uint (value, self->priv->max_size_time);
+      break;
+    case PROP_MAX_SIZE_PACKETS:
+      g_value_set_uint (value, self->priv->max_size_packets);
+      break;
+    case PROP_BYPASS:
+      g_value_set_boolean (value, self->priv->bypass);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_structure_new ("rtx-cache-stats",
+              "hits", G_TYPE_UINT64, self->priv->hits, "misses",
+              G_TYPE_UINT64, self->priv->misses, NULL));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_rtx_cache_finalize (GObject * object)
+{
+  KmsRtxCache *self = KMS_RTX_CACHE (object);
+
+  g_hash_table_unref (self->priv->rings);
+  g_list_free_full (self->priv->pending, (GDestroyNotify) gst_buffer_unref);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+kms_rtx_cache_class_init (KmsRtxCacheClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_set_details_simple (gstelement_class,
+      "RtxCache",
+      "Generic",
+      "Keeps sent RTP packets to be retransmitted on request",
+      "Kurento <kurento@googlegroups.com>");
+
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+
+  gobject_class->set_property = kms_rtx_cache_set_property;
+  gobject_class->get_property = kms_rtx_cache_get_property;
+  gobject_class->finalize = kms_rtx_cache_finalize;
+
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (kms_rtx_cache_change_state);
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_template));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_SIZE_TIME,
+      g_param_spec_uint ("max-size-time", "Max size time",
+          "Milliseconds packets are kept (0 = unlimited)", 0, G_MAXUINT,
+          DEFAULT_MAX_SIZE_TIME, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_SIZE_PACKETS,
+      g_param_spec_uint ("max-size-packets", "Max size packets",
+          "Packets kept for each SSRC (0 = unlimited)", 0, G_MAXUINT,
+          DEFAULT_MAX_SIZE_PACKETS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BYPASS,
+      g_param_spec_boolean ("bypass", "Bypass",
+          "Forward packets without keeping them, retransmission requests "
+          "are dropped", DEFAULT_BYPASS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Stats",
+          "Retransmission requests served (hits) and not found (misses)",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  hits_metric = kms_metrics_get_counter ("kms_rtx_cache_hits",
+      "Retransmission requests served from the RTX caches");
+  misses_metric = kms_metrics_get_counter ("kms_rtx_cache_misses",
+      "Retransmission requests for packets no longer cached");
+  memory_metric = kms_metrics_get_gauge ("kms_rtx_cache_bytes",
+      "Memory used by the packets kept in the RTX caches");
+
+  g_type_class_add_private (klass, sizeof (KmsRtxCachePrivate));
+}
+
+static void
+kms_rtx_cache_init (KmsRtxCache * self)
+{
+  self->priv = KMS_RTX_CACHE_GET_PRIVATE (self);
+
+  self->priv->rings = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) kms_rtx_ring_destroy);
+  self->priv->max_size_time = DEFAULT_MAX_SIZE_TIME;
+  self->priv->max_size_packets = DEFAULT_MAX_SIZE_PACKETS;
+  self->priv->bypass = DEFAULT_BYPASS;
+
+  self->priv->sinkpad = gst_pad_new_from_static_template (&sink_template,
+      "sink");
+  gst_pad_set_chain_function (self->priv->sinkpad,
+      GST_DEBUG_FUNCPTR (kms_rtx_cache_chain));
+  gst_pad_set_chain_list_function (self->priv->sinkpad,
+      GST_DEBUG_FUNCPTR (kms_rtx_cache_chain_list));
+  gst_pad_set_event_function (self->priv->sinkpad,
+      GST_DEBUG_FUNCPTR (kms_rtx_cache_sink_event));
+  GST_PAD_SET_PROXY_CAPS (self->priv->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->priv->sinkpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->priv->sinkpad);
+
+  self->priv->srcpad = gst_pad_new_from_static_template (&src_template, "src");
+  gst_pad_set_event_function (self->priv->srcpad,
+      GST_DEBUG_FUNCPTR (kms_rtx_cache_src_event));
+  GST_PAD_SET_PROXY_CAPS (self->priv->srcpad);
+  GST_PAD_SET_PROXY_ALLOCATION (self->priv->srcpad);
+  gst_element_add_pad (GST_ELEMENT (self), self->priv->srcpad);
+}
+
+KmsRtxCache *
+kms_rtx_cache_new (void)
+{
+  return g_object_new (KMS_TYPE_RTX_CACHE, NULL);
+}
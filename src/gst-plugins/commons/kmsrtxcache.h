@@ -0,0 +1,70 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_RTX_CACHE_H__
+#define __KMS_RTX_CACHE_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+#define KMS_TYPE_RTX_CACHE \
+  (kms_rtx_cache_get_type())
+#define KMS_RTX_CACHE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),KMS_TYPE_RTX_CACHE,KmsRtxCache))
+#define KMS_RTX_CACHE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),KMS_TYPE_RTX_CACHE,KmsRtxCacheClass))
+#define KMS_IS_RTX_CACHE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),KMS_TYPE_RTX_CACHE))
+#define KMS_IS_RTX_CACHE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),KMS_TYPE_RTX_CACHE))
+#define KMS_RTX_CACHE_CAST(obj) ((KmsRtxCache*)(obj))
+
+typedef struct _KmsRtxCache KmsRtxCache;
+typedef struct _KmsRtxCacheClass KmsRtxCacheClass;
+typedef struct _KmsRtxCachePrivate KmsRtxCachePrivate;
+
+/*
+ * Keeps the RTP packets sent on each SSRC during a time window and resends
+ * them when a GstRTPRetransmissionRequest event is received, like
+ * rtprtxqueue. Packets are kept by reference and the memory they use is
+ * accounted process wide, so payloads shared by several endpoints sending
+ * the same stream are only counted once. When the memory limit is exceeded
+ * the oldest packets of all the caches are released first, though the last
+ * packet of each SSRC is always kept.
+ */
+struct _KmsRtxCache
+{
+  GstElement parent;
+
+  KmsRtxCachePrivate *priv;
+};
+
+struct _KmsRtxCacheClass
+{
+  GstElementClass parent_class;
+};
+
+GType kms_rtx_cache_get_type (void);
+
+KmsRtxCache * kms_rtx_cache_new (void);
+
+/* Limit of the memory used by all the caches, 0 for unlimited */
+void kms_rtx_cache_set_memory_limit (gsize bytes);
+gsize kms_rtx_cache_get_memory_used (void);
+
+G_END_DECLS
+#endif /* __KMS_RTX_CACHE_H__ */
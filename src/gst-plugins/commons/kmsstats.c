@@ -33,7 +33,9 @@ typedef struct _BufferLatencyValues
 } BufferLatencyValues;
 
 typedef struct _ProbeData ProbeData;
-typedef void (*BufferCb) (GstBuffer * buffer, ProbeData * pdata);
+/* @now is read once for all the buffers of a list, they arrive together */
+typedef void (*BufferCb) (GstBuffer * buffer, GstClockTime now,
+    ProbeData * pdata);
 
 typedef struct _ProbeData
 {
@@ -48,6 +50,12 @@ typedef struct _ProbeData
   gboolean locked;
 } ProbeData;
 
+typedef struct _MetaIterData
+{
+  ProbeData *pdata;
+  GstClockTime now;
+} MetaIterData;
+
 static BufferLatencyValues *
 buffer_latency_values_new (gboolean is_valid, KmsMediaType type)
 {
@@ -103,36 +111,32 @@ probe_data_destroy (ProbeData * pdata)
   g_slice_free (ProbeData, pdata);
 }
 
-static void
-process_buffer (GstBuffer * buffer, gpointer user_data)
+static GstPadProbeReturn
+process_buffer_probe_cb (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
 {
   ProbeData *pdata = user_data;
+  GstClockTime now;
 
-  if (pdata->invoke_cb != NULL) {
-    pdata->invoke_cb (buffer, pdata);
+  if (pdata->invoke_cb == NULL) {
+    return GST_PAD_PROBE_OK;
   }
-}
 
-static gboolean
-process_buffer_list_cb (GstBuffer ** buffer, guint idx, gpointer user_data)
-{
-  process_buffer (*buffer, user_data);
-
-  return TRUE;
-}
+  now = kms_utils_get_time_nsecs ();
 
-static GstPadProbeReturn
-process_buffer_probe_cb (GstPad * pad, GstPadProbeInfo * info,
-    gpointer user_data)
-{
   if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
     GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
 
-    process_buffer (buffer, user_data);
+    pdata->invoke_cb (buffer, now, pdata);
   } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
     GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint i, len;
+
+    len = gst_buffer_list_length (list);
 
-    gst_buffer_list_foreach (list, process_buffer_list_cb, user_data);
+    for (i = 0; i < len; i++) {
+      pdata->invoke_cb (gst_buffer_list_get (list, i), now, pdata);
+    }
   }
 
   return GST_PAD_PROBE_OK;
@@ -165,14 +169,12 @@ kms_stats_get_element_stats (GstStructure * stats)
 }
 
 static void
-buffer_latency_probe_cb (GstBuffer * buffer, ProbeData * pdata)
+buffer_latency_probe_cb (GstBuffer * buffer, GstClockTime now,
+    ProbeData * pdata)
 {
   BufferLatencyValues *blv = (BufferLatencyValues *) pdata->invoke_data;
-  GstClockTime time;
-
-  time = kms_utils_get_time_nsecs ();
 
-  kms_buffer_add_buffer_latency_meta (buffer, time, blv->valid, blv->type);
+  kms_buffer_add_buffer_latency_meta (buffer, now, blv->valid, blv->type);
 }
 
 gulong
@@ -214,7 +216,8 @@ buffer_for_each_meta_update_data_cb (GstBuffer * buffer, GstMeta ** meta,
 }
 
 static void
-buffer_update_latency_probe_cb (GstBuffer * buffer, ProbeData * pdata)
+buffer_update_latency_probe_cb (GstBuffer * buffer, GstClockTime now,
+    ProbeData * pdata)
 {
   gst_buffer_foreach_meta (buffer,
       (GstBufferForeachMetaFunc) buffer_for_each_meta_update_data_cb, pdata);
@@ -239,13 +242,14 @@ kms_stats_add_buffer_update_latency_meta_probe (GstPad * pad, gboolean is_valid,
 }
 
 static gboolean
-buffer_for_each_meta_cb (GstBuffer * buffer, GstMeta ** meta, ProbeData * pdata)
+buffer_for_each_meta_cb (GstBuffer * buffer, GstMeta ** meta,
+    MetaIterData * data)
 {
+  ProbeData *pdata = data->pdata;
   BufferLatencyCallback func = (BufferLatencyCallback) pdata->cb;
   GstPad *pad = GST_PAD (pdata->invoke_data);
   KmsBufferLatencyMeta *blmeta;
   GstClockTimeDiff diff;
-  GstClockTime now;
 
   if ((*meta)->info->api != KMS_BUFFER_LATENCY_META_API_TYPE) {
     /* continue iterating */
@@ -263,14 +267,13 @@ buffer_for_each_meta_cb (GstBuffer * buffer, GstMeta ** meta, ProbeData * pdata)
     return TRUE;
   }
 
-  now = kms_utils_get_time_nsecs ();
-  diff = GST_CLOCK_DIFF (blmeta->ts, now);
+  diff = GST_CLOCK_DIFF (blmeta->ts, data->now);
 
   if (pdata->locked) {
     KMS_BUFFER_LATENCY_DATA_LOCK (blmeta);
   }
 
-  func (pad, blmeta->type, diff, blmeta->data, pdata->user_data);
+  func (pad, blmeta->type, diff, &blmeta->data, pdata->user_data);
 
   if (pdata->locked) {
     KMS_BUFFER_LATENCY_DATA_UNLOCK (blmeta);
@@ -280,10 +283,13 @@ buffer_for_each_meta_cb (GstBuffer * buffer, GstMeta ** meta, ProbeData * pdata)
 }
 
 static void
-buffer_latency_calculation_cb (GstBuffer * buffer, ProbeData * pdata)
+buffer_latency_calculation_cb (GstBuffer * buffer, GstClockTime now,
+    ProbeData * pdata)
 {
+  MetaIterData data = { pdata, now };
+
   gst_buffer_foreach_meta (buffer,
-      (GstBufferForeachMetaFunc) buffer_for_each_meta_cb, pdata);
+      (GstBufferForeachMetaFunc) buffer_for_each_meta_cb, &data);
 }
 
 gulong
@@ -0,0 +1,110 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "kmstemporallayermeta.h"
+
+GType
+kms_temporal_layer_meta_api_get_type (void)
+{
+  static volatile GType type;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("KmsTemporalLayerMetaAPI", tags);
+
+    g_once_init_leave (&type, _type);
+  }
+
+  return type;
+}
+
+static gboolean
+kms_temporal_layer_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  KmsTemporalLayerMeta *tmeta = (KmsTemporalLayerMeta *) meta;
+
+  tmeta->tid = -1;
+  tmeta->layer_sync = FALSE;
+  tmeta->non_reference = FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+kms_temporal_layer_meta_transform (GstBuffer * transbuf, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  KmsTemporalLayerMeta *new_meta, *tmeta;
+
+  /* Parsers copy the frame, the layer does not change on any copy */
+  if (!GST_META_TRANSFORM_IS_COPY (type)) {
+    return TRUE;
+  }
+
+  tmeta = (KmsTemporalLayerMeta *) meta;
+  new_meta = kms_buffer_add_temporal_layer_meta (transbuf, tmeta->tid,
+      tmeta->layer_sync);
+
+  if (new_meta == NULL) {
+    return FALSE;
+  }
+
+  new_meta->non_reference = tmeta->non_reference;
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+kms_temporal_layer_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter (&meta_info)) {
+    const GstMetaInfo *mi = gst_meta_register (KMS_TEMPORAL_LAYER_META_API_TYPE,
+        "KmsTemporalLayerMeta",
+        sizeof (KmsTemporalLayerMeta),
+        kms_temporal_layer_meta_init,
+        NULL,
+        kms_temporal_layer_meta_transform);
+
+    g_once_init_leave (&meta_info, mi);
+  }
+
+  return meta_info;
+}
+
+KmsTemporalLayerMeta *
+kms_buffer_add_temporal_layer_meta (GstBuffer * buffer, gint tid,
+    gboolean layer_sync)
+{
+  KmsTemporalLayerMeta *meta;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  meta = kms_buffer_get_temporal_layer_meta (buffer);
+
+  if (meta == NULL) {
+    meta = (KmsTemporalLayerMeta *) gst_buffer_add_meta (buffer,
+        KMS_TEMPORAL_LAYER_META_INFO, NULL);
+  }
+
+  meta->tid = tid;
+  meta->layer_sync = layer_sync;
+
+  return meta;
+}
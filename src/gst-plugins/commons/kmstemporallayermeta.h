@@ -0,0 +1,61 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_TEMPORAL_LAYER_META_H__
+#define __KMS_TEMPORAL_LAYER_META_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KmsTemporalLayerMeta KmsTemporalLayerMeta;
+
+/**
+ * KmsTemporalLayerMeta:
+ * @meta: the parent type
+ * @tid: temporal layer of the frame, -1 if unknown
+ * @layer_sync: the frame only depends on the base layer, so forwarding can
+ * switch up to @tid from it
+ * @non_reference: no other frame depends on this one
+ *
+ * Buffer metadata describing the temporal scalability of an encoded frame.
+ */
+struct _KmsTemporalLayerMeta {
+  GstMeta meta;
+
+  gint tid;
+  gboolean layer_sync;
+  gboolean non_reference;
+};
+
+GType kms_temporal_layer_meta_api_get_type (void);
+#define KMS_TEMPORAL_LAYER_META_API_TYPE \
+  (kms_temporal_layer_meta_api_get_type())
+
+#define kms_buffer_get_temporal_layer_meta(b) \
+  ((KmsTemporalLayerMeta*)gst_buffer_get_meta((b), KMS_TEMPORAL_LAYER_META_API_TYPE))
+
+/* implementation */
+const GstMetaInfo *kms_temporal_layer_meta_get_info (void);
+#define KMS_TEMPORAL_LAYER_META_INFO (kms_temporal_layer_meta_get_info ())
+
+KmsTemporalLayerMeta * kms_buffer_add_temporal_layer_meta (GstBuffer *buffer,
+  gint tid, gboolean layer_sync);
+
+G_END_DECLS
+
+#endif /* __KMS_TEMPORAL_LAYER_META_H__ */
@@ -0,0 +1,177 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "kmsvp8.h"
+
+#define VP8_FRAME_TAG_SIZE 3
+
+void
+kms_vp8_bool_decoder_init (KmsVp8BoolDecoder * d, const guint8 * data,
+    gsize size)
+{
+  d->data = data;
+  d->end = data + size;
+  d->value = 0;
+  d->range = 255;
+  d->bit_count = 0;
+
+  if (d->data < d->end) {
+    d->value = (*d->data++) << 8;
+  }
+
+  if (d->data < d->end) {
+    d->value |= *d->data++;
+  }
+}
+
+guint
+kms_vp8_bool_decoder_read_bool (KmsVp8BoolDecoder * d, guint prob)
+{
+  guint32 split = 1 + (((d->range - 1) * prob) >> 8);
+  guint32 big_split = split << 8;
+  guint ret;
+
+  if (d->value >= big_split) {
+    ret = 1;
+    d->range -= split;
+    d->value -= big_split;
+  } else {
+    ret = 0;
+    d->range = split;
+  }
+
+  while (d->range < 128) {
+    d->value <<= 1;
+    d->range <<= 1;
+
+    if (++d->bit_count == 8) {
+      d->bit_count = 0;
+
+      if (d->data < d->end) {
+        d->value |= *d->data++;
+      }
+    }
+  }
+
+  return ret;
+}
+
+guint
+kms_vp8_bool_decoder_read_literal (KmsVp8BoolDecoder * d, guint bits)
+{
+  guint value = 0;
+
+  while (bits-- > 0) {
+    value = (value << 1) | kms_vp8_bool_decoder_read_bool (d, 128);
+  }
+
+  return value;
+}
+
+/* Skips an optional signed value: flag, magnitude bits and sign */
+static void
+kms_vp8_bool_decoder_skip_delta (KmsVp8BoolDecoder * d, guint bits)
+{
+  if (kms_vp8_bool_decoder_read_literal (d, 1)) {
+    kms_vp8_bool_decoder_read_literal (d, bits + 1);
+  }
+}
+
+/* Encoders signal the upper temporal layers this way. See RFC 6386, 9 */
+gboolean
+kms_vp8_frame_is_non_reference (const guint8 * data, gsize size)
+{
+  KmsVp8BoolDecoder d;
+  guint first_part_size, i;
+  gboolean refresh_golden, refresh_alt, update_map;
+  guint copy_golden = 0, copy_alt = 0;
+
+  if (size < VP8_FRAME_TAG_SIZE || !(data[0] & 0x01)) {
+    /* Key frames are always referenced */
+    return FALSE;
+  }
+
+  first_part_size = (data[0] | (data[1] << 8) | (data[2] << 16)) >> 5;
+  size -= VP8_FRAME_TAG_SIZE;
+  kms_vp8_bool_decoder_init (&d, data + VP8_FRAME_TAG_SIZE,
+      MIN (first_part_size, size));
+
+  /* Segmentation */
+  if (kms_vp8_bool_decoder_read_literal (&d, 1)) {
+    update_map = kms_vp8_bool_decoder_read_literal (&d, 1);
+
+    if (kms_vp8_bool_decoder_read_literal (&d, 1)) {
+      kms_vp8_bool_decoder_read_literal (&d, 1);
+      for (i = 0; i < 4; i++) {
+        kms_vp8_bool_decoder_skip_delta (&d, 7);
+      }
+      for (i = 0; i < 4; i++) {
+        kms_vp8_bool_decoder_skip_delta (&d, 6);
+      }
+    }
+
+    if (update_map) {
+      for (i = 0; i < 3; i++) {
+        if (kms_vp8_bool_decoder_read_literal (&d, 1)) {
+          kms_vp8_bool_decoder_read_literal (&d, 8);
+        }
+      }
+    }
+  }
+
+  /* Filter type, loop filter level and sharpness */
+  kms_vp8_bool_decoder_read_literal (&d, 1 + 6 + 3);
+
+  /* Loop filter adjustments */
+  if (kms_vp8_bool_decoder_read_literal (&d, 1)) {
+    if (kms_vp8_bool_decoder_read_literal (&d, 1)) {
+      for (i = 0; i < 8; i++) {
+        kms_vp8_bool_decoder_skip_delta (&d, 6);
+      }
+    }
+  }
+
+  /* Number of DCT partitions */
+  kms_vp8_bool_decoder_read_literal (&d, 2);
+
+  /* Quantizer indices */
+  kms_vp8_bool_decoder_read_literal (&d, 7);
+  for (i = 0; i < 5; i++) {
+    kms_vp8_bool_decoder_skip_delta (&d, 4);
+  }
+
+  refresh_golden = kms_vp8_bool_decoder_read_literal (&d, 1);
+  refresh_alt = kms_vp8_bool_decoder_read_literal (&d, 1);
+
+  if (!refresh_golden) {
+    copy_golden = kms_vp8_bool_decoder_read_literal (&d, 2);
+  }
+
+  if (!refresh_alt) {
+    copy_alt = kms_vp8_bool_decoder_read_literal (&d, 2);
+  }
+
+  /* Sign bias for golden and altref */
+  kms_vp8_bool_decoder_read_literal (&d, 2);
+
+  if (refresh_golden || refresh_alt || copy_golden != 0 || copy_alt != 0) {
+    return FALSE;
+  }
+
+  /* refresh_entropy_probs and refresh_last */
+  return kms_vp8_bool_decoder_read_literal (&d, 2) == 0;
+}
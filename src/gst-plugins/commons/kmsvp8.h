@@ -0,0 +1,48 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __KMS_VP8_H__
+#define __KMS_VP8_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* VP8 boolean entropy decoder as described in RFC 6386, section 7 */
+typedef struct _KmsVp8BoolDecoder
+{
+  const guint8 *data;
+  const guint8 *end;
+  guint32 value;
+  guint32 range;
+  gint bit_count;
+} KmsVp8BoolDecoder;
+
+void kms_vp8_bool_decoder_init (KmsVp8BoolDecoder * d, const guint8 * data,
+    gsize size);
+guint kms_vp8_bool_decoder_read_bool (KmsVp8BoolDecoder * d, guint prob);
+guint kms_vp8_bool_decoder_read_literal (KmsVp8BoolDecoder * d, guint bits);
+
+/*
+ * TRUE for inter frames updating neither reference buffers nor persistent
+ * entropy probabilities, so no other frame depends on them
+ */
+gboolean kms_vp8_frame_is_non_reference (const guint8 * data, gsize size);
+
+G_END_DECLS
+
+#endif /* __KMS_VP8_H__ */
@@ -163,23 +163,11 @@ end:
   return ret;
 }
 
-static void
-kms_rtp_synchronizer_process_rtcp_packet (KmsRtpSynchronizer * self,
-    GstRTCPPacket * packet, GstClockTime current_time)
+void
+kms_rtp_synchronizer_process_rtcp_sr (KmsRtpSynchronizer * self, guint32 ssrc,
+    guint64 ntp_time, guint32 rtp_time, GstClockTime current_time)
 {
-  GstRTCPType type;
-  guint32 ssrc, rtp_time;
-  guint64 ntp_time, ntp_ns_time;
-
-  type = gst_rtcp_packet_get_type (packet);
-  GST_DEBUG_OBJECT (self, "Received RTCP buffer of type: %d", type);
-
-  if (type != GST_RTCP_TYPE_SR) {
-    return;
-  }
-
-  gst_rtcp_packet_sr_get_sender_info (packet, &ssrc, &ntp_time, &rtp_time,
-      NULL, NULL);
+  guint64 ntp_ns_time;
 
   /* convert ntp_time to nanoseconds */
   ntp_ns_time =
@@ -206,6 +194,28 @@ kms_rtp_synchronizer_process_rtcp_packet (KmsRtpSynchronizer * self,
   KMS_RTP_SYNCHRONIZER_UNLOCK (self);
 }
 
+static void
+kms_rtp_synchronizer_process_rtcp_packet (KmsRtpSynchronizer * self,
+    GstRTCPPacket * packet, GstClockTime current_time)
+{
+  GstRTCPType type;
+  guint32 ssrc, rtp_time;
+  guint64 ntp_time;
+
+  type = gst_rtcp_packet_get_type (packet);
+  GST_DEBUG_OBJECT (self, "Received RTCP buffer of type: %d", type);
+
+  if (type != GST_RTCP_TYPE_SR) {
+    return;
+  }
+
+  gst_rtcp_packet_sr_get_sender_info (packet, &ssrc, &ntp_time, &rtp_time,
+      NULL, NULL);
+
+  kms_rtp_synchronizer_process_rtcp_sr (self, ssrc, ntp_time, rtp_time,
+      current_time);
+}
+
 gboolean
 kms_rtp_synchronizer_process_rtcp_buffer (KmsRtpSynchronizer * self,
     GstBuffer * buffer, GstClockTime current_time, GError ** error)
@@ -301,22 +311,48 @@ kms_rtp_synchronizer_rtp_diff (KmsRtpSynchronizer * self,
       FALSE, FALSE);
 }
 
-gboolean
-kms_rtp_synchronizer_process_rtp_buffer_mapped (KmsRtpSynchronizer * self,
-    GstRTPBuffer * rtp_buffer, GError ** error)
+/* Values written to the stats file once the lock is released */
+typedef struct _KmsRtpSyncStatsData
+{
+  gboolean valid;
+  guint32 ssrc;
+  gint32 clock_rate;
+  guint64 pts_orig;
+  guint64 pts;
+  guint64 dts;
+  guint64 ext_ts;
+  guint64 last_sr_ntp_ns_time;
+  guint64 last_sr_ext_ts;
+} KmsRtpSyncStatsData;
+
+static void
+kms_rtp_synchronizer_write_stats (KmsRtpSynchronizer * self,
+    KmsRtpSyncStatsData * stats)
+{
+  if (!stats->valid) {
+    return;
+  }
+
+  kms_rtp_sync_context_write_stats (self->priv->context, stats->ssrc,
+      stats->clock_rate, stats->pts_orig, stats->pts, stats->dts,
+      stats->ext_ts, stats->last_sr_ntp_ns_time, stats->last_sr_ext_ts);
+}
+
+/* Must be called with the synchronizer lock */
+static gboolean
+kms_rtp_synchronizer_process_rtp_buffer_locked (KmsRtpSynchronizer * self,
+    GstRTPBuffer * rtp_buffer, KmsRtpSyncStatsData * stats, GError ** error)
 {
   GstBuffer *buffer = rtp_buffer->buffer;
-  guint64 pts_orig, ext_ts, last_sr_ext_ts, last_sr_ntp_ns_time;
+  guint64 pts_orig;
   guint64 diff_ntp_ns_time;
   guint8 pt;
   guint32 ssrc, ts;
-  gint32 clock_rate;
   gboolean ret = TRUE;
 
+  stats->valid = FALSE;
   ssrc = gst_rtp_buffer_get_ssrc (rtp_buffer);
 
-  KMS_RTP_SYNCHRONIZER_LOCK (self);
-
   if (self->priv->ssrc == 0) {
     self->priv->ssrc = ssrc;
   } else if (ssrc != self->priv->ssrc) {
@@ -328,8 +364,6 @@ kms_rtp_synchronizer_process_rtp_buffer_mapped (KmsRtpSynchronizer * self,
         msg);
     g_free (msg);
 
-    KMS_RTP_SYNCHRONIZER_UNLOCK (self);
-
     return FALSE;
   }
 
@@ -344,8 +378,6 @@ kms_rtp_synchronizer_process_rtp_buffer_mapped (KmsRtpSynchronizer * self,
         msg);
     g_free (msg);
 
-    KMS_RTP_SYNCHRONIZER_UNLOCK (self);
-
     return FALSE;
   }
 
@@ -436,16 +468,32 @@ kms_rtp_synchronizer_process_rtp_buffer_mapped (KmsRtpSynchronizer * self,
   }
 
 end:
-  clock_rate = self->priv->clock_rate;
-  ext_ts = self->priv->ext_ts;
-  last_sr_ext_ts = self->priv->last_sr_ext_ts;
-  last_sr_ntp_ns_time = self->priv->last_sr_ntp_ns_time;
+  stats->valid = TRUE;
+  stats->ssrc = ssrc;
+  stats->clock_rate = self->priv->clock_rate;
+  stats->pts_orig = pts_orig;
+  stats->pts = GST_BUFFER_PTS (buffer);
+  stats->dts = GST_BUFFER_DTS (buffer);
+  stats->ext_ts = self->priv->ext_ts;
+  stats->last_sr_ntp_ns_time = self->priv->last_sr_ntp_ns_time;
+  stats->last_sr_ext_ts = self->priv->last_sr_ext_ts;
+
+  return ret;
+}
 
+gboolean
+kms_rtp_synchronizer_process_rtp_buffer_mapped (KmsRtpSynchronizer * self,
+    GstRTPBuffer * rtp_buffer, GError ** error)
+{
+  KmsRtpSyncStatsData stats;
+  gboolean ret;
+
+  KMS_RTP_SYNCHRONIZER_LOCK (self);
+  ret = kms_rtp_synchronizer_process_rtp_buffer_locked (self, rtp_buffer,
+      &stats, error);
   KMS_RTP_SYNCHRONIZER_UNLOCK (self);
 
-  kms_rtp_sync_context_write_stats (self->priv->context, ssrc, clock_rate,
-      pts_orig, GST_BUFFER_PTS (buffer), GST_BUFFER_DTS (buffer), ext_ts,
-      last_sr_ntp_ns_time, last_sr_ext_ts);
+  kms_rtp_synchronizer_write_stats (self, &stats);
 
   return ret;
 }
@@ -473,3 +521,54 @@ kms_rtp_synchronizer_process_rtp_buffer (KmsRtpSynchronizer * self,
 
   return ret;
 }
+
+gboolean
+kms_rtp_synchronizer_process_rtp_buffer_list (KmsRtpSynchronizer * self,
+    GstBufferList * list, GError ** error)
+{
+  KmsRtpSyncStatsData *stats;
+  gboolean ret = TRUE;
+  guint i, len;
+
+  len = gst_buffer_list_length (list);
+  stats = g_new (KmsRtpSyncStatsData, len);
+
+  KMS_RTP_SYNCHRONIZER_LOCK (self);
+
+  for (i = 0; i < len; i++) {
+    GstRTPBuffer rtp_buffer = GST_RTP_BUFFER_INIT;
+    GstBuffer *buffer = gst_buffer_list_get (list, i);
+
+    stats[i].valid = FALSE;
+
+    if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp_buffer)) {
+      GST_ERROR_OBJECT (self, "Buffer cannot be mapped as RTP");
+
+      if (ret) {
+        g_set_error_literal (error, KMS_RTP_SYNC_ERROR,
+            KMS_RTP_SYNC_UNEXPECTED_ERROR, "Buffer cannot be mapped as RTP");
+      }
+
+      ret = FALSE;
+      continue;
+    }
+
+    /* Only the first error is reported */
+    if (!kms_rtp_synchronizer_process_rtp_buffer_locked (self, &rtp_buffer,
+            &stats[i], ret ? error : NULL)) {
+      ret = FALSE;
+    }
+
+    gst_rtp_buffer_unmap (&rtp_buffer);
+  }
+
+  KMS_RTP_SYNCHRONIZER_UNLOCK (self);
+
+  for (i = 0; i < len; i++) {
+    kms_rtp_synchronizer_write_stats (self, &stats[i]);
+  }
+
+  g_free (stats);
+
+  return ret;
+}
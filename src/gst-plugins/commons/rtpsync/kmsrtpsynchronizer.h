@@ -104,12 +104,23 @@ gboolean kms_rtp_synchronizer_process_rtcp_buffer (KmsRtpSynchronizer * self,
                                                    GstClockTime current_time,
                                                    GError ** error);
 
+/* Sender info of an SR already decoded, @ntp_time in NTP format */
+void kms_rtp_synchronizer_process_rtcp_sr (KmsRtpSynchronizer * self,
+                                           guint32 ssrc,
+                                           guint64 ntp_time,
+                                           guint32 rtp_time,
+                                           GstClockTime current_time);
+
 gboolean kms_rtp_synchronizer_process_rtp_buffer_mapped (KmsRtpSynchronizer * self,
                                                          GstRTPBuffer * rtp_buffer,
                                                          GError ** error);
 gboolean kms_rtp_synchronizer_process_rtp_buffer (KmsRtpSynchronizer * self,
                                                   GstBuffer * buffer,
                                                   GError ** error);
+/* Same as processing each buffer, locking once for the whole list */
+gboolean kms_rtp_synchronizer_process_rtp_buffer_list (KmsRtpSynchronizer * self,
+                                                       GstBufferList * list,
+                                                       GError ** error);
 
 G_END_DECLS
 
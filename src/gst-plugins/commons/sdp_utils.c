@@ -146,49 +146,58 @@ sdp_utils_media_get_ssrc (const GstSDPMedia * media)
   return ssrc;
 }
 
+/* Returns the SSRCs of the first ssrc-group with the given semantics */
 static gchar **
-sdp_media_get_fid_ssrcs_str (const GstSDPMedia * media)
+sdp_media_get_group_ssrcs_str (const GstSDPMedia * media,
+    const gchar * semantics)
 {
   gchar **ssrcs = NULL;
-  gchar *ssrcs_str;
+  gchar *pattern;
   const gchar *val;
   GRegex *regex;
-  GMatchInfo *match_info = NULL;
+  guint i;
 
-  val = gst_sdp_media_get_attribute_val (media, "ssrc-group");
-  if (val == NULL) {
-    return NULL;
-  }
+  pattern = g_strdup_printf ("^%s (?<ssrcs>[0-9\\ ]+)$", semantics);
+  regex = g_regex_new (pattern, 0, 0, NULL);
+  g_free (pattern);
 
-  regex = g_regex_new ("^FID (?<ssrcs>[0-9\\ ]+)$", 0, 0, NULL);
-  g_regex_match (regex, val, 0, &match_info);
-  g_regex_unref (regex);
+  for (i = 0; ssrcs == NULL
+      && (val = gst_sdp_media_get_attribute_val_n (media, "ssrc-group",
+              i)) != NULL; i++) {
+    GMatchInfo *match_info = NULL;
 
-  if (g_match_info_matches (match_info)) {
-    ssrcs_str = g_match_info_fetch_named (match_info, "ssrcs");
-    ssrcs = g_strsplit (ssrcs_str, " ", 0);
-    g_free (ssrcs_str);
+    g_regex_match (regex, val, 0, &match_info);
+
+    if (g_match_info_matches (match_info)) {
+      gchar *ssrcs_str = g_match_info_fetch_named (match_info, "ssrcs");
+
+      ssrcs = g_strsplit (ssrcs_str, " ", 0);
+      g_free (ssrcs_str);
+    }
+    g_match_info_free (match_info);
   }
-  g_match_info_free (match_info);
+
+  g_regex_unref (regex);
 
   return ssrcs;
 }
 
-guint
-sdp_utils_media_get_fid_ssrc (const GstSDPMedia * media, guint pos)
+static guint
+sdp_media_get_group_ssrc (const GstSDPMedia * media, const gchar * semantics,
+    guint pos)
 {
   gchar **ssrcs;
   guint ssrc = 0;
   guint len;
 
-  ssrcs = sdp_media_get_fid_ssrcs_str (media);
+  ssrcs = sdp_media_get_group_ssrcs_str (media, semantics);
   if (ssrcs == NULL) {
     return 0;
   }
 
   len = g_strv_length (ssrcs);
   if (len <= pos) {
-    GST_WARNING ("Pos '%u' greater than len '%u'", pos, len);
+    GST_DEBUG ("Pos '%u' greater than %s group len '%u'", pos, semantics, len);
   } else {
     ssrc = ssrc_str_to_uint (ssrcs[pos]);
   }
@@ -198,6 +207,19 @@ sdp_utils_media_get_fid_ssrc (const GstSDPMedia * media, guint pos)
   return ssrc;
 }
 
+guint
+sdp_utils_media_get_fid_ssrc (const GstSDPMedia * media, guint pos)
+{
+  return sdp_media_get_group_ssrc (media, "FID", pos);
+}
+
+/* Simulcast layers, signalled with a=ssrc-group:SIM */
+guint
+sdp_utils_media_get_sim_ssrc (const GstSDPMedia * media, guint pos)
+{
+  return sdp_media_get_group_ssrc (media, "SIM", pos);
+}
+
 GstSDPDirection
 sdp_utils_media_config_get_direction (const GstSDPMedia * media)
 {
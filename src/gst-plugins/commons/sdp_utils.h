@@ -41,6 +41,7 @@ gboolean sdp_utils_is_attribute_in_media (const GstSDPMedia * media, const GstSD
 gboolean sdp_utils_attribute_is_direction (const GstSDPAttribute * attr, GstSDPDirection * direction);
 guint sdp_utils_media_get_ssrc (const GstSDPMedia * media);
 guint sdp_utils_media_get_fid_ssrc (const GstSDPMedia * media, guint pos);
+guint sdp_utils_media_get_sim_ssrc (const GstSDPMedia * media, guint pos);
 GstSDPDirection sdp_utils_media_config_get_direction (const GstSDPMedia * media);
 gboolean sdp_utils_media_config_set_direction (GstSDPMedia * media, GstSDPDirection direction);
 
@@ -26,12 +26,25 @@
 #include "kmsdectreebin.h"
 #include "kmsenctreebin.h"
 #include "kmsrtppaytreebin.h"
+#include "kmstemporallayermeta.h"
 
 #define PLUGIN_NAME "agnosticbin"
 
 #define UNLINKING_DATA "unlinking-data"
 G_DEFINE_QUARK (UNLINKING_DATA, unlinking_data);
 
+#define LINKED_BIN_DATA "linked-bin-data"
+G_DEFINE_QUARK (LINKED_BIN_DATA, linked_bin_data);
+
+#define SELECTOR_DATA "selector-data"
+G_DEFINE_QUARK (SELECTOR_DATA, selector_data);
+
+#define LAYER_DATA "layer-data"
+G_DEFINE_QUARK (LAYER_DATA, layer_data);
+
+#define TEMPORAL_FILTER_DATA "temporal-filter-data"
+G_DEFINE_QUARK (TEMPORAL_FILTER_DATA, temporal_filter_data);
+
 #define KMS_AGNOSTIC_PAD_STARTED (GST_PAD_FLAG_LAST << 1)
 
 static GstStaticCaps static_raw_audio_caps =
@@ -71,6 +84,7 @@ G_DEFINE_TYPE (KmsAgnosticBin2, kms_agnostic_bin2, GST_TYPE_BIN);
 struct _KmsAgnosticBin2Private
 {
   GHashTable *bins;
+  GHashTable *bins_by_caps;     /* caps string -> GstBin (not owned) */
 
   GRecMutex thread_mutex;
 
@@ -78,11 +92,15 @@ struct _KmsAgnosticBin2Private
   GstCaps *input_caps;
   GstBin *input_bin;
   GstCaps *input_bin_src_caps;
+  gulong input_caps_update_probe_id;
 
   GstPad *sink;
   guint pad_count;
   gboolean started;
 
+  GPtrArray *layers;
+  guint layer_count;
+
   GThreadPool *remove_pool;
 
   gint max_bitrate;
@@ -112,17 +130,117 @@ static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src_%u",
     GST_PAD_REQUEST,
     GST_STATIC_CAPS_ANY);
 
+/* Additional encodings of the same media, e.g. simulcast layers */
+static GstStaticPadTemplate sink_layer_factory =
+GST_STATIC_PAD_TEMPLATE ("sink_layer_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (KMS_AGNOSTIC_NO_RTP_CAPS_CAPS));
+
+typedef struct _KmsAgnosticBin2Layer
+{
+  GstElement *tee;
+  GstElement *fakesink;
+  GstBin *parse_bin;
+} KmsAgnosticBin2Layer;
+
+typedef struct _KmsAgnosticBin2SelectorInput
+{
+  GstBin *bin;
+  GstPad *sink;
+} KmsAgnosticBin2SelectorInput;
+
+typedef struct _KmsAgnosticBin2Selector
+{
+  GstElement *selector;
+  GSList *inputs;
+  gulong remb_probe_id;
+  GstPad *src;
+
+  GMutex mutex;
+  GstPad *pending;
+  gulong pending_probe_id;
+} KmsAgnosticBin2Selector;
+
+typedef struct _KmsAgnosticBin2TemporalFilter
+{
+  KmsParseTreeBin *bin;
+  GstPad *src;
+  gulong remb_probe_id;
+  gulong buffer_probe_id;
+  guint remb;
+  guint dropped;
+
+  /* Only used from the streaming thread of the pad */
+  gboolean congested;
+  gint max_tid;                 /* Highest layer forwarded, G_MAXINT for all */
+} KmsAgnosticBin2TemporalFilter;
+
 static gboolean kms_agnostic_bin2_process_pad (KmsAgnosticBin2 * self,
     GstPad * pad);
 
 static GstBin *kms_agnostic_bin2_find_or_create_bin_for_caps (KmsAgnosticBin2 *
     self, GstCaps * caps);
 
+static gboolean kms_agnostic_bin2_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
+static GstFlowReturn kms_agnostic_bin2_sink_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buffer);
+static GstFlowReturn kms_agnostic_bin2_sink_chain_list (GstPad * pad,
+    GstObject * parent, GstBufferList * list);
+
+static void
+kms_agnostic_bin2_layer_free (KmsAgnosticBin2Layer * layer)
+{
+  /* Elements are owned by the agnosticbin */
+  g_slice_free (KmsAgnosticBin2Layer, layer);
+}
+
+/*
+ * Stores @bin and, when @caps is given, indexes it so that following
+ * lookups for the same caps are resolved without scanning the tree bins.
+ * Should be called with the agnostic lock held.
+ */
 static void
-kms_agnostic_bin2_insert_bin (KmsAgnosticBin2 * self, GstBin * bin)
+kms_agnostic_bin2_insert_bin (KmsAgnosticBin2 * self, GstBin * bin,
+    const GstCaps * caps)
 {
   g_hash_table_insert (self->priv->bins, GST_OBJECT_NAME (bin),
       g_object_ref (bin));
+
+  if (caps != NULL && !gst_caps_is_any (caps) && !gst_caps_is_empty (caps)) {
+    g_hash_table_insert (self->priv->bins_by_caps, gst_caps_to_string (caps),
+        bin);
+  }
+}
+
+static gboolean
+index_entry_points_to_bin (gpointer key, gpointer value, gpointer bin)
+{
+  return value == bin;
+}
+
+/*
+ * Drops every index entry resolving to @bin, to be used when it is removed.
+ * Should be called with the agnostic lock held.
+ */
+static void
+kms_agnostic_bin2_unindex_bin (KmsAgnosticBin2 * self, GstBin * bin)
+{
+  g_hash_table_foreach_remove (self->priv->bins_by_caps,
+      index_entry_points_to_bin, bin);
+}
+
+/*
+ * Lookup results also depend on the input caps, so the whole index must be
+ * invalidated when they change.
+ * Should be called with the agnostic lock held.
+ */
+static void
+kms_agnostic_bin2_invalidate_caps_index (KmsAgnosticBin2 * self)
+{
+  GST_TRACE_OBJECT (self, "Invalidating caps index");
+  g_hash_table_remove_all (self->priv->bins_by_caps);
 }
 
 /*
@@ -351,6 +469,10 @@ remove_target_pad (GstPad * pad)
 
   GST_DEBUG_OBJECT (pad, "Removing target pad");
 
+  g_object_set_qdata (G_OBJECT (pad), linked_bin_data_quark (), NULL);
+  g_object_set_qdata (G_OBJECT (pad), selector_data_quark (), NULL);
+  g_object_set_qdata (G_OBJECT (pad), temporal_filter_data_quark (), NULL);
+
   if (target == NULL) {
     return;
   }
@@ -463,6 +585,29 @@ kms_agnostic_bin2_link_to_tee (KmsAgnosticBin2 * self, GstPad * pad,
   link_element_to_tee (tee, queue);
 }
 
+/**
+ * Check if caps can be served by a bin producing current_caps
+ *
+ * @caps: The requested caps
+ * @current_caps: (transfer full): The caps produced by the bin
+ */
+static gboolean
+caps_can_intersect_without_features (const GstCaps * caps,
+    GstCaps * current_caps)
+{
+  //TODO: Remove this when problem in negotiation with features will be
+  //resolved
+  GstCaps *caps_without_features = gst_caps_make_writable (current_caps);
+  gboolean ret;
+
+  gst_caps_set_features (caps_without_features, 0,
+      gst_caps_features_new_empty ());
+  ret = gst_caps_can_intersect (caps, caps_without_features);
+  gst_caps_unref (caps_without_features);
+
+  return ret;
+}
+
 static gboolean
 check_bin (KmsTreeBin * tree_bin, const GstCaps * caps)
 {
@@ -481,16 +626,7 @@ check_bin (KmsTreeBin * tree_bin, const GstCaps * caps)
   }
 
   if (current_caps != NULL) {
-    //TODO: Remove this when problem in negotiation with features will be
-    //resolved
-    GstCaps *caps_without_features = gst_caps_make_writable (current_caps);
-
-    gst_caps_set_features (caps_without_features, 0,
-        gst_caps_features_new_empty ());
-    if (gst_caps_can_intersect (caps, caps_without_features)) {
-      ret = TRUE;
-    }
-    gst_caps_unref (caps_without_features);
+    ret = caps_can_intersect_without_features (caps, current_caps);
   }
 
   g_object_unref (tee_sink);
@@ -498,16 +634,43 @@ check_bin (KmsTreeBin * tree_bin, const GstCaps * caps)
   return ret;
 }
 
+static gboolean
+kms_agnostic_bin2_has_bin (KmsAgnosticBin2 * self, GstBin * bin)
+{
+  if (bin == self->priv->input_bin) {
+    return TRUE;
+  }
+
+  return g_hash_table_lookup (self->priv->bins,
+      GST_OBJECT_NAME (bin)) == bin;
+}
+
 static GstBin *
 kms_agnostic_bin2_find_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
 {
   GList *bins, *l;
   GstBin *bin = NULL;
+  gchar *key;
 
   if (gst_caps_is_any (caps) || gst_caps_is_empty (caps)) {
     return self->priv->input_bin;
   }
 
+  key = gst_caps_to_string (caps);
+  bin = g_hash_table_lookup (self->priv->bins_by_caps, key);
+
+  if (bin != NULL) {
+    if (kms_agnostic_bin2_has_bin (self, bin)) {
+      GST_TRACE_OBJECT (self, "Caps index hit for %s: %" GST_PTR_FORMAT, key,
+          bin);
+      g_free (key);
+      return bin;
+    }
+
+    g_hash_table_remove (self->priv->bins_by_caps, key);
+    bin = NULL;
+  }
+
   if (check_bin (KMS_TREE_BIN (self->priv->input_bin), caps)) {
     bin = self->priv->input_bin;
   }
@@ -522,6 +685,13 @@ kms_agnostic_bin2_find_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
   }
   g_list_free (bins);
 
+  if (bin != NULL) {
+    /* Key ownership is transferred to the index */
+    g_hash_table_insert (self->priv->bins_by_caps, key, bin);
+  } else {
+    g_free (key);
+  }
+
   return bin;
 }
 
@@ -589,7 +759,7 @@ kms_agnostic_bin2_get_or_create_dec_bin (KmsAgnosticBin2 * self, GstCaps * caps)
       dec_bin = kms_agnostic_bin2_create_dec_bin (self, raw_caps);
 
       if (dec_bin != NULL) {
-        kms_agnostic_bin2_insert_bin (self, dec_bin);
+        kms_agnostic_bin2_insert_bin (self, dec_bin, raw_caps);
       }
     }
 
@@ -627,9 +797,17 @@ kms_agnostic_bin2_create_rtp_pay_bin (KmsAgnosticBin2 * self, GstCaps * caps)
   g_object_unref (sink);
 
   enc_bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, input_caps);
-  kms_agnostic_bin2_insert_bin (self, GST_BIN (bin));
   gst_caps_unref (input_caps);
 
+  if (enc_bin == NULL) {
+    gst_element_set_locked_state (GST_ELEMENT (bin), TRUE);
+    gst_element_set_state (GST_ELEMENT (bin), GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (self), GST_ELEMENT (bin));
+    return NULL;
+  }
+
+  kms_agnostic_bin2_insert_bin (self, GST_BIN (bin), caps);
+
   output_tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (enc_bin));
   gst_element_link (output_tee, input_element);
 
@@ -642,6 +820,7 @@ kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
   GstBin *dec_bin;
   KmsEncTreeBin *enc_bin;
   GstElement *input_element, *output_tee;
+  GstCaps *raw_caps;
 
   if (kms_utils_caps_are_rtp (caps)) {
     return kms_agnostic_bin2_create_rtp_pay_bin (self, caps);
@@ -656,11 +835,22 @@ kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
     return dec_bin;
   }
 
+  /* Decoded caps, if already negotiated, let the encoder keep its context */
+  raw_caps = kms_tree_bin_get_input_caps (KMS_TREE_BIN (dec_bin));
   enc_bin =
-      kms_enc_tree_bin_new (caps, TARGET_BITRATE_DEFAULT,
+      kms_enc_tree_bin_new (caps, raw_caps, TARGET_BITRATE_DEFAULT,
       self->priv->min_bitrate, self->priv->max_bitrate,
       self->priv->codec_config);
+
+  if (raw_caps != NULL) {
+    gst_caps_unref (raw_caps);
+  }
+
   if (enc_bin == NULL) {
+    /* No encoder for the caps, or the maximum number of them is in use */
+    GST_ELEMENT_WARNING (self, RESOURCE, FAILED,
+        ("Cannot create an encoder"),
+        ("Encoder for %" GST_PTR_FORMAT " not available", caps));
     return NULL;
   }
 
@@ -671,7 +861,7 @@ kms_agnostic_bin2_create_bin_for_caps (KmsAgnosticBin2 * self, GstCaps * caps)
   input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (enc_bin));
   gst_element_link (output_tee, input_element);
 
-  kms_agnostic_bin2_insert_bin (self, GST_BIN (enc_bin));
+  kms_agnostic_bin2_insert_bin (self, GST_BIN (enc_bin), caps);
 
   return GST_BIN (enc_bin);
 }
@@ -692,199 +882,833 @@ kms_agnostic_bin2_find_or_create_bin_for_caps (KmsAgnosticBin2 * self,
   return bin;
 }
 
-/**
- * Link a pad internally
- *
- * @self: The #KmsAgnosticBin2 owner of the pad
- * @pad: (transfer full): The pad to be linked
- * @peer: (transfer full): The peer pad
- */
 static void
-kms_agnostic_bin2_link_pad (KmsAgnosticBin2 * self, GstPad * pad, GstPad * peer)
+kms_agnostic_bin2_selector_input_destroy (KmsAgnosticBin2SelectorInput * input)
 {
-  GstCaps *caps;
-  GstBin *bin;
-
-  GST_INFO_OBJECT (self, "Linking: %" GST_PTR_FORMAT, pad);
-
-  caps = gst_pad_query_caps (peer, NULL);
+  g_object_unref (input->sink);
+  g_slice_free (KmsAgnosticBin2SelectorInput, input);
+}
 
-  if (caps == NULL) {
-    goto end;
+static void
+kms_agnostic_bin2_selector_destroy (KmsAgnosticBin2Selector * data)
+{
+  if (data->remb_probe_id != 0) {
+    gst_pad_remove_probe (data->src, data->remb_probe_id);
   }
 
-  GST_DEBUG ("Query caps are: %" GST_PTR_FORMAT, caps);
-  bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, caps);
-
-  if (bin != NULL) {
-    GstElement *tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (bin));
-
-    if (!kms_utils_caps_are_rtp (caps)) {
-      kms_utils_drop_until_keyframe (pad, TRUE);
-    }
-    kms_agnostic_bin2_link_to_tee (self, pad, tee, caps);
+  g_mutex_lock (&data->mutex);
+  if (data->pending != NULL) {
+    gst_pad_remove_probe (data->pending, data->pending_probe_id);
+    data->pending = NULL;
   }
+  g_mutex_unlock (&data->mutex);
 
-  gst_caps_unref (caps);
-
-end:
-  g_object_unref (peer);
+  g_slist_free_full (data->inputs,
+      (GDestroyNotify) kms_agnostic_bin2_selector_input_destroy);
+  g_object_unref (data->selector);
+  g_mutex_clear (&data->mutex);
+  g_slice_free (KmsAgnosticBin2Selector, data);
 }
 
-/**
- * Process a pad for connecting or disconnecting, it should be always called
- * whint the agnostic lock hold.
- *
- * @self: The #KmsAgnosticBin2 owner of the pad
- * @pad: The pad to be processed
- */
-static gboolean
-kms_agnostic_bin2_process_pad (KmsAgnosticBin2 * self, GstPad * pad)
+static GstPadProbeReturn
+switch_on_keyframe_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
 {
-  GstPad *peer = NULL;
-
-  if (!GST_OBJECT_FLAG_IS_SET (pad, KMS_AGNOSTIC_PAD_STARTED)) {
-    return FALSE;
-  }
+  KmsAgnosticBin2Selector *data = user_data;
+  GstBuffer *buffer;
 
-  if (!self->priv->started) {
-    return FALSE;
-  }
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    buffer = gst_pad_probe_info_get_buffer (info);
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
 
-  GST_DEBUG_OBJECT (self, "Processing pad: %" GST_PTR_FORMAT, pad);
+    if (gst_buffer_list_length (list) == 0) {
+      return GST_PAD_PROBE_OK;
+    }
 
-  if (pad == NULL) {
-    return FALSE;
+    buffer = gst_buffer_list_get (list, 0);
+  } else {
+    return GST_PAD_PROBE_OK;
   }
 
-  peer = gst_pad_get_peer (pad);
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    return GST_PAD_PROBE_OK;
+  }
 
-  if (peer != NULL) {
-    GstPad *target = gst_ghost_pad_get_target (GST_GHOST_PAD (pad));
+  g_mutex_lock (&data->mutex);
+  if (data->pending != pad) {
+    g_mutex_unlock (&data->mutex);
+    return GST_PAD_PROBE_REMOVE;
+  }
 
-    if (target) {
-      GstCaps *caps = gst_pad_get_current_caps (pad);
+  data->pending = NULL;
+  data->pending_probe_id = 0;
+  g_mutex_unlock (&data->mutex);
 
-      if (caps != NULL) {
-        gboolean accepted;
+  GST_DEBUG_OBJECT (data->selector, "Switching to layer %" GST_PTR_FORMAT,
+      pad);
+  g_object_set (data->selector, "active-pad", pad, NULL);
 
-        accepted = gst_pad_query_accept_caps (peer, caps);
-        gst_caps_unref (caps);
+  return GST_PAD_PROBE_REMOVE;
+}
 
-        if (accepted) {
-          GST_DEBUG_OBJECT (self, "No need to reconfigure pad %" GST_PTR_FORMAT,
-              pad);
-          g_object_unref (target);
-          g_object_unref (peer);
-          return FALSE;
-        }
+static KmsAgnosticBin2SelectorInput *
+kms_agnostic_bin2_selector_choose (KmsAgnosticBin2Selector * data,
+    guint bitrate)
+{
+  KmsAgnosticBin2SelectorInput *best = NULL, *lowest = NULL;
+  guint best_br = 0, lowest_br = G_MAXUINT;
+  GSList *l;
 
-        remove_target_pad (pad);
-      }
+  for (l = data->inputs; l != NULL; l = l->next) {
+    KmsAgnosticBin2SelectorInput *input = l->data;
+    guint br = kms_parse_tree_bin_get_bitrate (KMS_PARSE_TREE_BIN (input->bin));
 
-      g_object_unref (target);
+    if (br == 0) {
+      /* No media measured yet */
+      continue;
     }
 
-    kms_agnostic_bin2_link_pad (self, pad, peer);
-  }
-
-  return TRUE;
-}
+    if (br < lowest_br) {
+      lowest = input;
+      lowest_br = br;
+    }
 
-static void
-add_linked_pads (GstPad * pad, KmsAgnosticBin2 * self)
-{
-  if (!gst_pad_is_linked (pad)) {
-    return;
+    if (br <= bitrate && br > best_br) {
+      best = input;
+      best_br = br;
+    }
   }
 
-  remove_target_pad (pad);
-  kms_agnostic_bin2_process_pad (self, pad);
+  return best != NULL ? best : lowest;
 }
 
 static GstPadProbeReturn
-input_bin_src_caps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer bin)
+selector_remb_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
 {
-  KmsAgnosticBin2 *self = KMS_AGNOSTIC_BIN2 (GST_OBJECT_PARENT (bin));
+  KmsAgnosticBin2Selector *data = user_data;
   GstEvent *event = gst_pad_probe_info_get_event (info);
-  GstCaps *current_caps;
+  KmsAgnosticBin2SelectorInput *input;
+  GstPad *active;
+  guint bitrate, ssrc;
 
-  if (self == NULL) {
-    GST_WARNING_OBJECT (bin, "Parent agnosticbin seems to be released");
+  if (!kms_utils_remb_event_upstream_parse (event, &bitrate, &ssrc)) {
     return GST_PAD_PROBE_OK;
   }
 
-  GST_TRACE_OBJECT (self, "Event in parser pad: %" GST_PTR_FORMAT, event);
+  input = kms_agnostic_bin2_selector_choose (data, bitrate);
 
-  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS) {
+  if (input == NULL) {
     return GST_PAD_PROBE_OK;
   }
 
-  KMS_AGNOSTIC_BIN2_LOCK (self);
+  g_object_get (data->selector, "active-pad", &active, NULL);
 
-  self->priv->started = TRUE;
-  if (self->priv->input_bin_src_caps != NULL) {
-    gst_caps_unref (self->priv->input_bin_src_caps);
+  g_mutex_lock (&data->mutex);
+
+  if (input->sink == active || input->sink == data->pending) {
+    goto end;
   }
 
-  gst_event_parse_caps (event, &current_caps);
-  self->priv->input_bin_src_caps = gst_caps_copy (current_caps);
-  kms_agnostic_bin2_insert_bin (self, GST_BIN (bin));
+  if (data->pending != NULL) {
+    gst_pad_remove_probe (data->pending, data->pending_probe_id);
+  }
 
-  GST_INFO_OBJECT (self, "Setting current caps to: %" GST_PTR_FORMAT,
-      current_caps);
+  GST_DEBUG_OBJECT (pad, "Estimated bitrate %u, switching to %" GST_PTR_FORMAT
+      " on next key frame", bitrate, input->bin);
 
-  kms_element_for_each_src_pad (GST_ELEMENT (self),
-      (KmsPadIterationAction) add_linked_pads, self);
+  data->pending = input->sink;
+  data->pending_probe_id = gst_pad_add_probe (input->sink,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      switch_on_keyframe_probe, data, NULL);
+  kms_utils_drop_until_keyframe (input->sink, TRUE);
 
-  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+end:
+  g_mutex_unlock (&data->mutex);
 
-  return GST_PAD_PROBE_REMOVE;
+  if (active != NULL) {
+    g_object_unref (active);
+  }
+
+  /* Upstream elements still need the estimation */
+  return GST_PAD_PROBE_OK;
 }
 
-static void
-remove_bin (gpointer key, gpointer value, gpointer agnosticbin)
+static GstPad *
+kms_agnostic_bin2_selector_add_input (KmsAgnosticBin2 * self,
+    KmsAgnosticBin2Selector * data, GstBin * bin)
 {
-  GST_DEBUG_OBJECT (agnosticbin, "Removing %" GST_PTR_FORMAT, value);
-  gst_bin_remove (GST_BIN (agnosticbin), value);
-  gst_element_set_state (value, GST_STATE_NULL);
+  KmsAgnosticBin2SelectorInput *input;
+  GstElement *queue = gst_element_factory_make ("queue", NULL);
+  GstPad *queue_src;
+
+  input = g_slice_new0 (KmsAgnosticBin2SelectorInput);
+  input->bin = bin;
+  input->sink = gst_element_get_request_pad (data->selector, "sink_%u");
+  data->inputs = g_slist_append (data->inputs, input);
+
+  gst_bin_add (GST_BIN (self), queue);
+  gst_element_sync_state_with_parent (queue);
+
+  queue_src = gst_element_get_static_pad (queue, "src");
+  gst_pad_link_full (queue_src, input->sink, GST_PAD_LINK_CHECK_NOTHING);
+  g_object_unref (queue_src);
+
+  link_element_to_tee (kms_tree_bin_get_output_tee (KMS_TREE_BIN (bin)),
+      queue);
+
+  return input->sink;
 }
 
+/*
+ * Forwards one of the available encodings without transcoding, selecting
+ * the one that fits the bitrate estimated by the peer.
+ */
 static void
-kms_agnostic_bin2_configure_input (KmsAgnosticBin2 * self, const GstCaps * caps)
+kms_agnostic_bin2_link_to_selector (KmsAgnosticBin2 * self, GstPad * pad,
+    GstCaps * caps)
 {
-  KmsParseTreeBin *parse_bin;
-  GstElement *parser;
-  GstPad *parser_src;
-  GstElement *input_element;
+  KmsAgnosticBin2Selector *data;
+  GstPad *main_sink, *target;
+  GstProxyPad *proxy;
+  guint i;
 
-  KMS_AGNOSTIC_BIN2_LOCK (self);
+  data = g_slice_new0 (KmsAgnosticBin2Selector);
+  g_mutex_init (&data->mutex);
+  data->src = pad;
+  data->selector = gst_element_factory_make ("input-selector", NULL);
+  g_object_ref (data->selector);
 
-  if (self->priv->input_bin != NULL) {
-    kms_tree_bin_unlink_input_element_from_tee (KMS_TREE_BIN (self->
-            priv->input_bin));
-  }
+  remove_element_on_unlinked (data->selector, "src", "sink");
+  gst_bin_add (GST_BIN (self), data->selector);
+  gst_element_sync_state_with_parent (data->selector);
 
-  parse_bin = kms_parse_tree_bin_new (caps);
-  self->priv->input_bin = GST_BIN (parse_bin);
+  main_sink =
+      kms_agnostic_bin2_selector_add_input (self, data, self->priv->input_bin);
 
-  parser = kms_parse_tree_bin_get_parser (KMS_PARSE_TREE_BIN (parse_bin));
-  parser_src = gst_element_get_static_pad (parser, "src");
-  gst_pad_add_probe (parser_src, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
-      input_bin_src_caps_probe, g_object_ref (parse_bin), g_object_unref);
-  g_object_unref (parser_src);
+  for (i = 0; i < self->priv->layers->len; i++) {
+    KmsAgnosticBin2Layer *layer = g_ptr_array_index (self->priv->layers, i);
 
-  gst_bin_add (GST_BIN (self), GST_ELEMENT (parse_bin));
-  gst_element_sync_state_with_parent (GST_ELEMENT (parse_bin));
+    if (layer->parse_bin != NULL
+        && check_bin (KMS_TREE_BIN (layer->parse_bin), caps)) {
+      kms_agnostic_bin2_selector_add_input (self, data, layer->parse_bin);
+    }
+  }
 
-  input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (parse_bin));
-  gst_element_link (self->priv->input_tee, input_element);
+  g_object_set (data->selector, "active-pad", main_sink, NULL);
 
-  self->priv->started = FALSE;
+  target = gst_element_get_static_pad (data->selector, "src");
+  gst_ghost_pad_set_target (GST_GHOST_PAD (pad), target);
+  g_object_unref (target);
 
-  GST_DEBUG ("Removing old treebins");
-  g_hash_table_foreach (self->priv->bins, remove_bin, self);
-  g_hash_table_remove_all (self->priv->bins);
+  proxy = gst_proxy_pad_get_internal (GST_PROXY_PAD (pad));
+  gst_pad_set_query_function (GST_PAD_CAST (proxy),
+      proxy_src_pad_query_function);
+  g_object_unref (proxy);
+
+  data->remb_probe_id = gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, selector_remb_probe, data, NULL);
+
+  g_object_set_qdata_full (G_OBJECT (pad), selector_data_quark (), data,
+      (GDestroyNotify) kms_agnostic_bin2_selector_destroy);
+}
+
+static gboolean
+kms_agnostic_bin2_has_layers (KmsAgnosticBin2 * self)
+{
+  guint i;
+
+  for (i = 0; i < self->priv->layers->len; i++) {
+    KmsAgnosticBin2Layer *layer = g_ptr_array_index (self->priv->layers, i);
+
+    if (layer->parse_bin != NULL) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static void
+kms_agnostic_bin2_temporal_filter_destroy (KmsAgnosticBin2TemporalFilter * data)
+{
+  gst_pad_remove_probe (data->src, data->remb_probe_id);
+  gst_pad_remove_probe (data->src, data->buffer_probe_id);
+
+  GST_DEBUG_OBJECT (data->src, "Dropped %u frames of upper temporal layers",
+      data->dropped);
+
+  g_object_unref (data->bin);
+  g_slice_free (KmsAgnosticBin2TemporalFilter, data);
+}
+
+static GstPadProbeReturn
+temporal_filter_remb_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  KmsAgnosticBin2TemporalFilter *data = user_data;
+  GstEvent *event = gst_pad_probe_info_get_event (info);
+  guint bitrate, ssrc;
+
+  if (kms_utils_remb_event_upstream_parse (event, &bitrate, &ssrc)) {
+    g_atomic_int_set (&data->remb, bitrate);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/*
+ * The forwarded layers only change where the decoder does not miss any
+ * reference: down on base layer frames, up on layer sync frames and to
+ * any layer on key frames.
+ */
+static gboolean
+temporal_filter_check_buffer (KmsAgnosticBin2TemporalFilter * data,
+    GstBuffer * buffer)
+{
+  KmsTemporalLayerMeta *meta;
+  gint target = data->congested ? 0 : G_MAXINT;
+
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    data->max_tid = target;
+    return TRUE;
+  }
+
+  meta = kms_buffer_get_temporal_layer_meta (buffer);
+
+  if (meta == NULL) {
+    return TRUE;
+  }
+
+  if (meta->tid < 0) {
+    /* Layer unknown, only frames nothing depends on can be dropped */
+    return !(data->congested && meta->non_reference);
+  }
+
+  if (meta->tid == 0 && target < data->max_tid) {
+    data->max_tid = target;
+  } else if (meta->layer_sync && meta->tid > data->max_tid
+      && meta->tid <= target) {
+    data->max_tid = meta->tid;
+  }
+
+  return meta->tid <= data->max_tid;
+}
+
+static gboolean
+temporal_filter_check_list (GstBuffer ** buffer, guint idx, gpointer user_data)
+{
+  KmsAgnosticBin2TemporalFilter *data = user_data;
+
+  if (!temporal_filter_check_buffer (data, *buffer)) {
+    gst_buffer_unref (*buffer);
+    *buffer = NULL;
+    data->dropped++;
+  }
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+temporal_filter_buffer_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  KmsAgnosticBin2TemporalFilter *data = user_data;
+  guint remb, bitrate;
+  gboolean congested;
+
+  remb = g_atomic_int_get (&data->remb);
+  bitrate = kms_parse_tree_bin_get_bitrate (data->bin);
+  congested = remb != 0 && bitrate != 0 && remb < bitrate;
+
+  if (congested != data->congested) {
+    GST_DEBUG_OBJECT (pad, "Estimated %u, input %u, %s upper temporal layers",
+        remb, bitrate, congested ? "dropping" : "forwarding");
+    data->congested = congested;
+  }
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buffer = gst_pad_probe_info_get_buffer (info);
+
+    if (temporal_filter_check_buffer (data, buffer)) {
+      return GST_PAD_PROBE_OK;
+    }
+
+    GST_TRACE_OBJECT (pad, "Dropping %" GST_PTR_FORMAT, buffer);
+    data->dropped++;
+
+    return GST_PAD_PROBE_DROP;
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = gst_pad_probe_info_get_buffer_list (info);
+
+    list = gst_buffer_list_make_writable (list);
+    gst_buffer_list_foreach (list, temporal_filter_check_list, data);
+    GST_PAD_PROBE_INFO_DATA (info) = list;
+
+    if (gst_buffer_list_length (list) == 0) {
+      return GST_PAD_PROBE_DROP;
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/*
+ * When an encoding is forwarded as is, frames no other frame depends on
+ * can be dropped while the peer cannot receive the full input bitrate.
+ */
+static void
+kms_agnostic_bin2_add_temporal_filter (KmsAgnosticBin2 * self, GstPad * pad)
+{
+  KmsAgnosticBin2TemporalFilter *data;
+
+  if (!KMS_IS_PARSE_TREE_BIN (self->priv->input_bin)) {
+    return;
+  }
+
+  data = g_slice_new0 (KmsAgnosticBin2TemporalFilter);
+  data->bin = g_object_ref (self->priv->input_bin);
+  data->src = pad;
+  /* All the layers until the first REMB */
+  data->max_tid = G_MAXINT;
+
+  data->remb_probe_id = gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_EVENT_UPSTREAM, temporal_filter_remb_probe, data,
+      NULL);
+  data->buffer_probe_id = gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      temporal_filter_buffer_probe, data, NULL);
+
+  g_object_set_qdata_full (G_OBJECT (pad), temporal_filter_data_quark (), data,
+      (GDestroyNotify) kms_agnostic_bin2_temporal_filter_destroy);
+}
+
+/**
+ * Link a pad internally
+ *
+ * @self: The #KmsAgnosticBin2 owner of the pad
+ * @pad: (transfer full): The pad to be linked
+ * @peer: (transfer full): The peer pad
+ */
+static void
+kms_agnostic_bin2_link_pad (KmsAgnosticBin2 * self, GstPad * pad, GstPad * peer)
+{
+  GstCaps *caps;
+  GstBin *bin;
+
+  GST_INFO_OBJECT (self, "Linking: %" GST_PTR_FORMAT, pad);
+
+  caps = gst_pad_query_caps (peer, NULL);
+
+  if (caps == NULL) {
+    goto end;
+  }
+
+  GST_DEBUG ("Query caps are: %" GST_PTR_FORMAT, caps);
+  bin = kms_agnostic_bin2_find_or_create_bin_for_caps (self, caps);
+
+  if (bin != NULL) {
+    GstElement *tee = kms_tree_bin_get_output_tee (KMS_TREE_BIN (bin));
+
+    if (!kms_utils_caps_are_rtp (caps)) {
+      kms_utils_drop_until_keyframe (pad, TRUE);
+    }
+
+    if (bin == self->priv->input_bin && kms_agnostic_bin2_has_layers (self)
+        && !gst_caps_is_any (caps) && !kms_utils_caps_are_raw (caps)) {
+      kms_agnostic_bin2_link_to_selector (self, pad, caps);
+    } else {
+      kms_agnostic_bin2_link_to_tee (self, pad, tee, caps);
+
+      if (bin == self->priv->input_bin && !gst_caps_is_any (caps)
+          && kms_utils_caps_are_video (caps) && !kms_utils_caps_are_raw (caps)
+          && !kms_utils_caps_are_rtp (caps)) {
+        kms_agnostic_bin2_add_temporal_filter (self, pad);
+      }
+    }
+    g_object_set_qdata (G_OBJECT (pad), linked_bin_data_quark (), bin);
+  }
+
+  gst_caps_unref (caps);
+
+end:
+  g_object_unref (peer);
+}
+
+/**
+ * Process a pad for connecting or disconnecting, it should be always called
+ * whint the agnostic lock hold.
+ *
+ * @self: The #KmsAgnosticBin2 owner of the pad
+ * @pad: The pad to be processed
+ */
+static gboolean
+kms_agnostic_bin2_process_pad (KmsAgnosticBin2 * self, GstPad * pad)
+{
+  GstPad *peer = NULL;
+
+  if (!GST_OBJECT_FLAG_IS_SET (pad, KMS_AGNOSTIC_PAD_STARTED)) {
+    return FALSE;
+  }
+
+  if (!self->priv->started) {
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (self, "Processing pad: %" GST_PTR_FORMAT, pad);
+
+  if (pad == NULL) {
+    return FALSE;
+  }
+
+  peer = gst_pad_get_peer (pad);
+
+  if (peer != NULL) {
+    GstPad *target = gst_ghost_pad_get_target (GST_GHOST_PAD (pad));
+
+    if (target) {
+      GstCaps *caps = gst_pad_get_current_caps (pad);
+
+      if (caps != NULL) {
+        gboolean accepted;
+
+        accepted = gst_pad_query_accept_caps (peer, caps);
+        gst_caps_unref (caps);
+
+        if (accepted) {
+          GST_DEBUG_OBJECT (self, "No need to reconfigure pad %" GST_PTR_FORMAT,
+              pad);
+          g_object_unref (target);
+          g_object_unref (peer);
+          return FALSE;
+        }
+
+        remove_target_pad (pad);
+      }
+
+      g_object_unref (target);
+    }
+
+    kms_agnostic_bin2_link_pad (self, pad, peer);
+  }
+
+  return TRUE;
+}
+
+static void
+add_linked_pads (GstPad * pad, KmsAgnosticBin2 * self)
+{
+  if (!gst_pad_is_linked (pad)) {
+    return;
+  }
+
+  remove_target_pad (pad);
+  kms_agnostic_bin2_process_pad (self, pad);
+}
+
+static GstPadProbeReturn
+input_bin_src_caps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer bin)
+{
+  KmsAgnosticBin2 *self = KMS_AGNOSTIC_BIN2 (GST_OBJECT_PARENT (bin));
+  GstEvent *event = gst_pad_probe_info_get_event (info);
+  GstCaps *current_caps;
+
+  if (self == NULL) {
+    GST_WARNING_OBJECT (bin, "Parent agnosticbin seems to be released");
+    return GST_PAD_PROBE_OK;
+  }
+
+  GST_TRACE_OBJECT (self, "Event in parser pad: %" GST_PTR_FORMAT, event);
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  self->priv->started = TRUE;
+  if (self->priv->input_bin_src_caps != NULL) {
+    gst_caps_unref (self->priv->input_bin_src_caps);
+  }
+
+  gst_event_parse_caps (event, &current_caps);
+  self->priv->input_bin_src_caps = gst_caps_copy (current_caps);
+  kms_agnostic_bin2_invalidate_caps_index (self);
+  kms_agnostic_bin2_insert_bin (self, GST_BIN (bin), NULL);
+
+  GST_INFO_OBJECT (self, "Setting current caps to: %" GST_PTR_FORMAT,
+      current_caps);
+
+  kms_element_for_each_src_pad (GST_ELEMENT (self),
+      (KmsPadIterationAction) add_linked_pads, self);
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/*
+ * Caps that the branch linked to @pad is going to push with the new input.
+ * Pass-through branches forward the input caps as they are, transcoding
+ * branches keep their output caps because videoscale, videorate and the
+ * encoder renegotiate internally.
+ */
+static GstCaps *
+kms_agnostic_bin2_get_branch_output_caps (KmsAgnosticBin2 * self,
+    GstPad * pad, GstBin * bin)
+{
+  if (bin == self->priv->input_bin) {
+    return gst_caps_ref (self->priv->input_bin_src_caps);
+  }
+
+  return gst_pad_get_current_caps (pad);
+}
+
+/*
+ * Branches are kept while their peer accepts the caps they are going to
+ * produce, only the ones refused are rebuilt.
+ */
+static void
+reconfigure_linked_pad (GstPad * pad, KmsAgnosticBin2 * self)
+{
+  GstPad *peer;
+  GstCaps *caps;
+  GstBin *bin;
+  gboolean accepted;
+
+  if (!GST_OBJECT_FLAG_IS_SET (pad, KMS_AGNOSTIC_PAD_STARTED)) {
+    return;
+  }
+
+  bin = g_object_get_qdata (G_OBJECT (pad), linked_bin_data_quark ());
+
+  if (bin == NULL) {
+    return;
+  }
+
+  caps = kms_agnostic_bin2_get_branch_output_caps (self, pad, bin);
+
+  if (caps == NULL) {
+    /* Not negotiated yet, it will be done with the new caps */
+    return;
+  }
+
+  peer = gst_pad_get_peer (pad);
+
+  if (peer == NULL) {
+    gst_caps_unref (caps);
+    return;
+  }
+
+  accepted = gst_pad_query_accept_caps (peer, caps);
+  g_object_unref (peer);
+
+  if (accepted) {
+    GST_DEBUG_OBJECT (self, "Keeping branch for pad %" GST_PTR_FORMAT, pad);
+  } else {
+    GST_DEBUG_OBJECT (self, "Rebuilding branch for pad %" GST_PTR_FORMAT
+        ", peer refuses %" GST_PTR_FORMAT, pad, caps);
+    remove_target_pad (pad);
+    kms_agnostic_bin2_process_pad (self, pad);
+  }
+
+  gst_caps_unref (caps);
+}
+
+static void
+remove_bin (gpointer key, gpointer value, gpointer agnosticbin)
+{
+  GST_DEBUG_OBJECT (agnosticbin, "Removing %" GST_PTR_FORMAT, value);
+  kms_agnostic_bin2_unindex_bin (KMS_AGNOSTIC_BIN2 (agnosticbin), value);
+  gst_bin_remove (GST_BIN (agnosticbin), value);
+  gst_element_set_state (value, GST_STATE_NULL);
+}
+
+static GstPadProbeReturn
+input_bin_src_caps_update_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer bin)
+{
+  KmsAgnosticBin2 *self = KMS_AGNOSTIC_BIN2 (GST_OBJECT_PARENT (bin));
+  GstEvent *event = gst_pad_probe_info_get_event (info);
+  GstCaps *current_caps;
+
+  if (self == NULL) {
+    GST_WARNING_OBJECT (bin, "Parent agnosticbin seems to be released");
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  if (self->priv->input_bin != bin) {
+    /* Input was fully reconfigured meanwhile */
+    KMS_AGNOSTIC_BIN2_UNLOCK (self);
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  self->priv->input_caps_update_probe_id = 0;
+
+  if (self->priv->input_bin_src_caps != NULL) {
+    gst_caps_unref (self->priv->input_bin_src_caps);
+  }
+
+  gst_event_parse_caps (event, &current_caps);
+  self->priv->input_bin_src_caps = gst_caps_copy (current_caps);
+  kms_agnostic_bin2_invalidate_caps_index (self);
+
+  GST_INFO_OBJECT (self, "Updating current caps to: %" GST_PTR_FORMAT,
+      current_caps);
+
+  kms_element_for_each_src_pad (GST_ELEMENT (self),
+      (KmsPadIterationAction) reconfigure_linked_pad, self);
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/*
+ * Should be called with the agnostic lock held.
+ */
+static void
+kms_agnostic_bin2_remove_input_caps_update_probe (KmsAgnosticBin2 * self)
+{
+  GstElement *parser;
+  GstPad *parser_src;
+
+  if (self->priv->input_caps_update_probe_id == 0) {
+    return;
+  }
+
+  parser =
+      kms_parse_tree_bin_get_parser (KMS_PARSE_TREE_BIN (self->priv->
+          input_bin));
+  parser_src = gst_element_get_static_pad (parser, "src");
+  gst_pad_remove_probe (parser_src, self->priv->input_caps_update_probe_id);
+  g_object_unref (parser_src);
+
+  self->priv->input_caps_update_probe_id = 0;
+}
+
+/*
+ * Input format is kept, so the parser and the enc/dec trees are reused.
+ * Once the parser announces the new caps, only the branches whose peer
+ * refuses them are rebuilt.
+ */
+static void
+kms_agnostic_bin2_reconfigure_input (KmsAgnosticBin2 * self)
+{
+  GstElement *parser;
+  GstPad *parser_src;
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  if (!self->priv->started) {
+    /* Nothing linked yet, first caps on parser will link everything */
+    KMS_AGNOSTIC_BIN2_UNLOCK (self);
+    return;
+  }
+
+  /* Only the last reconfiguration matters, do not stack probes */
+  kms_agnostic_bin2_remove_input_caps_update_probe (self);
+
+  parser =
+      kms_parse_tree_bin_get_parser (KMS_PARSE_TREE_BIN (self->priv->
+          input_bin));
+  parser_src = gst_element_get_static_pad (parser, "src");
+  self->priv->input_caps_update_probe_id =
+      gst_pad_add_probe (parser_src, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      input_bin_src_caps_update_probe, g_object_ref (self->priv->input_bin),
+      g_object_unref);
+  g_object_unref (parser_src);
+
+  kms_agnostic_bin2_invalidate_caps_index (self);
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+}
+
+static gboolean
+structure_field_is_kept (const GstStructure * current_st,
+    const GstStructure * new_st, const gchar * field)
+{
+  const GValue *current_value, *new_value;
+
+  current_value = gst_structure_get_value (current_st, field);
+  new_value = gst_structure_get_value (new_st, field);
+
+  if (current_value == NULL || new_value == NULL) {
+    return current_value == new_value;
+  }
+
+  return gst_value_compare (current_value, new_value) == GST_VALUE_EQUAL;
+}
+
+/*
+ * The format is kept when the media type does not change. Raw video may also
+ * change its geometry and rate in place, encoded media keeps them.
+ */
+static gboolean
+kms_agnostic_bin2_keeps_format (const GstCaps * current_caps,
+    const GstCaps * new_caps)
+{
+  GstStructure *current_st, *new_st;
+
+  current_st = gst_caps_get_structure (current_caps, 0);
+  new_st = gst_caps_get_structure (new_caps, 0);
+
+  if (!gst_structure_has_name (new_st, gst_structure_get_name (current_st))) {
+    return FALSE;
+  }
+
+  if (gst_structure_has_name (new_st, "video/x-raw")) {
+    return TRUE;
+  }
+
+  return structure_field_is_kept (current_st, new_st, "width")
+      && structure_field_is_kept (current_st, new_st, "height")
+      && structure_field_is_kept (current_st, new_st, "framerate");
+}
+
+static void
+kms_agnostic_bin2_configure_input (KmsAgnosticBin2 * self, const GstCaps * caps)
+{
+  KmsParseTreeBin *parse_bin;
+  GstElement *parser;
+  GstPad *parser_src;
+  GstElement *input_element;
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  if (self->priv->input_bin != NULL) {
+    kms_agnostic_bin2_remove_input_caps_update_probe (self);
+    kms_tree_bin_unlink_input_element_from_tee (KMS_TREE_BIN (self->
+            priv->input_bin));
+  }
+
+  parse_bin = kms_parse_tree_bin_new (caps);
+  self->priv->input_bin = GST_BIN (parse_bin);
+
+  parser = kms_parse_tree_bin_get_parser (KMS_PARSE_TREE_BIN (parse_bin));
+  parser_src = gst_element_get_static_pad (parser, "src");
+  gst_pad_add_probe (parser_src, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      input_bin_src_caps_probe, g_object_ref (parse_bin), g_object_unref);
+  g_object_unref (parser_src);
+
+  gst_bin_add (GST_BIN (self), GST_ELEMENT (parse_bin));
+  gst_element_sync_state_with_parent (GST_ELEMENT (parse_bin));
+
+  input_element = kms_tree_bin_get_input_element (KMS_TREE_BIN (parse_bin));
+  gst_element_link (self->priv->input_tee, input_element);
+
+  self->priv->started = FALSE;
+
+  GST_DEBUG ("Removing old treebins");
+  kms_agnostic_bin2_invalidate_caps_index (self);
+  g_hash_table_foreach (self->priv->bins, remove_bin, self);
+  g_hash_table_remove_all (self->priv->bins);
 
   KMS_AGNOSTIC_BIN2_UNLOCK (self);
 }
@@ -922,9 +1746,12 @@ kms_agnostic_bin2_sink_caps_probe (GstPad * pad, GstPadProbeInfo * info,
 
   if (current_caps != NULL) {
     GstStructure *st;
+    gboolean keeps_format;
 
     GST_TRACE_OBJECT (self, "Current caps: %" GST_PTR_FORMAT, current_caps);
 
+    keeps_format = kms_agnostic_bin2_keeps_format (current_caps, new_caps);
+
     st = gst_caps_get_structure (current_caps, 0);
     // Remove famerate, width, height, streamheader that make unecessary
     // agnostic reconstruction happen
@@ -935,8 +1762,15 @@ kms_agnostic_bin2_sink_caps_probe (GstPad * pad, GstPadProbeInfo * info,
     if (!gst_caps_can_intersect (new_caps, current_caps) &&
         !kms_utils_caps_are_raw (current_caps)
         && !kms_utils_caps_are_raw (new_caps)) {
-      GST_DEBUG_OBJECT (self, "Caps differ caps: %" GST_PTR_FORMAT, new_caps);
-      kms_agnostic_bin2_configure_input (self, new_caps);
+      if (keeps_format) {
+        GST_DEBUG_OBJECT (self, "Same format, reconfiguring: %" GST_PTR_FORMAT,
+            new_caps);
+        kms_agnostic_bin2_reconfigure_input (self);
+      } else {
+        GST_DEBUG_OBJECT (self, "Caps differ caps: %" GST_PTR_FORMAT,
+            new_caps);
+        kms_agnostic_bin2_configure_input (self, new_caps);
+      }
     }
 
     gst_caps_unref (current_caps);
@@ -991,6 +1825,154 @@ kms_agnostic_bin2_src_unlinked (GstPad * pad, GstPad * peer,
   KMS_AGNOSTIC_BIN2_UNLOCK (self);
 }
 
+static void
+rebuild_selector_pad (GstPad * pad, KmsAgnosticBin2 * self)
+{
+  if (g_object_get_qdata (G_OBJECT (pad), linked_bin_data_quark ()) !=
+      self->priv->input_bin) {
+    return;
+  }
+
+  remove_target_pad (pad);
+  kms_agnostic_bin2_process_pad (self, pad);
+}
+
+static GstPadProbeReturn
+kms_agnostic_bin2_layer_caps_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer user_data)
+{
+  KmsAgnosticBin2Layer *layer = user_data;
+  GstEvent *event = gst_pad_probe_info_get_event (info);
+  KmsAgnosticBin2 *self;
+  GstElement *input_element;
+  GstCaps *caps;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  self = KMS_AGNOSTIC_BIN2 (GST_OBJECT_PARENT (layer->tee));
+
+  if (self == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_event_parse_caps (event, &caps);
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  if (layer->parse_bin != NULL) {
+    GST_DEBUG_OBJECT (self, "Layer already configured, new caps: %"
+        GST_PTR_FORMAT, caps);
+    KMS_AGNOSTIC_BIN2_UNLOCK (self);
+    return GST_PAD_PROBE_OK;
+  }
+
+  GST_INFO_OBJECT (self, "Configuring layer with caps: %" GST_PTR_FORMAT,
+      caps);
+
+  layer->parse_bin = GST_BIN (kms_parse_tree_bin_new (caps));
+  gst_bin_add (GST_BIN (self), GST_ELEMENT (layer->parse_bin));
+  gst_element_sync_state_with_parent (GST_ELEMENT (layer->parse_bin));
+
+  input_element =
+      kms_tree_bin_get_input_element (KMS_TREE_BIN (layer->parse_bin));
+  gst_element_link (layer->tee, input_element);
+
+  /* Pass-through branches can now forward this layer */
+  kms_element_for_each_src_pad (GST_ELEMENT (self),
+      (KmsPadIterationAction) rebuild_selector_pad, self);
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPad *
+kms_agnostic_bin2_request_new_layer_pad (KmsAgnosticBin2 * self,
+    GstPadTemplate * templ)
+{
+  KmsAgnosticBin2Layer *layer;
+  GstPad *pad, *target, *sink;
+  gchar *pad_name;
+
+  layer = g_slice_new0 (KmsAgnosticBin2Layer);
+  layer->tee = gst_element_factory_make ("tee", NULL);
+  layer->fakesink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (layer->fakesink, "async", FALSE, "sync", FALSE, NULL);
+
+  gst_bin_add_many (GST_BIN (self), layer->tee, layer->fakesink, NULL);
+  gst_element_link (layer->tee, layer->fakesink);
+  gst_element_sync_state_with_parent (layer->fakesink);
+  gst_element_sync_state_with_parent (layer->tee);
+
+  sink = gst_element_get_static_pad (layer->fakesink, "sink");
+  gst_pad_add_probe (sink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      kms_agnostic_bin2_layer_caps_probe, layer, NULL);
+  g_object_unref (sink);
+
+  GST_OBJECT_LOCK (self);
+  pad_name = g_strdup_printf ("sink_layer_%u", self->priv->layer_count++);
+  GST_OBJECT_UNLOCK (self);
+
+  target = gst_element_get_static_pad (layer->tee, "sink");
+  pad = gst_ghost_pad_new_from_template (pad_name, target, templ);
+  g_object_unref (target);
+  g_free (pad_name);
+
+  gst_pad_set_query_function (pad, kms_agnostic_bin2_sink_query);
+  gst_pad_set_chain_function (pad, kms_agnostic_bin2_sink_chain);
+  gst_pad_set_chain_list_function (pad, kms_agnostic_bin2_sink_chain_list);
+  g_object_set_qdata (G_OBJECT (pad), layer_data_quark (), layer);
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+  g_ptr_array_add (self->priv->layers, layer);
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+
+  gst_pad_set_active (pad, TRUE);
+
+  if (gst_element_add_pad (GST_ELEMENT (self), pad)) {
+    return pad;
+  }
+
+  g_object_unref (pad);
+
+  return NULL;
+}
+
+static void
+kms_agnostic_bin2_release_layer_pad (KmsAgnosticBin2 * self, GstPad * pad,
+    KmsAgnosticBin2Layer * layer)
+{
+  GstBin *parse_bin;
+
+  gst_element_remove_pad (GST_ELEMENT (self), pad);
+
+  KMS_AGNOSTIC_BIN2_LOCK (self);
+
+  parse_bin = layer->parse_bin;
+  layer->parse_bin = NULL;
+
+  if (parse_bin != NULL) {
+    /* Stop forwarding this layer before removing it */
+    kms_element_for_each_src_pad (GST_ELEMENT (self),
+        (KmsPadIterationAction) rebuild_selector_pad, self);
+
+    gst_bin_remove (GST_BIN (self), GST_ELEMENT (parse_bin));
+    gst_element_set_state (GST_ELEMENT (parse_bin), GST_STATE_NULL);
+  }
+
+  gst_element_set_locked_state (layer->tee, TRUE);
+  gst_element_set_locked_state (layer->fakesink, TRUE);
+  gst_element_set_state (layer->tee, GST_STATE_NULL);
+  gst_element_set_state (layer->fakesink, GST_STATE_NULL);
+  gst_bin_remove_many (GST_BIN (self), layer->tee, layer->fakesink, NULL);
+
+  g_ptr_array_remove (self->priv->layers, layer);
+
+  KMS_AGNOSTIC_BIN2_UNLOCK (self);
+}
+
 static GstPad *
 kms_agnostic_bin2_request_new_pad (GstElement * element,
     GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
@@ -999,6 +1981,10 @@ kms_agnostic_bin2_request_new_pad (GstElement * element,
   gchar *pad_name;
   KmsAgnosticBin2 *self = KMS_AGNOSTIC_BIN2 (element);
 
+  if (GST_PAD_TEMPLATE_DIRECTION (templ) == GST_PAD_SINK) {
+    return kms_agnostic_bin2_request_new_layer_pad (self, templ);
+  }
+
   GST_OBJECT_LOCK (self);
   pad_name = g_strdup_printf ("src_%d", self->priv->pad_count++);
   GST_OBJECT_UNLOCK (self);
@@ -1028,6 +2014,16 @@ kms_agnostic_bin2_request_new_pad (GstElement * element,
 static void
 kms_agnostic_bin2_release_pad (GstElement * element, GstPad * pad)
 {
+  KmsAgnosticBin2Layer *layer;
+
+  layer = g_object_get_qdata (G_OBJECT (pad), layer_data_quark ());
+
+  if (layer != NULL) {
+    kms_agnostic_bin2_release_layer_pad (KMS_AGNOSTIC_BIN2 (element), pad,
+        layer);
+    return;
+  }
+
   gst_element_remove_pad (element, pad);
 }
 
@@ -1071,6 +2067,8 @@ kms_agnostic_bin2_finalize (GObject * object)
 
   g_rec_mutex_clear (&self->priv->thread_mutex);
 
+  g_ptr_array_unref (self->priv->layers);
+  g_hash_table_unref (self->priv->bins_by_caps);
   g_hash_table_unref (self->priv->bins);
 
   /* chain up */
@@ -1209,6 +2207,8 @@ kms_agnostic_bin2_class_init (KmsAgnosticBin2Class * klass)
       gst_static_pad_template_get (&src_factory));
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&sink_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_layer_factory));
 
   gstelement_class->request_new_pad =
       GST_DEBUG_FUNCPTR (kms_agnostic_bin2_request_new_pad);
@@ -1346,6 +2346,10 @@ kms_agnostic_bin2_init (KmsAgnosticBin2 * self)
       g_thread_pool_new (remove_on_unlinked_async, NULL, -1, FALSE, NULL);
   self->priv->bins =
       g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+  self->priv->bins_by_caps =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->priv->layers = g_ptr_array_new_with_free_func ((GDestroyNotify)
+      kms_agnostic_bin2_layer_free);
   g_rec_mutex_init (&self->priv->thread_mutex);
   self->priv->min_bitrate = MIN_BITRATE_DEFAULT;
   self->priv->max_bitrate = MAX_BITRATE_DEFAULT;
@@ -19,6 +19,8 @@
 #endif
 
 #include "kmsvp8parse.h"
+#include "kmsvp8.h"
+#include "kmstemporallayermeta.h"
 
 #include <string.h>
 
@@ -206,6 +208,18 @@ kms_vp8_parse_handle_frame (GstBaseParse * parse, GstBaseParseFrame * frame,
 
     GST_BUFFER_FLAG_SET (frame->buffer, GST_BUFFER_FLAG_DELTA_UNIT);
     GST_BUFFER_FLAG_UNSET (frame->buffer, GST_BUFFER_FLAG_HEADER);
+
+    /* The layer may already have been read from the RTP descriptor */
+    if (kms_vp8_frame_is_non_reference (minfo.data, minfo.size)) {
+      KmsTemporalLayerMeta *meta;
+
+      GST_TRACE_OBJECT (parse, "Non reference frame");
+      meta = kms_buffer_get_temporal_layer_meta (frame->buffer);
+      if (meta == NULL) {
+        meta = kms_buffer_add_temporal_layer_meta (frame->buffer, -1, FALSE);
+      }
+      meta->non_reference = TRUE;
+    }
   }
 
   if (!self->priv->started) {
@@ -0,0 +1,183 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "AdmissionController.hpp"
+#include "MediaSet.hpp"
+#include "MediaPipelineImpl.hpp"
+#include <KurentoException.hpp>
+#include <gst/gst.h>
+#include "kmsencoderpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+#define GST_CAT_DEFAULT kurento_admission_controller
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoAdmissionController"
+
+namespace kurento
+{
+
+static const std::chrono::seconds CPU_SAMPLE_PERIOD (1);
+
+static std::atomic<int> cpuLoadLimit (0);
+static std::atomic<int> lagLimit (0);
+static std::atomic<int> transcodersLimit (0);
+
+/* Percentage of all the cores, updated by the sampling thread */
+static std::atomic<int> cpuLoad (0);
+static std::once_flag samplerStarted;
+
+static int64_t
+get_process_cpu_ticks ()
+{
+  std::ifstream statFile ("/proc/self/stat");
+  std::string stat, field;
+  int64_t ticks = 0;
+  size_t pos;
+
+  std::getline (statFile, stat);
+
+  /* Command name could contain spaces, fields are counted after it */
+  pos = stat.rfind (')');
+
+  if (pos == std::string::npos) {
+    return -1;
+  }
+
+  std::istringstream fields (stat.substr (pos + 1) );
+
+  /* utime and stime are fields 14 and 15, the first one after the name is 3 */
+  for (int i = 3; i <= 15 && (fields >> field); i++) {
+    if (i >= 14) {
+      ticks += atoll (field.c_str () );
+    }
+  }
+
+  return ticks;
+}
+
+static void
+sample_cpu_load ()
+{
+  int64_t ticksPerSecond = sysconf (_SC_CLK_TCK);
+  int64_t cores = std::max (1u, std::thread::hardware_concurrency () );
+  int64_t lastTicks = get_process_cpu_ticks ();
+  auto lastTime = std::chrono::steady_clock::now ();
+
+  for (;;) {
+    std::this_thread::sleep_for (CPU_SAMPLE_PERIOD);
+
+    int64_t ticks = get_process_cpu_ticks ();
+    auto now = std::chrono::steady_clock::now ();
+    int64_t wall = std::chrono::duration_cast<std::chrono::milliseconds>
+                   (now - lastTime).count ();
+
+    if (ticks >= 0 && lastTicks >= 0 && wall > 0 && ticksPerSecond > 0) {
+      cpuLoad = ( (ticks - lastTicks) * 1000 * 100) /
+                (ticksPerSecond * wall * cores);
+    }
+
+    lastTicks = ticks;
+    lastTime = now;
+  }
+}
+
+void
+AdmissionController::configure (int maxCpuLoad, int maxStreamingLag,
+                                 int maxTranscoders)
+{
+  cpuLoadLimit = std::max (0, maxCpuLoad);
+  lagLimit = std::max (0, maxStreamingLag);
+  transcodersLimit = std::max (0, maxTranscoders);
+
+  GST_INFO ("Admission limits: CPU %d%%, streaming lag %d ms, %d transcoders",
+            cpuLoadLimit.load (), lagLimit.load (), transcodersLimit.load () );
+
+  /* New transcoding branches are rejected by the encoder pool itself */
+  kms_encoder_pool_set_max_active (transcodersLimit);
+
+  if (cpuLoadLimit > 0) {
+    std::call_once (samplerStarted, [] () {
+      std::thread (sample_cpu_load).detach ();
+    });
+  }
+}
+
+int
+AdmissionController::getCpuLoad ()
+{
+  return cpuLoad;
+}
+
+std::chrono::milliseconds
+AdmissionController::getStreamingLag ()
+{
+  std::chrono::milliseconds lag (0);
+
+  for (auto it : MediaSet::getMediaSet ()->getPipelines () ) {
+    auto pipeline = std::dynamic_pointer_cast <MediaPipelineImpl> (it);
+
+    if (pipeline) {
+      lag = std::max (lag, pipeline->getAccounting ()->getLag () );
+    }
+  }
+
+  return lag;
+}
+
+void
+AdmissionController::checkPipelineCreation ()
+{
+  std::string reason;
+  int load = cpuLoad;
+
+  if (cpuLoadLimit > 0 && load >= cpuLoadLimit) {
+    reason = "CPU load is " + std::to_string (load) + "%";
+  } else if (transcodersLimit > 0 &&
+             kms_encoder_pool_get_active () >= (guint) transcodersLimit) {
+    reason = "Maximum number of transcoders reached";
+  } else if (lagLimit > 0) {
+    auto lag = getStreamingLag ();
+
+    if (lag.count () >= lagLimit) {
+      reason = "Streaming threads are lagging " + std::to_string (lag.count () ) +
+               " ms";
+    }
+  }
+
+  if (!reason.empty () ) {
+    GST_WARNING ("Rejecting new pipeline: %s", reason.c_str () );
+    throw KurentoException (SERVER_OVERLOADED, "Server overloaded: " + reason);
+  }
+}
+
+AdmissionController::StaticConstructor AdmissionController::staticConstructor;
+
+AdmissionController::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
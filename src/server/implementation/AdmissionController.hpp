@@ -0,0 +1,58 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __ADMISSION_CONTROLLER_HPP__
+#define __ADMISSION_CONTROLLER_HPP__
+
+#include <chrono>
+
+namespace kurento
+{
+
+/*
+ * Rejects new work while the server is overloaded, so clients can place it
+ * in another server before the media of the running sessions degrades. The
+ * load is measured as the CPU used by the process, the lag of the streaming
+ * threads against the pipeline clocks and the number of active transcoders.
+ */
+class AdmissionController
+{
+public:
+  /* Limits set to 0 are not checked. CPU load is a percentage of all the */
+  /* available cores and the streaming lag is given in milliseconds */
+  static void configure (int maxCpuLoad, int maxStreamingLag,
+                         int maxTranscoders);
+
+  /* Throws a KurentoException with SERVER_OVERLOADED code when over limits */
+  static void checkPipelineCreation ();
+
+  static int getCpuLoad ();
+  static std::chrono::milliseconds getStreamingLag ();
+
+private:
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} // kurento
+
+#endif /* __ADMISSION_CONTROLLER_HPP__ */
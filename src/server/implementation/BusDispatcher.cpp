@@ -0,0 +1,148 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "BusDispatcher.hpp"
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define GST_CAT_DEFAULT kurento_bus_dispatcher
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoBusDispatcher"
+
+/* Messages emitted as "sync-message" signals from the posting thread */
+#define SYNC_MESSAGES (GST_MESSAGE_STREAM_STATUS)
+
+namespace kurento
+{
+
+static std::mutex mutex;
+static int dispatcherThreads = std::max (1u, std::thread::hardware_concurrency () );
+static std::vector<std::shared_ptr<WorkerPool>> dispatchers;
+
+static GQuark
+subscribed_types_quark ()
+{
+  static GQuark quark = g_quark_from_static_string ("kms-bus-subscribed-types");
+
+  return quark;
+}
+
+static GstMessageType
+getSubscribedTypes (GstBus *bus)
+{
+  return (GstMessageType) GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (bus),
+         subscribed_types_quark () ) );
+}
+
+void
+BusDispatcher::setThreads (int threads)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  dispatcherThreads = std::max (1, threads);
+}
+
+static std::shared_ptr<WorkerPool>
+getDispatcher (GstBus *bus)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  if (dispatchers.empty() ) {
+    GST_DEBUG ("Creating %d bus dispatcher threads", dispatcherThreads);
+
+    for (int i = 0; i < dispatcherThreads; i++) {
+      dispatchers.push_back (std::shared_ptr<WorkerPool> (new WorkerPool (1) ) );
+    }
+  }
+
+  return dispatchers[std::hash<GstBus *> () (bus) % dispatchers.size ()];
+}
+
+static void
+dispatch_message (GstBus *bus, GstMessage *message)
+{
+  gst_bus_async_signal_func (bus, message, NULL);
+
+  gst_message_unref (message);
+  g_object_unref (bus);
+}
+
+static GstBusSyncReply
+bus_sync_handler (GstBus *bus, GstMessage *message, gpointer data)
+{
+  WorkerPool *dispatcher = (WorkerPool *) data;
+
+  if (GST_MESSAGE_TYPE (message) & (SYNC_MESSAGES) ) {
+    gst_bus_sync_signal_handler (bus, message, NULL);
+    return GST_BUS_DROP;
+  }
+
+  if (! (GST_MESSAGE_TYPE (message) & getSubscribedTypes (bus) ) ) {
+    /* Nobody listens to it, do not leave the streaming thread */
+    return GST_BUS_DROP;
+  }
+
+  dispatcher->post (std::bind (dispatch_message,
+                               (GstBus *) g_object_ref (bus), gst_message_ref (message) ) );
+
+  /* Nobody pops messages from the bus */
+  return GST_BUS_DROP;
+}
+
+void
+BusDispatcher::attach (GstBus *bus)
+{
+  /* Dispatchers are never destroyed while buses are alive */
+  gst_bus_set_sync_handler (bus, bus_sync_handler,
+                            getDispatcher (bus).get (), NULL);
+}
+
+void
+BusDispatcher::detach (GstBus *bus)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  gst_bus_set_sync_handler (bus, NULL, NULL, NULL);
+  /* Buses are reused with pooled pipelines */
+  g_object_set_qdata (G_OBJECT (bus), subscribed_types_quark (), NULL);
+}
+
+void
+BusDispatcher::subscribe (GstBus *bus, GstMessageType types)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  guint subscribed = getSubscribedTypes (bus) | types;
+
+  g_object_set_qdata (G_OBJECT (bus), subscribed_types_quark (),
+                      GUINT_TO_POINTER (subscribed) );
+}
+
+BusDispatcher::StaticConstructor BusDispatcher::staticConstructor;
+
+BusDispatcher::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
@@ -0,0 +1,60 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __BUS_DISPATCHER_HPP__
+#define __BUS_DISPATCHER_HPP__
+
+#include <gst/gst.h>
+
+namespace kurento
+{
+
+/*
+ * Dispatches bus messages without a main context: a sync handler takes
+ * them in the thread posting the message and they are emitted as "message"
+ * signals from a pool of dispatcher threads. Messages of the same bus are
+ * always dispatched in order from the same thread. Stream status messages
+ * are emitted as "sync-message" signals from the posting thread instead.
+ *
+ * Only the message types subscribed for a bus are dispatched, the rest are
+ * dropped in the posting thread.
+ */
+class BusDispatcher
+{
+public:
+  static void attach (GstBus *bus);
+  static void detach (GstBus *bus);
+
+  /* Types handled by "message" signal handlers connected to the bus */
+  static void subscribe (GstBus *bus, GstMessageType types);
+
+  /* Only takes effect before the first bus is attached */
+  static void setThreads (int threads);
+
+private:
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} // kurento
+
+#endif /* __BUS_DISPATCHER_HPP__ */
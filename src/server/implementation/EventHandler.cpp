@@ -17,10 +17,17 @@
 
 #include "EventHandler.hpp"
 #include <WorkerPool.hpp>
+#include "kmsmetrics.h"
+
+#include <chrono>
 
 namespace kurento
 {
 
+static const gdouble DELIVERY_BOUNDS[] = {
+  0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5
+};
+
 static void
 post_task (std::function <void () > cb)
 {
@@ -49,7 +56,20 @@ EventHandler::~EventHandler()
 void
 EventHandler::sendEventAsync  (std::function <void () > cb)
 {
-  post_task (cb);
+  static KmsMetric *delivery = kms_metrics_get_histogram (
+                                 "kms_event_delivery_seconds",
+                                 "Time since an event is raised until it is sent to the client",
+                                 DELIVERY_BOUNDS, G_N_ELEMENTS (DELIVERY_BOUNDS) );
+  auto raised = std::chrono::steady_clock::now ();
+
+  post_task ([cb, raised] () {
+    std::chrono::duration<double> elapsed;
+
+    cb ();
+
+    elapsed = std::chrono::steady_clock::now () - raised;
+    kms_metric_observe (delivery, elapsed.count () );
+  });
 }
 
 } /* kurento */
@@ -21,18 +21,20 @@
 #include <KurentoException.hpp>
 #include <MediaPipelineImpl.hpp>
 #include <ServerManagerImpl.hpp>
+#include <StatsPublisher.hpp>
 
 #include <functional>
+#include <algorithm>
 
 /* This is included to avoid problems with slots and lamdas */
 #include <type_traits>
 #include <sigc++/sigc++.h>
+#include "kmsmetrics.h"
 
 #define GST_CAT_DEFAULT kurento_media_set
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoMediaSet"
 
-const int MEDIASET_THREADS_DEFAULT = 1;
 
 namespace kurento
 {
@@ -43,6 +45,25 @@ static const std::chrono::seconds COLLECTOR_INTERVAL_DEFAULT =
 
 std::chrono::seconds MediaSet::collectorInterval = COLLECTOR_INTERVAL_DEFAULT;
 
+static KmsMetric *objectsMetric;
+static KmsMetric *sessionsMetric;
+static KmsMetric *teardownMetric;
+
+static const gdouble TEARDOWN_BOUNDS[] = {
+  0.01, 0.05, 0.1, 0.5, 1, 5, 10
+};
+
+/* A collector interval is split in this number of wheel slots */
+static const size_t KEEPALIVE_WHEEL_TICKS = 8;
+
+static int
+teardownThreadsDefault ()
+{
+  return std::max (1u, std::thread::hardware_concurrency () );
+}
+
+int MediaSet::teardownThreads = teardownThreadsDefault ();
+
 void
 MediaSet::setCollectorInterval (std::chrono::seconds interval)
 {
@@ -55,6 +76,19 @@ MediaSet::getCollectorInterval()
   return collectorInterval;
 }
 
+/* Only takes effect before the MediaSet is created */
+void
+MediaSet::setTeardownThreads (int threads)
+{
+  teardownThreads = std::max (1, threads);
+}
+
+int
+MediaSet::getTeardownThreads()
+{
+  return teardownThreads;
+}
+
 
 static std::shared_ptr<MediaSet> mediaSet;
 static std::recursive_mutex mutex;
@@ -107,29 +141,50 @@ MediaSet::deleteMediaSet()
     sig->disconnect();
   }
 
+  /* Publisher thread must not outlive the server */
+  StatsPublisher::stop ();
+
   GST_INFO ("Destroying mediaSet");
 
   mediaSet.reset();
 }
 
+std::chrono::milliseconds
+MediaSet::getCollectorTick ()
+{
+  auto tick = std::chrono::duration_cast<std::chrono::milliseconds>
+              (collectorInterval) / KEEPALIVE_WHEEL_TICKS;
+
+  return std::max (tick, std::chrono::milliseconds (1) );
+}
+
 void MediaSet::doGarbageCollection ()
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
-  auto sessions = sessionInUse;
+  std::unordered_set<std::string> expired;
+  size_t slot;
+
+  keepAliveCurrent = (keepAliveCurrent + 1) % keepAliveWheel.size();
+  slot = keepAliveCurrent;
+  expired.swap (keepAliveWheel[slot]);
 
   lock.unlock();
 
-  GST_DEBUG ("Running garbage collector");
+  GST_DEBUG ("Running garbage collector, %lu session/s expired",
+             expired.size() );
 
-  for (auto it : sessions) {
-    if (it.second) {
-      lock.lock();
-      sessionInUse[it.first] = false;
-      lock.unlock();
-    } else {
-      GST_WARNING ("Session timeout: %s", it.first.c_str() );
-      unrefSession (it.first);
+  for (auto sessionId : expired) {
+    lock.lock();
+
+    auto it = keepAliveSlot.find (sessionId);
+
+    /* Session could have been kept alive after leaving the wheel */
+    if (it != keepAliveSlot.end() && it->second == slot) {
+      GST_WARNING ("Session timeout: %s", sessionId.c_str() );
+      unrefSession (sessionId);
     }
+
+    lock.unlock();
   }
 }
 
@@ -137,25 +192,34 @@ MediaSet::MediaSet()
 {
   terminated = false;
 
-  workers = std::shared_ptr<WorkerPool> (new WorkerPool (
-      MEDIASET_THREADS_DEFAULT) );
+  /* Sessions are placed one slot beyond a full collector interval so they */
+  /* always live for at least that interval since their last keepalive */
+  keepAliveWheel.resize (KEEPALIVE_WHEEL_TICKS + 2);
+
+  for (int i = 0; i < teardownThreads; i++) {
+    workers.push_back (std::shared_ptr<WorkerPool> (new WorkerPool (1) ) );
+  }
 
   thread = std::thread ( [&] () {
     std::unique_lock <std::recursive_mutex> lock (recMutex);
 
 
     while (!terminated && waitCond.wait_for (lock,
-           collectorInterval) == std::cv_status::timeout) {
+           getCollectorTick() ) == std::cv_status::timeout) {
 
       if (terminated) {
         return;
       }
 
+      lock.unlock();
+
       try {
         doGarbageCollection();
       } catch (...) {
         GST_ERROR ("Error during garbage collection");
       }
+
+      lock.lock();
     }
 
   });
@@ -176,7 +240,7 @@ MediaSet::~MediaSet ()
 
   lock.unlock();
 
-  workers.reset();
+  workers.clear();
 
   if (std::this_thread::get_id() != thread.get_id() ) {
     try {
@@ -195,13 +259,21 @@ MediaSet::~MediaSet ()
   }
 }
 
+/*
+ * The work of one object is always serialized in the same shard, while
+ * different objects, even of the same pipeline, are released in parallel.
+ * A pipeline is only deleted after all its children, as they keep a
+ * reference to it.
+ */
 void
-MediaSet::post (std::function<void (void) > f)
+MediaSet::post (const std::string &id, std::function<void (void) > f)
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
 
-  if (!terminated && workers) {
-    workers->post (f);
+  if (!terminated && !workers.empty () ) {
+    size_t shard = std::hash<std::string> () (id) % workers.size ();
+
+    workers[shard]->post (f);
   } else {
     lock.unlock();
     f();
@@ -237,6 +309,7 @@ MediaSet::ref (MediaObjectImpl *mediaObjectPtr)
   });
 
   objectsMap[mediaObject->getId()] = std::weak_ptr<MediaObjectImpl> (mediaObject);
+  kms_metric_set (objectsMetric, objectsMap.size () );
 
   if (mediaObject->getParent() ) {
     std::shared_ptr<MediaObjectImpl> parent = std::dynamic_pointer_cast
@@ -283,6 +356,7 @@ MediaSet::ref (const std::string &sessionId,
   }
 
   sessionMap[sessionId][mediaObject->getId()] = mediaObject;
+  kms_metric_set (sessionsMetric, sessionMap.size () );
   reverseSessionMap[mediaObject->getId()].insert (sessionId);
 }
 
@@ -305,17 +379,35 @@ void
 MediaSet::keepAliveSession (const std::string &sessionId, bool create)
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
+  size_t slot = (keepAliveCurrent + keepAliveWheel.size() - 1) %
+                keepAliveWheel.size();
 
-  auto it = sessionInUse.find (sessionId);
+  auto it = keepAliveSlot.find (sessionId);
 
-  if (it == sessionInUse.end() ) {
+  if (it == keepAliveSlot.end() ) {
     if (create) {
-      sessionInUse[sessionId] = true;
+      keepAliveSlot[sessionId] = slot;
     } else {
       throw KurentoException (INVALID_SESSION, "Invalid session");
     }
+  } else if (it->second != slot) {
+    keepAliveWheel[it->second].erase (sessionId);
+    it->second = slot;
   } else {
-    it->second = true;
+    return;
+  }
+
+  keepAliveWheel[slot].insert (sessionId);
+}
+
+void
+MediaSet::removeKeepAlive (const std::string &sessionId)
+{
+  auto it = keepAliveSlot.find (sessionId);
+
+  if (it != keepAliveSlot.end() ) {
+    keepAliveWheel[it->second].erase (sessionId);
+    keepAliveSlot.erase (it);
   }
 }
 
@@ -335,7 +427,8 @@ MediaSet::releaseSession (const std::string &sessionId)
   }
 
   sessionMap.erase (sessionId);
-  sessionInUse.erase (sessionId);
+  kms_metric_set (sessionsMetric, sessionMap.size () );
+  removeKeepAlive (sessionId);
   eventHandler.erase (sessionId);
   lock.unlock ();
 
@@ -357,7 +450,8 @@ MediaSet::unrefSession (const std::string &sessionId)
   }
 
   sessionMap.erase (sessionId);
-  sessionInUse.erase (sessionId);
+  kms_metric_set (sessionsMetric, sessionMap.size () );
+  removeKeepAlive (sessionId);
   eventHandler.erase (sessionId);
 
   lock.unlock();
@@ -442,7 +536,7 @@ MediaSet::unref (const std::string &sessionId,
   }
 
   if (released) {
-    post (std::bind (call_release, mediaObject) );
+    post (mediaObject->getId (), std::bind (call_release, mediaObject) );
   }
 
   lock.unlock();
@@ -463,12 +557,47 @@ MediaSet::unref (const std::string &sessionId,
   unref (sessionId, object);
 }
 
-static void
-async_delete (MediaObjectImpl *mediaObject, std::string id)
+void MediaSet::deleteObject (MediaObjectImpl *mediaObject,
+                             const std::string &id)
 {
+  bool isPipeline = dynamic_cast <MediaPipelineImpl *> (mediaObject) != NULL;
+  auto start = std::chrono::steady_clock::now ();
+  std::chrono::microseconds duration;
+
   GST_DEBUG ("Destroying %s -> %s", mediaObject->getType().c_str(), id.c_str() );
   /* Deletion of mediaObject weak reference */
   delete mediaObject;
+
+  duration = std::chrono::duration_cast<std::chrono::microseconds>
+             (std::chrono::steady_clock::now () - start);
+
+  if (isPipeline) {
+    std::unique_lock <std::mutex> statsLock (statsMutex);
+
+    teardownStats.pipelines++;
+    teardownStats.total += duration;
+    teardownStats.max = std::max (teardownStats.max, duration);
+    statsLock.unlock ();
+
+    kms_metric_observe (teardownMetric, duration.count () / 1e6);
+
+    GST_DEBUG ("Pipeline %s torn down in %" G_GINT64_FORMAT " us", id.c_str(),
+               (gint64) duration.count () );
+  }
+
+  /* Only notify once the object is really gone */
+  std::unique_lock <std::recursive_mutex> lock (recMutex);
+  std::shared_ptr <ServerManagerImpl> manager;
+
+  if (!terminated) {
+    manager = serverManager;
+  }
+
+  lock.unlock();
+
+  if (manager) {
+    manager->signalObjectDestroyed (ObjectDestroyed (manager, id) );
+  }
 }
 
 void MediaSet::releasePointer (MediaObjectImpl *mediaObject)
@@ -477,19 +606,23 @@ void MediaSet::releasePointer (MediaObjectImpl *mediaObject)
   std::string id = mediaObject->getId();
 
   objectsMap.erase (id );
+  kms_metric_set (objectsMetric, objectsMap.size () );
 
-  post (std::bind (async_delete, mediaObject, id) );
-
-  if (this->serverManager && !terminated) {
-    serverManager->signalObjectDestroyed (ObjectDestroyed (this->serverManager,
-                                          id) );
-  }
+  post (id, std::bind (&MediaSet::deleteObject, this, mediaObject, id) );
 
   lock.unlock();
 
   checkEmpty();
 }
 
+TeardownStats
+MediaSet::getTeardownStats ()
+{
+  std::unique_lock <std::mutex> lock (statsMutex);
+
+  return teardownStats;
+}
+
 void MediaSet::release (std::shared_ptr< MediaObjectImpl > mediaObject)
 {
   std::unique_lock <std::recursive_mutex> lock (recMutex);
@@ -691,6 +824,14 @@ MediaSet::StaticConstructor::StaticConstructor()
 {
   GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
                            GST_DEFAULT_NAME);
+
+  objectsMetric = kms_metrics_get_gauge ("kms_media_objects",
+                                         "Media objects alive in the server");
+  sessionsMetric = kms_metrics_get_gauge ("kms_sessions",
+                   "Sessions holding references to media objects");
+  teardownMetric = kms_metrics_get_histogram ("kms_pipeline_teardown_seconds",
+                   "Time spent deleting a pipeline once all its elements are gone",
+                   TEARDOWN_BOUNDS, G_N_ELEMENTS (TEARDOWN_BOUNDS) );
 }
 
 } // kurento
@@ -21,6 +21,7 @@
 #include <MediaObjectImpl.hpp>
 
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -37,6 +38,12 @@ typedef struct _KeepAliveData KeepAliveData;
 
 class ServerManagerImpl;
 
+struct TeardownStats {
+  uint64_t pipelines;
+  std::chrono::microseconds total;
+  std::chrono::microseconds max;
+};
+
 class MediaSet
 {
 public:
@@ -85,6 +92,10 @@ public:
   static void deleteMediaSet();
   static void setCollectorInterval (std::chrono::seconds interval);
   static std::chrono::seconds getCollectorInterval();
+  static void setTeardownThreads (int threads);
+  static int getTeardownThreads();
+
+  TeardownStats getTeardownStats ();
 
   sigc::signal<void> signalEmptyLocked;
   sigc::signal<void> signalEmpty;
@@ -92,16 +103,19 @@ public:
 private:
 
   void keepAliveSession (const std::string &sessionId, bool create);
+  void removeKeepAlive (const std::string &sessionId);
   void doGarbageCollection ();
+  static std::chrono::milliseconds getCollectorTick ();
 
   std::thread thread;
 
   void releasePointer (MediaObjectImpl *obj);
+  void deleteObject (MediaObjectImpl *obj, const std::string &id);
 
   void checkEmpty ();
   bool isServerManager (std::shared_ptr< MediaObjectImpl > mediaObject);
 
-  void post (std::function<void (void) > f);
+  void post (const std::string &id, std::function<void (void) > f);
 
   MediaSet ();
 
@@ -119,15 +133,24 @@ private:
   std::map<std::string, std::map <std::string, std::shared_ptr<MediaObjectImpl>>>
   sessionMap;
 
-  std::map<std::string, bool> sessionInUse;
+  /* Timing wheel, each session is in the slot where its keepalive expires */
+  std::vector<std::unordered_set<std::string>> keepAliveWheel;
+  std::unordered_map<std::string, size_t> keepAliveSlot;
+  size_t keepAliveCurrent = 0;
+
   std::map<std::string, std::map<std::string, std::map<std::string, std::shared_ptr<EventHandler>>>>
   eventHandler;
 
   std::map<std::string, std::unordered_set<std::string>> reverseSessionMap;
 
-  std::shared_ptr<WorkerPool> workers;
+  /* One single threaded pool per shard, objects are sharded by id */
+  std::vector<std::shared_ptr<WorkerPool>> workers;
+
+  std::mutex statsMutex;
+  TeardownStats teardownStats = {};
 
   static std::chrono::seconds collectorInterval;
+  static int teardownThreads;
 
   class StaticConstructor
   {
@@ -0,0 +1,102 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "MetricsFileSink.hpp"
+#include <gst/gst.h>
+#include "kmsmetrics.h"
+
+#include <cstdio>
+#include <fstream>
+
+#define GST_CAT_DEFAULT kurento_metrics_file_sink
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoMetricsFileSink"
+
+namespace kurento
+{
+
+MetricsFileSink::MetricsFileSink (const std::string &path,
+                                  std::chrono::seconds interval) : path (path), interval (interval)
+{
+  GST_INFO ("Writing metrics to %s every %ld s", path.c_str (),
+            (long) interval.count () );
+
+  thread = std::thread ([this] () {
+    std::unique_lock <std::mutex> lock (mutex);
+
+    do {
+      lock.unlock ();
+      write ();
+      lock.lock ();
+    } while (!cond.wait_for (lock, this->interval, [this] () {
+    return terminated;
+  }) );
+  });
+}
+
+MetricsFileSink::~MetricsFileSink ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  terminated = true;
+  cond.notify_all ();
+  lock.unlock ();
+
+  if (thread.joinable () ) {
+    thread.join ();
+  }
+}
+
+std::string
+MetricsFileSink::render ()
+{
+  gchar *text = kms_metrics_render ();
+  std::string ret (text);
+
+  g_free (text);
+
+  return ret;
+}
+
+void
+MetricsFileSink::write ()
+{
+  std::string tmpPath = path + ".tmp";
+  std::ofstream file (tmpPath, std::ios::trunc);
+
+  file << render ();
+  file.close ();
+
+  if (file.fail () ) {
+    GST_WARNING ("Cannot write metrics to %s", tmpPath.c_str () );
+    return;
+  }
+
+  if (std::rename (tmpPath.c_str (), path.c_str () ) != 0) {
+    GST_WARNING ("Cannot replace metrics file %s", path.c_str () );
+  }
+}
+
+MetricsFileSink::StaticConstructor MetricsFileSink::staticConstructor;
+
+MetricsFileSink::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
@@ -0,0 +1,65 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __METRICS_FILE_SINK_HPP__
+#define __METRICS_FILE_SINK_HPP__
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace kurento
+{
+
+/*
+ * Periodically writes the metrics registered in kmsmetrics.h to a file in
+ * OpenMetrics text format. The file is replaced atomically, so a scraper
+ * (like the textfile collector of node_exporter) never reads it half written.
+ */
+class MetricsFileSink
+{
+public:
+  MetricsFileSink (const std::string &path, std::chrono::seconds interval);
+  ~MetricsFileSink ();
+
+  static std::string render ();
+
+private:
+  void write ();
+
+  std::string path;
+  std::chrono::seconds interval;
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool terminated = false;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} // kurento
+
+#endif /* __METRICS_FILE_SINK_HPP__ */
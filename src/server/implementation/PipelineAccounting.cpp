@@ -0,0 +1,485 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "PipelineAccounting.hpp"
+#include "BusDispatcher.hpp"
+
+#include <algorithm>
+#include <pthread.h>
+
+#define GST_CAT_DEFAULT kurento_pipeline_accounting
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoPipelineAccounting"
+
+#define ACCOUNTED_PAD "kms-accounted-pad"
+
+/* Lag is sampled once every this number of buffers */
+#define LAG_SAMPLE_INTERVAL 64
+
+/* Lag is halved every this time without samples */
+#define LAG_HALF_LIFE GST_SECOND
+
+namespace kurento
+{
+
+static int64_t
+get_clock_time (clockid_t clock)
+{
+  struct timespec ts;
+
+  if (clock_gettime (clock, &ts) != 0) {
+    return -1;
+  }
+
+  return (int64_t) ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+static void
+destroy_accounting (gpointer data)
+{
+  delete (std::shared_ptr<PipelineAccounting> *) data;
+}
+
+static std::shared_ptr<PipelineAccounting> *
+new_accounting_data (std::shared_ptr<PipelineAccounting> accounting)
+{
+  return new std::shared_ptr<PipelineAccounting> (accounting);
+}
+
+/* Latency configured upstream of @pad, buffers are expected that late */
+static GstClockTime
+get_upstream_latency (GstPad *pad)
+{
+  GstClockTime min = 0, max;
+  GstQuery *query;
+  gboolean live;
+
+  query = gst_query_new_latency ();
+
+  if (gst_pad_query (pad, query) ) {
+    gst_query_parse_latency (query, &live, &min, &max);
+
+    if (!live || !GST_CLOCK_TIME_IS_VALID (min) ) {
+      min = 0;
+    }
+  }
+
+  gst_query_unref (query);
+
+  return min;
+}
+
+static GstPadProbeReturn
+count_buffers_probe (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  PipelineAccounting *accounting =
+    ( (std::shared_ptr<PipelineAccounting> *) data)->get ();
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    accounting->countBuffer (pad, GST_PAD_PROBE_INFO_BUFFER (info) );
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    accounting->countBufferList (pad, GST_PAD_PROBE_INFO_BUFFER_LIST (info) );
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_UPSTREAM) {
+    /* Sent by the pipeline after (re)computing its latency */
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info) ) == GST_EVENT_LATENCY) {
+      accounting->refreshLatency (pad);
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+sync_message_cb (GstBus *bus, GstMessage *message, gpointer data)
+{
+  (* (std::shared_ptr<PipelineAccounting> *) data)->streamStatus (message);
+}
+
+static void
+latency_message_cb (GstBus *bus, GstMessage *message, gpointer data)
+{
+  (* (std::shared_ptr<PipelineAccounting> *) data)->refreshLatencies ();
+}
+
+void
+PipelineAccounting::attach (GstBus *bus)
+{
+  syncHandler = g_signal_connect_data (bus, "sync-message::stream-status",
+                                       G_CALLBACK (sync_message_cb),
+                                       new_accounting_data (shared_from_this () ),
+                                       (GClosureNotify) destroy_accounting,
+                                       (GConnectFlags) 0);
+  latencyHandler = g_signal_connect_data (bus, "message::latency",
+                                          G_CALLBACK (latency_message_cb),
+                                          new_accounting_data (shared_from_this () ),
+                                          (GClosureNotify) destroy_accounting,
+                                          (GConnectFlags) 0);
+  BusDispatcher::subscribe (bus, GST_MESSAGE_LATENCY);
+}
+
+void
+PipelineAccounting::detach (GstBus *bus)
+{
+  if (syncHandler > 0) {
+    g_signal_handler_disconnect (bus, syncHandler);
+    syncHandler = 0;
+  }
+
+  if (latencyHandler > 0) {
+    g_signal_handler_disconnect (bus, latencyHandler);
+    latencyHandler = 0;
+  }
+}
+
+/* Runs in the thread posting the message, for ENTER and LEAVE messages */
+/* this is the streaming thread being accounted */
+void
+PipelineAccounting::streamStatus (GstMessage *message)
+{
+  GstStreamStatusType type;
+  GstElement *owner;
+  const GValue *val;
+  GstTask *task;
+  GstPad *pad;
+
+  gst_message_parse_stream_status (message, &type, &owner);
+  val = gst_message_get_stream_status_object (message);
+
+  if (val == NULL || !G_VALUE_HOLDS_OBJECT (val) ||
+      !GST_IS_TASK (g_value_get_object (val) ) ) {
+    return;
+  }
+
+  task = GST_TASK (g_value_get_object (val) );
+
+  switch (type) {
+  case GST_STREAM_STATUS_TYPE_ENTER:
+    taskEnter (task);
+    return;
+
+  case GST_STREAM_STATUS_TYPE_LEAVE:
+    taskLeave (task);
+    return;
+
+  case GST_STREAM_STATUS_TYPE_CREATE:
+    break;
+
+  default:
+    return;
+  }
+
+  if (!GST_IS_PAD (GST_MESSAGE_SRC (message) ) ) {
+    return;
+  }
+
+  pad = GST_PAD (GST_MESSAGE_SRC (message) );
+
+  /* Tasks are created again every time a pad is activated */
+  if (g_object_get_data (G_OBJECT (pad), ACCOUNTED_PAD) != NULL) {
+    return;
+  }
+
+  GST_TRACE_OBJECT (owner, "Accounting buffers of %" GST_PTR_FORMAT, pad);
+
+  std::shared_ptr<PadLatency> latency (new PadLatency (pad) );
+
+  std::unique_lock <std::mutex> lock (mutex);
+  latencies.push_back (latency);
+  lock.unlock ();
+
+  g_object_set_data_full (G_OBJECT (pad), ACCOUNTED_PAD,
+                          new std::shared_ptr<PadLatency> (latency),
+                          destroyPadLatency);
+  gst_pad_add_probe (pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER |
+                     GST_PAD_PROBE_TYPE_BUFFER_LIST |
+                     GST_PAD_PROBE_TYPE_EVENT_UPSTREAM), count_buffers_probe,
+                     new_accounting_data (shared_from_this () ), destroy_accounting);
+}
+
+void
+PipelineAccounting::destroyPadLatency (gpointer data)
+{
+  delete (std::shared_ptr<PadLatency> *) data;
+}
+
+PipelineAccounting::PadLatency::PadLatency (GstPad *pad)
+{
+  g_weak_ref_init (&this->pad, pad);
+}
+
+PipelineAccounting::PadLatency::~PadLatency ()
+{
+  g_weak_ref_clear (&pad);
+}
+
+void
+PipelineAccounting::PadLatency::refresh ()
+{
+  GstPad *pad = (GstPad *) g_weak_ref_get (&this->pad);
+
+  if (pad == NULL) {
+    return;
+  }
+
+  latency = get_upstream_latency (pad);
+  GST_TRACE_OBJECT (pad, "Upstream latency %" GST_TIME_FORMAT,
+                    GST_TIME_ARGS ( (GstClockTime) latency) );
+
+  g_object_unref (pad);
+}
+
+void
+PipelineAccounting::refreshLatency (GstPad *pad)
+{
+  auto latency = (std::shared_ptr<PadLatency> *) g_object_get_data (G_OBJECT (
+                   pad), ACCOUNTED_PAD);
+
+  if (latency != NULL) {
+    (*latency)->refresh ();
+  }
+}
+
+/* Runs in a bus dispatcher thread, out of the streaming threads */
+void
+PipelineAccounting::refreshLatencies ()
+{
+  std::vector<std::shared_ptr<PadLatency>> current;
+  std::unique_lock <std::mutex> lock (mutex);
+
+  /* Forget pads already destroyed */
+  latencies.erase (std::remove_if (latencies.begin (), latencies.end (),
+  [] (const std::shared_ptr<PadLatency> &latency) {
+    return latency.use_count () == 1;
+  }), latencies.end () );
+  current = latencies;
+
+  lock.unlock ();
+
+  for (auto latency : current) {
+    latency->refresh ();
+  }
+}
+
+void
+PipelineAccounting::taskEnter (GstTask *task)
+{
+  ThreadClock clock;
+
+  if (pthread_getcpuclockid (pthread_self (), &clock.clock) != 0) {
+    GST_WARNING ("Cannot get CPU clock of task %" GST_PTR_FORMAT, task);
+    return;
+  }
+
+  clock.start = get_clock_time (clock.clock);
+
+  std::unique_lock <std::mutex> lock (mutex);
+  running[task] = clock;
+}
+
+void
+PipelineAccounting::taskLeave (GstTask *task)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  auto it = running.find (task);
+
+  if (it == running.end () ) {
+    return;
+  }
+
+  finished += std::max<int64_t> (0,
+                                 get_clock_time (it->second.clock) - it->second.start);
+  running.erase (it);
+}
+
+std::chrono::microseconds
+PipelineAccounting::getCpuTime ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  int64_t total = finished;
+
+  for (auto it : running) {
+    int64_t now = get_clock_time (it.second.clock);
+
+    if (now > it.second.start) {
+      total += now - it.second.start;
+    }
+  }
+
+  return std::chrono::duration_cast<std::chrono::microseconds>
+         (std::chrono::nanoseconds (total) );
+}
+
+std::chrono::milliseconds
+PipelineAccounting::getLag ()
+{
+  int64_t value = lag;
+  int64_t idle = g_get_monotonic_time () * GST_USECOND - lagTime;
+
+  if (value > 0 && idle > LAG_HALF_LIFE) {
+    int64_t halvings = idle / LAG_HALF_LIFE;
+
+    value = halvings >= 63 ? 0 : value >> halvings;
+  }
+
+  return std::chrono::duration_cast<std::chrono::milliseconds>
+         (std::chrono::nanoseconds (value) );
+}
+
+void
+PipelineAccounting::sampleLag (GstPad *pad, GstBuffer *buffer)
+{
+  GstClockTime running = GST_CLOCK_TIME_NONE;
+  const GstSegment *segment;
+  GstClockTimeDiff sample;
+  GstElement *element;
+  GstEvent *event;
+  GstClock *clock;
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer) ) {
+    return;
+  }
+
+  event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+
+  if (event == NULL) {
+    return;
+  }
+
+  gst_event_parse_segment (event, &segment);
+
+  if (segment->format == GST_FORMAT_TIME) {
+    running = gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+                                           GST_BUFFER_PTS (buffer) );
+  }
+
+  gst_event_unref (event);
+
+  if (!GST_CLOCK_TIME_IS_VALID (running) ) {
+    return;
+  }
+
+  element = gst_pad_get_parent_element (pad);
+
+  if (element == NULL) {
+    return;
+  }
+
+  clock = gst_element_get_clock (element);
+
+  if (clock != NULL) {
+    auto latency = (std::shared_ptr<PadLatency> *) g_object_get_data (G_OBJECT (
+                     pad), ACCOUNTED_PAD);
+
+    sample = GST_CLOCK_DIFF (running, gst_clock_get_time (clock) -
+                             gst_element_get_base_time (element) );
+
+    /* Never queried from here, it would block the streaming thread */
+    if (latency != NULL) {
+      sample -= (GstClockTimeDiff) (*latency)->latency;
+    }
+
+    /* Start from the decayed value if the pipeline was idle */
+    lag = (getLag ().count () * GST_MSECOND * 7 +
+           std::max<int64_t> (sample, 0) ) / 8;
+    lagTime = g_get_monotonic_time () * GST_USECOND;
+
+    gst_object_unref (clock);
+  }
+
+  gst_object_unref (element);
+}
+
+void
+PipelineAccounting::countBuffer (GstPad *pad, GstBuffer *buffer)
+{
+  bytes += gst_buffer_get_size (buffer);
+
+  if (++buffers % LAG_SAMPLE_INTERVAL == 0) {
+    sampleLag (pad, buffer);
+  }
+}
+
+void
+PipelineAccounting::countBufferList (GstPad *pad, GstBufferList *list)
+{
+  guint len = gst_buffer_list_length (list);
+  int64_t previous;
+
+  if (len == 0) {
+    return;
+  }
+
+  for (guint i = 0; i < len; i++) {
+    bytes += gst_buffer_get_size (gst_buffer_list_get (list, i) );
+  }
+
+  previous = buffers.fetch_add (len);
+
+  if (previous / LAG_SAMPLE_INTERVAL != (previous + len) / LAG_SAMPLE_INTERVAL) {
+    sampleLag (pad, gst_buffer_list_get (list, 0) );
+  }
+}
+
+void
+PipelineAccounting::countElements (GstBin *bin, int &elements, int &pads)
+{
+  GstIterator *it;
+  gboolean done = FALSE;
+  GValue item = G_VALUE_INIT;
+
+  it = gst_bin_iterate_recurse (bin);
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item) ) {
+    case GST_ITERATOR_OK: {
+      GstElement *element = GST_ELEMENT (g_value_get_object (&item) );
+
+      elements++;
+      GST_OBJECT_LOCK (element);
+      pads += element->numpads;
+      GST_OBJECT_UNLOCK (element);
+
+      g_value_reset (&item);
+      break;
+    }
+
+    case GST_ITERATOR_RESYNC:
+      gst_iterator_resync (it);
+      elements = 0;
+      pads = 0;
+      break;
+
+    case GST_ITERATOR_ERROR:
+    case GST_ITERATOR_DONE:
+      done = TRUE;
+      break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+PipelineAccounting::StaticConstructor PipelineAccounting::staticConstructor;
+
+PipelineAccounting::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
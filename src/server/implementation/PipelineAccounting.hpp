@@ -0,0 +1,128 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __PIPELINE_ACCOUNTING_HPP__
+#define __PIPELINE_ACCOUNTING_HPP__
+
+#include <gst/gst.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <time.h>
+#include <vector>
+
+namespace kurento
+{
+
+/*
+ * Accounts the resources used by the streaming threads of a pipeline. CPU
+ * time is read from the CPU clock of the threads running the pad tasks of
+ * the pipeline, between their ENTER and LEAVE stream status messages, and
+ * buffers are counted on the pads that drive those tasks, that is, once per
+ * streaming thread.
+ */
+class PipelineAccounting : public
+  std::enable_shared_from_this<PipelineAccounting>
+{
+public:
+  PipelineAccounting () {};
+  ~PipelineAccounting () {};
+
+  /*
+   * Stream status messages must be emitted as sync messages on @bus and
+   * latency messages dispatched as "message" signals
+   */
+  void attach (GstBus *bus);
+  void detach (GstBus *bus);
+
+  std::chrono::microseconds getCpuTime ();
+
+  int64_t getBytes ()
+  {
+    return bytes;
+  }
+
+  int64_t getBuffers ()
+  {
+    return buffers;
+  }
+
+  /*
+   * Smoothed delay of buffers against the pipeline clock, not counting the
+   * latency configured upstream (e.g. jitterbuffers). It decays while no
+   * buffers are sampled, so an idle pipeline stops reporting old lag.
+   */
+  std::chrono::milliseconds getLag ();
+
+  static void countElements (GstBin *bin, int &elements, int &pads);
+
+  void streamStatus (GstMessage *message);
+  void countBuffer (GstPad *pad, GstBuffer *buffer);
+  void countBufferList (GstPad *pad, GstBufferList *list);
+  void refreshLatency (GstPad *pad);
+  void refreshLatencies ();
+
+private:
+  void taskEnter (GstTask *task);
+  void taskLeave (GstTask *task);
+  void sampleLag (GstPad *pad, GstBuffer *buffer);
+
+  struct ThreadClock {
+    clockid_t clock;
+    int64_t start;
+  };
+
+  /* Upstream latency of an accounted pad, queried out of its streaming thread */
+  struct PadLatency {
+    GWeakRef pad;
+    std::atomic<uint64_t> latency {0};
+
+    PadLatency (GstPad *pad);
+    ~PadLatency ();
+    void refresh ();
+  };
+
+  static void destroyPadLatency (gpointer data);
+
+  std::mutex mutex;
+  std::map<GstTask *, ThreadClock> running;
+  int64_t finished = 0;
+  std::vector<std::shared_ptr<PadLatency>> latencies;
+
+  std::atomic<int64_t> bytes {0};
+  std::atomic<int64_t> buffers {0};
+  std::atomic<int64_t> lag {0};
+  std::atomic<int64_t> lagTime {0};
+
+  gulong syncHandler = 0;
+  gulong latencyHandler = 0;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} // kurento
+
+#endif /* __PIPELINE_ACCOUNTING_HPP__ */
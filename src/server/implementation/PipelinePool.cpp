@@ -0,0 +1,215 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "PipelinePool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define GST_CAT_DEFAULT kurento_pipeline_pool
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoPipelinePool"
+
+namespace kurento
+{
+
+/* Never destroyed, the refill thread runs until the process exits */
+struct PoolState {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<GstElement *> idle;
+  size_t size = 0;
+  int refillRate = 1;
+  bool running = false;
+};
+
+static PoolState *
+getState ()
+{
+  static PoolState *state = new PoolState ();
+
+  return state;
+}
+
+static GstElement *
+createPipeline ()
+{
+  GstElement *pipeline;
+  GstClock *clock;
+
+  pipeline = gst_pipeline_new (NULL);
+
+  if (pipeline == NULL) {
+    return NULL;
+  }
+
+  clock = gst_system_clock_obtain ();
+  gst_pipeline_use_clock (GST_PIPELINE (pipeline), clock);
+  g_object_unref (clock);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  return pipeline;
+}
+
+static void
+destroyPipeline (GstElement *pipeline)
+{
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (pipeline);
+}
+
+static void
+refillLoop (PoolState *state)
+{
+  std::unique_lock <std::mutex> lock (state->mutex);
+
+  while (true) {
+    GstElement *pipeline;
+
+    state->cond.wait (lock, [state] () {
+      return state->idle.size () < state->size;
+    });
+
+    lock.unlock ();
+    pipeline = createPipeline ();
+    lock.lock ();
+
+    if (pipeline != NULL && state->idle.size () < state->size) {
+      state->idle.push_back (pipeline);
+      GST_TRACE ("Pipeline added to pool, %" G_GSIZE_FORMAT " idle",
+                 state->idle.size () );
+    } else if (pipeline != NULL) {
+      lock.unlock ();
+      destroyPipeline (pipeline);
+      lock.lock ();
+    }
+
+    lock.unlock ();
+    std::this_thread::sleep_for (std::chrono::microseconds (
+                                   G_USEC_PER_SEC / state->refillRate) );
+    lock.lock ();
+  }
+}
+
+void
+PipelinePool::configure (int size, int refillRate)
+{
+  PoolState *state = getState ();
+  std::unique_lock <std::mutex> lock (state->mutex);
+  std::vector<GstElement *> excess;
+
+  state->size = std::max (0, size);
+  state->refillRate = std::max (1, refillRate);
+
+  while (state->idle.size () > state->size) {
+    excess.push_back (state->idle.back () );
+    state->idle.pop_back ();
+  }
+
+  GST_INFO ("Pipeline pool size %d, refill rate %d/s", size,
+            state->refillRate);
+
+  if (state->size > 0 && !state->running) {
+    state->running = true;
+    std::thread (refillLoop, state).detach ();
+  }
+
+  state->cond.notify_all ();
+  lock.unlock ();
+
+  for (auto pipeline : excess) {
+    destroyPipeline (pipeline);
+  }
+}
+
+GstElement *
+PipelinePool::acquire ()
+{
+  PoolState *state = getState ();
+  std::unique_lock <std::mutex> lock (state->mutex);
+  GstElement *pipeline;
+
+  if (state->idle.empty () ) {
+    lock.unlock ();
+
+    return createPipeline ();
+  }
+
+  pipeline = state->idle.front ();
+  state->idle.pop_front ();
+  state->cond.notify_all ();
+
+  GST_DEBUG ("Reusing pipeline %" GST_PTR_FORMAT, pipeline);
+
+  return pipeline;
+}
+
+bool
+PipelinePool::release (GstElement *pipeline)
+{
+  PoolState *state = getState ();
+  std::unique_lock <std::mutex> lock (state->mutex);
+  GstState current, pending;
+  GstBus *bus;
+
+  if (state->idle.size () >= state->size) {
+    return false;
+  }
+
+  /* Only clean pipelines are reused */
+  GST_OBJECT_LOCK (pipeline);
+  current = GST_STATE (pipeline);
+  pending = GST_STATE_PENDING (pipeline);
+
+  if (GST_BIN_NUMCHILDREN (pipeline) != 0 || current != GST_STATE_PLAYING
+      || pending != GST_STATE_VOID_PENDING
+      || GST_OBJECT_REFCOUNT_VALUE (pipeline) != 1) {
+    GST_OBJECT_UNLOCK (pipeline);
+    return false;
+  }
+
+  GST_OBJECT_UNLOCK (pipeline);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
+  gst_bus_set_flushing (bus, TRUE);
+  gst_bus_set_flushing (bus, FALSE);
+  g_object_unref (bus);
+
+  gst_pipeline_set_latency (GST_PIPELINE (pipeline), GST_CLOCK_TIME_NONE);
+
+  state->idle.push_back (pipeline);
+
+  GST_DEBUG ("Pipeline %" GST_PTR_FORMAT " returned to pool", pipeline);
+
+  return true;
+}
+
+PipelinePool::StaticConstructor PipelinePool::staticConstructor;
+
+PipelinePool::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
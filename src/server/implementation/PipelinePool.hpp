@@ -0,0 +1,61 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __PIPELINE_POOL_HPP__
+#define __PIPELINE_POOL_HPP__
+
+#include <gst/gst.h>
+
+namespace kurento
+{
+
+/*
+ * Process wide pool of idle pipelines, already PLAYING with the system
+ * clock, so creating a MediaPipeline does not wait for the state change.
+ * Disabled (size 0) by default.
+ */
+class PipelinePool
+{
+public:
+  /*
+   * refillRate is the maximum number of pipelines created per second, idle
+   * pipelines over the new size are destroyed
+   */
+  static void configure (int size, int refillRate);
+
+  /* Returns a PLAYING pipeline, created on the spot if the pool is empty */
+  static GstElement *acquire ();
+
+  /*
+   * Takes back a pipeline without children, returns false if it cannot be
+   * reused and must be destroyed by the caller.
+   */
+  static bool release (GstElement *pipeline);
+
+private:
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} // kurento
+
+#endif /* __PIPELINE_POOL_HPP__ */
@@ -0,0 +1,604 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "PipelineTopology.hpp"
+
+#include <json/json.h>
+
+#define GST_CAT_DEFAULT kurento_pipeline_topology
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoPipelineTopology"
+
+namespace kurento
+{
+
+static void
+destroy_topology (gpointer data)
+{
+  delete (std::shared_ptr<PipelineTopology> *) data;
+}
+
+static std::shared_ptr<PipelineTopology> *
+new_topology_data (std::shared_ptr<PipelineTopology> topology)
+{
+  return new std::shared_ptr<PipelineTopology> (topology);
+}
+
+static PipelineTopology *
+get_topology (gpointer data)
+{
+  return ( (std::shared_ptr<PipelineTopology> *) data)->get ();
+}
+
+static void
+destroy_counters (gpointer data)
+{
+  delete (std::shared_ptr<PipelineTopology::Counters> *) data;
+}
+
+static void
+element_added_cb (GstBin *bin, GstElement *element, gpointer data)
+{
+  get_topology (data)->elementAdded (bin, element);
+}
+
+static void
+element_removed_cb (GstBin *bin, GstElement *element, gpointer data)
+{
+  get_topology (data)->elementRemoved (bin, element);
+}
+
+static void
+pad_added_cb (GstElement *element, GstPad *pad, gpointer data)
+{
+  get_topology (data)->padAdded (element, pad);
+}
+
+static void
+pad_removed_cb (GstElement *element, GstPad *pad, gpointer data)
+{
+  get_topology (data)->padRemoved (element, pad);
+}
+
+static void
+pad_linked_cb (GstPad *pad, GstPad *peer, gpointer data)
+{
+  get_topology (data)->padLinked (pad, peer);
+}
+
+static void
+pad_unlinked_cb (GstPad *pad, GstPad *peer, gpointer data)
+{
+  get_topology (data)->padUnlinked (pad);
+}
+
+static void
+caps_changed_cb (GstPad *pad, GParamSpec *pspec, gpointer data)
+{
+  get_topology (data)->capsChanged (pad);
+}
+
+static GstPadProbeReturn
+count_buffers_probe (GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  PipelineTopology::Counters *counters =
+    ( (std::shared_ptr<PipelineTopology::Counters> *) data)->get ();
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    counters->buffers++;
+    counters->bytes += gst_buffer_get_size (GST_PAD_PROBE_INFO_BUFFER (info) );
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint len = gst_buffer_list_length (list);
+
+    counters->buffers += len;
+
+    for (guint i = 0; i < len; i++) {
+      counters->bytes += gst_buffer_get_size (gst_buffer_list_get (list, i) );
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+disconnect_handler (gpointer instance, GCallback callback)
+{
+  g_signal_handlers_disconnect_matched (instance, G_SIGNAL_MATCH_FUNC, 0, 0,
+                                        NULL, (gpointer) callback, NULL);
+}
+
+static void
+connect_handler (gpointer instance, const gchar *signal, GCallback callback,
+                 std::shared_ptr<PipelineTopology> topology)
+{
+  g_signal_connect_data (instance, signal, callback,
+                         new_topology_data (topology),
+                         (GClosureNotify) destroy_topology, (GConnectFlags) 0);
+}
+
+/* Media type of the first structure and, for RTP, its encoding name */
+static std::string
+summarize_caps (GstPad *pad)
+{
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  const GstStructure *st;
+  const gchar *encoding;
+  std::string summary;
+
+  if (caps == NULL) {
+    return summary;
+  }
+
+  if (gst_caps_get_size (caps) > 0) {
+    st = gst_caps_get_structure (caps, 0);
+    summary = gst_structure_get_name (st);
+    encoding = gst_structure_get_string (st, "encoding-name");
+
+    if (encoding != NULL) {
+      summary += std::string (",") + encoding;
+    }
+  }
+
+  gst_caps_unref (caps);
+
+  return summary;
+}
+
+static std::string
+take_name (gchar *name)
+{
+  std::string ret = name != NULL ? name : "";
+
+  g_free (name);
+
+  return ret;
+}
+
+void
+PipelineTopology::attach (GstBin *bin)
+{
+  GstIterator *it;
+  gboolean done = FALSE;
+  GValue item = G_VALUE_INIT;
+
+  pipeline = GST_ELEMENT (bin);
+
+  connect_handler (bin, "element-added", G_CALLBACK (element_added_cb),
+                   shared_from_this () );
+  connect_handler (bin, "element-removed", G_CALLBACK (element_removed_cb),
+                   shared_from_this () );
+
+  it = gst_bin_iterate_elements (bin);
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item) ) {
+    case GST_ITERATOR_OK:
+      trackElement (GST_ELEMENT (g_value_get_object (&item) ), pipeline);
+      g_value_reset (&item);
+      break;
+
+    case GST_ITERATOR_RESYNC:
+      gst_iterator_resync (it);
+      break;
+
+    case GST_ITERATOR_ERROR:
+    case GST_ITERATOR_DONE:
+      done = TRUE;
+      break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+void
+PipelineTopology::detach (GstBin *bin)
+{
+  std::vector<GstElement *> children;
+
+  disconnect_handler (bin, G_CALLBACK (element_added_cb) );
+  disconnect_handler (bin, G_CALLBACK (element_removed_cb) );
+
+  std::unique_lock <std::mutex> lock (mutex);
+
+  for (auto &it : elements) {
+    if (it.second.parent == pipeline) {
+      children.push_back (it.first);
+    }
+  }
+
+  lock.unlock ();
+
+  for (auto element : children) {
+    untrackElement (element);
+  }
+}
+
+void
+PipelineTopology::trackElement (GstElement *element, GstElement *parent)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+  std::unique_lock <std::mutex> lock (mutex);
+  GstIterator *it;
+  gboolean done = FALSE;
+  GValue item = G_VALUE_INIT;
+
+  if (elements.find (element) != elements.end () ) {
+    return;
+  }
+
+  Element &tracked = elements[element];
+  tracked.id = ++lastId;
+  tracked.parent = parent;
+  tracked.name = take_name (gst_element_get_name (element) );
+
+  if (factory != NULL) {
+    tracked.factory = gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory) );
+  }
+
+  lock.unlock ();
+
+  GST_TRACE_OBJECT (element, "Tracking element");
+
+  /* Connect before iterating so no pad or child is missed */
+  connect_handler (element, "pad-added", G_CALLBACK (pad_added_cb),
+                   shared_from_this () );
+  connect_handler (element, "pad-removed", G_CALLBACK (pad_removed_cb),
+                   shared_from_this () );
+
+  it = gst_element_iterate_pads (element);
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item) ) {
+    case GST_ITERATOR_OK:
+      trackPad (element, GST_PAD (g_value_get_object (&item) ) );
+      g_value_reset (&item);
+      break;
+
+    case GST_ITERATOR_RESYNC:
+      gst_iterator_resync (it);
+      break;
+
+    case GST_ITERATOR_ERROR:
+    case GST_ITERATOR_DONE:
+      done = TRUE;
+      break;
+    }
+  }
+
+  gst_iterator_free (it);
+
+  if (!GST_IS_BIN (element) ) {
+    g_value_unset (&item);
+    return;
+  }
+
+  connect_handler (element, "element-added", G_CALLBACK (element_added_cb),
+                   shared_from_this () );
+  connect_handler (element, "element-removed", G_CALLBACK (element_removed_cb),
+                   shared_from_this () );
+
+  it = gst_bin_iterate_elements (GST_BIN (element) );
+  done = FALSE;
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item) ) {
+    case GST_ITERATOR_OK:
+      trackElement (GST_ELEMENT (g_value_get_object (&item) ), element);
+      g_value_reset (&item);
+      break;
+
+    case GST_ITERATOR_RESYNC:
+      gst_iterator_resync (it);
+      break;
+
+    case GST_ITERATOR_ERROR:
+    case GST_ITERATOR_DONE:
+      done = TRUE;
+      break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+}
+
+void
+PipelineTopology::trackPad (GstElement *element, GstPad *pad)
+{
+  GstPad *peer = gst_pad_get_peer (pad);
+  std::string caps = summarize_caps (pad);
+  std::shared_ptr<Counters> counters;
+  gulong probe;
+
+  if (peer != NULL) {
+    /* Only used as a key, it is untracked before being destroyed */
+    gst_object_unref (peer);
+  }
+
+  std::unique_lock <std::mutex> lock (mutex);
+  auto owner = elements.find (element);
+
+  if (owner == elements.end () || pads.find (pad) != pads.end () ) {
+    return;
+  }
+
+  Pad &tracked = pads[pad];
+  tracked.element = element;
+  tracked.name = take_name (gst_pad_get_name (pad) );
+  tracked.direction = GST_PAD_DIRECTION (pad);
+  tracked.peer = peer;
+  tracked.caps = caps;
+  tracked.probe = 0;
+
+  if (owner->second.parent == pipeline) {
+    counters = std::make_shared<Counters> ();
+    tracked.counters = counters;
+  }
+
+  lock.unlock ();
+
+  connect_handler (pad, "linked", G_CALLBACK (pad_linked_cb),
+                   shared_from_this () );
+  connect_handler (pad, "unlinked", G_CALLBACK (pad_unlinked_cb),
+                   shared_from_this () );
+  connect_handler (pad, "notify::caps", G_CALLBACK (caps_changed_cb),
+                   shared_from_this () );
+
+  if (!counters) {
+    return;
+  }
+
+  probe = gst_pad_add_probe (pad, (GstPadProbeType) (GST_PAD_PROBE_TYPE_BUFFER |
+                             GST_PAD_PROBE_TYPE_BUFFER_LIST), count_buffers_probe,
+                             new std::shared_ptr<Counters> (counters), destroy_counters);
+
+  lock.lock ();
+  auto it = pads.find (pad);
+
+  if (it != pads.end () && it->second.counters == counters) {
+    it->second.probe = probe;
+    return;
+  }
+
+  /* Removed while the probe was being added */
+  lock.unlock ();
+  gst_pad_remove_probe (pad, probe);
+}
+
+void
+PipelineTopology::untrackPad (GstPad *pad)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  auto it = pads.find (pad);
+  gulong probe;
+
+  if (it == pads.end () ) {
+    return;
+  }
+
+  probe = it->second.probe;
+  pads.erase (it);
+  lock.unlock ();
+
+  disconnect_handler (pad, G_CALLBACK (pad_linked_cb) );
+  disconnect_handler (pad, G_CALLBACK (pad_unlinked_cb) );
+  disconnect_handler (pad, G_CALLBACK (caps_changed_cb) );
+
+  if (probe > 0) {
+    gst_pad_remove_probe (pad, probe);
+  }
+}
+
+void
+PipelineTopology::untrackElement (GstElement *element)
+{
+  std::vector<GstElement *> removed;
+  std::vector<GstPad *> removedPads;
+  std::unique_lock <std::mutex> lock (mutex);
+
+  if (elements.find (element) == elements.end () ) {
+    return;
+  }
+
+  /* Children of removed bins are not notified, untrack them too */
+  for (auto &it : elements) {
+    GstElement *ancestor = it.first;
+
+    while (ancestor != element) {
+      auto parent = elements.find (ancestor);
+
+      if (parent == elements.end () ) {
+        break;
+      }
+
+      ancestor = parent->second.parent;
+    }
+
+    if (ancestor == element) {
+      removed.push_back (it.first);
+    }
+  }
+
+  for (auto &it : pads) {
+    for (auto e : removed) {
+      if (it.second.element == e) {
+        removedPads.push_back (it.first);
+        break;
+      }
+    }
+  }
+
+  lock.unlock ();
+
+  for (auto pad : removedPads) {
+    untrackPad (pad);
+  }
+
+  for (auto e : removed) {
+    disconnect_handler (e, G_CALLBACK (pad_added_cb) );
+    disconnect_handler (e, G_CALLBACK (pad_removed_cb) );
+
+    if (GST_IS_BIN (e) ) {
+      disconnect_handler (e, G_CALLBACK (element_added_cb) );
+      disconnect_handler (e, G_CALLBACK (element_removed_cb) );
+    }
+  }
+
+  lock.lock ();
+
+  for (auto e : removed) {
+    elements.erase (e);
+  }
+}
+
+void
+PipelineTopology::elementAdded (GstBin *bin, GstElement *element)
+{
+  trackElement (element, GST_ELEMENT (bin) );
+}
+
+void
+PipelineTopology::elementRemoved (GstBin *bin, GstElement *element)
+{
+  GST_TRACE_OBJECT (element, "Untracking element");
+  untrackElement (element);
+}
+
+void
+PipelineTopology::padAdded (GstElement *element, GstPad *pad)
+{
+  trackPad (element, pad);
+}
+
+void
+PipelineTopology::padRemoved (GstElement *element, GstPad *pad)
+{
+  untrackPad (pad);
+}
+
+void
+PipelineTopology::padLinked (GstPad *pad, GstPad *peer)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  auto it = pads.find (pad);
+
+  if (it != pads.end () ) {
+    it->second.peer = peer;
+  }
+}
+
+void
+PipelineTopology::padUnlinked (GstPad *pad)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+  auto it = pads.find (pad);
+
+  if (it != pads.end () ) {
+    it->second.peer = NULL;
+  }
+}
+
+/* Called from the streaming thread when a caps event is stored */
+void
+PipelineTopology::capsChanged (GstPad *pad)
+{
+  std::string caps = summarize_caps (pad);
+  std::unique_lock <std::mutex> lock (mutex);
+  auto it = pads.find (pad);
+
+  if (it != pads.end () ) {
+    it->second.caps = caps;
+  }
+}
+
+std::string
+PipelineTopology::getSnapshot ()
+{
+  Json::Value root;
+  Json::Value &list = root["elements"];
+  std::map<GstElement *, Json::ArrayIndex> indexes;
+  Json::FastWriter writer;
+  std::unique_lock <std::mutex> lock (mutex);
+
+  list = Json::Value (Json::arrayValue);
+
+  for (auto &it : elements) {
+    Json::Value element;
+    auto parent = elements.find (it.second.parent);
+
+    element["id"] = it.second.id;
+    element["parent"] = parent != elements.end () ? parent->second.id : 0;
+    element["name"] = it.second.name;
+    element["factory"] = it.second.factory;
+    element["pads"] = Json::Value (Json::arrayValue);
+
+    indexes[it.first] = list.size ();
+    list.append (element);
+  }
+
+  for (auto &it : pads) {
+    Json::Value pad;
+    auto index = indexes.find (it.second.element);
+
+    if (index == indexes.end () ) {
+      continue;
+    }
+
+    pad["name"] = it.second.name;
+    pad["direction"] = it.second.direction == GST_PAD_SRC ? "src" :
+                       it.second.direction == GST_PAD_SINK ? "sink" : "unknown";
+
+    if (!it.second.caps.empty () ) {
+      pad["caps"] = it.second.caps;
+    }
+
+    auto peer = pads.find (it.second.peer);
+
+    if (peer != pads.end () ) {
+      auto peerElement = elements.find (peer->second.element);
+
+      if (peerElement != elements.end () ) {
+        pad["peer"]["element"] = peerElement->second.id;
+        pad["peer"]["pad"] = peer->second.name;
+      }
+    }
+
+    if (it.second.counters) {
+      pad["buffers"] = (Json::Int64) it.second.counters->buffers.load ();
+      pad["bytes"] = (Json::Int64) it.second.counters->bytes.load ();
+    }
+
+    list[index->second]["pads"].append (pad);
+  }
+
+  lock.unlock ();
+
+  return writer.write (root);
+}
+
+PipelineTopology::StaticConstructor PipelineTopology::staticConstructor;
+
+PipelineTopology::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
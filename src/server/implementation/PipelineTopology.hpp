@@ -0,0 +1,108 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __PIPELINE_TOPOLOGY_HPP__
+#define __PIPELINE_TOPOLOGY_HPP__
+
+#include <gst/gst.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace kurento
+{
+
+/*
+ * Copy of the structure of a pipeline that is kept up to date from the
+ * signals emitted when elements are added or removed, pads are created and
+ * linked and caps are negotiated. Getting a snapshot only reads this copy,
+ * so, unlike dumping a dot graph, it never takes locks of the running
+ * elements. Buffers are counted on the pads of the elements placed directly
+ * in the pipeline, where media flows between media elements.
+ */
+class PipelineTopology : public std::enable_shared_from_this<PipelineTopology>
+{
+public:
+  PipelineTopology () {};
+  ~PipelineTopology () {};
+
+  void attach (GstBin *pipeline);
+  void detach (GstBin *pipeline);
+
+  /* Compact JSON with the elements and their pads */
+  std::string getSnapshot ();
+
+  void elementAdded (GstBin *bin, GstElement *element);
+  void elementRemoved (GstBin *bin, GstElement *element);
+  void padAdded (GstElement *element, GstPad *pad);
+  void padRemoved (GstElement *element, GstPad *pad);
+  void padLinked (GstPad *pad, GstPad *peer);
+  void padUnlinked (GstPad *pad);
+  void capsChanged (GstPad *pad);
+
+  struct Counters {
+    std::atomic<int64_t> buffers {0};
+    std::atomic<int64_t> bytes {0};
+  };
+
+private:
+  struct Element {
+    int id;
+    GstElement *parent;
+    std::string name;
+    std::string factory;
+  };
+
+  struct Pad {
+    GstElement *element;
+    std::string name;
+    GstPadDirection direction;
+    GstPad *peer;
+    std::string caps;
+    std::shared_ptr<Counters> counters;
+    gulong probe;
+  };
+
+  void trackElement (GstElement *element, GstElement *parent);
+  void trackPad (GstElement *element, GstPad *pad);
+  void untrackPad (GstPad *pad);
+  void untrackPads (GstElement *element);
+  void untrackElement (GstElement *element);
+
+  std::mutex mutex;
+  std::map<GstElement *, Element> elements;
+  std::map<GstPad *, Pad> pads;
+  int lastId = 0;
+
+  GstElement *pipeline = NULL;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} // kurento
+
+#endif /* __PIPELINE_TOPOLOGY_HPP__ */
@@ -0,0 +1,341 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "StatsPublisher.hpp"
+#include "MediaSet.hpp"
+#include "MediaElementImpl.hpp"
+#include "MediaPipelineImpl.hpp"
+#include <StatsUpdate.hpp>
+#include <jsonrpc/JsonSerializer.hpp>
+#include <gst/gst.h>
+
+#include <list>
+#include <vector>
+
+#define GST_CAT_DEFAULT kurento_stats_publisher
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "KurentoStatsPublisher"
+
+/* A complete document is sent every this number of updates, so that */
+/* subscribers that missed some events are able to resynchronize */
+#define FULL_UPDATE_PERIOD 10
+
+namespace kurento
+{
+
+static const std::chrono::milliseconds MIN_INTERVAL (100);
+
+static std::shared_ptr<StatsPublisher> publisher;
+static std::mutex publisherMutex;
+
+std::shared_ptr<StatsPublisher>
+StatsPublisher::getPublisher ()
+{
+  std::unique_lock <std::mutex> lock (publisherMutex);
+
+  if (!publisher) {
+    publisher = std::shared_ptr<StatsPublisher> (new StatsPublisher () );
+  }
+
+  return publisher;
+}
+
+void
+StatsPublisher::stop ()
+{
+  std::shared_ptr<StatsPublisher> current;
+  std::unique_lock <std::mutex> lock (publisherMutex);
+
+  current.swap (publisher);
+  lock.unlock ();
+
+  if (current) {
+    current->terminate ();
+  }
+}
+
+StatsPublisher::StatsPublisher ()
+{
+  thread = std::thread (&StatsPublisher::run, this);
+}
+
+StatsPublisher::~StatsPublisher ()
+{
+  terminate ();
+}
+
+void
+StatsPublisher::terminate ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  terminated = true;
+  cond.notify_all ();
+  lock.unlock ();
+
+  if (thread.joinable () ) {
+    thread.join ();
+  }
+}
+
+void
+StatsPublisher::setInterval (std::shared_ptr<MediaObjectImpl> source,
+                             std::chrono::milliseconds interval)
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  if (interval.count () <= 0) {
+    subscriptions.erase (source.get () );
+    return;
+  }
+
+  if (interval < MIN_INTERVAL) {
+    GST_WARNING ("Stats interval of %s raised to %d ms",
+                 source->getId ().c_str (), (int) MIN_INTERVAL.count () );
+    interval = MIN_INTERVAL;
+  }
+
+  Subscription &subscription = subscriptions[source.get ()];
+
+  if (subscription.source.lock () != source) {
+    /* New subscription, or an old one from a destroyed object */
+    subscription = Subscription ();
+    subscription.source = source;
+  }
+
+  subscription.interval = interval;
+  subscription.next = std::chrono::steady_clock::now () + interval;
+
+  cond.notify_all ();
+}
+
+Json::Value
+StatsPublisher::diff (const Json::Value &previous, const Json::Value &current)
+{
+  Json::Value delta (Json::objectValue);
+
+  if (!previous.isObject () || !current.isObject () ) {
+    return current;
+  }
+
+  for (auto &name : current.getMemberNames () ) {
+    const Json::Value &value = current[name];
+
+    if (!previous.isMember (name) ) {
+      delta[name] = value;
+    } else if (previous[name] != value) {
+      if (value.isObject () && previous[name].isObject () ) {
+        delta[name] = diff (previous[name], value);
+      } else {
+        delta[name] = value;
+      }
+    }
+  }
+
+  for (auto &name : previous.getMemberNames () ) {
+    if (!current.isMember (name) ) {
+      delta[name] = Json::Value::null;
+    }
+  }
+
+  return delta;
+}
+
+static bool
+hasListeners (std::shared_ptr<MediaObjectImpl> source)
+{
+  auto pipeline = std::dynamic_pointer_cast<MediaPipelineImpl> (source);
+
+  if (pipeline) {
+    return !pipeline->signalStatsUpdate.empty ();
+  }
+
+  auto element = std::dynamic_pointer_cast<MediaElementImpl> (source);
+
+  return element && !element->signalStatsUpdate.empty ();
+}
+
+static void
+raiseStatsUpdate (std::shared_ptr<MediaObjectImpl> source,
+                  const std::string &stats, bool full)
+{
+  auto pipeline = std::dynamic_pointer_cast<MediaPipelineImpl> (source);
+  auto element = std::dynamic_pointer_cast<MediaElementImpl> (source);
+  StatsUpdate event (std::dynamic_pointer_cast<MediaObject> (source),
+                     StatsUpdate::getName (), stats, full);
+
+  if (pipeline) {
+    pipeline->signalStatsUpdate (event);
+  } else if (element) {
+    element->signalStatsUpdate (event);
+  }
+}
+
+static void
+getElements (std::shared_ptr<MediaObjectImpl> object,
+             std::vector<std::shared_ptr<MediaElementImpl>> &elements)
+{
+  auto element = std::dynamic_pointer_cast<MediaElementImpl> (object);
+
+  if (element) {
+    elements.push_back (element);
+  }
+
+  for (auto child : MediaSet::getMediaSet ()->getChildren (object) ) {
+    getElements (child, elements);
+  }
+}
+
+static Json::Value
+collectStats (std::shared_ptr<MediaElementImpl> element)
+{
+  Json::Value value (Json::objectValue);
+
+  for (auto &it : element->getStats () ) {
+    JsonSerializer serializer (true);
+
+    it.second->Serialize (serializer);
+
+    /* Events already carry their own timestamp */
+    serializer.JsonValue.removeMember ("timestamp");
+    value[it.first] = serializer.JsonValue;
+  }
+
+  return value;
+}
+
+void
+StatsPublisher::publish (std::shared_ptr<MediaObjectImpl> source,
+                         Subscription &subscription,
+                         std::map<std::string, Json::Value> &collected)
+{
+  std::vector<std::shared_ptr<MediaElementImpl>> elements;
+  Json::Value current (Json::objectValue);
+  Json::Value delta;
+  bool full;
+
+  getElements (source, elements);
+
+  for (auto element : elements) {
+    std::string id = element->getId ();
+    auto it = collected.find (id);
+
+    if (it == collected.end () ) {
+      it = collected.insert (std::make_pair (id, collectStats (element) ) ).first;
+    }
+
+    current[id] = it->second;
+  }
+
+  full = subscription.updates % FULL_UPDATE_PERIOD == 0;
+  delta = full ? current : diff (subscription.last, current);
+
+  subscription.last = current;
+  subscription.updates++;
+
+  if (!full && delta.empty () ) {
+    return;
+  }
+
+  raiseStatsUpdate (source, Json::FastWriter ().write (delta), full);
+}
+
+void
+StatsPublisher::run ()
+{
+  std::unique_lock <std::mutex> lock (mutex);
+
+  while (!terminated) {
+    std::list<std::pair<std::shared_ptr<MediaObjectImpl>, Subscription>> due;
+    std::map<std::string, Json::Value> collected;
+    auto now = std::chrono::steady_clock::now ();
+    auto next = now + std::chrono::hours (1);
+
+    for (auto it = subscriptions.begin (); it != subscriptions.end ();) {
+      auto source = it->second.source.lock ();
+
+      if (!source) {
+        it = subscriptions.erase (it);
+        continue;
+      }
+
+      if (it->second.next <= now) {
+        it->second.next += it->second.interval;
+
+        if (it->second.next <= now) {
+          /* Do not try to catch up after a delay */
+          it->second.next = now + it->second.interval;
+        }
+
+        if (hasListeners (source) ) {
+          due.push_back (std::make_pair (source, it->second) );
+        } else {
+          /* First event after listeners come back must be complete */
+          it->second.last = Json::Value ();
+          it->second.updates = 0;
+        }
+      }
+
+      next = std::min (next, it->second.next);
+      ++it;
+    }
+
+    if (due.empty () ) {
+      cond.wait_until (lock, next);
+      continue;
+    }
+
+    /* Stats are gathered without blocking changes to subscriptions */
+    lock.unlock ();
+
+    for (auto &it : due) {
+      try {
+        publish (it.first, it.second, collected);
+      } catch (std::exception &e) {
+        GST_WARNING ("Error publishing stats of %s: %s",
+                     it.first->getId ().c_str (), e.what () );
+      }
+    }
+
+    lock.lock ();
+
+    for (auto &it : due) {
+      auto subscription = subscriptions.find (it.first.get () );
+
+      if (subscription != subscriptions.end () &&
+          subscription->second.source.lock () == it.first) {
+        subscription->second.last = it.second.last;
+        subscription->second.updates = it.second.updates;
+      }
+    }
+
+    /* Last references could be released here, outside the lock */
+    lock.unlock ();
+    due.clear ();
+    lock.lock ();
+  }
+}
+
+StatsPublisher::StaticConstructor StatsPublisher::staticConstructor;
+
+StatsPublisher::StaticConstructor::StaticConstructor()
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+                           GST_DEFAULT_NAME);
+}
+
+} // kurento
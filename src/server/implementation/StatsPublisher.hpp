@@ -0,0 +1,94 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef __STATS_PUBLISHER_HPP__
+#define __STATS_PUBLISHER_HPP__
+
+#include <json/json.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace kurento
+{
+
+class MediaObjectImpl;
+
+/*
+ * Periodically raises StatsUpdate events on the pipelines and elements that
+ * have a stats update interval. All of them are served from one thread: on
+ * each wake up the stats of every element involved are gathered once, even
+ * if several subscriptions include it, and each subscription gets a single
+ * serialized document with the values that changed since its previous event.
+ */
+class StatsPublisher
+{
+public:
+  ~StatsPublisher ();
+
+  static std::shared_ptr<StatsPublisher> getPublisher ();
+  /* Joins the publishing thread, called when the server shuts down */
+  static void stop ();
+
+  /* A zero interval removes the subscription */
+  void setInterval (std::shared_ptr<MediaObjectImpl> source,
+                    std::chrono::milliseconds interval);
+
+  /* Members of current that differ from previous, removed ones as null */
+  static Json::Value diff (const Json::Value &previous,
+                           const Json::Value &current);
+
+private:
+  struct Subscription {
+    std::weak_ptr<MediaObjectImpl> source;
+    std::chrono::milliseconds interval;
+    std::chrono::steady_clock::time_point next;
+    Json::Value last;
+    int updates = 0;
+  };
+
+  StatsPublisher ();
+
+  void terminate ();
+  void run ();
+  void publish (std::shared_ptr<MediaObjectImpl> source,
+                Subscription &subscription,
+                std::map<std::string, Json::Value> &collected);
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool terminated = false;
+  std::thread thread;
+
+  std::map<MediaObjectImpl *, Subscription> subscriptions;
+
+  class StaticConstructor
+  {
+  public:
+    StaticConstructor();
+  };
+
+  static StaticConstructor staticConstructor;
+};
+
+} // kurento
+
+#endif /* __STATS_PUBLISHER_HPP__ */
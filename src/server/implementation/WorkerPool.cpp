@@ -18,6 +18,7 @@
 #include <gst/gst.h>
 
 #include "WorkerPool.hpp"
+#include "kmsmetrics.h"
 #include <atomic>
 
 #define GST_CAT_DEFAULT kurento_worker_pool
@@ -29,6 +30,8 @@ const int WORKER_THREADS_TIMEOUT = 3; /* seconds */
 namespace kurento
 {
 
+static KmsMetric *queuedTasks;
+
 static void
 workerThreadLoop ( boost::shared_ptr< boost::asio::io_service > io_service )
 {
@@ -168,12 +171,25 @@ WorkerPool::setWatcher ()
   watcher_service->post (std::bind (&WorkerPool::checkWorkers, this) );
 }
 
+WorkerPool::QueuedTask::QueuedTask ()
+{
+  kms_metric_add (queuedTasks, 1);
+}
+
+WorkerPool::QueuedTask::~QueuedTask ()
+{
+  kms_metric_add (queuedTasks, -1);
+}
+
 WorkerPool::StaticConstructor WorkerPool::staticConstructor;
 
 WorkerPool::StaticConstructor::StaticConstructor()
 {
   GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
                            GST_DEFAULT_NAME);
+
+  queuedTasks = kms_metrics_get_gauge ("kms_worker_pool_queued_tasks",
+                                       "Tasks waiting or running in the worker pools");
 }
 
 } // kurento
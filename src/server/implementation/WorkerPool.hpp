@@ -18,6 +18,7 @@
 #ifndef __WORKERPOOL_HPP__
 #define __WORKERPOOL_HPP__
 
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <boost/asio.hpp>
@@ -35,11 +36,25 @@ public:
   BOOST_ASIO_INITFN_RESULT_TYPE (CompletionHandler, void () )
   post (BOOST_ASIO_MOVE_ARG (CompletionHandler) handler)
   {
+    /* Released after running, or when the task is discarded */
+    std::shared_ptr<QueuedTask> task (new QueuedTask () );
+
     setWatcher();
-    return io_service->post (handler);
+    return io_service->post ([task, handler] () mutable {
+      handler();
+      task.reset();
+    });
   }
 
 private:
+  /* Accounts a task in the queued tasks gauge while it is alive */
+  class QueuedTask
+  {
+  public:
+    QueuedTask ();
+    ~QueuedTask ();
+  };
+
   void setWatcher();
   void checkWorkers();
 
@@ -26,6 +26,8 @@
 #include <MediaType.hpp>
 
 #include "RembParams.hpp"
+#include "JitterBufferParams.hpp"
+#include "ProtectionParams.hpp"
 
 #include "StatsType.hpp"
 #include "RTCInboundRTPStreamStats.hpp"
@@ -33,6 +35,8 @@
 #include "EndpointStats.hpp"
 #include "kmsstats.h"
 #include "kmsutils.h"
+#include "kmsbasertpendpoint.h"
+#include "kmsrtxcache.h"
 
 #define GST_CAT_DEFAULT kurento_base_rtp_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -43,15 +47,24 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define KMS_CONNECTION_DISCONNECTED 0
 #define KMS_CONNECTION_CONNECTED 1
 #define REMB_PARAMS "remb-params"
-
-#define KMS_STATISTIC_FIELD_PREFIX_SESSION "session-"
-#define KMS_STATISTIC_FIELD_PREFIX_SSRC "ssrc-"
+#define JITTER_BUFFER_PARAMS "jitter-buffer-params"
+#define PROTECTION_PARAMS "protection-params"
+#define RTC_STATS_STRUCTURE "rtc-stats-structure"
 
 #define PARAM_MIN_PORT "minPort"
 #define PARAM_MAX_PORT "maxPort"
+#define PARAM_RTX_CACHE_MEMORY_LIMIT "rtxCacheMemoryLimit"
+#define PARAM_PACING "pacing"
+#define PARAM_SHARED_PACKETIZATION "sharedPacketization"
+#define PARAM_SEND_FEC "sendFec"
+#define PARAM_MTU "mtu"
 
 #define PROP_MIN_PORT "min-port"
 #define PROP_MAX_PORT "max-port"
+#define PROP_PACING "pacing"
+#define PROP_SHARED_PACKETIZATION "shared-packetization"
+#define PROP_SEND_FEC "send-fec"
+#define PROP_MTU "mtu"
 
 /* Fixed point conversion macros */
 #define FRIC        65536.                  /* 2^16 as a double */
@@ -63,6 +76,10 @@ void BaseRtpEndpointImpl::postConstructor ()
 {
   SdpEndpointImpl::postConstructor ();
 
+  /* RTC stats are built from kms_base_rtp_endpoint_get_rtp_stats, there is */
+  /* no need to serialize them in the structure returned by "stats" */
+  g_object_set (element, RTC_STATS_STRUCTURE, FALSE, NULL);
+
   mediaStateChangedHandlerId = register_signal_handler (G_OBJECT (element),
                                "media-state-changed",
                                std::function <void (GstElement *, guint) > (std::bind (
@@ -109,6 +126,50 @@ BaseRtpEndpointImpl::BaseRtpEndpointImpl (const boost::property_tree::ptree
   } catch (boost::property_tree::ptree_bad_path &e) {
     /* Expected when configuration is not set */
   }
+
+  try {
+    /* Shared by all the endpoints, in MiB */
+    guint limit = getConfigValue <guint, BaseRtpEndpoint>
+                  (PARAM_RTX_CACHE_MEMORY_LIMIT);
+
+    kms_rtx_cache_set_memory_limit ( (gsize) limit * 1024 * 1024);
+  } catch (boost::property_tree::ptree_bad_path &e) {
+    /* Expected when configuration is not set */
+  }
+
+  try {
+    bool pacing = getConfigValue <bool, BaseRtpEndpoint> (PARAM_PACING);
+
+    g_object_set (getGstreamerElement (), PROP_PACING, pacing, NULL);
+  } catch (boost::property_tree::ptree_bad_path &e) {
+    /* Expected when configuration is not set */
+  }
+
+  try {
+    bool shared = getConfigValue <bool, BaseRtpEndpoint>
+                  (PARAM_SHARED_PACKETIZATION);
+
+    g_object_set (getGstreamerElement (), PROP_SHARED_PACKETIZATION, shared,
+                  NULL);
+  } catch (boost::property_tree::ptree_bad_path &e) {
+    /* Expected when configuration is not set */
+  }
+
+  try {
+    bool sendFec = getConfigValue <bool, BaseRtpEndpoint> (PARAM_SEND_FEC);
+
+    g_object_set (getGstreamerElement (), PROP_SEND_FEC, sendFec, NULL);
+  } catch (boost::property_tree::ptree_bad_path &e) {
+    /* Expected when configuration is not set */
+  }
+
+  try {
+    guint mtu = getConfigValue <guint, BaseRtpEndpoint> (PARAM_MTU);
+
+    g_object_set (getGstreamerElement (), PROP_MTU, mtu, NULL);
+  } catch (boost::property_tree::ptree_bad_path &e) {
+    /* Expected when configuration is not set */
+  }
 }
 
 BaseRtpEndpointImpl::~BaseRtpEndpointImpl ()
@@ -382,203 +443,197 @@ BaseRtpEndpointImpl::setRembParams (std::shared_ptr<RembParams> rembParams)
   gst_structure_free (params);
 }
 
-/******************/
-/* RTC statistics */
-/******************/
-static std::shared_ptr<RTCInboundRTPStreamStats>
-createRTCInboundRTPStreamStats (const GstStructure *stats)
+std::shared_ptr<JitterBufferParams>
+BaseRtpEndpointImpl::getJitterBufferParams ()
 {
-  guint64 bytesReceived, packetsReceived;
-  guint jitter, fractionLost, pliCount, firCount, remb;
-  gint packetLost, clock_rate;
-  float jitterSec;
-
-  packetLost = jitter = fractionLost = pliCount = firCount = remb =
-                                         clock_rate = 0;
-  bytesReceived = packetsReceived = G_GUINT64_CONSTANT (0);
-  jitterSec = 0.0;
-
-  gst_structure_get (stats, "packets-received", G_TYPE_UINT64, &packetsReceived,
-                     "octets-received", G_TYPE_UINT64, &bytesReceived,
-                     "sent-rb-packetslost", G_TYPE_INT, &packetLost,
-                     "sent-rb-fractionlost", G_TYPE_UINT, &fractionLost,
-                     "clock-rate", G_TYPE_INT, &clock_rate,
-                     "jitter", G_TYPE_UINT, &jitter, NULL);
+  std::shared_ptr<JitterBufferParams> ret (new JitterBufferParams() );
+  GstStructure *params;
+  gboolean adaptive;
+  gint auxi;
 
-  /* jitter is computed in timestamp units. Convert it to seconds */
-  if (clock_rate > 0) {
-    jitterSec = (float) jitter / clock_rate;
+  g_object_get (G_OBJECT (element), JITTER_BUFFER_PARAMS, &params, NULL);
+
+  if (params == NULL)  {
+    return ret;
   }
 
-  /* Next fields are only available with PLI and FIR statistics patches so */
-  /* hey are prone to fail if these patches are not applied in Gstreamer */
-  if (!gst_structure_get (stats, "sent-pli-count", G_TYPE_UINT, &pliCount,
-                          "sent-fir-count", G_TYPE_UINT, &firCount, NULL) ) {
-    GST_WARNING ("Current version of gstreamer has neither PLI nor FIR statistics patches applied.");
+  if (gst_structure_get (params, "adaptive", G_TYPE_BOOLEAN, &adaptive,
+                         NULL) ) {
+    ret->setAdaptive (adaptive);
   }
 
-  if (!gst_structure_get (stats, "remb", G_TYPE_UINT, &remb, NULL) ) {
-    GST_TRACE ("No remb stats collected");
+  if (gst_structure_get (params, "min-latency", G_TYPE_INT, &auxi, NULL) ) {
+    ret->setMinLatency (auxi);
   }
 
-  return std::make_shared <RTCInboundRTPStreamStats> ("",
-         std::make_shared <StatsType> (StatsType::inboundrtp), 0.0, "",
-         "", false, "", "", "", firCount, pliCount, 0, 0, remb,
-         packetLost, (float) fractionLost, packetsReceived, bytesReceived,
-         jitterSec);
-}
+  if (gst_structure_get (params, "max-latency", G_TYPE_INT, &auxi, NULL) ) {
+    ret->setMaxLatency (auxi);
+  }
 
-static std::shared_ptr<RTCOutboundRTPStreamStats>
-createRTCOutboundRTPStreamStats (const GstStructure *stats)
-{
-  guint64 bytesSent, packetsSent, bitRate;
-  guint pliCount, firCount, remb, rtt, fractionLost;
-  float roundTripTime;
-  gint packetLost;
+  gst_structure_free (params);
 
-  bytesSent = packetsSent = bitRate = G_GUINT64_CONSTANT (0);
-  pliCount = firCount = remb = rtt = 0;
+  return ret;
+}
 
-  gst_structure_get (stats, "packets-sent", G_TYPE_UINT64, &packetsSent,
-                     "octets-sent", G_TYPE_UINT64, &bytesSent, "bitrate",
-                     G_TYPE_UINT64, &bitRate, "round-trip-time", G_TYPE_UINT,
-                     &rtt, "outbound-fraction-lost", G_TYPE_UINT, &fractionLost,
-                     "outbound-packet-lost", G_TYPE_INT, &packetLost, NULL);
+void
+BaseRtpEndpointImpl::setJitterBufferParams (std::shared_ptr<JitterBufferParams>
+    jitterBufferParams)
+{
+  GstStructure *params = gst_structure_new_empty (JITTER_BUFFER_PARAMS);
 
-  /* the round-trip time (in NTP Short Format, 16.16 fixed point) */
-  roundTripTime = FP2D (rtt);
+  if (jitterBufferParams->isSetAdaptive () ) {
+    gst_structure_set (params, "adaptive", G_TYPE_BOOLEAN,
+                       jitterBufferParams->getAdaptive(), NULL);
+  }
 
-  /* Next fields are only available with PLI and FIR statistics patches so */
-  /* hey are prone to fail if these patches are not applied in Gstreamer */
-  if (!gst_structure_get (stats, "recv-pli-count", G_TYPE_UINT, &pliCount,
-                          "recv-fir-count", G_TYPE_UINT, &firCount, NULL) ) {
-    GST_WARNING ("Current version of gstreamer has neither PLI nor FIR statistics patches applied.");
+  if (jitterBufferParams->isSetMinLatency () ) {
+    gst_structure_set (params, "min-latency", G_TYPE_INT,
+                       jitterBufferParams->getMinLatency(), NULL);
   }
 
-  if (!gst_structure_get (stats, "remb", G_TYPE_UINT, &remb, NULL) ) {
-    GST_TRACE ("No remb stats collected");
+  if (jitterBufferParams->isSetMaxLatency () ) {
+    gst_structure_set (params, "max-latency", G_TYPE_INT,
+                       jitterBufferParams->getMaxLatency(), NULL);
   }
 
-  return std::make_shared <RTCOutboundRTPStreamStats> ("",
-         std::make_shared <StatsType> (StatsType::outboundrtp), 0.0, "",
-         "", false, "", "", "", firCount, pliCount, 0, 0, remb, packetLost,
-         (float) fractionLost, packetsSent, bytesSent, (float) bitRate,
-         roundTripTime);
+  GST_DEBUG_OBJECT (element, "New jitter buffer params %" GST_PTR_FORMAT,
+                    params);
+
+  g_object_set (G_OBJECT (element), JITTER_BUFFER_PARAMS, params, NULL);
+  gst_structure_free (params);
 }
 
-static std::shared_ptr<RTCRTPStreamStats>
-createRTCRTPStreamStats (guint nackSent, guint nackRecv,
-                         const GstStructure *stats)
+std::shared_ptr<ProtectionParams>
+BaseRtpEndpointImpl::getProtectionParams ()
 {
-  std::shared_ptr<RTCRTPStreamStats> rtcStats;
-  gboolean isInternal;
-  gchar *ssrcStr, *id;
-  uint ssrc, nackCount;
+  std::shared_ptr<ProtectionParams> ret (new ProtectionParams() );
+  GstStructure *params;
+  gboolean adaptive;
+  gint auxi;
 
-  gst_structure_get (stats, "ssrc", G_TYPE_UINT, &ssrc, "internal",
-                     G_TYPE_BOOLEAN, &isInternal, "id", G_TYPE_STRING, &id, NULL);
+  g_object_get (G_OBJECT (element), PROTECTION_PARAMS, &params, NULL);
+
+  if (params == NULL)  {
+    return ret;
+  }
 
-  ssrcStr = g_strdup_printf ("%u", ssrc);
+  if (gst_structure_get (params, "adaptive", G_TYPE_BOOLEAN, &adaptive,
+                         NULL) ) {
+    ret->setAdaptive (adaptive);
+  }
 
-  if (isInternal) {
-    /* Local SSRC */
-    rtcStats = createRTCOutboundRTPStreamStats (stats);
-    nackCount = nackRecv;
-  } else {
-    /* Remote SSRC */
-    rtcStats = createRTCInboundRTPStreamStats (stats);
-    nackCount = nackSent;
+  if (gst_structure_get (params, "max-fec-percentage", G_TYPE_INT, &auxi,
+                         NULL) ) {
+    ret->setMaxFecPercentage (auxi);
   }
 
-  rtcStats->setNackCount (nackCount);
-  rtcStats->setSsrc (ssrcStr);
-  rtcStats->setId (id);
+  if (gst_structure_get (params, "rtx-max-rtt", G_TYPE_INT, &auxi, NULL) ) {
+    ret->setRtxMaxRtt (auxi);
+  }
 
-  g_free (ssrcStr);
-  g_free (id);
+  gst_structure_free (params);
 
-  return rtcStats;
+  return ret;
 }
 
-static void
-collectRTCRTPStreamStats (std::map <std::string, std::shared_ptr<Stats>>
-                          &statsReport, double timestamp, const GstStructure *stats)
+void
+BaseRtpEndpointImpl::setProtectionParams (std::shared_ptr<ProtectionParams>
+    protectionParams)
 {
-  guint nackSent, nackRecv;
-  gint i, n;
+  GstStructure *params = gst_structure_new_empty (PROTECTION_PARAMS);
 
-  nackSent = nackRecv = 0;
-
-  gst_structure_get (stats, "sent-nack-count", G_TYPE_UINT, &nackSent,
-                     "recv-nack-count", G_TYPE_UINT, &nackRecv, NULL);
-
-  n = gst_structure_n_fields (stats);
+  if (protectionParams->isSetAdaptive () ) {
+    gst_structure_set (params, "adaptive", G_TYPE_BOOLEAN,
+                       protectionParams->getAdaptive(), NULL);
+  }
 
-  for (i = 0; i < n; i++) {
-    std::shared_ptr<RTCStats> rtcStats;
-    const GValue *value;
-    const gchar *name;
+  if (protectionParams->isSetMaxFecPercentage () ) {
+    gst_structure_set (params, "max-fec-percentage", G_TYPE_INT,
+                       protectionParams->getMaxFecPercentage(), NULL);
+  }
 
-    name = gst_structure_nth_field_name (stats, i);
+  if (protectionParams->isSetRtxMaxRtt () ) {
+    gst_structure_set (params, "rtx-max-rtt", G_TYPE_INT,
+                       protectionParams->getRtxMaxRtt(), NULL);
+  }
 
-    if (!g_str_has_prefix (name, KMS_STATISTIC_FIELD_PREFIX_SSRC) ) {
-      continue;
-    }
+  GST_DEBUG_OBJECT (element, "New protection params %" GST_PTR_FORMAT,
+                    params);
 
-    value = gst_structure_get_value (stats, name);
+  g_object_set (G_OBJECT (element), PROTECTION_PARAMS, params, NULL);
+  gst_structure_free (params);
+}
 
-    if (!GST_VALUE_HOLDS_STRUCTURE (value) ) {
-      gchar *str_val;
+/******************/
+/* RTC statistics */
+/******************/
+static std::shared_ptr<RTCInboundRTPStreamStats>
+createRTCInboundRTPStreamStats (const KmsRtpSsrcSnapshot *ssrc)
+{
+  std::shared_ptr<RTCInboundRTPStreamStats> inboundStats;
+  float jitterSec = 0.0;
 
-      str_val = g_strdup_value_contents (value);
-      GST_WARNING ("Unexpected field type (%s) = %s", name, str_val);
-      g_free (str_val);
+  /* jitter is computed in timestamp units. Convert it to seconds */
+  if (ssrc->clock_rate > 0) {
+    jitterSec = (float) ssrc->jitter / ssrc->clock_rate;
+  }
 
-      continue;
-    }
+  inboundStats = std::make_shared <RTCInboundRTPStreamStats> ("",
+                 std::make_shared <StatsType> (StatsType::inboundrtp), 0.0, "",
+                 "", false, "", "", "", ssrc->sent_fir_count, ssrc->sent_pli_count,
+                 0, 0, ssrc->remb, ssrc->sent_rb_packetslost,
+                 (float) ssrc->sent_rb_fractionlost, ssrc->packets_received,
+                 ssrc->octets_received, jitterSec);
 
-    rtcStats = createRTCRTPStreamStats (nackSent, nackRecv,
-                                        gst_value_get_structure (value) );
+  if (ssrc->has_jitter_buffer) {
+    inboundStats->setJitterBufferLatency ( (double) ssrc->jb_latency / 1000);
+    inboundStats->setPacketsLate (ssrc->jb_num_late);
+  }
 
-    rtcStats->setTimestamp (timestamp);
+  return inboundStats;
+}
 
-    statsReport[rtcStats->getId ()] = rtcStats;
-  }
+static std::shared_ptr<RTCOutboundRTPStreamStats>
+createRTCOutboundRTPStreamStats (const KmsRtpSsrcSnapshot *ssrc)
+{
+  /* the round-trip time (in NTP Short Format, 16.16 fixed point) */
+  return std::make_shared <RTCOutboundRTPStreamStats> ("",
+         std::make_shared <StatsType> (StatsType::outboundrtp), 0.0, "",
+         "", false, "", "", "", ssrc->recv_fir_count, ssrc->recv_pli_count, 0,
+         0, ssrc->remb, ssrc->outbound_packet_lost,
+         (float) ssrc->outbound_fraction_lost, ssrc->packets_sent,
+         ssrc->octets_sent, (float) ssrc->bitrate,
+         FP2D (ssrc->round_trip_time) );
 }
 
 static void
 collectRTCStats (std::map <std::string, std::shared_ptr<Stats>>
-                 &statsReport, double timestamp, const GstStructure *stats)
+                 &statsReport, double timestamp,
+                 const KmsRtpStatsSnapshot *snapshot)
 {
-  gint i, n;
-
-  n = gst_structure_n_fields (stats);
-
-  for (i = 0; i < n; i++) {
-    const GValue *value;
-    const gchar *name;
-
-    name = gst_structure_nth_field_name (stats, i);
-
-    if (!g_str_has_prefix (name, KMS_STATISTIC_FIELD_PREFIX_SESSION) ) {
-      GST_DEBUG ("Ignoring field %s", name);
-      continue;
+  for (guint i = 0; i < snapshot->n_sessions; i++) {
+    const KmsRtpSessionSnapshot *session = &snapshot->sessions[i];
+
+    for (guint j = 0; j < session->n_ssrcs; j++) {
+      const KmsRtpSsrcSnapshot *ssrc = &session->ssrcs[j];
+      std::shared_ptr<RTCRTPStreamStats> rtcStats;
+
+      if (ssrc->internal) {
+        /* Local SSRC */
+        rtcStats = createRTCOutboundRTPStreamStats (ssrc);
+        rtcStats->setNackCount (session->recv_nack_count);
+      } else {
+        /* Remote SSRC */
+        rtcStats = createRTCInboundRTPStreamStats (ssrc);
+        rtcStats->setNackCount (session->sent_nack_count);
+      }
+
+      rtcStats->setSsrc (std::to_string (ssrc->ssrc) );
+      rtcStats->setId (ssrc->id);
+      rtcStats->setTimestamp (timestamp);
+
+      statsReport[rtcStats->getId ()] = rtcStats;
     }
-
-    value = gst_structure_get_value (stats, name);
-
-    if (!GST_VALUE_HOLDS_STRUCTURE (value) ) {
-      gchar *str_val;
-
-      str_val = g_strdup_value_contents (value);
-      GST_WARNING ("Unexpected field type (%s) = %s", name, str_val);
-      g_free (str_val);
-
-      continue;
-    }
-
-    collectRTCRTPStreamStats (statsReport, timestamp,
-                              gst_value_get_structure (value) );
   }
 }
 
@@ -630,7 +685,7 @@ BaseRtpEndpointImpl::fillStatsReport (std::map
                                       <std::string, std::shared_ptr<Stats>>
                                       &report, const GstStructure *stats, double timestamp)
 {
-  const GstStructure *e_stats, *rtc_stats;
+  const GstStructure *e_stats;
 
   e_stats = kms_utils_get_structure_by_name (stats, KMS_MEDIA_ELEMENT_FIELD);
 
@@ -638,13 +693,28 @@ BaseRtpEndpointImpl::fillStatsReport (std::map
     collectEndpointStats (report, getId (), e_stats, timestamp);
   }
 
-  rtc_stats = kms_utils_get_structure_by_name (stats, KMS_RTC_STATISTICS_FIELD);
+  SdpEndpointImpl::fillStatsReport (report, stats, timestamp);
+}
+
+std::map <std::string, std::shared_ptr<Stats>>
+    BaseRtpEndpointImpl::generateStats (const gchar *selector)
+{
+  std::map <std::string, std::shared_ptr<Stats>> statsReport;
+  KmsRtpStatsSnapshot snapshot;
 
-  if (rtc_stats != NULL) {
-    collectRTCStats (report, timestamp, rtc_stats );
+  statsReport = SdpEndpointImpl::generateStats (selector);
+
+  if (selector != NULL && g_strcmp0 (selector, "audio") != 0 &&
+      g_strcmp0 (selector, "video") != 0) {
+    return statsReport;
   }
 
-  SdpEndpointImpl::fillStatsReport (report, stats, timestamp);
+  /* RTP counters are read directly from the element, see postConstructor */
+  kms_base_rtp_endpoint_get_rtp_stats (KMS_BASE_RTP_ENDPOINT (element),
+                                       selector, &snapshot);
+  collectRTCStats (statsReport, time (NULL), &snapshot);
+
+  return statsReport;
 }
 
 BaseRtpEndpointImpl::StaticConstructor BaseRtpEndpointImpl::staticConstructor;
@@ -64,6 +64,14 @@ public:
   virtual std::shared_ptr<RembParams> getRembParams ();
   virtual void setRembParams (std::shared_ptr<RembParams> rembParams);
 
+  virtual std::shared_ptr<JitterBufferParams> getJitterBufferParams ();
+  virtual void setJitterBufferParams (std::shared_ptr<JitterBufferParams>
+                                      jitterBufferParams);
+
+  virtual std::shared_ptr<ProtectionParams> getProtectionParams ();
+  virtual void setProtectionParams (std::shared_ptr<ProtectionParams>
+                                    protectionParams);
+
   sigc::signal<void, MediaStateChanged> signalMediaStateChanged;
   sigc::signal<void, ConnectionStateChanged> signalConnectionStateChanged;
 
@@ -81,6 +89,8 @@ protected:
   virtual void postConstructor ();
   virtual void fillStatsReport (std::map <std::string, std::shared_ptr<Stats>>
                                 &report, const GstStructure *stats, double timestamp);
+  virtual std::map <std::string, std::shared_ptr<Stats>> generateStats (
+        const gchar *selector);
 
 private:
 
@@ -28,6 +28,7 @@
 #include <KurentoException.hpp>
 #include <MediaPipelineImpl.hpp>
 #include <MediaSet.hpp>
+#include <BusDispatcher.hpp>
 #include <gst/gst.h>
 #include <ElementConnectionData.hpp>
 #include <DotGraph.hpp>
@@ -36,6 +37,7 @@
 #include "ElementStats.hpp"
 #include "kmsstats.h"
 #include <SignalHandler.hpp>
+#include <StatsPublisher.hpp>
 
 #define GST_CAT_DEFAULT kurento_media_element_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -153,6 +155,21 @@ public:
     return sinkPadName;
   }
 
+  std::shared_ptr<MediaType> getType ()
+  {
+    return type;
+  }
+
+  const std::string &getSourceDescription ()
+  {
+    return sourceDescription;
+  }
+
+  const std::string &getSinkDescription ()
+  {
+    return sinkDescription;
+  }
+
   GstPad *getSinkPad ()
   {
     std::shared_ptr <MediaElementImpl> sinkLocked = getSink ();
@@ -293,112 +310,65 @@ void
 _media_element_pad_added (GstElement *elem, GstPad *pad, gpointer data)
 {
   MediaElementImpl *self = (MediaElementImpl *) data;
-  bool retry = false;
+  std::unique_lock<std::recursive_mutex> lock (*self->connectionsMutex);
+  std::shared_ptr<MediaType> type;
+  std::string description;
 
   GST_LOG_OBJECT (pad, "Pad added");
 
-  do {
-    if (retry) {
-      GST_DEBUG_OBJECT (pad, "Retriying connection");
+  if (GST_PAD_IS_SRC (pad) ) {
+    if (g_str_has_prefix (GST_OBJECT_NAME (pad), "audio_") ) {
+      type = std::shared_ptr<MediaType> (new MediaType (MediaType::AUDIO) );
+      description = std::string (GST_OBJECT_NAME (pad) + sizeof ("audio_src") );
+    } else if (g_str_has_prefix (GST_OBJECT_NAME (pad), "video_") ) {
+      type = std::shared_ptr<MediaType> (new MediaType (MediaType::VIDEO) );
+      description = std::string (GST_OBJECT_NAME (pad) + sizeof ("video_src") );
+    } else {
+      type = std::shared_ptr<MediaType> (new MediaType (MediaType::DATA) );
+      description = std::string (GST_OBJECT_NAME (pad) + sizeof ("data_src") );
     }
 
-    if (GST_PAD_IS_SRC (pad) ) {
-      std::unique_lock<std::recursive_timed_mutex> lock (self->sinksMutex,
-          std::defer_lock);
-      std::shared_ptr<MediaType> type;
-
-      retry = !lock.try_lock_for (std::chrono::milliseconds {self->dist (self->rnd) });
-
-      if (retry) {
-        continue;
-      }
-
-      std::string description;
-
-      if (g_str_has_prefix (GST_OBJECT_NAME (pad), "audio_") ) {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::AUDIO) );
-        description = std::string (GST_OBJECT_NAME (pad) + sizeof ("audio_src") );
-      } else if (g_str_has_prefix (GST_OBJECT_NAME (pad), "video_") ) {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::VIDEO) );
-        description = std::string (GST_OBJECT_NAME (pad) + sizeof ("video_src") );
-      } else {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::DATA) );
-        description = std::string (GST_OBJECT_NAME (pad) + sizeof ("data_src") );
-      }
-
-      auto pos = description.find_last_of ("_");
-      description.erase (pos);
-
-      try {
-        auto connections = self->sinks.at (type).at (description);
-
-        for (auto it : connections) {
-          if (g_strcmp0 (GST_OBJECT_NAME (pad), it->getSourcePadName() ) == 0) {
-            std::unique_lock<std::recursive_timed_mutex> sinkLock (
-              it->getSink()->sourcesMutex,
-              std::defer_lock);
-
-            retry = !sinkLock.try_lock_for (std::chrono::milliseconds {self->dist (self->rnd) });
+    auto pos = description.find_last_of ("_");
+    description.erase (pos);
 
-            if (retry) {
-              continue;
-            }
+    try {
+      auto connections = self->sinks.at (type).at (description);
 
-            self->performConnection (it);
-          }
+      for (auto it : connections) {
+        if (g_strcmp0 (GST_OBJECT_NAME (pad), it->getSourcePadName() ) == 0) {
+          self->performConnection (it);
         }
-      } catch (std::out_of_range) {
-
-      }
-    } else {
-      std::unique_lock<std::recursive_timed_mutex> lock (self->sourcesMutex,
-          std::defer_lock);
-      std::shared_ptr<MediaType> type;
-
-      retry = !lock.try_lock_for (std::chrono::milliseconds {self->dist (self->rnd) });
-
-      if (retry) {
-        continue;
-      }
-
-      std::string description;
-
-      if (g_str_has_prefix (GST_OBJECT_NAME (pad), "sink_audio_") ) {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::AUDIO) );
-        description = std::string (GST_OBJECT_NAME (pad) + sizeof ("sink_audio") );
-      } else if (g_str_has_prefix (GST_OBJECT_NAME (pad), "sink_video_") ) {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::VIDEO) );
-        description = std::string (GST_OBJECT_NAME (pad) + sizeof ("sink_video") );
-      } else {
-        type = std::shared_ptr<MediaType> (new MediaType (MediaType::DATA) );
-        description = std::string (GST_OBJECT_NAME (pad) + sizeof ("sink_data") );
       }
+    } catch (std::out_of_range) {
 
-      try {
-        auto sourceData = self->sources.at (type).at (description);
-
-        auto source = sourceData->getSource();
-
-        if (source) {
-          if (g_strcmp0 (GST_OBJECT_NAME (pad),
-                         sourceData->getSinkPadName().c_str() ) == 0) {
-            std::unique_lock<std::recursive_timed_mutex> sourceLock (source->sinksMutex,
-                std::defer_lock);
+    }
+  } else {
+    if (g_str_has_prefix (GST_OBJECT_NAME (pad), "sink_audio_") ) {
+      type = std::shared_ptr<MediaType> (new MediaType (MediaType::AUDIO) );
+      description = std::string (GST_OBJECT_NAME (pad) + sizeof ("sink_audio") );
+    } else if (g_str_has_prefix (GST_OBJECT_NAME (pad), "sink_video_") ) {
+      type = std::shared_ptr<MediaType> (new MediaType (MediaType::VIDEO) );
+      description = std::string (GST_OBJECT_NAME (pad) + sizeof ("sink_video") );
+    } else {
+      type = std::shared_ptr<MediaType> (new MediaType (MediaType::DATA) );
+      description = std::string (GST_OBJECT_NAME (pad) + sizeof ("sink_data") );
+    }
 
-            retry = !sourceLock.try_lock_for (std::chrono::milliseconds {self->dist (self->rnd) });
+    try {
+      auto sourceData = self->sources.at (type).at (description);
 
-            if (retry) {
-              continue;
-            }
+      auto source = sourceData->getSource();
 
-            source->performConnection (sourceData);
-          }
+      if (source) {
+        if (g_strcmp0 (GST_OBJECT_NAME (pad),
+                       sourceData->getSinkPadName().c_str() ) == 0) {
+          source->performConnection (sourceData);
         }
-      } catch (std::out_of_range) {
-
       }
+    } catch (std::out_of_range) {
+
     }
-  } while (retry);
+  }
 }
 
 std::string
@@ -562,9 +532,12 @@ MediaElementImpl::MediaElementImpl (const boost::property_tree::ptree &config,
                             "Cannot create gstreamer element: " + factoryName);
   }
 
+  connectionsMutex = pipe->getConnectionsMutex ();
+
   bus = gst_pipeline_get_bus (GST_PIPELINE (pipe->getPipeline () ) );
   handlerId = g_signal_connect (bus, "message",
                                 G_CALLBACK (_media_element_impl_bus_message), this);
+  BusDispatcher::subscribe (bus, GST_MESSAGE_ERROR);
 
 
   padAddedHandlerId = g_signal_connect (element, "pad_added",
@@ -621,69 +594,100 @@ MediaElementImpl::release ()
   MediaObjectImpl::release();
 }
 
-void MediaElementImpl::disconnectAll ()
+/*
+ * Removes a connection from both of its ends, any of them can be NULL when
+ * it is being destroyed. Connections mutex must be held by the caller.
+ */
+void
+MediaElementImpl::removeConnection (std::shared_ptr
+                                    <ElementConnectionDataInternal> data, MediaElementImpl *source,
+                                    MediaElementImpl *sink)
 {
-  while (!getSinkConnections().empty() ) {
-    std::unique_lock<std::recursive_timed_mutex> sinkLock (sinksMutex,
-        std::defer_lock);
+  if (sink != NULL) {
+    auto itType = sink->sources.find (data->getType () );
 
-    if (!sinkLock.try_lock_for (std::chrono::milliseconds {dist (rnd) }) ) {
-      GST_DEBUG_OBJECT (getGstreamerElement(), "Retry disconnect all");
-      continue;
+    if (itType != sink->sources.end () ) {
+      auto it = itType->second.find (data->getSinkDescription () );
+
+      if (it != itType->second.end () && it->second == data) {
+        itType->second.erase (it);
+      }
     }
+  }
 
-    for (std::shared_ptr<ElementConnectionData> connData : getSinkConnections() ) {
-      auto sinkImpl = std::dynamic_pointer_cast <MediaElementImpl>
-                      (connData->getSink () );
-      std::unique_lock<std::recursive_timed_mutex> sinkLock (sinkImpl->sourcesMutex,
-          std::defer_lock);
+  if (source != NULL) {
+    gboolean ret;
+    auto itType = source->sinks.find (data->getType () );
 
-      if (sinkLock.try_lock_for (std::chrono::milliseconds {dist (rnd) }) ) {
-        disconnect (connData->getSink (), connData->getType (),
-                    connData->getSourceDescription (),
-                    connData->getSinkDescription () );
-      }
-      else {
-        GST_DEBUG_OBJECT (sinkImpl->getGstreamerElement(),
-                          "Retry disconnect all %" GST_PTR_FORMAT, getGstreamerElement() );
+    if (itType != source->sinks.end () ) {
+      auto it = itType->second.find (data->getSourceDescription () );
+
+      if (it != itType->second.end () ) {
+        it->second.erase (data);
       }
     }
+
+    g_signal_emit_by_name (source->getGstreamerElement (),
+                           "release-requested-pad", data->getSourcePadName (), &ret, NULL);
   }
+}
 
-  while (!getSourceConnections().empty() ) {
-    std::unique_lock<std::recursive_timed_mutex> sourceLock (sourcesMutex,
-        std::defer_lock);
+void MediaElementImpl::disconnectAll ()
+{
+  std::unique_lock<std::recursive_mutex> lock (*connectionsMutex);
+  std::vector<std::shared_ptr<ElementConnectionDataInternal>> sinkConnections;
+  std::vector<std::shared_ptr<ElementConnectionDataInternal>> sourceConnections;
+
+  for (auto &it : sinks) {
+    for (auto &it2 : it.second) {
+      sinkConnections.insert (sinkConnections.end (), it2.second.begin (),
+                              it2.second.end () );
+    }
+  }
 
-    if (!sourceLock.try_lock_for (std::chrono::milliseconds {dist (rnd) }) ) {
-      GST_DEBUG_OBJECT (getGstreamerElement(), "Retry disconnect all");
-      continue;
+  for (auto &it : sources) {
+    for (auto &it2 : it.second) {
+      sourceConnections.push_back (it2.second);
     }
+  }
 
-    for (std::shared_ptr<ElementConnectionData> connData :
-         getSourceConnections() ) {
-      auto sourceImpl = std::dynamic_pointer_cast <MediaElementImpl>
-                        (connData->getSource () );
-      std::unique_lock<std::recursive_timed_mutex> sourceLock (sourceImpl->sinksMutex,
-          std::defer_lock);
-
-      if (sourceLock.try_lock_for (std::chrono::milliseconds {dist (rnd) }) ) {
-        connData->getSource ()->disconnect (connData->getSink (),
-                                            connData->getType (),
-                                            connData->getSourceDescription (),
-                                            connData->getSinkDescription () );
-      }
-      else {
-        GST_DEBUG_OBJECT (sourceImpl->getGstreamerElement (),
-                          "Retry disconnect all %" GST_PTR_FORMAT, getGstreamerElement() );
-      }
+  GST_DEBUG_OBJECT (element, "Disconnecting %" G_GSIZE_FORMAT " sinks and %"
+                    G_GSIZE_FORMAT " sources", sinkConnections.size (),
+                    sourceConnections.size () );
+
+  for (auto conn : sinkConnections) {
+    removeConnection (conn, this, conn->getSink ().get () );
+  }
+
+  for (auto conn : sourceConnections) {
+    removeConnection (conn, conn->getSource ().get (), this);
+  }
+
+  lock.unlock ();
+
+  sinkConnections.insert (sinkConnections.end (), sourceConnections.begin (),
+                          sourceConnections.end () );
+
+  for (auto conn : sinkConnections) {
+    std::shared_ptr<MediaElementImpl> source = conn->getSource ();
+    std::shared_ptr<MediaElementImpl> sink = conn->getSink ();
+
+    /* Ends being destroyed cannot be referenced from the event */
+    if (!source || !sink) {
+      continue;
     }
+
+    ElementDisconnected elementDisconnected (source,
+        ElementDisconnected::getName (), sink, conn->getType (),
+        conn->getSourceDescription (), conn->getSinkDescription () );
+    source->signalElementDisconnected (elementDisconnected);
   }
 }
 
 std::vector<std::shared_ptr<ElementConnectionData>>
     MediaElementImpl::getSourceConnections ()
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sourcesMutex);
+  std::unique_lock<std::recursive_mutex> lock (*connectionsMutex);
   std::vector<std::shared_ptr<ElementConnectionData>> ret;
 
   for (auto it : sources) {
@@ -702,7 +706,7 @@ std::vector<std::shared_ptr<ElementConnectionData>>
     MediaElementImpl::getSourceConnections (
       std::shared_ptr<MediaType> mediaType)
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sourcesMutex);
+  std::unique_lock<std::recursive_mutex> lock (*connectionsMutex);
   std::vector<std::shared_ptr<ElementConnectionData>> ret;
 
   try {
@@ -724,7 +728,7 @@ std::vector<std::shared_ptr<ElementConnectionData>>
     MediaElementImpl::getSourceConnections (
       std::shared_ptr<MediaType> mediaType, const std::string &description)
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sourcesMutex);
+  std::unique_lock<std::recursive_mutex> lock (*connectionsMutex);
   std::vector<std::shared_ptr<ElementConnectionData>> ret;
 
   try {
@@ -741,7 +745,7 @@ std::vector<std::shared_ptr<ElementConnectionData>>
 std::vector<std::shared_ptr<ElementConnectionData>>
     MediaElementImpl::getSinkConnections ()
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
+  std::unique_lock<std::recursive_mutex> lock (*connectionsMutex);
   std::vector<std::shared_ptr<ElementConnectionData>> ret;
 
   for (auto it : sinks) {
@@ -763,7 +767,7 @@ std::vector<std::shared_ptr<ElementConnectionData>>
     MediaElementImpl::getSinkConnections (
       std::shared_ptr<MediaType> mediaType)
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
+  std::unique_lock<std::recursive_mutex> lock (*connectionsMutex);
   std::vector<std::shared_ptr<ElementConnectionData>> ret;
 
   try {
@@ -787,7 +791,7 @@ std::vector<std::shared_ptr<ElementConnectionData>>
     MediaElementImpl::getSinkConnections (
       std::shared_ptr<MediaType> mediaType, const std::string &description)
 {
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
+  std::unique_lock<std::recursive_mutex> lock (*connectionsMutex);
   std::vector<std::shared_ptr<ElementConnectionData>> ret;
 
   try {
@@ -852,8 +856,7 @@ void MediaElementImpl::connect (std::shared_ptr<MediaElement> sink,
                             "Media elements do not share pipeline");
   }
 
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
-  std::unique_lock<std::recursive_timed_mutex> sinkLock (sinkImpl->sourcesMutex);
+  std::unique_lock<std::recursive_mutex> lock (*connectionsMutex);
   std::vector <std::shared_ptr <ElementConnectionData>> connections;
   std::shared_ptr <ElementConnectionDataInternal> connectionData (
     new ElementConnectionDataInternal (std::dynamic_pointer_cast<MediaElement>
@@ -896,7 +899,6 @@ void MediaElementImpl::connect (std::shared_ptr<MediaElement> sink,
 
   performConnection (connectionData);
 
-  sinkLock.unlock();
   lock.unlock ();
 
   ElementConnected elementConnected (shared_from_this(),
@@ -984,8 +986,7 @@ void MediaElementImpl::disconnect (std::shared_ptr<MediaElement> sink,
 
   std::shared_ptr<MediaElementImpl> sinkImpl =
     std::dynamic_pointer_cast<MediaElementImpl> (sink);
-  std::unique_lock<std::recursive_timed_mutex> sinkLock (sinkImpl->sourcesMutex);
-  std::unique_lock<std::recursive_timed_mutex> lock (sinksMutex);
+  std::unique_lock<std::recursive_mutex> lock (*connectionsMutex);
 
   GST_DEBUG ("Disconnecting %s - %s params %s %s %s", getName().c_str(),
              sink->getName ().c_str (), mediaType->getString ().c_str (),
@@ -997,14 +998,13 @@ void MediaElementImpl::disconnect (std::shared_ptr<MediaElement> sink,
 
     connectionData = sinkImpl->sources.at (mediaType).at (sinkMediaDescription);
 
-    if (connectionData->toInterface()->getSourceDescription() ==
-        sourceMediaDescription) {
+    if (connectionData->getSourceDescription() == sourceMediaDescription) {
       sinkImpl->sources.at (mediaType).erase (sinkMediaDescription);
     }
 
     for (auto conn : sinks.at (mediaType).at (sourceMediaDescription) ) {
-      if (conn->toInterface()->getSink() == sink &&
-          conn->toInterface()->getSinkDescription() == sinkMediaDescription) {
+      if (conn->getSink() == sinkImpl &&
+          conn->getSinkDescription() == sinkMediaDescription) {
         sinks.at (mediaType).at (sourceMediaDescription).erase (conn);
         break;
       }
@@ -1016,7 +1016,6 @@ void MediaElementImpl::disconnect (std::shared_ptr<MediaElement> sink,
 
   }
 
-  sinkLock.unlock();
   lock.unlock ();
 
   ElementDisconnected elementDisconnected (shared_from_this(),
@@ -1186,6 +1185,24 @@ void MediaElementImpl::setMaxOutputBitrate (int maxOutputBitrate)
                 NULL);
 }
 
+int MediaElementImpl::getStatsUpdateInterval ()
+{
+  return statsUpdateInterval;
+}
+
+void MediaElementImpl::setStatsUpdateInterval (int statsUpdateInterval)
+{
+  if (statsUpdateInterval < 0) {
+    throw KurentoException (MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                            "Stats update interval cannot be negative");
+  }
+
+  this->statsUpdateInterval = statsUpdateInterval;
+  StatsPublisher::getPublisher ()->setInterval (std::dynamic_pointer_cast
+      <MediaObjectImpl> (shared_from_this () ),
+      std::chrono::milliseconds (statsUpdateInterval) );
+}
+
 std::map <std::string, std::shared_ptr<Stats>>
     MediaElementImpl::generateStats (const gchar *selector)
 {
@@ -23,12 +23,13 @@
 #include "MediaLatencyStat.hpp"
 #include <EventHandler.hpp>
 #include <gst/gst.h>
+#include <atomic>
 #include <mutex>
 #include <set>
-#include <random>
 #include "MediaFlowOutStateChange.hpp"
 #include "MediaFlowInStateChange.hpp"
 #include "MediaFlowState.hpp"
+#include "StatsUpdate.hpp"
 #include "commons/kmselement.h"
 
 namespace kurento
@@ -164,6 +165,9 @@ public:
   virtual int getMaxOutputBitrate () override;
   virtual void setMaxOutputBitrate (int maxOutputBitrate) override;
 
+  virtual int getStatsUpdateInterval () override;
+  virtual void setStatsUpdateInterval (int statsUpdateInterval) override;
+
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
                         std::shared_ptr<EventHandler> handler) override;
@@ -172,6 +176,7 @@ public:
   sigc::signal<void, ElementDisconnected> signalElementDisconnected;
   sigc::signal<void, MediaFlowOutStateChange> signalMediaFlowOutStateChange;
   sigc::signal<void, MediaFlowInStateChange> signalMediaFlowInStateChange;
+  sigc::signal<void, StatsUpdate> signalStatsUpdate;
 
   virtual void invoke (std::shared_ptr<MediaObjectImpl> obj,
                        const std::string &methodName, const Json::Value &params,
@@ -191,6 +196,8 @@ protected:
                             &latencyStats, const GstStructure *stats);
   virtual void fillStatsReport (std::map <std::string, std::shared_ptr<Stats>>
                                 &report, const GstStructure *stats, double timestamp);
+  virtual std::map <std::string, std::shared_ptr<Stats>> generateStats (
+        const gchar *selector);
 
   virtual void prepareSinkConnection (std::shared_ptr<MediaElement> src,
                                       std::shared_ptr<MediaType> mediaType,
@@ -198,8 +205,8 @@ protected:
                                       const std::string &sinkMediaDescription);
 
 private:
-  std::recursive_timed_mutex sourcesMutex;
-  std::recursive_timed_mutex sinksMutex;
+  /* Shared by all the elements of the pipeline, see MediaPipelineImpl */
+  std::shared_ptr<std::recursive_mutex> connectionsMutex;
 
   std::map < std::shared_ptr <MediaType>, std::map < std::string,
       std::shared_ptr<ElementConnectionDataInternal >> , MediaTypeCmp > sources;
@@ -207,17 +214,15 @@ private:
       std::set<std::shared_ptr<ElementConnectionDataInternal> >> , MediaTypeCmp >
       sinks;
 
-  std::mt19937_64 rnd {std::random_device{}() };
-  std::uniform_int_distribution<> dist {1, 100};
-
   gulong padAddedHandlerId = 0;
   gulong mediaFlowOutHandler = 0;
   gulong mediaFlowInHandler = 0;
+  std::atomic<int> statsUpdateInterval {0};
 
   void disconnectAll();
+  static void removeConnection (std::shared_ptr<ElementConnectionDataInternal>
+                                data, MediaElementImpl *source, MediaElementImpl *sink);
   void performConnection (std::shared_ptr <ElementConnectionDataInternal> data);
-  std::map <std::string, std::shared_ptr<Stats>> generateStats (
-        const gchar *selector);
   void mediaFlowOutStateChange (gboolean isFlowing, gchar *padName,
                                 KmsElementPadType type);
   void mediaFlowInStateChange (gboolean isFlowing, gchar *padName,
@@ -23,12 +23,25 @@
 #include <DotGraph.hpp>
 #include <GstreamerDotDetails.hpp>
 #include <SignalHandler.hpp>
+#include <BusDispatcher.hpp>
+#include <PipelinePool.hpp>
+#include <AdmissionController.hpp>
+#include <PipelineResourceUsage.hpp>
+#include <StatsPublisher.hpp>
+#include <mutex>
 #include "kmselement.h"
 
 #define GST_CAT_DEFAULT kurento_media_pipeline_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoMediaPipelineImpl"
 
+#define POOL_SIZE "poolSize"
+#define POOL_REFILL_RATE "poolRefillRate"
+#define POOL_REFILL_RATE_DEFAULT 10
+#define MAX_CPU_LOAD "maxCpuLoad"
+#define MAX_STREAMING_LAG "maxStreamingLag"
+#define MAX_TRANSCODERS "maxTranscoders"
+
 namespace kurento
 {
 void
@@ -84,7 +97,10 @@ void MediaPipelineImpl::postConstructor ()
   MediaObjectImpl::postConstructor ();
 
   bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
-  gst_bus_add_signal_watch (bus);
+  BusDispatcher::attach (bus);
+  BusDispatcher::subscribe (bus, GST_MESSAGE_ERROR);
+  accounting->attach (bus);
+  topology->attach (GST_BIN (pipeline) );
   busMessageHandler = register_signal_handler (G_OBJECT (bus), "message",
                       std::function <void (GstBus *, GstMessage *) > (std::bind (
                             &MediaPipelineImpl::busMessage, this,
@@ -97,21 +113,27 @@ void MediaPipelineImpl::postConstructor ()
 MediaPipelineImpl::MediaPipelineImpl (const boost::property_tree::ptree &config)
   : MediaObjectImpl (config)
 {
-  GstClock *clock;
+  static std::once_flag poolConfigured;
+
+  std::call_once (poolConfigured, [this] () {
+    PipelinePool::configure (getConfigValue <int, MediaPipeline> (POOL_SIZE, 0),
+                             getConfigValue <int, MediaPipeline> (POOL_REFILL_RATE,
+                                 POOL_REFILL_RATE_DEFAULT) );
+    AdmissionController::configure (
+      getConfigValue <int, MediaPipeline> (MAX_CPU_LOAD, 0),
+      getConfigValue <int, MediaPipeline> (MAX_STREAMING_LAG, 0),
+      getConfigValue <int, MediaPipeline> (MAX_TRANSCODERS, 0) );
+  });
 
-  pipeline = gst_pipeline_new (NULL);
+  AdmissionController::checkPipelineCreation ();
+
+  pipeline = PipelinePool::acquire ();
 
   if (pipeline == NULL) {
     throw KurentoException (MEDIA_OBJECT_NOT_AVAILABLE,
                             "Cannot create gstreamer pipeline");
   }
 
-  clock = gst_system_clock_obtain ();
-  gst_pipeline_use_clock (GST_PIPELINE (pipeline), clock);
-  g_object_unref (clock);
-
-  gst_element_set_state (pipeline, GST_STATE_PLAYING);
-
   busMessageHandler = 0;
 }
 
@@ -119,15 +141,19 @@ MediaPipelineImpl::~MediaPipelineImpl ()
 {
   GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline) );
 
-  gst_element_set_state (pipeline, GST_STATE_NULL);
-
   if (busMessageHandler > 0) {
     unregister_signal_handler (bus, busMessageHandler);
   }
 
-  gst_bus_remove_signal_watch (bus);
+  topology->detach (GST_BIN (pipeline) );
+  accounting->detach (bus);
+  BusDispatcher::detach (bus);
   g_object_unref (bus);
-  g_object_unref (pipeline);
+
+  if (!PipelinePool::release (pipeline) ) {
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    g_object_unref (pipeline);
+  }
 }
 
 std::string MediaPipelineImpl::getGstreamerDot (
@@ -143,6 +169,11 @@ std::string MediaPipelineImpl::getGstreamerDot()
                                  GstreamerDotDetails::SHOW_VERBOSE) ) );
 }
 
+std::string MediaPipelineImpl::getGstreamerTopology ()
+{
+  return topology->getSnapshot ();
+}
+
 bool
 MediaPipelineImpl::getLatencyStats ()
 {
@@ -193,6 +224,39 @@ MediaPipelineImpl::setLatencyStats (bool latencyStats)
   gst_iterator_free (it);
 }
 
+int
+MediaPipelineImpl::getStatsUpdateInterval ()
+{
+  return statsUpdateInterval;
+}
+
+void
+MediaPipelineImpl::setStatsUpdateInterval (int statsUpdateInterval)
+{
+  if (statsUpdateInterval < 0) {
+    throw KurentoException (MEDIA_OBJECT_ILLEGAL_PARAM_ERROR,
+                            "Stats update interval cannot be negative");
+  }
+
+  this->statsUpdateInterval = statsUpdateInterval;
+  StatsPublisher::getPublisher ()->setInterval (std::dynamic_pointer_cast
+      <MediaObjectImpl> (shared_from_this () ),
+      std::chrono::milliseconds (statsUpdateInterval) );
+}
+
+std::shared_ptr<PipelineResourceUsage>
+MediaPipelineImpl::getResourceUsage ()
+{
+  int elements = 0, pads = 0;
+
+  PipelineAccounting::countElements (GST_BIN (pipeline), elements, pads);
+
+  return std::shared_ptr<PipelineResourceUsage> (new PipelineResourceUsage (
+           std::dynamic_pointer_cast<MediaPipeline> (shared_from_this() ),
+           accounting->getCpuTime ().count (), accounting->getBytes (),
+           accounting->getBuffers (), elements, pads) );
+}
+
 bool
 MediaPipelineImpl::addElement (GstElement *element)
 {
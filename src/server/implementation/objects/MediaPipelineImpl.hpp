@@ -22,11 +22,16 @@
 #include <EventHandler.hpp>
 #include <gst/gst.h>
 #include <boost/property_tree/ptree.hpp>
+#include <PipelineAccounting.hpp>
+#include <PipelineTopology.hpp>
+#include <StatsUpdate.hpp>
+#include <atomic>
 
 namespace kurento
 {
 
 class MediaPipelineImpl;
+class PipelineResourceUsage;
 
 void Serialize (std::shared_ptr<MediaPipelineImpl> &object,
                 JsonSerializer &serializer);
@@ -49,9 +54,16 @@ public:
   virtual std::string getGstreamerDot (std::shared_ptr<GstreamerDotDetails>
                                        details);
 
+  virtual std::string getGstreamerTopology ();
+
   virtual bool getLatencyStats ();
   virtual void setLatencyStats (bool latencyStats);
 
+  virtual int getStatsUpdateInterval ();
+  virtual void setStatsUpdateInterval (int statsUpdateInterval);
+
+  sigc::signal<void, StatsUpdate> signalStatsUpdate;
+
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
                         std::shared_ptr<EventHandler> handler);
@@ -64,6 +76,19 @@ public:
 
   bool addElement (GstElement *element);
 
+  std::shared_ptr<PipelineResourceUsage> getResourceUsage ();
+
+  std::shared_ptr<PipelineAccounting> getAccounting ()
+  {
+    return accounting;
+  }
+
+  /* Guards the connections between all the elements of this pipeline */
+  std::shared_ptr<std::recursive_mutex> getConnectionsMutex ()
+  {
+    return connectionsMutex;
+  }
+
 protected:
   virtual void postConstructor ();
 private:
@@ -73,7 +98,15 @@ private:
   gulong busMessageHandler;
 
   std::recursive_mutex recMutex;
+  std::shared_ptr<std::recursive_mutex> connectionsMutex =
+    std::make_shared<std::recursive_mutex> ();
   bool latencyStats = false;
+  std::atomic<int> statsUpdateInterval {0};
+
+  std::shared_ptr<PipelineAccounting> accounting =
+    std::make_shared<PipelineAccounting> ();
+  std::shared_ptr<PipelineTopology> topology =
+    std::make_shared<PipelineTopology> ();
 
   void busMessage (GstMessage *message);
 
@@ -18,6 +18,8 @@
 #include <gst/gst.h>
 #include "ServerInfo.hpp"
 #include "MediaPipelineImpl.hpp"
+#include "PipelineResourceUsage.hpp"
+#include "PipelinesResourceUsage.hpp"
 #include "ServerManagerImpl.hpp"
 #include <jsonrpc/JsonSerializer.hpp>
 #include <KurentoException.hpp>
@@ -29,6 +31,11 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoServerManagerImpl"
 
 #define METADATA "metadata"
+#define RESOURCE_USAGE_INTERVAL "resourceUsageInterval"
+#define RESOURCE_USAGE_INTERVAL_DEFAULT 10
+#define METRICS_FILE "metricsFile"
+#define METRICS_INTERVAL "metricsInterval"
+#define METRICS_INTERVAL_DEFAULT 10
 
 namespace kurento
 {
@@ -57,7 +64,66 @@ ServerManagerImpl::ServerManagerImpl (const std::shared_ptr<ServerInfo> info,
                                       ModuleManager &moduleManager) : MediaObjectImpl (config),
   info (info), moduleManager (moduleManager)
 {
+  std::string metricsFile;
+  int interval, metricsInterval;
+
   metadata = childToString (config, METADATA);
+
+  metricsFile = getConfigValue <std::string, ServerManager> (METRICS_FILE, "");
+  metricsInterval = getConfigValue <int, ServerManager> (METRICS_INTERVAL,
+                    METRICS_INTERVAL_DEFAULT);
+
+  if (!metricsFile.empty () && metricsInterval > 0) {
+    metricsSink.reset (new MetricsFileSink (metricsFile,
+                                            std::chrono::seconds (metricsInterval) ) );
+  }
+
+  interval = getConfigValue <int, ServerManager> (RESOURCE_USAGE_INTERVAL,
+             RESOURCE_USAGE_INTERVAL_DEFAULT);
+
+  if (interval <= 0) {
+    return;
+  }
+
+  usageState = std::make_shared<UsageState> ();
+
+  /*
+   * The manager may be destroyed from this thread while reporting, when the
+   * report holds its last reference. After that only the state is used.
+   */
+  usageThread = std::thread ([this, interval] (std::shared_ptr<UsageState>
+  state) {
+    std::unique_lock <std::mutex> lock (state->mutex);
+
+    while (!state->cond.wait_for (lock, std::chrono::seconds (interval),
+    [state] () {
+    return state->terminated;
+  }) ) {
+      lock.unlock ();
+      reportResourceUsage ();
+      lock.lock ();
+    }
+  }, usageState);
+}
+
+ServerManagerImpl::~ServerManagerImpl ()
+{
+  if (!usageState) {
+    return;
+  }
+
+  std::unique_lock <std::mutex> lock (usageState->mutex);
+
+  usageState->terminated = true;
+  usageState->cond.notify_all ();
+  lock.unlock ();
+
+  /* Last reference could be released by the reporting thread itself */
+  if (usageThread.get_id () == std::this_thread::get_id () ) {
+    usageThread.detach ();
+  } else {
+    usageThread.join ();
+  }
 }
 
 std::shared_ptr<ServerInfo> ServerManagerImpl::getInfo ()
@@ -132,6 +198,50 @@ ServerManagerImpl::getUsedMemory()
   return get_int64 (stat, ' ', 22) / 1024;
 }
 
+std::vector<std::shared_ptr<PipelineResourceUsage>>
+    ServerManagerImpl::getPipelinesResourceUsage ()
+{
+  std::vector<std::shared_ptr<PipelineResourceUsage>> ret;
+
+  for (auto it : MediaSet::getMediaSet ()->getPipelines() ) {
+    auto pipeline = std::dynamic_pointer_cast <MediaPipelineImpl> (it);
+
+    if (pipeline) {
+      ret.push_back (pipeline->getResourceUsage () );
+    }
+  }
+
+  return ret;
+}
+
+std::string
+ServerManagerImpl::getMetrics ()
+{
+  return MetricsFileSink::render ();
+}
+
+/* Nothing can be accessed after self is released, it may be the last ref */
+void
+ServerManagerImpl::reportResourceUsage ()
+{
+  std::shared_ptr<MediaObject> self;
+
+  /* Nobody is subscribed, avoid walking all the pipelines */
+  if (signalPipelinesResourceUsage.empty () ) {
+    return;
+  }
+
+  try {
+    self = std::dynamic_pointer_cast<MediaObject> (shared_from_this () );
+    PipelinesResourceUsage event (self, getPipelinesResourceUsage () );
+
+    signalPipelinesResourceUsage (event);
+  } catch (std::bad_weak_ptr &e) {
+  } catch (std::exception &e) {
+    GST_WARNING ("Error reporting resource usage: %s", e.what () );
+  }
+}
+
 ServerManagerImpl::StaticConstructor ServerManagerImpl::staticConstructor;
 
 ServerManagerImpl::StaticConstructor::StaticConstructor()
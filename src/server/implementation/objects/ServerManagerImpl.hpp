@@ -23,6 +23,10 @@
 #include <EventHandler.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <ModuleManager.hpp>
+#include <MetricsFileSink.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 namespace kurento
 {
@@ -39,6 +43,7 @@ namespace kurento
 {
 class ServerInfo;
 class MediaPipelineImpl;
+class PipelineResourceUsage;
 } /* kurento */
 
 namespace kurento
@@ -53,7 +58,7 @@ public:
                      const boost::property_tree::ptree &config,
                      ModuleManager &moduleManager);
 
-  virtual ~ServerManagerImpl () {};
+  virtual ~ServerManagerImpl ();
 
   std::string getKmd (const std::string &moduleName) override;
 
@@ -72,12 +77,18 @@ public:
 
   virtual int64_t getUsedMemory() override;
 
+  virtual std::vector<std::shared_ptr<PipelineResourceUsage>>
+      getPipelinesResourceUsage () override;
+
+  virtual std::string getMetrics () override;
+
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
                         std::shared_ptr<EventHandler> handler) override;
 
   sigc::signal<void, ObjectCreated> signalObjectCreated;
   sigc::signal<void, ObjectDestroyed> signalObjectDestroyed;
+  sigc::signal<void, PipelinesResourceUsage> signalPipelinesResourceUsage;
   virtual void invoke (std::shared_ptr<MediaObjectImpl> obj,
                        const std::string &methodName, const Json::Value &params,
                        Json::Value &response) override;
@@ -91,6 +102,20 @@ private:
 
   ModuleManager &moduleManager;
 
+  /* Owned by the reporting thread too, it can outlive the manager */
+  struct UsageState {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool terminated = false;
+  };
+
+  std::thread usageThread;
+  std::shared_ptr<UsageState> usageState;
+
+  std::unique_ptr<MetricsFileSink> metricsSink;
+
+  void reportResourceUsage ();
+
   class StaticConstructor
   {
   public:
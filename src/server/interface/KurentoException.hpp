@@ -38,6 +38,7 @@
 #define INVALID_SESSION 40007
 #define MALFORMED_TRANSACTION 40008
 #define NOT_ENOUGH_RESOURCES 40009
+#define SERVER_OVERLOADED 40010
 
 /* MediaObject ERRORS */
 #define MEDIA_OBJECT_ERROR_MIN 40100
@@ -161,6 +162,9 @@ public:
     case NOT_ENOUGH_RESOURCES:
       return "NOT_ENOUGH_RESOURCES";
 
+    case SERVER_OVERLOADED:
+      return "SERVER_OVERLOADED";
+
     /* MediaObject ERRORS */
     case MEDIA_OBJECT_TYPE_NOT_FOUND:
       return "MEDIA_OBJECT_TYPE_NOT_FOUND";
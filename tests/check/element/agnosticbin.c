@@ -900,6 +900,205 @@ GST_START_TEST (encoded_input_link)
 }
 
 GST_END_TEST
+GST_START_TEST (simulcast_layers_link)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, TRUE);
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  GstElement *videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *encoder = gst_element_factory_make ("vp8enc", NULL);
+  GstElement *videotestsrc_low =
+      gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *encoder_low = gst_element_factory_make ("vp8enc", NULL);
+  GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+  GstElement *filter = gst_element_factory_make ("capsfilter", NULL);
+  GstElement *agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  GstPad *layer_sink, *src;
+  GstCaps *caps;
+  gboolean ret;
+
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, NULL);
+  g_object_set (G_OBJECT (videotestsrc_low), "is-live", TRUE, NULL);
+  g_object_set (G_OBJECT (encoder_low), "target-bitrate", 100000, NULL);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  g_object_set (G_OBJECT (fakesink), "sync", TRUE, "signal-handoffs", TRUE,
+      "async", FALSE, NULL);
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off), loop);
+
+  caps = gst_caps_from_string ("video/x-vp8");
+  g_object_set (G_OBJECT (filter), "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  mark_point ();
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, encoder,
+      videotestsrc_low, encoder_low, agnosticbin, filter, fakesink, NULL);
+  mark_point ();
+  ret = gst_element_link_many (videotestsrc, encoder, agnosticbin, filter,
+      fakesink, NULL);
+  fail_unless (ret);
+
+  layer_sink = gst_element_get_request_pad (agnosticbin, "sink_layer_%u");
+  fail_if (layer_sink == NULL);
+  ret = gst_element_link (videotestsrc_low, encoder_low);
+  fail_unless (ret);
+  src = gst_element_get_static_pad (encoder_low, "src");
+  fail_unless (gst_pad_link (src, layer_sink) == GST_PAD_LINK_OK);
+  g_object_unref (src);
+
+  mark_point ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  mark_point ();
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_element_release_request_pad (agnosticbin, layer_sink);
+  g_object_unref (layer_sink);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST
+#define LOW_LAYER_WIDTH 160
+
+static gboolean
+send_remb (gpointer sink_pad)
+{
+  GstStructure *remb = gst_structure_new ("REMB", "bitrate", G_TYPE_UINT,
+      100000, "ssrc", G_TYPE_UINT, 0, NULL);
+
+  gst_pad_push_event (GST_PAD (sink_pad),
+      gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM, remb));
+
+  return G_SOURCE_CONTINUE;
+}
+
+static GstPadProbeReturn
+low_layer_caps_probe (GstPad * pad, GstPadProbeInfo * info, gpointer switched)
+{
+  GstEvent *event = gst_pad_probe_info_get_event (info);
+  GstCaps *caps;
+  gint width;
+
+  if (GST_EVENT_TYPE (event) != GST_EVENT_CAPS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_event_parse_caps (event, &caps);
+
+  if (gst_structure_get_int (gst_caps_get_structure (caps, 0), "width",
+          &width) && width == LOW_LAYER_WIDTH) {
+    *(gboolean *) switched = TRUE;
+    g_idle_add (quit_main_loop_idle, loop);
+
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+GST_START_TEST (simulcast_layer_switch)
+{
+  GstElement *pipeline = gst_pipeline_new (__FUNCTION__);
+  GstElement *videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *filter_high = gst_element_factory_make ("capsfilter", NULL);
+  GstElement *encoder = gst_element_factory_make ("vp8enc", NULL);
+  GstElement *videotestsrc_low =
+      gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *filter_low = gst_element_factory_make ("capsfilter", NULL);
+  GstElement *encoder_low = gst_element_factory_make ("vp8enc", NULL);
+  GstElement *agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  GstElement *fakesink = gst_element_factory_make ("fakesink", NULL);
+  GstPad *layer_sink, *src, *sink;
+  gboolean switched = FALSE;
+  guint remb_source, timeout_source;
+  GSource *timeout;
+  GstCaps *caps;
+
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  g_object_set (G_OBJECT (videotestsrc), "is-live", TRUE, NULL);
+  g_object_set (G_OBJECT (videotestsrc_low), "is-live", TRUE, NULL);
+  g_object_set (G_OBJECT (encoder), "target-bitrate", 500000, "deadline",
+      G_GINT64_CONSTANT (1), NULL);
+  g_object_set (G_OBJECT (encoder_low), "target-bitrate", 50000, "deadline",
+      G_GINT64_CONSTANT (1), "keyframe-max-dist", 10, NULL);
+  g_object_set (G_OBJECT (fakesink), "sync", FALSE, "async", FALSE, NULL);
+
+  caps = gst_caps_from_string ("video/x-raw,width=320,height=240");
+  g_object_set (G_OBJECT (filter_high), "caps", caps, NULL);
+  gst_caps_unref (caps);
+  caps = gst_caps_new_simple ("video/x-raw", "width", G_TYPE_INT,
+      LOW_LAYER_WIDTH, "height", G_TYPE_INT, 120, NULL);
+  g_object_set (G_OBJECT (filter_low), "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  gst_bin_add_many (GST_BIN (pipeline), videotestsrc, filter_high, encoder,
+      videotestsrc_low, filter_low, encoder_low, agnosticbin, fakesink, NULL);
+  fail_unless (gst_element_link_many (videotestsrc, filter_high, encoder,
+          agnosticbin, NULL));
+  fail_unless (gst_element_link_many (videotestsrc_low, filter_low,
+          encoder_low, NULL));
+
+  layer_sink = gst_element_get_request_pad (agnosticbin, "sink_layer_%u");
+  fail_if (layer_sink == NULL);
+  src = gst_element_get_static_pad (encoder_low, "src");
+  fail_unless (gst_pad_link (src, layer_sink) == GST_PAD_LINK_OK);
+  g_object_unref (src);
+
+  caps = gst_caps_from_string ("video/x-vp8");
+  fail_unless (gst_element_link_filtered (agnosticbin, fakesink, caps));
+  gst_caps_unref (caps);
+
+  sink = gst_element_get_static_pad (fakesink, "sink");
+  gst_pad_add_probe (sink, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      low_layer_caps_probe, &switched, NULL);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* Estimation only fits the low layer, output must switch to it */
+  remb_source = g_timeout_add (500, send_remb, sink);
+  timeout_source = g_timeout_add_seconds (20, quit_main_loop_idle, loop);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  g_source_remove (remb_source);
+  timeout = g_main_context_find_source_by_id (NULL, timeout_source);
+  if (timeout != NULL) {
+    g_source_destroy (timeout);
+  }
+
+  fail_unless (switched);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_element_release_request_pad (agnosticbin, layer_sink);
+  g_object_unref (layer_sink);
+  g_object_unref (sink);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
 GST_START_TEST (simple_link)
 {
   GMainLoop *loop = g_main_loop_new (NULL, TRUE);
@@ -1352,6 +1551,152 @@ test_codec_config (const gchar * pipeline_str, const gchar * config_str,
   g_main_loop_unref (loop);
 }
 
+static guint
+count_children_of_type (GstElement * pipeline, const gchar * bin_name,
+    const gchar * type_name)
+{
+  GstElement *bin = gst_bin_get_by_name (GST_BIN (pipeline), bin_name);
+  GstIterator *it = gst_bin_iterate_elements (GST_BIN (bin));
+  GValue item = G_VALUE_INIT;
+  gboolean done = FALSE;
+  guint count = 0;
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item)) {
+      case GST_ITERATOR_OK:
+        if (g_strcmp0 (G_OBJECT_TYPE_NAME (g_value_get_object (&item)),
+                type_name) == 0) {
+          count++;
+        }
+        g_value_reset (&item);
+        break;
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync (it);
+        count = 0;
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+  g_object_unref (bin);
+
+  return count;
+}
+
+GST_START_TEST (same_caps_share_enc_tree_bin)
+{
+  GstElement *fakesink;
+  GstElement *pipeline =
+      gst_parse_launch
+      ("videotestsrc is-live=true ! agnosticbin name=ag "
+      "ag. ! video/x-vp8 ! fakesink async=true sync=true name=sink signal-handoffs=true "
+      "ag. ! video/x-vp8 ! fakesink async=true sync=true", NULL);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+
+  g_signal_connect (G_OBJECT (fakesink), "handoff",
+      G_CALLBACK (fakesink_hand_off), loop);
+
+  g_object_unref (fakesink);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  /* The second output must be served by the tree bin indexed for the first */
+  fail_unless_equals_int (count_children_of_type (pipeline, "ag",
+          "KmsEncTreeBin"), 1);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+static gboolean
+change_pixel_aspect_ratio_cb (gpointer pipeline)
+{
+  GstElement *capsfilter =
+      gst_bin_get_by_name (GST_BIN (pipeline), "input_caps");
+  gint *par_n = g_object_get_qdata (G_OBJECT (pipeline), count_key_quark ());
+  GstCaps *caps;
+
+  (*par_n)++;
+  caps = gst_caps_new_simple ("video/x-raw", "pixel-aspect-ratio",
+      GST_TYPE_FRACTION, *par_n, 1, NULL);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  g_object_unref (capsfilter);
+
+  if (*par_n == 3) {
+    GstElement *fakesink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+
+    g_signal_connect (G_OBJECT (fakesink), "handoff",
+        G_CALLBACK (fakesink_hand_off), loop);
+    g_object_unref (fakesink);
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+GST_START_TEST (input_same_format_reconfiguration)
+{
+  GstElement *pipeline =
+      gst_parse_launch
+      ("videotestsrc is-live=true ! capsfilter name=input_caps caps=video/x-raw,pixel-aspect-ratio=1/1 ! vp8enc deadline=1 ! agnosticbin name=ag "
+      "ag. ! video/x-raw ! fakesink async=false sync=false signal-handoffs=true name=sink "
+      "ag. ! video/x-vp8 ! fakesink async=false sync=false", NULL);
+  GstBus *bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gint *par_n = g_malloc0 (sizeof (gint));
+
+  loop = g_main_loop_new (NULL, TRUE);
+
+  *par_n = 1;
+  g_object_set_qdata_full (G_OBJECT (pipeline), count_key_quark (), par_n,
+      g_free);
+
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), pipeline);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* Only the pixel aspect ratio changes, so the format is kept and the
+   * input is reconfigured in place twice */
+  g_timeout_add_seconds (1, change_pixel_aspect_ratio_cb, pipeline);
+  g_timeout_add_seconds (10, timeout_check, pipeline);
+
+  mark_point ();
+  g_main_loop_run (loop);
+  mark_point ();
+
+  /* Decoding tree is rebuilt for the new caps, never duplicated */
+  fail_unless_equals_int (count_children_of_type (pipeline, "ag",
+          "KmsDecTreeBin"), 1);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
 GST_START_TEST (test_codec_config_vp8)
 {
   const gchar *pipeline_str =
@@ -1406,6 +1751,8 @@ agnostic2_suite (void)
   tcase_add_test (tc_chain, create_test);
   tcase_add_test (tc_chain, simple_link);
   tcase_add_test (tc_chain, encoded_input_link);
+  tcase_add_test (tc_chain, simulcast_layers_link);
+  tcase_add_test (tc_chain, simulcast_layer_switch);
   tcase_add_test (tc_chain, static_link);
   tcase_add_test (tc_chain, reconnect_test);
   if (FALSE) {
@@ -1428,6 +1775,8 @@ agnostic2_suite (void)
 
   tcase_add_test (tc_chain, test_raw_to_rtp);
   tcase_add_test (tc_chain, test_codec_to_rtp);
+  tcase_add_test (tc_chain, same_caps_share_enc_tree_bin);
+  tcase_add_test (tc_chain, input_same_format_reconfiguration);
 
   return s;
 }
@@ -19,6 +19,7 @@
 #include <glib.h>
 
 #include "kmslist.h"
+#include "kmsquarkmap.h"
 
 GST_START_TEST (list_create)
 {
@@ -124,6 +125,85 @@ GST_START_TEST (list_remove)
   kms_list_unref (list);
 }
 
+GST_END_TEST
+GST_START_TEST (quark_map_add)
+{
+  KmsQuarkMap *map;
+  KmsQuarkMapIter iter;
+  gpointer value;
+  GQuark key;
+  guint i;
+
+  map = kms_quark_map_new_full (NULL, NULL);
+
+  /* Go beyond the inline storage */
+  for (i = 1; i <= 2 * KMS_QUARK_MAP_INLINE_SIZE; i++) {
+    gchar *name = g_strdup_printf ("key%u", i);
+
+    kms_quark_map_insert (map, g_quark_from_string (name),
+        GUINT_TO_POINTER (i));
+    g_free (name);
+  }
+
+  fail_if (kms_quark_map_length (map) != 2 * KMS_QUARK_MAP_INLINE_SIZE);
+  fail_if (kms_quark_map_lookup_string (map, "key1") != GUINT_TO_POINTER (1));
+  fail_if (kms_quark_map_lookup_string (map, "key8") != GUINT_TO_POINTER (8));
+  fail_if (kms_quark_map_lookup_string (map, "missing-key") != NULL);
+
+  /* Replace an existing value */
+  kms_quark_map_insert (map, g_quark_from_string ("key2"),
+      GUINT_TO_POINTER (20));
+  fail_if (kms_quark_map_length (map) != 2 * KMS_QUARK_MAP_INLINE_SIZE);
+  fail_if (kms_quark_map_lookup_string (map, "key2") != GUINT_TO_POINTER (20));
+
+  fail_unless (kms_quark_map_remove (map, g_quark_from_string ("key1")));
+  fail_if (kms_quark_map_remove (map, g_quark_from_string ("key1")));
+  fail_if (kms_quark_map_length (map) != 2 * KMS_QUARK_MAP_INLINE_SIZE - 1);
+
+  i = 0;
+  kms_quark_map_iter_init (&iter, map);
+  while (kms_quark_map_iter_next (&iter, &key, &value)) {
+    fail_if (kms_quark_map_lookup (map, key) != value);
+    i++;
+  }
+
+  fail_if (i != kms_quark_map_length (map));
+
+  kms_quark_map_unref (map);
+}
+
+GST_END_TEST
+GST_START_TEST (quark_map_copy_on_write)
+{
+  KmsQuarkMap *map, *shared;
+  GQuark key;
+
+  map = kms_quark_map_new_full ((GBoxedCopyFunc) g_strdup, g_free);
+  key = g_quark_from_string ("key");
+  kms_quark_map_insert (map, key, g_strdup ("value"));
+
+  fail_unless (kms_quark_map_is_writable (map));
+  fail_unless (kms_quark_map_make_writable (map) == map);
+
+  shared = kms_quark_map_ref (map);
+  fail_if (kms_quark_map_is_writable (map));
+
+  map = kms_quark_map_make_writable (map);
+  fail_if (map == shared);
+  fail_unless (kms_quark_map_is_writable (map));
+  fail_unless (kms_quark_map_is_writable (shared));
+
+  kms_quark_map_insert (map, g_quark_from_string ("other"), g_strdup ("v"));
+  fail_if (kms_quark_map_length (map) != 2);
+  fail_if (kms_quark_map_length (shared) != 1);
+  fail_if (g_strcmp0 (kms_quark_map_lookup (map, key), "value") != 0);
+  fail_if (kms_quark_map_lookup (map, key) ==
+      kms_quark_map_lookup (shared, key));
+
+  kms_quark_map_unref (shared);
+  kms_quark_map_unref (map);
+}
+
 GST_END_TEST static Suite *
 lists_suite (void)
 {
@@ -135,6 +215,8 @@ lists_suite (void)
   tcase_add_test (tc_chain, list_create);
   tcase_add_test (tc_chain, list_add);
   tcase_add_test (tc_chain, list_remove);
+  tcase_add_test (tc_chain, quark_map_add);
+  tcase_add_test (tc_chain, quark_map_copy_on_write);
 
   return s;
 }
@@ -0,0 +1,305 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib.h>
+
+#include "kmsencoderpool.h"
+#include "kmsenctreebin.h"
+
+#define WAIT_RETRIES 100
+
+static guint
+get_stat (const gchar * name)
+{
+  GstStructure *stats = kms_encoder_pool_get_stats ();
+  guint64 value64;
+  guint value = 0;
+
+  if (gst_structure_get_uint64 (stats, name, &value64)) {
+    value = value64;
+  } else {
+    gst_structure_get_uint (stats, name, &value);
+  }
+
+  gst_structure_free (stats);
+
+  return value;
+}
+
+static void
+wait_idle (guint expected)
+{
+  guint i;
+
+  for (i = 0; i < WAIT_RETRIES && get_stat ("idle") != expected; i++) {
+    g_usleep (10000);
+  }
+
+  fail_unless (get_stat ("idle") == expected);
+}
+
+#define INPUT_CAPS "video/x-raw,format=I420,width=320,height=240,framerate=15/1"
+#define OTHER_INPUT_CAPS \
+  "video/x-raw,format=I420,width=640,height=480,framerate=15/1"
+
+/* Prerolls @encoder with INPUT_CAPS and takes it out of the pipeline */
+static void
+negotiate_encoder (GstElement * encoder)
+{
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *src = gst_element_factory_make ("videotestsrc", NULL);
+  GstElement *filter = gst_element_factory_make ("capsfilter", NULL);
+  GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+  GstCaps *caps = gst_caps_from_string (INPUT_CAPS);
+
+  g_object_set (filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  gst_bin_add_many (GST_BIN (pipeline), src, filter, encoder, sink, NULL);
+  fail_unless (gst_element_link_many (src, filter, encoder, sink, NULL));
+
+  gst_element_set_state (pipeline, GST_STATE_PAUSED);
+  fail_unless (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_SUCCESS);
+
+  gst_object_ref (encoder);
+  gst_bin_remove (GST_BIN (pipeline), encoder);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (pipeline);
+}
+
+GST_START_TEST (reuse_released)
+{
+  GstElementFactory *factory = gst_element_factory_find ("vp8enc");
+  GstCaps *caps = gst_caps_from_string (INPUT_CAPS);
+  GstCaps *other_caps = gst_caps_from_string (OTHER_INPUT_CAPS);
+  GstCaps *current_caps;
+  GstElement *enc1, *enc2, *enc3;
+  GstState state;
+  gint bitrate;
+  GstPad *sink;
+
+  fail_if (factory == NULL);
+
+  kms_encoder_pool_set_size (1);
+
+  enc1 = kms_encoder_pool_acquire (factory, caps);
+  fail_if (enc1 == NULL);
+
+  /* Pool is refilled with one standby instance */
+  wait_idle (1);
+
+  negotiate_encoder (enc1);
+  g_object_set (enc1, "target-bitrate", 100000, NULL);
+  kms_encoder_pool_release (enc1);
+
+  /* Released encoder is kept under its negotiated caps */
+  wait_idle (2);
+
+  enc2 = kms_encoder_pool_acquire (factory, caps);
+  fail_unless (enc2 == enc1);
+  fail_unless (g_object_is_floating (enc2));
+  gst_object_ref_sink (enc2);
+  fail_unless (get_stat ("hits") == 1);
+
+  /* Context is kept */
+  gst_element_get_state (enc2, &state, NULL, 0);
+  fail_unless (state == GST_STATE_PAUSED);
+  sink = gst_element_get_static_pad (enc2, "sink");
+  current_caps = gst_pad_get_current_caps (sink);
+  fail_if (current_caps == NULL);
+  fail_unless (gst_caps_is_subset (current_caps, caps));
+  gst_caps_unref (current_caps);
+  g_object_unref (sink);
+
+  /* Properties are reset */
+  g_object_get (enc2, "target-bitrate", &bitrate, NULL);
+  fail_if (bitrate == 100000);
+
+  /* Other caps cannot use that context, a standby encoder is given */
+  enc3 = kms_encoder_pool_acquire (factory, other_caps);
+  fail_if (enc3 == NULL);
+  fail_if (enc3 == enc1);
+  gst_object_ref_sink (enc3);
+  fail_unless (get_stat ("hits") == 1);
+  fail_unless (get_stat ("standby") == 1);
+
+  kms_encoder_pool_set_size (0);
+  kms_encoder_pool_release (enc2);
+  kms_encoder_pool_release (enc3);
+  wait_idle (0);
+
+  gst_caps_unref (caps);
+  gst_caps_unref (other_caps);
+  g_object_unref (factory);
+}
+
+GST_END_TEST
+GST_START_TEST (disabled_pool)
+{
+  GstElementFactory *factory = gst_element_factory_find ("identity");
+  GstElement *enc;
+
+  kms_encoder_pool_set_size (0);
+
+  enc = kms_encoder_pool_acquire (factory, NULL);
+  fail_if (enc == NULL);
+  gst_object_ref_sink (enc);
+  kms_encoder_pool_release (enc);
+
+  fail_unless (get_stat ("idle") == 0);
+
+  g_object_unref (factory);
+}
+
+GST_END_TEST
+GST_START_TEST (max_active)
+{
+  GstElementFactory *factory = gst_element_factory_find ("identity");
+  GstElement *enc1, *enc2, *enc3;
+
+  kms_encoder_pool_set_size (0);
+  kms_encoder_pool_set_max_active (1);
+
+  enc1 = kms_encoder_pool_acquire (factory, NULL);
+  fail_if (enc1 == NULL);
+  gst_object_ref_sink (enc1);
+  fail_unless (kms_encoder_pool_get_active () == 1);
+
+  /* Limit reached */
+  enc2 = kms_encoder_pool_acquire (factory, NULL);
+  fail_unless (enc2 == NULL);
+  fail_unless (get_stat ("rejected") == 1);
+
+  kms_encoder_pool_release (enc1);
+  fail_unless (kms_encoder_pool_get_active () == 0);
+
+  /* Destroying an encoder without releasing it also frees its slot */
+  enc3 = kms_encoder_pool_acquire (factory, NULL);
+  fail_if (enc3 == NULL);
+  gst_object_ref_sink (enc3);
+  g_object_unref (enc3);
+  fail_unless (kms_encoder_pool_get_active () == 0);
+
+  kms_encoder_pool_set_max_active (0);
+
+  g_object_unref (factory);
+}
+
+GST_END_TEST
+GST_START_TEST (enc_tree_bin_at_limit)
+{
+  GstElementFactory *factory = gst_element_factory_find ("identity");
+  GstCaps *caps = gst_caps_from_string ("video/x-vp8");
+  KmsEncTreeBin *bin;
+  GstElement *busy;
+
+  kms_encoder_pool_set_size (0);
+  kms_encoder_pool_set_max_active (1);
+
+  busy = kms_encoder_pool_acquire (factory, NULL);
+  fail_if (busy == NULL);
+  gst_object_ref_sink (busy);
+
+  /* Creation fails cleanly without an encoder */
+  bin = kms_enc_tree_bin_new (caps, NULL, 300000, 0, 0, NULL);
+  fail_unless (bin == NULL);
+  fail_unless (kms_encoder_pool_get_active () == 1);
+
+  kms_encoder_pool_release (busy);
+
+  bin = kms_enc_tree_bin_new (caps, NULL, 300000, 0, 0, NULL);
+  fail_if (bin == NULL);
+  fail_unless (kms_encoder_pool_get_active () == 1);
+
+  gst_object_ref_sink (bin);
+  g_object_unref (bin);
+  fail_unless (kms_encoder_pool_get_active () == 0);
+
+  kms_encoder_pool_set_max_active (0);
+
+  gst_caps_unref (caps);
+  g_object_unref (factory);
+}
+
+GST_END_TEST
+GST_START_TEST (agnosticbin_at_limit)
+{
+  GstElementFactory *factory = gst_element_factory_find ("identity");
+  GstElement *pipeline, *busy;
+  GstMessage *msg;
+  GstBus *bus;
+
+  kms_encoder_pool_set_size (0);
+  kms_encoder_pool_set_max_active (1);
+
+  busy = kms_encoder_pool_acquire (factory, NULL);
+  fail_if (busy == NULL);
+  gst_object_ref_sink (busy);
+
+  /* Transcoding is needed, for both encoded and RTP outputs */
+  pipeline =
+      gst_parse_launch ("videotestsrc is-live=true ! agnosticbin name=ab "
+      "ab. ! video/x-vp8 ! fakesink async=false "
+      "ab. ! application/x-rtp,media=(string)video,"
+      "encoding-name=(string)VP8,clock-rate=(int)90000 ! fakesink async=false",
+      NULL);
+  fail_if (pipeline == NULL);
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  /* Agnosticbin reports the missing encoder instead of crashing */
+  msg = gst_bus_timed_pop_filtered (bus, 5 * GST_SECOND,
+      GST_MESSAGE_WARNING | GST_MESSAGE_ERROR);
+  fail_if (msg == NULL);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_WARNING);
+  gst_message_unref (msg);
+
+  fail_unless (kms_encoder_pool_get_active () == 1);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+
+  kms_encoder_pool_release (busy);
+  kms_encoder_pool_set_max_active (0);
+
+  g_object_unref (factory);
+}
+
+GST_END_TEST
+/* Suite initialization */
+static Suite *
+encoderpool_suite (void)
+{
+  Suite *s = suite_create ("encoderpool");
+  TCase *tc_chain = tcase_create ("pool");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, disabled_pool);
+  tcase_add_test (tc_chain, reuse_released);
+  tcase_add_test (tc_chain, max_active);
+  tcase_add_test (tc_chain, enc_tree_bin_at_limit);
+  tcase_add_test (tc_chain, agnosticbin_at_limit);
+
+  return s;
+}
+
+GST_CHECK_MAIN (encoderpool);
@@ -0,0 +1,194 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib.h>
+
+#include "kmsjitterbuffercontrol.h"
+
+/* Default bounds of the control */
+#define MIN_LATENCY 20
+#define MAX_LATENCY 1000
+
+/* Latency required for 5 ms of jitter: 4 * 5 + 10 */
+#define LOW_JITTER 5
+#define LOW_JITTER_LATENCY 30
+
+GST_START_TEST (follow_jitter)
+{
+  KmsJitterBufferControl *control = kms_jitter_buffer_control_new ();
+  guint stable = 3;
+
+  /* Latency grows at once to cover the jitter plus the margin */
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 20,
+          10, FALSE, &stable), 50);
+  fail_unless_equals_int (stable, 0);
+
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 50,
+          10, FALSE, &stable), 50);
+  fail_unless_equals_int (stable, 1);
+
+  kms_jitter_buffer_control_destroy (control);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (late_packets)
+{
+  KmsJitterBufferControl *control = kms_jitter_buffer_control_new ();
+  guint stable = 4;
+
+  /* A quarter more, even if the jitter does not require it */
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 200,
+          LOW_JITTER, TRUE, &stable), 250);
+  fail_unless_equals_int (stable, 0);
+
+  /* Or what the jitter requires if it is more */
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 40,
+          20, TRUE, &stable), 90);
+
+  kms_jitter_buffer_control_destroy (control);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (stable_network)
+{
+  KmsJitterBufferControl *control = kms_jitter_buffer_control_new ();
+  guint stable = 0, i;
+
+  /* Latency is kept until the network has been stable for a while */
+  for (i = 1; i < 5; i++) {
+    fail_unless_equals_int (kms_jitter_buffer_control_get_target (control,
+            200, LOW_JITTER, FALSE, &stable), 200);
+    fail_unless_equals_int (stable, i);
+  }
+
+  /* Then a quarter of the excess is removed on every update */
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 200,
+          LOW_JITTER, FALSE, &stable), 200 - (200 - LOW_JITTER_LATENCY) / 4);
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 158,
+          LOW_JITTER, FALSE, &stable), 158 - (158 - LOW_JITTER_LATENCY) / 4);
+
+  kms_jitter_buffer_control_destroy (control);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (bounds)
+{
+  KmsJitterBufferControl *control = kms_jitter_buffer_control_new ();
+  GstStructure *params;
+  guint stable = 0;
+
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 200,
+          500, FALSE, &stable), MAX_LATENCY);
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 10,
+          0, FALSE, &stable), MIN_LATENCY);
+
+  params = gst_structure_new ("params", "min-latency", G_TYPE_INT, 100,
+      "max-latency", G_TYPE_INT, 300, NULL);
+  kms_jitter_buffer_control_set_params (control, params);
+  gst_structure_free (params);
+
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 100,
+          LOW_JITTER, TRUE, &stable), 125);
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 280,
+          LOW_JITTER, TRUE, &stable), 300);
+  fail_unless_equals_int (kms_jitter_buffer_control_get_target (control, 200,
+          0, FALSE, &stable), 200);
+
+  kms_jitter_buffer_control_destroy (control);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (min_change)
+{
+  KmsJitterBufferControl *control = kms_jitter_buffer_control_new ();
+
+  /* Small changes are not worth reconfiguring the pipeline latency */
+  fail_if (kms_jitter_buffer_control_needs_change (control, 100, 100));
+  fail_if (kms_jitter_buffer_control_needs_change (control, 100, 109));
+  fail_if (kms_jitter_buffer_control_needs_change (control, 100, 91));
+  fail_unless (kms_jitter_buffer_control_needs_change (control, 100, 110));
+  fail_unless (kms_jitter_buffer_control_needs_change (control, 100, 90));
+
+  /* Unless the latency is out of bounds */
+  fail_unless (kms_jitter_buffer_control_needs_change (control, 15,
+          MIN_LATENCY));
+  fail_unless (kms_jitter_buffer_control_needs_change (control, 1005,
+          MAX_LATENCY));
+
+  kms_jitter_buffer_control_destroy (control);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (disposed_jitterbuffer)
+{
+  KmsJitterBufferControl *control = kms_jitter_buffer_control_new ();
+  GObject *session = g_object_new (G_TYPE_OBJECT, NULL);
+  GstElement *jitterbuffer, *other;
+  guint jitter, target;
+
+  jitterbuffer = gst_element_factory_make ("rtpjitterbuffer", NULL);
+  other = gst_element_factory_make ("rtpjitterbuffer", NULL);
+  gst_object_ref_sink (jitterbuffer);
+  gst_object_ref_sink (other);
+
+  kms_jitter_buffer_control_add (control, jitterbuffer, session, 1234, 0);
+  fail_unless (kms_jitter_buffer_control_get_values (control, jitterbuffer,
+          &jitter, &target));
+  fail_if (kms_jitter_buffer_control_get_values (control, other, &jitter,
+          &target));
+
+  /* The control does not keep the jitter buffer alive */
+  g_object_add_weak_pointer (G_OBJECT (jitterbuffer),
+      (gpointer *) & jitterbuffer);
+  g_object_unref (jitterbuffer);
+  fail_unless (jitterbuffer == NULL);
+
+  /* Next update removes the entry without touching the jitter buffer */
+  g_usleep (1500 * G_TIME_SPAN_MILLISECOND);
+
+  kms_jitter_buffer_control_destroy (control);
+  g_object_unref (other);
+  g_object_unref (session);
+}
+
+GST_END_TEST;
+
+/* Suite initialization */
+static Suite *
+jitterbuffercontrol_suite (void)
+{
+  Suite *s = suite_create ("jitterbuffercontrol");
+  TCase *tc_chain = tcase_create ("control");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, follow_jitter);
+  tcase_add_test (tc_chain, late_packets);
+  tcase_add_test (tc_chain, stable_network);
+  tcase_add_test (tc_chain, bounds);
+  tcase_add_test (tc_chain, min_change);
+  tcase_add_test (tc_chain, disposed_jitterbuffer);
+
+  return s;
+}
+
+GST_CHECK_MAIN (jitterbuffercontrol);
@@ -0,0 +1,116 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib.h>
+
+#include "kmsloop.h"
+
+typedef struct _LoopData
+{
+  KmsLoop *loop;
+  GThread *thread;
+  gboolean current;
+  gboolean done;
+} LoopData;
+
+static GMutex mutex;
+static GCond cond;
+
+static gboolean
+record_thread (LoopData * data)
+{
+  g_mutex_lock (&mutex);
+  data->thread = g_thread_self ();
+  data->current = kms_loop_is_current_thread (data->loop);
+  data->done = TRUE;
+  g_cond_signal (&cond);
+  g_mutex_unlock (&mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+wait_done (LoopData * data)
+{
+  g_mutex_lock (&mutex);
+  while (!data->done) {
+    g_cond_wait (&cond, &mutex);
+  }
+  g_mutex_unlock (&mutex);
+}
+
+GST_START_TEST (shared_thread)
+{
+  LoopData data1 = { 0 }, data2 = { 0 };
+
+  data1.loop = kms_loop_new ();
+  data2.loop = kms_loop_new ();
+
+  kms_loop_idle_add (data1.loop, (GSourceFunc) record_thread, &data1);
+  kms_loop_idle_add (data2.loop, (GSourceFunc) record_thread, &data2);
+
+  wait_done (&data1);
+  wait_done (&data2);
+
+  fail_unless (data1.current);
+  fail_unless (data2.current);
+  fail_unless (data1.thread == data2.thread);
+  fail_if (kms_loop_is_current_thread (data1.loop));
+
+  g_object_unref (data1.loop);
+  g_object_unref (data2.loop);
+}
+
+GST_END_TEST
+GST_START_TEST (dispose_removes_sources)
+{
+  LoopData data1 = { 0 }, data2 = { 0 };
+
+  data1.loop = kms_loop_new ();
+  data2.loop = kms_loop_new ();
+
+  kms_loop_timeout_add (data1.loop, 50, (GSourceFunc) record_thread, &data1);
+  kms_loop_timeout_add (data2.loop, 100, (GSourceFunc) record_thread, &data2);
+
+  g_object_unref (data1.loop);
+
+  /* The shared thread keeps running sources of other loops */
+  wait_done (&data2);
+  fail_if (data1.done);
+
+  g_object_unref (data2.loop);
+}
+
+GST_END_TEST
+/* Suite initialization */
+static Suite *
+loop_suite (void)
+{
+  Suite *s = suite_create ("loop");
+  TCase *tc_chain = tcase_create ("shared");
+
+  g_setenv (KMS_LOOP_POOL_SIZE_ENV, "1", TRUE);
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, shared_thread);
+  tcase_add_test (tc_chain, dispose_removes_sources);
+
+  return s;
+}
+
+GST_CHECK_MAIN (loop);
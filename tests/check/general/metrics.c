@@ -0,0 +1,123 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <glib.h>
+
+#include "kmsmetrics.h"
+
+#define N_THREADS 4
+#define N_INCREMENTS 10000
+
+static gpointer
+increment_counter (KmsMetric * counter)
+{
+  guint i;
+
+  for (i = 0; i < N_INCREMENTS; i++) {
+    kms_metric_add (counter, 1);
+  }
+
+  return NULL;
+}
+
+GST_START_TEST (counter)
+{
+  KmsMetric *counter;
+  GThread *threads[N_THREADS];
+  gchar *text;
+  guint i;
+
+  counter = kms_metrics_get_counter ("test_counter", "Test counter");
+  fail_unless (kms_metrics_get_counter ("test_counter", "Test") == counter);
+
+  for (i = 0; i < N_THREADS; i++) {
+    threads[i] = g_thread_new (NULL, (GThreadFunc) increment_counter, counter);
+  }
+
+  for (i = 0; i < N_THREADS; i++) {
+    g_thread_join (threads[i]);
+  }
+
+  fail_unless (kms_metric_get (counter) == N_THREADS * N_INCREMENTS);
+
+  text = kms_metrics_render ();
+  fail_unless (strstr (text, "# TYPE test_counter counter\n") != NULL);
+  fail_unless (strstr (text, "test_counter_total 40000\n") != NULL);
+  fail_unless (g_str_has_suffix (text, "# EOF\n"));
+  g_free (text);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (gauge)
+{
+  KmsMetric *gauge;
+
+  gauge = kms_metrics_get_gauge ("test_gauge", "Test gauge");
+
+  kms_metric_set (gauge, 10);
+  kms_metric_add (gauge, -3);
+  fail_unless (kms_metric_get (gauge) == 7);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (histogram)
+{
+  const gdouble bounds[] = { 1, 10 };
+  KmsMetric *histogram;
+  gchar *text;
+
+  histogram = kms_metrics_get_histogram ("test_histogram", "Test histogram",
+      bounds, G_N_ELEMENTS (bounds));
+
+  kms_metric_observe (histogram, 0.5);
+  kms_metric_observe (histogram, 1);
+  kms_metric_observe (histogram, 5);
+  kms_metric_observe (histogram, 20);
+
+  /* Buckets are cumulative */
+  text = kms_metrics_render ();
+  fail_unless (strstr (text, "test_histogram_bucket{le=\"1\"} 2\n") != NULL);
+  fail_unless (strstr (text, "test_histogram_bucket{le=\"10\"} 3\n") !=
+      NULL);
+  fail_unless (strstr (text, "test_histogram_bucket{le=\"+Inf\"} 4\n") !=
+      NULL);
+  fail_unless (strstr (text, "test_histogram_count 4\n") != NULL);
+  fail_unless (strstr (text, "test_histogram_sum 26.5\n") != NULL);
+  g_free (text);
+}
+
+GST_END_TEST;
+
+/* Suite initialization */
+static Suite *
+metrics_suite (void)
+{
+  Suite *s = suite_create ("metrics");
+  TCase *tc_chain = tcase_create ("registry");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, counter);
+  tcase_add_test (tc_chain, gauge);
+  tcase_add_test (tc_chain, histogram);
+
+  return s;
+}
+
+GST_CHECK_MAIN (metrics);
@@ -0,0 +1,341 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+#include <glib.h>
+#include <string.h>
+
+#include "kmsrtcpdispatcher.h"
+
+#define SESSION 1
+#define SENDER_SSRC 1234
+#define MEDIA_SSRC 5678
+#define NTP_TIME G_GUINT64_CONSTANT (0x0000000100000000)
+#define RTP_TIME 90000
+#define REMB_BITRATE 300000
+#define NACK_PID 100
+#define NACK_BLP 0x0005
+
+typedef struct _Received
+{
+  GMutex mutex;
+  GCond cond;
+  guint count;
+  GThread *thread;
+  guint session;
+  GstClockTime arrival;
+  KmsRtcpSenderReport sr;
+  KmsRtcpReportBlock rb;
+  KmsRtcpNack nack;
+  KmsRtcpKeyFrameRequest request;
+  guint32 remb_bitrate;
+  guint n_rembs;
+} Received;
+
+static void
+on_rtcp (const KmsRtcpCompound * compound, Received * received)
+{
+  g_mutex_lock (&received->mutex);
+
+  received->thread = g_thread_self ();
+  received->session = compound->session;
+  received->arrival = compound->arrival;
+
+  fail_unless_equals_int (compound->sender_reports->len, 1);
+  fail_unless_equals_int (compound->report_blocks->len, 1);
+  fail_unless_equals_int (compound->nacks->len, 1);
+  fail_unless_equals_int (compound->key_frame_requests->len, 1);
+
+  received->sr = g_array_index (compound->sender_reports,
+      KmsRtcpSenderReport, 0);
+  received->rb = g_array_index (compound->report_blocks,
+      KmsRtcpReportBlock, 0);
+  received->nack = g_array_index (compound->nacks, KmsRtcpNack, 0);
+  received->request = g_array_index (compound->key_frame_requests,
+      KmsRtcpKeyFrameRequest, 0);
+  received->n_rembs = compound->rembs->len;
+
+  if (received->n_rembs > 0) {
+    received->remb_bitrate =
+        g_array_index (compound->rembs, KmsRTCPPSFBAFBREMBPacket, 0).bitrate;
+  }
+
+  received->count++;
+  g_cond_signal (&received->cond);
+
+  g_mutex_unlock (&received->mutex);
+}
+
+static GstBuffer *
+create_compound (GstClockTime arrival)
+{
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  KmsRTCPPSFBAFBREMBPacket remb_packet;
+  GstRTCPPacket packet;
+  GstBuffer *buffer;
+  guint8 *fci;
+
+  buffer = gst_rtcp_buffer_new (1400);
+  GST_BUFFER_DTS (buffer) = arrival;
+  gst_rtcp_buffer_map (buffer, GST_MAP_READWRITE, &rtcp);
+
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_SR, &packet));
+  gst_rtcp_packet_sr_set_sender_info (&packet, SENDER_SSRC, NTP_TIME,
+      RTP_TIME, 10, 1000);
+  gst_rtcp_packet_add_rb (&packet, MEDIA_SSRC, 25, 3, 500, 10, 0, 0);
+
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_RTPFB,
+          &packet));
+  gst_rtcp_packet_fb_set_type (&packet, GST_RTCP_RTPFB_TYPE_NACK);
+  gst_rtcp_packet_fb_set_sender_ssrc (&packet, SENDER_SSRC);
+  gst_rtcp_packet_fb_set_media_ssrc (&packet, MEDIA_SSRC);
+  fail_unless (gst_rtcp_packet_fb_set_fci_length (&packet, 1));
+  fci = gst_rtcp_packet_fb_get_fci (&packet);
+  GST_WRITE_UINT16_BE (fci, NACK_PID);
+  GST_WRITE_UINT16_BE (fci + 2, NACK_BLP);
+
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_PSFB,
+          &packet));
+  gst_rtcp_packet_fb_set_type (&packet, GST_RTCP_PSFB_TYPE_PLI);
+  gst_rtcp_packet_fb_set_sender_ssrc (&packet, SENDER_SSRC);
+  gst_rtcp_packet_fb_set_media_ssrc (&packet, MEDIA_SSRC);
+
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_PSFB,
+          &packet));
+  remb_packet.bitrate = REMB_BITRATE;
+  remb_packet.n_ssrcs = 1;
+  remb_packet.ssrcs[0] = MEDIA_SSRC;
+  fail_unless (kms_rtcp_psfb_afb_remb_marshall_packet (&packet, &remb_packet,
+          SENDER_SSRC));
+
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  return buffer;
+}
+
+static void
+received_init (Received * received)
+{
+  memset (received, 0, sizeof (Received));
+  g_mutex_init (&received->mutex);
+  g_cond_init (&received->cond);
+}
+
+static void
+received_clear (Received * received)
+{
+  g_mutex_clear (&received->mutex);
+  g_cond_clear (&received->cond);
+}
+
+static void
+wait_received (Received * received, guint count)
+{
+  g_mutex_lock (&received->mutex);
+
+  while (received->count < count) {
+    g_cond_wait (&received->cond, &received->mutex);
+  }
+
+  g_mutex_unlock (&received->mutex);
+}
+
+GST_START_TEST (decode)
+{
+  KmsRtcpDispatcher *dispatcher = kms_rtcp_dispatcher_new ();
+  Received received;
+  GstBuffer *buffer;
+
+  received_init (&received);
+  kms_rtcp_dispatcher_add_handler (dispatcher,
+      (KmsRtcpHandlerFunc) on_rtcp, &received, NULL);
+
+  buffer = create_compound (GST_SECOND);
+  kms_rtcp_dispatcher_push (dispatcher, SESSION, buffer);
+  gst_buffer_unref (buffer);
+
+  wait_received (&received, 1);
+
+  /* Handlers never run in the thread pushing the RTCP */
+  fail_if (received.thread == g_thread_self ());
+  fail_unless_equals_int (received.session, SESSION);
+  fail_unless_equals_uint64 (received.arrival, GST_SECOND);
+
+  fail_unless_equals_int (received.sr.ssrc, SENDER_SSRC);
+  fail_unless_equals_uint64 (received.sr.ntp_time, NTP_TIME);
+  fail_unless_equals_int (received.sr.rtp_time, RTP_TIME);
+
+  fail_unless_equals_int (received.rb.sender_ssrc, SENDER_SSRC);
+  fail_unless_equals_int (received.rb.ssrc, MEDIA_SSRC);
+  fail_unless_equals_int (received.rb.fraction_lost, 25);
+  fail_unless_equals_int (received.rb.packets_lost, 3);
+
+  fail_unless_equals_int (received.nack.media_ssrc, MEDIA_SSRC);
+  fail_unless_equals_int (received.nack.pid, NACK_PID);
+  fail_unless_equals_int (received.nack.blp, NACK_BLP);
+
+  fail_unless_equals_int (received.request.media_ssrc, MEDIA_SSRC);
+  fail_if (received.request.fir);
+
+  fail_unless_equals_int (received.n_rembs, 1);
+  fail_unless_equals_int (received.remb_bitrate, REMB_BITRATE);
+
+  g_object_unref (dispatcher);
+  received_clear (&received);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (remove_handler)
+{
+  KmsRtcpDispatcher *dispatcher = kms_rtcp_dispatcher_new ();
+  Received received, removed;
+  GstBuffer *buffer;
+  guint id;
+
+  received_init (&received);
+  received_init (&removed);
+
+  id = kms_rtcp_dispatcher_add_handler (dispatcher,
+      (KmsRtcpHandlerFunc) on_rtcp, &removed, NULL);
+  kms_rtcp_dispatcher_remove_handler (dispatcher, id);
+  kms_rtcp_dispatcher_add_handler (dispatcher,
+      (KmsRtcpHandlerFunc) on_rtcp, &received, NULL);
+
+  buffer = create_compound (GST_SECOND);
+  kms_rtcp_dispatcher_push (dispatcher, SESSION, buffer);
+  kms_rtcp_dispatcher_push (dispatcher, SESSION, buffer);
+  gst_buffer_unref (buffer);
+
+  wait_received (&received, 2);
+  fail_unless_equals_int (removed.count, 0);
+
+  g_object_unref (dispatcher);
+  received_clear (&received);
+  received_clear (&removed);
+}
+
+GST_END_TEST;
+
+typedef struct _RemoveData
+{
+  KmsRtcpDispatcher *dispatcher;
+  guint id;
+} RemoveData;
+
+static void
+remove_other (const KmsRtcpCompound * compound, RemoveData * data)
+{
+  if (data->id != 0) {
+    kms_rtcp_dispatcher_remove_handler (data->dispatcher, data->id);
+    data->id = 0;
+  }
+}
+
+GST_START_TEST (remove_from_handler)
+{
+  KmsRtcpDispatcher *dispatcher = kms_rtcp_dispatcher_new ();
+  Received received, removed;
+  RemoveData data;
+  GstBuffer *buffer;
+
+  received_init (&received);
+  received_init (&removed);
+
+  /* The first handler removes the one after it */
+  data.dispatcher = dispatcher;
+  kms_rtcp_dispatcher_add_handler (dispatcher,
+      (KmsRtcpHandlerFunc) remove_other, &data, NULL);
+  data.id = kms_rtcp_dispatcher_add_handler (dispatcher,
+      (KmsRtcpHandlerFunc) on_rtcp, &removed, NULL);
+  kms_rtcp_dispatcher_add_handler (dispatcher,
+      (KmsRtcpHandlerFunc) on_rtcp, &received, NULL);
+
+  buffer = create_compound (GST_SECOND);
+  kms_rtcp_dispatcher_push (dispatcher, SESSION, buffer);
+  wait_received (&received, 1);
+  kms_rtcp_dispatcher_push (dispatcher, SESSION, buffer);
+  wait_received (&received, 2);
+  gst_buffer_unref (buffer);
+
+  fail_unless_equals_int (removed.count, 0);
+
+  g_object_unref (dispatcher);
+  received_clear (&received);
+  received_clear (&removed);
+}
+
+GST_END_TEST;
+
+#define N_DISPATCHERS 16
+
+GST_START_TEST (shared_threads)
+{
+  KmsRtcpDispatcher *dispatchers[N_DISPATCHERS];
+  Received received[N_DISPATCHERS];
+  GHashTable *threads;
+  GstBuffer *buffer;
+  guint i;
+
+  threads = g_hash_table_new (g_direct_hash, g_direct_equal);
+  buffer = create_compound (GST_SECOND);
+
+  for (i = 0; i < N_DISPATCHERS; i++) {
+    dispatchers[i] = kms_rtcp_dispatcher_new ();
+    received_init (&received[i]);
+    kms_rtcp_dispatcher_add_handler (dispatchers[i],
+        (KmsRtcpHandlerFunc) on_rtcp, &received[i], NULL);
+    kms_rtcp_dispatcher_push (dispatchers[i], SESSION, buffer);
+  }
+
+  for (i = 0; i < N_DISPATCHERS; i++) {
+    wait_received (&received[i], 1);
+    g_hash_table_add (threads, received[i].thread);
+  }
+
+  /* Dispatchers do not get a thread each */
+  fail_unless (g_hash_table_size (threads) < N_DISPATCHERS);
+
+  for (i = 0; i < N_DISPATCHERS; i++) {
+    g_object_unref (dispatchers[i]);
+    received_clear (&received[i]);
+  }
+
+  gst_buffer_unref (buffer);
+  g_hash_table_unref (threads);
+}
+
+GST_END_TEST;
+
+/* Suite initialization */
+static Suite *
+rtcpdispatcher_suite (void)
+{
+  Suite *s = suite_create ("rtcpdispatcher");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, decode);
+  tcase_add_test (tc_chain, remove_handler);
+  tcase_add_test (tc_chain, remove_from_handler);
+  tcase_add_test (tc_chain, shared_threads);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtcpdispatcher);
@@ -0,0 +1,247 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <glib.h>
+
+#include "kmsrtppacer.h"
+#include "kmsutils.h"
+
+#define SSRC 1234
+#define PAYLOAD_SIZE 1000
+#define N_PACKETS 10
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstPad *mysrcpad, *mysinkpad;
+
+static GstElement *
+setup_rtp_pacer (guint bitrate)
+{
+  GstElement *pacer = GST_ELEMENT (kms_rtp_pacer_new (bitrate));
+  GstCaps *caps;
+
+  mysrcpad = gst_check_setup_src_pad (pacer, &srctemplate);
+  mysinkpad = gst_check_setup_sink_pad (pacer, &sinktemplate);
+  gst_pad_set_active (mysrcpad, TRUE);
+  gst_pad_set_active (mysinkpad, TRUE);
+
+  caps = gst_caps_from_string ("application/x-rtp");
+  gst_check_setup_events (mysrcpad, pacer, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  fail_unless (gst_element_set_state (pacer, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  return pacer;
+}
+
+static void
+cleanup_rtp_pacer (GstElement * pacer)
+{
+  gst_check_drop_buffers ();
+  gst_element_set_state (pacer, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_check_teardown_src_pad (pacer);
+  gst_check_teardown_sink_pad (pacer);
+  gst_check_teardown_element (pacer);
+}
+
+static GstBuffer *
+create_rtp_buffer (guint16 seqnum)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+
+  buffer = gst_rtp_buffer_new_allocate (PAYLOAD_SIZE, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_ssrc (&rtp, SSRC);
+  gst_rtp_buffer_set_seq (&rtp, seqnum);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+static guint16
+get_seqnum (GstBuffer * buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint16 seqnum;
+
+  gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp);
+  seqnum = gst_rtp_buffer_get_seq (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return seqnum;
+}
+
+static void
+push_packets (void)
+{
+  guint16 seqnum;
+
+  for (seqnum = 0; seqnum < N_PACKETS; seqnum++) {
+    fail_unless (gst_pad_push (mysrcpad,
+            create_rtp_buffer (seqnum)) == GST_FLOW_OK);
+  }
+}
+
+GST_START_TEST (burst_is_spread)
+{
+  GstElement *pacer = setup_rtp_pacer (800000);
+  GstStructure *stats;
+  guint64 paced;
+  GList *l;
+  guint16 seqnum = 0;
+
+  push_packets ();
+
+  /* Only the first packets fit in the bucket */
+  g_mutex_lock (&check_mutex);
+  fail_unless (g_list_length (buffers) < N_PACKETS);
+
+  while (g_list_length (buffers) < N_PACKETS) {
+    g_cond_wait (&check_cond, &check_mutex);
+  }
+  g_mutex_unlock (&check_mutex);
+
+  for (l = buffers; l != NULL; l = l->next) {
+    fail_unless_equals_int (get_seqnum (l->data), seqnum++);
+  }
+
+  g_object_get (pacer, "stats", &stats, NULL);
+  gst_structure_get (stats, "paced", G_TYPE_UINT64, &paced, NULL);
+  gst_structure_free (stats);
+
+  fail_unless (paced > 0);
+
+  cleanup_rtp_pacer (pacer);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (not_paced)
+{
+  GstElement *pacer = setup_rtp_pacer (0);
+
+  push_packets ();
+
+  fail_unless_equals_int (g_list_length (buffers), N_PACKETS);
+
+  cleanup_rtp_pacer (pacer);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (remb_bitrate)
+{
+  GstElement *pacer = setup_rtp_pacer (800000);
+  guint bitrate;
+
+  gst_pad_push_event (mysinkpad,
+      kms_utils_remb_event_upstream_new (300000, SSRC));
+
+  g_object_get (pacer, "bitrate", &bitrate, NULL);
+  fail_unless_equals_int (bitrate, 300000);
+
+  cleanup_rtp_pacer (pacer);
+}
+
+GST_END_TEST;
+
+static guint64
+get_queued_bytes (GstElement * pacer)
+{
+  GstStructure *stats;
+  guint64 queued;
+
+  g_object_get (pacer, "stats", &stats, NULL);
+  gst_structure_get (stats, "queued-bytes", G_TYPE_UINT64, &queued, NULL);
+  gst_structure_free (stats);
+
+  return queued;
+}
+
+GST_START_TEST (relinked)
+{
+  GstElement *pacer = setup_rtp_pacer (800000);
+  GstPad *srcpad = gst_element_get_static_pad (pacer, "src");
+  guint16 seqnum;
+
+  fail_unless (gst_pad_unlink (srcpad, mysinkpad));
+
+  for (seqnum = 0; seqnum < N_PACKETS; seqnum++) {
+    gst_pad_push (mysrcpad, create_rtp_buffer (seqnum));
+  }
+
+  /* Let the timer fail to push the queued packets */
+  while (get_queued_bytes (pacer) > 0) {
+    g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+  }
+  g_usleep (50 * G_TIME_SPAN_MILLISECOND);
+
+  fail_unless (gst_pad_link (srcpad, mysinkpad) == GST_PAD_LINK_OK);
+
+  /* The error is reported once, then packets flow again */
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (seqnum++)) == GST_FLOW_NOT_LINKED);
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (seqnum)) == GST_FLOW_OK);
+
+  g_mutex_lock (&check_mutex);
+  while (buffers == NULL) {
+    g_cond_wait (&check_cond, &check_mutex);
+  }
+  g_mutex_unlock (&check_mutex);
+
+  fail_unless_equals_int (get_seqnum (buffers->data), seqnum);
+
+  gst_object_unref (srcpad);
+  cleanup_rtp_pacer (pacer);
+}
+
+GST_END_TEST;
+
+/* Suite initialization */
+static Suite *
+rtppacer_suite (void)
+{
+  Suite *s = suite_create ("rtppacer");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, burst_is_spread);
+  tcase_add_test (tc_chain, not_paced);
+  tcase_add_test (tc_chain, remb_bitrate);
+  tcase_add_test (tc_chain, relinked);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtppacer);
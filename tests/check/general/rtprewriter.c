@@ -0,0 +1,366 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <glib.h>
+
+#include "kmsrtprewriter.h"
+
+#define INPUT_SSRC 1234
+#define OUTPUT_SSRC 5678
+#define OUTPUT_PT 111
+#define PAYLOAD_SIZE 1000
+
+#define AUDIO_CAPS "application/x-rtp, media=audio, payload=111, " \
+  "clock-rate=48000, encoding-name=OPUS"
+#define VIDEO_CAPS "application/x-rtp, media=video, payload=100, " \
+  "clock-rate=90000, encoding-name=VP8"
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstPad *mysrcpad, *mysinkpad;
+
+static GstElement *
+setup_rtp_rewriter (const gchar * caps_str)
+{
+  GstElement *rewriter;
+  GstCaps *caps;
+
+  caps = gst_caps_from_string (caps_str);
+  rewriter = GST_ELEMENT (kms_rtp_rewriter_new (caps, OUTPUT_SSRC));
+  gst_caps_unref (caps);
+
+  mysrcpad = gst_check_setup_src_pad (rewriter, &srctemplate);
+  mysinkpad = gst_check_setup_sink_pad (rewriter, &sinktemplate);
+  gst_pad_set_active (mysrcpad, TRUE);
+  gst_pad_set_active (mysinkpad, TRUE);
+
+  caps = gst_caps_from_string ("application/x-rtp");
+  gst_check_setup_events (mysrcpad, rewriter, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  fail_unless (gst_element_set_state (rewriter, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  return rewriter;
+}
+
+static void
+cleanup_rtp_rewriter (GstElement * rewriter)
+{
+  gst_check_drop_buffers ();
+  gst_element_set_state (rewriter, GST_STATE_NULL);
+  gst_pad_set_active (mysrcpad, FALSE);
+  gst_pad_set_active (mysinkpad, FALSE);
+  gst_check_teardown_src_pad (rewriter);
+  gst_check_teardown_sink_pad (rewriter);
+  gst_check_teardown_element (rewriter);
+}
+
+static GstBuffer *
+create_rtp_buffer (guint32 ssrc, guint16 seqnum, gboolean marker,
+    GstMemory * payload)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+
+  buffer = gst_rtp_buffer_new_allocate (0, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_ssrc (&rtp, ssrc);
+  gst_rtp_buffer_set_seq (&rtp, seqnum);
+  gst_rtp_buffer_set_marker (&rtp, marker);
+  gst_rtp_buffer_set_payload_type (&rtp, 96);
+  gst_rtp_buffer_unmap (&rtp);
+
+  if (payload != NULL) {
+    gst_buffer_append_memory (buffer, gst_memory_ref (payload));
+  }
+
+  return buffer;
+}
+
+static void
+check_header (GstBuffer * buffer, guint16 seqnum)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+  fail_unless_equals_int (gst_rtp_buffer_get_ssrc (&rtp), OUTPUT_SSRC);
+  fail_unless_equals_int (gst_rtp_buffer_get_payload_type (&rtp), OUTPUT_PT);
+  fail_unless_equals_int (gst_rtp_buffer_get_seq (&rtp), seqnum);
+  gst_rtp_buffer_unmap (&rtp);
+}
+
+static guint16
+get_seqnum (GstBuffer * buffer)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint16 seqnum;
+
+  gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp);
+  seqnum = gst_rtp_buffer_get_seq (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  return seqnum;
+}
+
+GST_START_TEST (rewrite)
+{
+  GstElement *rewriter = setup_rtp_rewriter (AUDIO_CAPS);
+  GstBuffer *input, *output;
+  GstMemory *payload, *mem;
+  guint16 seqnum;
+
+  payload = gst_allocator_alloc (NULL, PAYLOAD_SIZE, NULL);
+  input = create_rtp_buffer (INPUT_SSRC, 10, FALSE, payload);
+
+  fail_unless (gst_pad_push (mysrcpad, gst_buffer_ref (input)) ==
+      GST_FLOW_OK);
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (INPUT_SSRC, 11, FALSE, payload)) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 2);
+
+  output = buffers->data;
+  seqnum = get_seqnum (output);
+  check_header (output, seqnum);
+  check_header (g_list_nth_data (buffers, 1), seqnum + 1);
+
+  /* Only the header is copied, the input is not modified */
+  mem = gst_buffer_peek_memory (output, 1);
+  fail_unless (mem == payload || mem->parent == payload);
+  fail_unless (gst_buffer_get_size (output) == gst_buffer_get_size (input));
+  fail_unless_equals_int (get_seqnum (input), 10);
+
+  gst_buffer_unref (input);
+  gst_memory_unref (payload);
+
+  cleanup_rtp_rewriter (rewriter);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (ssrc_change)
+{
+  GstElement *rewriter = setup_rtp_rewriter (AUDIO_CAPS);
+  guint16 seqnum;
+
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (INPUT_SSRC, 10, FALSE, NULL)) == GST_FLOW_OK);
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (INPUT_SSRC + 1, 500, FALSE, NULL)) ==
+      GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 2);
+
+  /* The source payloader changed, the output continues */
+  seqnum = get_seqnum (buffers->data);
+  check_header (g_list_nth_data (buffers, 1), seqnum + 1);
+
+  cleanup_rtp_rewriter (rewriter);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (wait_frame)
+{
+  GstElement *rewriter = setup_rtp_rewriter (VIDEO_CAPS);
+
+  /* Video starts after the end of the frame it joined in */
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (INPUT_SSRC, 1, FALSE, NULL)) == GST_FLOW_OK);
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (INPUT_SSRC, 2, TRUE, NULL)) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 0);
+
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (INPUT_SSRC, 3, FALSE, NULL)) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 1);
+
+  cleanup_rtp_rewriter (rewriter);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (any_payload_type)
+{
+  GstElement *rewriter = setup_rtp_rewriter (VIDEO_CAPS);
+  GstCaps *caps, *query_caps;
+
+  query_caps = gst_pad_peer_query_caps (mysrcpad, NULL);
+
+  /* Any payloader of the codec is accepted */
+  caps = gst_caps_from_string ("application/x-rtp, media=video, payload=96, "
+      "clock-rate=90000, encoding-name=VP8");
+  fail_unless (gst_caps_can_intersect (caps, query_caps));
+  gst_caps_unref (caps);
+
+  caps = gst_caps_from_string ("application/x-rtp, media=video, payload=96, "
+      "clock-rate=90000, encoding-name=H264");
+  fail_if (gst_caps_can_intersect (caps, query_caps));
+  gst_caps_unref (caps);
+
+  gst_caps_unref (query_caps);
+
+  cleanup_rtp_rewriter (rewriter);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (oversized)
+{
+  GstElement *rewriter = setup_rtp_rewriter (AUDIO_CAPS);
+  GstMemory *payload;
+
+  g_object_set (rewriter, "mtu", PAYLOAD_SIZE, NULL);
+  payload = gst_allocator_alloc (NULL, PAYLOAD_SIZE, NULL);
+
+  /* It cannot be split, it would be fragmented on the wire */
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (INPUT_SSRC, 10, FALSE, payload)) == GST_FLOW_OK);
+  fail_unless (gst_pad_push (mysrcpad,
+          create_rtp_buffer (INPUT_SSRC, 11, FALSE, NULL)) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 1);
+
+  gst_memory_unref (payload);
+
+  cleanup_rtp_rewriter (rewriter);
+}
+
+GST_END_TEST;
+
+static void
+count_handoff (GstElement * fakesink, GstBuffer * buf, GstPad * pad,
+    gint * count)
+{
+  g_atomic_int_inc (count);
+}
+
+static guint
+count_pay_tree_bins (GstElement * agnosticbin)
+{
+  GstIterator *it = gst_bin_iterate_elements (GST_BIN (agnosticbin));
+  GValue item = G_VALUE_INIT;
+  gboolean done = FALSE;
+  guint count = 0;
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item)) {
+      case GST_ITERATOR_OK:
+        if (g_strcmp0 (G_OBJECT_TYPE_NAME (g_value_get_object (&item)),
+                "KmsRtpPayTreeBin") == 0) {
+          count++;
+        }
+        g_value_reset (&item);
+        break;
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync (it);
+        count = 0;
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+
+  g_value_unset (&item);
+  gst_iterator_free (it);
+
+  return count;
+}
+
+GST_START_TEST (single_payloader)
+{
+  GstElement *pipeline, *agnosticbin;
+  gint received[2] = { 0, 0 };
+  GstCaps *caps;
+  gint64 end_time;
+  guint i;
+
+  pipeline = gst_parse_launch ("videotestsrc is-live=true ! "
+      "agnosticbin name=ag", NULL);
+  fail_if (pipeline == NULL);
+  agnosticbin = gst_bin_get_by_name (GST_BIN (pipeline), "ag");
+
+  /* Two endpoints sending the same source with the same codec */
+  caps = gst_caps_from_string (VIDEO_CAPS);
+
+  for (i = 0; i < G_N_ELEMENTS (received); i++) {
+    GstElement *rewriter, *fakesink;
+
+    rewriter = GST_ELEMENT (kms_rtp_rewriter_new (caps, OUTPUT_SSRC + i));
+    fakesink = gst_element_factory_make ("fakesink", NULL);
+    g_object_set (fakesink, "async", FALSE, "sync", FALSE,
+        "signal-handoffs", TRUE, NULL);
+    g_signal_connect (fakesink, "handoff", G_CALLBACK (count_handoff),
+        &received[i]);
+
+    gst_bin_add_many (GST_BIN (pipeline), rewriter, fakesink, NULL);
+    fail_unless (gst_element_link_many (agnosticbin, rewriter, fakesink,
+            NULL));
+  }
+
+  gst_caps_unref (caps);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  end_time = g_get_monotonic_time () + 10 * G_TIME_SPAN_SECOND;
+
+  while (g_atomic_int_get (&received[0]) == 0 ||
+      g_atomic_int_get (&received[1]) == 0) {
+    fail_if (g_get_monotonic_time () > end_time);
+    g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+  }
+
+  /* Each frame is payloaded once for both */
+  fail_unless_equals_int (count_pay_tree_bins (agnosticbin), 1);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (agnosticbin);
+  g_object_unref (pipeline);
+}
+
+GST_END_TEST;
+
+/* Suite initialization */
+static Suite *
+rtprewriter_suite (void)
+{
+  Suite *s = suite_create ("rtprewriter");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, rewrite);
+  tcase_add_test (tc_chain, ssrc_change);
+  tcase_add_test (tc_chain, wait_frame);
+  tcase_add_test (tc_chain, any_payload_type);
+  tcase_add_test (tc_chain, oversized);
+  tcase_add_test (tc_chain, single_payloader);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtprewriter);
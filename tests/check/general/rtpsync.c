@@ -159,6 +159,64 @@ GST_START_TEST (test_sync_one_stream)
 
 GST_END_TEST;
 
+GST_START_TEST (test_sync_buffer_list)
+{
+  KmsRtpSynchronizer *sync;
+  GstBufferList *list;
+
+  sync = kms_rtp_synchronizer_new (NULL, FALSE);
+  fail_unless (kms_rtp_synchronizer_add_clock_rate_for_pt (sync, 96, 90000,
+          NULL));
+
+  process_rtcp (sync, 0x1, G_GUINT64_CONSTANT (0), 0, 0);
+
+  list = gst_buffer_list_new ();
+  gst_buffer_list_add (list, generate_rtp_buffer_full (100, 0x1, 96, 0, 0));
+  gst_buffer_list_add (list, generate_rtp_buffer_full (200, 0x1, 96, 1,
+          90000));
+
+  fail_unless (kms_rtp_synchronizer_process_rtp_buffer_list (sync, list,
+          NULL));
+  fail_unless (GST_BUFFER_PTS (gst_buffer_list_get (list, 0)) == 0);
+  fail_unless (GST_BUFFER_PTS (gst_buffer_list_get (list, 1)) == GST_SECOND);
+
+  gst_buffer_list_unref (list);
+  g_object_unref (sync);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_sync_buffer_list_error)
+{
+  KmsRtpSynchronizer *sync;
+  GstBufferList *list;
+  GError *error = NULL;
+
+  sync = kms_rtp_synchronizer_new (NULL, FALSE);
+  fail_unless (kms_rtp_synchronizer_add_clock_rate_for_pt (sync, 96, 90000,
+          NULL));
+
+  process_rtcp (sync, 0x1, G_GUINT64_CONSTANT (0), 0, 0);
+
+  list = gst_buffer_list_new ();
+  gst_buffer_list_add (list, generate_rtp_buffer_full (100, 0x2, 96, 0, 0));
+  gst_buffer_list_add (list, generate_rtp_buffer_full (200, 0x1, 96, 1,
+          90000));
+  gst_buffer_list_add (list, generate_rtp_buffer_full (300, 0x3, 96, 2,
+          90000));
+
+  /* Other SSRCs fail, but the rest of the list is still processed */
+  fail_if (kms_rtp_synchronizer_process_rtp_buffer_list (sync, list,
+          &error));
+  fail_unless (error != NULL);
+  g_error_free (error);
+
+  gst_buffer_list_unref (list);
+  g_object_unref (sync);
+}
+
+GST_END_TEST;
+
 GST_START_TEST (test_sync_one_stream_rtptime_after_sr_rtptime)
 {
   KmsRtpSynchronizer *sync;
@@ -356,6 +414,8 @@ rtpsync_suite (void)
   tcase_add_test (tc_chain, test_sync_add_clock_rate_for_pt);
   tcase_add_test (tc_chain, test_sync_one_stream);
   tcase_add_test (tc_chain, test_sync_one_stream_rtptime_after_sr_rtptime);
+  tcase_add_test (tc_chain, test_sync_buffer_list);
+  tcase_add_test (tc_chain, test_sync_buffer_list_error);
   tcase_add_test (tc_chain, test_sync_two_streams);
   tcase_add_test (tc_chain, test_sync_avoid_negative_pts);
 
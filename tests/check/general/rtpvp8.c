@@ -0,0 +1,460 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <glib.h>
+#include <string.h>
+
+#include "kmsrtpvp8.h"
+#include "kmsvp8.h"
+#include "kmstemporallayermeta.h"
+
+#define VP8_CAPS "application/x-rtp, media=video, payload=96, " \
+  "clock-rate=90000, encoding-name=VP8"
+#define SSRC 1234
+
+/* Boolean entropy encoder from RFC 6386, section 7.3 */
+typedef struct _BoolEncoder
+{
+  guint8 *output;
+  guint32 range;
+  guint32 bottom;
+  gint bit_count;
+} BoolEncoder;
+
+static void
+bool_encoder_init (BoolEncoder * e, guint8 * output)
+{
+  e->output = output;
+  e->range = 255;
+  e->bottom = 0;
+  e->bit_count = 24;
+}
+
+static void
+add_one_to_output (guint8 * q)
+{
+  while (*--q == 255) {
+    *q = 0;
+  }
+  ++*q;
+}
+
+static void
+bool_encoder_write_bool (BoolEncoder * e, guint prob, guint value)
+{
+  guint32 split = 1 + (((e->range - 1) * prob) >> 8);
+
+  if (value) {
+    e->bottom += split;
+    e->range -= split;
+  } else {
+    e->range = split;
+  }
+
+  while (e->range < 128) {
+    e->range <<= 1;
+
+    if (e->bottom & (1u << 31)) {
+      add_one_to_output (e->output);
+    }
+
+    e->bottom <<= 1;
+
+    if (!--e->bit_count) {
+      *e->output++ = (guint8) (e->bottom >> 24);
+      e->bottom &= (1 << 24) - 1;
+      e->bit_count = 8;
+    }
+  }
+}
+
+static void
+bool_encoder_write_literal (BoolEncoder * e, guint value, guint bits)
+{
+  while (bits-- > 0) {
+    bool_encoder_write_bool (e, 128, (value >> bits) & 1);
+  }
+}
+
+static void
+bool_encoder_flush (BoolEncoder * e)
+{
+  gint c = e->bit_count;
+  guint32 v = e->bottom;
+
+  if (v & (1u << (32 - c))) {
+    add_one_to_output (e->output);
+  }
+
+  v <<= c & 7;
+  c >>= 3;
+  while (--c >= 0) {
+    v <<= 8;
+  }
+
+  c = 4;
+  while (--c >= 0) {
+    *e->output++ = (guint8) (v >> 24);
+    v <<= 8;
+  }
+}
+
+static gboolean
+parse_payload (const guint8 * payload, guint size, KmsRtpVp8Descriptor * desc)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+  gboolean ret;
+
+  buffer = gst_rtp_buffer_new_allocate (size, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  memcpy (gst_rtp_buffer_get_payload (&rtp), payload, size);
+  ret = kms_rtp_vp8_parse_descriptor (&rtp, desc);
+  gst_rtp_buffer_unmap (&rtp);
+  gst_buffer_unref (buffer);
+
+  return ret;
+}
+
+GST_START_TEST (descriptor_no_extension)
+{
+  const guint8 payload[] = { 0x13, 0x00 };
+  KmsRtpVp8Descriptor desc;
+
+  fail_unless (parse_payload (payload, sizeof (payload), &desc));
+  fail_unless (desc.start_of_partition);
+  fail_unless_equals_int (desc.partition_id, 3);
+  fail_unless_equals_int (desc.picture_id, -1);
+  fail_unless_equals_int (desc.tl0picidx, -1);
+  fail_unless_equals_int (desc.tid, -1);
+  fail_if (desc.layer_sync);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (descriptor_all_fields)
+{
+  /* X S, I L T K, M picture id 0x1234, TL0PICIDX 7, TID 2 Y KEYIDX 5 */
+  const guint8 payload[] = { 0x90, 0xf0, 0x92, 0x34, 0x07, 0xa5, 0x00 };
+  KmsRtpVp8Descriptor desc;
+
+  fail_unless (parse_payload (payload, sizeof (payload), &desc));
+  fail_unless (desc.start_of_partition);
+  fail_unless_equals_int (desc.partition_id, 0);
+  fail_unless_equals_int (desc.picture_id, 0x1234);
+  fail_unless_equals_int (desc.tl0picidx, 7);
+  fail_unless_equals_int (desc.tid, 2);
+  fail_unless (desc.layer_sync);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (descriptor_short_picture_id)
+{
+  /* X, I T, 7 bits picture id 0x45, TID 1 without Y */
+  const guint8 payload[] = { 0x80, 0xa0, 0x45, 0x40 };
+  KmsRtpVp8Descriptor desc;
+
+  fail_unless (parse_payload (payload, sizeof (payload), &desc));
+  fail_if (desc.start_of_partition);
+  fail_unless_equals_int (desc.picture_id, 0x45);
+  fail_unless_equals_int (desc.tl0picidx, -1);
+  fail_unless_equals_int (desc.tid, 1);
+  fail_if (desc.layer_sync);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (descriptor_truncated)
+{
+  const guint8 payload[] = { 0x90, 0xf0, 0x92, 0x34, 0x07, 0xa5 };
+  KmsRtpVp8Descriptor desc;
+  guint size;
+
+  fail_if (parse_payload (payload, 0, &desc));
+
+  /* Every field is required by the flags of the previous bytes */
+  for (size = 1; size < sizeof (payload); size++) {
+    fail_if (parse_payload (payload, size, &desc), "Parsed %u bytes", size);
+  }
+
+  fail_unless (parse_payload (payload, sizeof (payload), &desc));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (bool_decoder_round_trip)
+{
+  guint8 data[4096] = { 0 };
+  guint probs[1000], values[1000], literals[100];
+  KmsVp8BoolDecoder d;
+  BoolEncoder e;
+  GRand *rand = g_rand_new_with_seed (42);
+  guint i;
+
+  bool_encoder_init (&e, data);
+
+  for (i = 0; i < G_N_ELEMENTS (probs); i++) {
+    probs[i] = g_rand_int_range (rand, 1, 256);
+    /* Values biased as the probability says, as real streams are */
+    values[i] = g_rand_int_range (rand, 0, 256) >= probs[i];
+    bool_encoder_write_bool (&e, probs[i], values[i]);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (literals); i++) {
+    literals[i] = g_rand_int_range (rand, 0, 1 << 7);
+    bool_encoder_write_literal (&e, literals[i], 7);
+  }
+
+  bool_encoder_flush (&e);
+  fail_unless ((gsize) (e.output - data) < sizeof (data));
+
+  kms_vp8_bool_decoder_init (&d, data, e.output - data);
+
+  for (i = 0; i < G_N_ELEMENTS (probs); i++) {
+    fail_unless_equals_int (kms_vp8_bool_decoder_read_bool (&d, probs[i]),
+        values[i]);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (literals); i++) {
+    fail_unless_equals_int (kms_vp8_bool_decoder_read_literal (&d, 7),
+        literals[i]);
+  }
+
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (bool_decoder_truncated)
+{
+  const guint8 data[] = { 0xff };
+  KmsVp8BoolDecoder d;
+  guint i;
+
+  /* Reading past the end must not access memory out of the buffer */
+  kms_vp8_bool_decoder_init (&d, data, 0);
+  for (i = 0; i < 64; i++) {
+    kms_vp8_bool_decoder_read_literal (&d, 8);
+  }
+
+  kms_vp8_bool_decoder_init (&d, data, sizeof (data));
+  for (i = 0; i < 64; i++) {
+    kms_vp8_bool_decoder_read_literal (&d, 8);
+  }
+}
+
+GST_END_TEST;
+
+/* Inter frame whose header refreshes the given references */
+static gsize
+create_inter_frame (guint8 * frame, gboolean refresh_golden,
+    gboolean refresh_last)
+{
+  BoolEncoder e;
+  gsize first_part_size;
+  guint i;
+
+  bool_encoder_init (&e, frame + 3);
+
+  bool_encoder_write_literal (&e, 0, 1);        /* segmentation_enabled */
+  bool_encoder_write_literal (&e, 0, 1);        /* filter_type */
+  bool_encoder_write_literal (&e, 20, 6);       /* loop_filter_level */
+  bool_encoder_write_literal (&e, 0, 3);        /* sharpness_level */
+  bool_encoder_write_literal (&e, 1, 1);        /* loop_filter_adj_enable */
+  bool_encoder_write_literal (&e, 1, 1);        /* mode_ref_lf_delta_update */
+  for (i = 0; i < 8; i++) {
+    bool_encoder_write_literal (&e, 1, 1);
+    bool_encoder_write_literal (&e, i, 6);
+    bool_encoder_write_literal (&e, i % 2, 1);
+  }
+  bool_encoder_write_literal (&e, 0, 2);        /* log2_nbr_of_dct_partitions */
+  bool_encoder_write_literal (&e, 60, 7);       /* y_ac_qi */
+  for (i = 0; i < 5; i++) {
+    bool_encoder_write_literal (&e, 0, 1);
+  }
+  bool_encoder_write_literal (&e, refresh_golden, 1);
+  bool_encoder_write_literal (&e, 0, 1);        /* refresh_alternate_frame */
+  if (!refresh_golden) {
+    bool_encoder_write_literal (&e, 0, 2);      /* copy_buffer_to_golden */
+  }
+  bool_encoder_write_literal (&e, 0, 2);        /* copy_buffer_to_alternate */
+  bool_encoder_write_literal (&e, 0, 2);        /* sign_bias */
+  bool_encoder_write_literal (&e, 0, 1);        /* refresh_entropy_probs */
+  bool_encoder_write_literal (&e, refresh_last, 1);
+  /* Padding as the rest of the first partition */
+  bool_encoder_write_literal (&e, 0, 32);
+  bool_encoder_flush (&e);
+
+  first_part_size = e.output - (frame + 3);
+  /* Inter frame, version 0, shown */
+  frame[0] = 0x01 | 0x10 | ((first_part_size << 5) & 0xe0);
+  frame[1] = (first_part_size >> 3) & 0xff;
+  frame[2] = (first_part_size >> 11) & 0xff;
+
+  return e.output - frame;
+}
+
+GST_START_TEST (frame_non_reference)
+{
+  guint8 frame[256] = { 0 };
+  const guint8 key_frame[] = { 0x10, 0x02, 0x00, 0x9d, 0x01, 0x2a, 0x40,
+    0x01, 0xf0, 0x00
+  };
+  gsize size;
+
+  size = create_inter_frame (frame, FALSE, FALSE);
+  fail_unless (kms_vp8_frame_is_non_reference (frame, size));
+
+  size = create_inter_frame (frame, FALSE, TRUE);
+  fail_if (kms_vp8_frame_is_non_reference (frame, size));
+
+  size = create_inter_frame (frame, TRUE, FALSE);
+  fail_if (kms_vp8_frame_is_non_reference (frame, size));
+
+  fail_if (kms_vp8_frame_is_non_reference (key_frame, sizeof (key_frame)));
+  fail_if (kms_vp8_frame_is_non_reference (frame, 2));
+}
+
+GST_END_TEST;
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-vp8")
+    );
+
+static GstBuffer *
+create_packet (guint16 seq, guint32 ts, gboolean start, gboolean marker,
+    gint tid, gboolean layer_sync)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+  guint8 *payload;
+  guint i;
+
+  buffer = gst_rtp_buffer_new_allocate (16, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, 96);
+  gst_rtp_buffer_set_ssrc (&rtp, SSRC);
+  gst_rtp_buffer_set_seq (&rtp, seq);
+  gst_rtp_buffer_set_timestamp (&rtp, ts);
+  gst_rtp_buffer_set_marker (&rtp, marker);
+
+  payload = gst_rtp_buffer_get_payload (&rtp);
+  payload[0] = 0x80 | (start ? 0x10 : 0x00);
+  payload[1] = 0x20;
+  payload[2] = (tid << 6) | (layer_sync ? 0x20 : 0x00);
+  /* Inter frame data */
+  for (i = 3; i < 16; i++) {
+    payload[i] = 0x01;
+  }
+
+  gst_rtp_buffer_unmap (&rtp);
+
+  return buffer;
+}
+
+static gint
+get_buffer_tid (GstBuffer * buffer)
+{
+  KmsTemporalLayerMeta *meta = kms_buffer_get_temporal_layer_meta (buffer);
+
+  return meta != NULL ? meta->tid : -1;
+}
+
+GST_START_TEST (tag_temporal_layers)
+{
+  GstElement *depay = gst_element_factory_make ("rtpvp8depay", NULL);
+  GstPad *srcpad, *sinkpad;
+  GstCaps *caps;
+
+  fail_unless (depay != NULL);
+  kms_rtp_vp8_tag_temporal_layers (depay);
+
+  srcpad = gst_check_setup_src_pad (depay, &srctemplate);
+  sinkpad = gst_check_setup_sink_pad (depay, &sinktemplate);
+  gst_pad_set_active (srcpad, TRUE);
+  gst_pad_set_active (sinkpad, TRUE);
+
+  caps = gst_caps_from_string (VP8_CAPS);
+  gst_check_setup_events (srcpad, depay, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  fail_unless_equals_int (gst_element_set_state (depay, GST_STATE_PLAYING),
+      GST_STATE_CHANGE_SUCCESS);
+
+  /* Base layer frame in one packet */
+  fail_unless_equals_int (gst_pad_push (srcpad,
+          create_packet (1, 0, TRUE, TRUE, 0, FALSE)), GST_FLOW_OK);
+
+  /* Frame with a lost packet, discarded by the depayloader */
+  fail_unless_equals_int (gst_pad_push (srcpad,
+          create_packet (2, 3000, TRUE, FALSE, 2, TRUE)), GST_FLOW_OK);
+  fail_unless_equals_int (gst_pad_push (srcpad,
+          create_packet (4, 3000, FALSE, TRUE, 2, TRUE)), GST_FLOW_OK);
+
+  /* Frame in two packets with the same timestamp as the lost one */
+  fail_unless_equals_int (gst_pad_push (srcpad,
+          create_packet (5, 3000, TRUE, FALSE, 1, TRUE)), GST_FLOW_OK);
+  fail_unless_equals_int (gst_pad_push (srcpad,
+          create_packet (6, 3000, FALSE, TRUE, 1, TRUE)), GST_FLOW_OK);
+
+  fail_unless_equals_int (g_list_length (buffers), 2);
+  fail_unless_equals_int (get_buffer_tid (g_list_nth_data (buffers, 0)), 0);
+  fail_unless_equals_int (get_buffer_tid (g_list_nth_data (buffers, 1)), 1);
+  fail_unless (kms_buffer_get_temporal_layer_meta (g_list_nth_data (buffers,
+              1))->layer_sync);
+
+  gst_check_drop_buffers ();
+  gst_element_set_state (depay, GST_STATE_NULL);
+  gst_check_teardown_src_pad (depay);
+  gst_check_teardown_sink_pad (depay);
+  gst_check_teardown_element (depay);
+}
+
+GST_END_TEST;
+
+/* Suite initialization */
+static Suite *
+rtpvp8_suite (void)
+{
+  Suite *s = suite_create ("rtpvp8");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, descriptor_no_extension);
+  tcase_add_test (tc_chain, descriptor_all_fields);
+  tcase_add_test (tc_chain, descriptor_short_picture_id);
+  tcase_add_test (tc_chain, descriptor_truncated);
+  tcase_add_test (tc_chain, bool_decoder_round_trip);
+  tcase_add_test (tc_chain, bool_decoder_truncated);
+  tcase_add_test (tc_chain, frame_non_reference);
+  tcase_add_test (tc_chain, tag_temporal_layers);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtpvp8);
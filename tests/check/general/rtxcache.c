@@ -0,0 +1,381 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <glib.h>
+
+#include "kmsrtxcache.h"
+
+#define SSRC 1234
+#define PAYLOAD_SIZE 10000
+
+static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("application/x-rtp")
+    );
+
+static GstPad *mysrcpad, *mysinkpad;
+
+static GstElement *
+setup_rtx_cache_with_pads (GstPad ** srcpad, GstPad ** sinkpad)
+{
+  GstElement *rtxcache = GST_ELEMENT (kms_rtx_cache_new ());
+  GstCaps *caps;
+
+  *srcpad = gst_check_setup_src_pad (rtxcache, &srctemplate);
+  *sinkpad = gst_check_setup_sink_pad (rtxcache, &sinktemplate);
+  gst_pad_set_active (*srcpad, TRUE);
+  gst_pad_set_active (*sinkpad, TRUE);
+
+  caps = gst_caps_from_string ("application/x-rtp");
+  gst_check_setup_events (*srcpad, rtxcache, caps, GST_FORMAT_TIME);
+  gst_caps_unref (caps);
+
+  fail_unless (gst_element_set_state (rtxcache, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  return rtxcache;
+}
+
+static GstElement *
+setup_rtx_cache (void)
+{
+  return setup_rtx_cache_with_pads (&mysrcpad, &mysinkpad);
+}
+
+static void
+cleanup_rtx_cache_with_pads (GstElement * rtxcache, GstPad * srcpad,
+    GstPad * sinkpad)
+{
+  gst_check_drop_buffers ();
+  gst_element_set_state (rtxcache, GST_STATE_NULL);
+  gst_pad_set_active (srcpad, FALSE);
+  gst_pad_set_active (sinkpad, FALSE);
+  gst_check_teardown_src_pad (rtxcache);
+  gst_check_teardown_sink_pad (rtxcache);
+  gst_check_teardown_element (rtxcache);
+}
+
+static void
+cleanup_rtx_cache (GstElement * rtxcache)
+{
+  cleanup_rtx_cache_with_pads (rtxcache, mysrcpad, mysinkpad);
+}
+
+static GstBuffer *
+create_rtp_buffer (guint16 seqnum, GstMemory * payload)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstBuffer *buffer;
+
+  buffer = gst_rtp_buffer_new_allocate (0, 0, 0);
+  gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp);
+  gst_rtp_buffer_set_ssrc (&rtp, SSRC);
+  gst_rtp_buffer_set_seq (&rtp, seqnum);
+  gst_rtp_buffer_unmap (&rtp);
+
+  if (payload != NULL) {
+    gst_buffer_append_memory (buffer, gst_memory_share (payload, 0, -1));
+  }
+
+  return buffer;
+}
+
+static gboolean
+request_retransmission_on (GstPad * sinkpad, guint seqnum)
+{
+  GstStructure *s;
+
+  s = gst_structure_new ("GstRTPRetransmissionRequest", "seqnum", G_TYPE_UINT,
+      seqnum, "ssrc", G_TYPE_UINT, SSRC, NULL);
+
+  return gst_pad_push_event (sinkpad,
+      gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM, s));
+}
+
+static gboolean
+request_retransmission (guint seqnum)
+{
+  return request_retransmission_on (mysinkpad, seqnum);
+}
+
+static guint64
+get_hits (GstElement * rtxcache)
+{
+  GstStructure *stats;
+  guint64 hits;
+
+  g_object_get (rtxcache, "stats", &stats, NULL);
+  gst_structure_get (stats, "hits", G_TYPE_UINT64, &hits, NULL);
+  gst_structure_free (stats);
+
+  return hits;
+}
+
+GST_START_TEST (retransmission)
+{
+  GstElement *rtxcache = setup_rtx_cache ();
+  GstStructure *stats;
+  guint64 hits, misses;
+  guint16 seqnum;
+
+  for (seqnum = 10; seqnum < 13; seqnum++) {
+    fail_unless (gst_pad_push (mysrcpad,
+            create_rtp_buffer (seqnum, NULL)) == GST_FLOW_OK);
+  }
+
+  fail_unless_equals_int (g_list_length (buffers), 3);
+
+  fail_unless (request_retransmission (11));
+  fail_unless (request_retransmission (99));
+
+  /* Retransmissions are sent before the next packet */
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (13, NULL)) ==
+      GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 5);
+  fail_unless (g_list_nth_data (buffers, 3) == g_list_nth_data (buffers, 1));
+
+  g_object_get (rtxcache, "stats", &stats, NULL);
+  gst_structure_get (stats, "hits", G_TYPE_UINT64, &hits, "misses",
+      G_TYPE_UINT64, &misses, NULL);
+  gst_structure_free (stats);
+
+  fail_unless (hits == 1);
+  fail_unless (misses == 1);
+
+  cleanup_rtx_cache (rtxcache);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (shared_memory)
+{
+  GstElement *rtxcache = setup_rtx_cache ();
+  GstMemory *payload;
+  gsize used;
+
+  payload = gst_allocator_alloc (NULL, PAYLOAD_SIZE, NULL);
+  used = kms_rtx_cache_get_memory_used ();
+
+  /* Same payload sent twice, as it happens when sent to several endpoints */
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (1, payload)) ==
+      GST_FLOW_OK);
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (2, payload)) ==
+      GST_FLOW_OK);
+  gst_memory_unref (payload);
+
+  used = kms_rtx_cache_get_memory_used () - used;
+  fail_unless (used >= PAYLOAD_SIZE);
+  fail_unless (used < 2 * PAYLOAD_SIZE);
+
+  cleanup_rtx_cache (rtxcache);
+
+  fail_unless_equals_int (kms_rtx_cache_get_memory_used (), 0);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (memory_limit)
+{
+  GstElement *rtxcache = setup_rtx_cache ();
+  GstStructure *stats;
+  guint64 hits;
+
+  kms_rtx_cache_set_memory_limit (1);
+
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (1, NULL)) ==
+      GST_FLOW_OK);
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (2, NULL)) ==
+      GST_FLOW_OK);
+
+  /* Only the last packet is kept over the limit */
+  fail_unless (request_retransmission (1));
+  fail_unless (request_retransmission (2));
+
+  g_object_get (rtxcache, "stats", &stats, NULL);
+  gst_structure_get (stats, "hits", G_TYPE_UINT64, &hits, NULL);
+  gst_structure_free (stats);
+
+  fail_unless (hits == 1);
+
+  kms_rtx_cache_set_memory_limit (0);
+  cleanup_rtx_cache (rtxcache);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (bypass)
+{
+  GstElement *rtxcache = setup_rtx_cache ();
+  GstMemory *payload;
+  gsize used;
+
+  payload = gst_allocator_alloc (NULL, PAYLOAD_SIZE, NULL);
+  used = kms_rtx_cache_get_memory_used ();
+
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (1, payload)) ==
+      GST_FLOW_OK);
+  fail_unless (kms_rtx_cache_get_memory_used () > used);
+
+  /* Cached packets are released and new ones only forwarded */
+  g_object_set (rtxcache, "bypass", TRUE, NULL);
+  fail_unless_equals_int (kms_rtx_cache_get_memory_used (), used);
+
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (2, payload)) ==
+      GST_FLOW_OK);
+  fail_unless_equals_int (kms_rtx_cache_get_memory_used (), used);
+  fail_if (request_retransmission (2));
+
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (3, NULL)) ==
+      GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 3);
+
+  /* Retransmissions work again when it is not bypassed */
+  g_object_set (rtxcache, "bypass", FALSE, NULL);
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (4, NULL)) ==
+      GST_FLOW_OK);
+  fail_unless (request_retransmission (4));
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (5, NULL)) ==
+      GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 6);
+
+  gst_memory_unref (payload);
+  cleanup_rtx_cache (rtxcache);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (seqnum_gaps)
+{
+  GstElement *rtxcache = setup_rtx_cache ();
+  guint16 seqnums[] = { 65530, 65533, 2, 3, 10 };
+  guint i;
+
+  /* Packets are not sent in every sequence number, e.g. with FEC or RTX */
+  for (i = 0; i < G_N_ELEMENTS (seqnums); i++) {
+    fail_unless (gst_pad_push (mysrcpad,
+            create_rtp_buffer (seqnums[i], NULL)) == GST_FLOW_OK);
+  }
+
+  fail_unless (request_retransmission (3));
+  fail_unless (request_retransmission (65533));
+  fail_unless (request_retransmission (10));
+  fail_unless (request_retransmission (4));
+  fail_unless (request_retransmission (65531));
+
+  fail_unless (get_hits (rtxcache) == 3);
+
+  cleanup_rtx_cache (rtxcache);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (buffer_list)
+{
+  GstElement *rtxcache = setup_rtx_cache ();
+  GstBufferList *list;
+  guint16 seqnum;
+
+  list = gst_buffer_list_new ();
+
+  for (seqnum = 1; seqnum < 4; seqnum++) {
+    gst_buffer_list_add (list, create_rtp_buffer (seqnum, NULL));
+  }
+
+  fail_unless (gst_pad_push_list (mysrcpad, list) == GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 3);
+
+  fail_unless (request_retransmission (2));
+  fail_unless (get_hits (rtxcache) == 1);
+
+  fail_unless (gst_pad_push (mysrcpad, create_rtp_buffer (4, NULL)) ==
+      GST_FLOW_OK);
+  fail_unless_equals_int (g_list_length (buffers), 5);
+  fail_unless (g_list_nth_data (buffers, 3) == g_list_nth_data (buffers, 1));
+
+  cleanup_rtx_cache (rtxcache);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (global_eviction)
+{
+  GstElement *rtxcache = setup_rtx_cache ();
+  GstPad *othersrcpad, *othersinkpad;
+  GstElement *other;
+  guint16 seqnum;
+
+  for (seqnum = 1; seqnum < 4; seqnum++) {
+    fail_unless (gst_pad_push (mysrcpad,
+            create_rtp_buffer (seqnum, NULL)) == GST_FLOW_OK);
+  }
+
+  /* Packets of the other cache are newer */
+  g_usleep (G_TIME_SPAN_MILLISECOND);
+  other = setup_rtx_cache_with_pads (&othersrcpad, &othersinkpad);
+
+  for (seqnum = 1; seqnum < 3; seqnum++) {
+    fail_unless (gst_pad_push (othersrcpad,
+            create_rtp_buffer (seqnum, NULL)) == GST_FLOW_OK);
+  }
+
+  /* Only the oldest packet of all is released */
+  kms_rtx_cache_set_memory_limit (kms_rtx_cache_get_memory_used () - 1);
+
+  fail_unless (request_retransmission (1));
+  fail_unless (request_retransmission (2));
+  fail_unless (request_retransmission_on (othersinkpad, 1));
+  fail_unless (request_retransmission_on (othersinkpad, 2));
+
+  fail_unless (get_hits (rtxcache) == 1);
+  fail_unless (get_hits (other) == 2);
+
+  kms_rtx_cache_set_memory_limit (0);
+  cleanup_rtx_cache_with_pads (other, othersrcpad, othersinkpad);
+  cleanup_rtx_cache (rtxcache);
+}
+
+GST_END_TEST;
+
+/* Suite initialization */
+static Suite *
+rtxcache_suite (void)
+{
+  Suite *s = suite_create ("rtxcache");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, retransmission);
+  tcase_add_test (tc_chain, shared_memory);
+  tcase_add_test (tc_chain, memory_limit);
+  tcase_add_test (tc_chain, bypass);
+  tcase_add_test (tc_chain, seqnum_gaps);
+  tcase_add_test (tc_chain, buffer_list);
+  tcase_add_test (tc_chain, global_eviction);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtxcache);
@@ -102,6 +102,47 @@ GST_START_TEST (check_sdp_utils_media_get_fid_ssrc)
 
 GST_END_TEST;
 
+/* *INDENT-OFF* */
+static const gchar *sdp_simulcast_str = "v=0\r\n"
+    "o=- 0 0 IN IP4 0.0.0.0\r\n"
+    "s=TestSession\r\n"
+    "c=IN IP4 0.0.0.0\r\n"
+    "t=0 0\r\n"
+    "m=video 1 RTP/SAVPF 100\r\n"
+    "a=rtpmap:100 VP8/90000\r\n"
+    "a=ssrc-group:SIM 1111 2222 3333\r\n"
+    "a=ssrc-group:FID 1111 4444\r\n"
+    "a=ssrc-group:FID 2222 5555\r\n"
+    "a=ssrc:1111 cname:test\r\n"
+    "a=rtcp-mux\r\n";
+/* *INDENT-ON* */
+
+GST_START_TEST (check_sdp_utils_media_get_sim_ssrc)
+{
+  GstSDPMessage *message;
+  const GstSDPMedia *media;
+
+  fail_unless (gst_sdp_message_new (&message) == GST_SDP_OK);
+  fail_unless (gst_sdp_message_parse_buffer ((const guint8 *)
+          sdp_simulcast_str, -1, message) == GST_SDP_OK);
+
+  media = gst_sdp_message_get_media (message, 0);
+  fail_if (media == NULL);
+
+  fail_unless_equals_int (sdp_utils_media_get_sim_ssrc (media, 0), 1111);
+  fail_unless_equals_int (sdp_utils_media_get_sim_ssrc (media, 1), 2222);
+  fail_unless_equals_int (sdp_utils_media_get_sim_ssrc (media, 2), 3333);
+  fail_unless_equals_int (sdp_utils_media_get_sim_ssrc (media, 3), 0);
+
+  /* FID groups are found after the SIM one */
+  fail_unless_equals_int (sdp_utils_media_get_fid_ssrc (media, 0), 1111);
+  fail_unless_equals_int (sdp_utils_media_get_fid_ssrc (media, 1), 4444);
+
+  gst_sdp_message_free (message);
+}
+
+GST_END_TEST;
+
 GMainLoop *loop = NULL;
 gint callbacks = 2;
 gint destroy_count = 0;
@@ -391,6 +432,7 @@ utils_suite (void)
   tcase_add_test (tc_chain, check_urls);
 
   tcase_add_test (tc_chain, check_sdp_utils_media_get_fid_ssrc);
+  tcase_add_test (tc_chain, check_sdp_utils_media_get_sim_ssrc);
   tcase_add_test (tc_chain, check_kms_utils_set_pad_event_function_full);
 
   tcase_add_test (tc_chain, check_kms_utils_set_pad_query_function_full);
@@ -0,0 +1,154 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE BusDispatcher
+#include <boost/test/unit_test.hpp>
+#include <BusDispatcher.hpp>
+
+#include <gst/gst.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <string>
+
+using namespace kurento;
+
+struct GF {
+  GF();
+};
+
+BOOST_GLOBAL_FIXTURE (GF)
+
+GF::GF()
+{
+  gst_init (NULL, NULL);
+}
+
+struct Received {
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<std::string> names;
+  std::vector<std::thread::id> threads;
+};
+
+static void
+on_message (GstBus *bus, GstMessage *message, Received *received)
+{
+  std::unique_lock<std::mutex> lock (received->mutex);
+  const GstStructure *st = gst_message_get_structure (message);
+
+  received->names.push_back (st != NULL ? gst_structure_get_name (st) :
+                             GST_MESSAGE_TYPE_NAME (message) );
+  received->threads.push_back (std::this_thread::get_id () );
+  received->cond.notify_all ();
+}
+
+static bool
+wait_received (Received &received, size_t count)
+{
+  std::unique_lock<std::mutex> lock (received.mutex);
+
+  return received.cond.wait_for (lock, std::chrono::seconds (5), [&] () {
+    return received.names.size () >= count;
+  });
+}
+
+BOOST_AUTO_TEST_CASE (element_message)
+{
+  GstBus *bus = gst_bus_new ();
+  Received received;
+  gulong handler;
+
+  BusDispatcher::attach (bus);
+  BusDispatcher::subscribe (bus, GST_MESSAGE_ELEMENT);
+  handler = g_signal_connect (bus, "message::element",
+                              G_CALLBACK (on_message), &received);
+
+  gst_bus_post (bus, gst_message_new_element (NULL,
+                gst_structure_new_empty ("first") ) );
+  gst_bus_post (bus, gst_message_new_element (NULL,
+                gst_structure_new_empty ("second") ) );
+
+  BOOST_REQUIRE (wait_received (received, 2) );
+
+  /* Dispatched in order, out of the posting thread */
+  BOOST_CHECK_EQUAL (received.names[0], "first");
+  BOOST_CHECK_EQUAL (received.names[1], "second");
+  BOOST_CHECK (received.threads[0] != std::this_thread::get_id () );
+  BOOST_CHECK (received.threads[0] == received.threads[1]);
+
+  /* Nothing is left queued in the bus */
+  BOOST_CHECK (!gst_bus_have_pending (bus) );
+
+  g_signal_handler_disconnect (bus, handler);
+  BusDispatcher::detach (bus);
+  gst_object_unref (bus);
+}
+
+BOOST_AUTO_TEST_CASE (unsubscribed_message)
+{
+  GstBus *bus = gst_bus_new ();
+  Received received;
+  gulong handler;
+
+  BusDispatcher::attach (bus);
+  BusDispatcher::subscribe (bus, GST_MESSAGE_ELEMENT);
+  handler = g_signal_connect (bus, "message", G_CALLBACK (on_message),
+                              &received);
+
+  gst_bus_post (bus, gst_message_new_eos (NULL) );
+  gst_bus_post (bus, gst_message_new_element (NULL,
+                gst_structure_new_empty ("subscribed") ) );
+
+  BOOST_REQUIRE (wait_received (received, 1) );
+
+  /* EOS is dropped in the posting thread and never dispatched */
+  BOOST_CHECK_EQUAL (received.names.size (), 1);
+  BOOST_CHECK_EQUAL (received.names[0], "subscribed");
+  BOOST_CHECK (!gst_bus_have_pending (bus) );
+
+  g_signal_handler_disconnect (bus, handler);
+  BusDispatcher::detach (bus);
+  gst_object_unref (bus);
+}
+
+BOOST_AUTO_TEST_CASE (stream_status_message)
+{
+  GstBus *bus = gst_bus_new ();
+  GstElement *owner = gst_element_factory_make ("fakesrc", NULL);
+  Received received;
+  gulong handler;
+
+  BusDispatcher::attach (bus);
+  handler = g_signal_connect (bus, "sync-message::stream-status",
+                              G_CALLBACK (on_message), &received);
+
+  gst_bus_post (bus, gst_message_new_stream_status (GST_OBJECT (owner),
+                GST_STREAM_STATUS_TYPE_CREATE, owner) );
+
+  /* Emitted from the posting thread before post returns */
+  BOOST_REQUIRE_EQUAL (received.names.size (), 1);
+  BOOST_CHECK (received.threads[0] == std::this_thread::get_id () );
+  BOOST_CHECK (!gst_bus_have_pending (bus) );
+
+  g_signal_handler_disconnect (bus, handler);
+  BusDispatcher::detach (bus);
+  gst_object_unref (bus);
+  gst_object_unref (owner);
+}
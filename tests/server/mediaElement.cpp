@@ -26,6 +26,13 @@
 #include <GstreamerDotDetails.hpp>
 #include <MediaSet.hpp>
 #include <ModuleManager.hpp>
+#include <StatsPublisher.hpp>
+#include <StatsUpdate.hpp>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 using namespace kurento;
 
@@ -299,3 +306,278 @@ BOOST_AUTO_TEST_CASE (dot_test)
   src.reset();
   pipe.reset();
 }
+
+#define N_CONCURRENT_SINKS 8
+#define N_CONCURRENT_ITERATIONS 20
+
+/* Fails instead of hanging forever if any of the tasks deadlocks */
+static void
+runConcurrently (const std::vector<std::function<void() >> &tasks)
+{
+  std::vector<std::future<void>> results;
+
+  for (auto &task : tasks) {
+    std::packaged_task<void() > packaged (task);
+
+    results.push_back (packaged.get_future () );
+    std::thread (std::move (packaged) ).detach ();
+  }
+
+  for (auto &result : results) {
+    BOOST_REQUIRE_MESSAGE (result.wait_for (std::chrono::seconds (30) ) ==
+                           std::future_status::ready, "Connections deadlocked");
+    result.get ();
+  }
+}
+
+BOOST_AUTO_TEST_CASE (concurrent_disconnect)
+{
+  std::string mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+  std::vector<std::shared_ptr <MediaElementImpl>> sinks;
+  std::vector<std::function<void() >> tasks;
+
+  std::shared_ptr <MediaElementImpl> src = createDummyElement ("dummysrc",
+      mediaPipelineId);
+  std::shared_ptr <MediaElementImpl> hub = createDummyElement ("dummyduplex",
+      mediaPipelineId);
+
+  g_object_set (src->getGstreamerElement(), "audio", TRUE, "video", TRUE, NULL);
+  g_object_set (hub->getGstreamerElement(), "src-audio", TRUE, "src-video",
+                TRUE, "sink-audio", TRUE, "sink-video", TRUE, NULL);
+
+  for (int i = 0; i < N_CONCURRENT_SINKS; i++) {
+    std::shared_ptr <MediaElementImpl> sink = createDummyElement ("dummysink",
+        mediaPipelineId);
+
+    g_object_set (sink->getGstreamerElement(), "audio", TRUE, "video", TRUE,
+                  NULL);
+    sinks.push_back (sink);
+  }
+
+  /* Both ends of the hub change at the same time */
+  for (auto sink : sinks) {
+    tasks.push_back ([hub, sink] () {
+      for (int i = 0; i < N_CONCURRENT_ITERATIONS; i++) {
+        hub->connect (sink);
+        sink->getSourceConnections ();
+        hub->disconnect (sink);
+      }
+    });
+  }
+
+  tasks.push_back ([src, hub] () {
+    for (int i = 0; i < N_CONCURRENT_ITERATIONS; i++) {
+      src->connect (hub);
+      hub->getSinkConnections ();
+      src->disconnect (hub);
+    }
+  });
+
+  runConcurrently (tasks);
+
+  BOOST_CHECK_EQUAL (hub->getSinkConnections ().size(), 0);
+  BOOST_CHECK_EQUAL (hub->getSourceConnections ().size(), 0);
+
+  /* Every element drops all of its connections at the same time */
+  src->connect (hub);
+
+  for (auto sink : sinks) {
+    hub->connect (sink);
+  }
+
+  BOOST_CHECK_EQUAL (hub->getSinkConnections ().size(),
+                     3 * N_CONCURRENT_SINKS);
+
+  tasks.clear ();
+  tasks.push_back ([hub] () {
+    releaseMediaObject (hub->getId () );
+  });
+  tasks.push_back ([src] () {
+    releaseMediaObject (src->getId () );
+  });
+
+  for (auto sink : sinks) {
+    tasks.push_back ([sink] () {
+      releaseMediaObject (sink->getId () );
+    });
+  }
+
+  runConcurrently (tasks);
+
+  BOOST_CHECK_EQUAL (hub->getSinkConnections ().size(), 0);
+  BOOST_CHECK_EQUAL (hub->getSourceConnections ().size(), 0);
+  BOOST_CHECK_EQUAL (src->getSinkConnections ().size(), 0);
+
+  for (auto sink : sinks) {
+    BOOST_CHECK_EQUAL (sink->getSourceConnections ().size(), 0);
+  }
+
+  releaseMediaObject (mediaPipelineId);
+
+  sinks.clear ();
+  hub.reset ();
+  src.reset ();
+}
+
+static Json::Value
+getTopology (std::shared_ptr <MediaPipelineImpl> pipe)
+{
+  Json::Value topology;
+  Json::Reader reader;
+
+  BOOST_REQUIRE (reader.parse (pipe->getGstreamerTopology(), topology) );
+
+  return topology;
+}
+
+static const Json::Value *
+findTopologyElement (const Json::Value &topology, GstElement *element)
+{
+  gchar *name = gst_element_get_name (element);
+  const Json::Value *found = NULL;
+
+  for (const Json::Value &it : topology["elements"]) {
+    if (it["parent"].asInt() == 0 && it["name"].asString() == name) {
+      found = &it;
+    }
+  }
+
+  g_free (name);
+
+  return found;
+}
+
+BOOST_AUTO_TEST_CASE (topology_test)
+{
+  std::string mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+
+  std::shared_ptr <MediaElementImpl> sink = createDummyElement ("dummysink",
+      mediaPipelineId);
+  std::shared_ptr <MediaElementImpl> src = createDummyElement ("dummysrc",
+      mediaPipelineId);
+  std::shared_ptr <MediaPipelineImpl> pipe = std::dynamic_pointer_cast
+      <MediaPipelineImpl> (MediaSet::getMediaSet()->getMediaObject (
+                             mediaPipelineId) );
+
+  Json::Value topology = getTopology (pipe);
+
+  BOOST_CHECK (findTopologyElement (topology, src->getGstreamerElement() ) );
+  BOOST_CHECK (findTopologyElement (topology, sink->getGstreamerElement() ) );
+
+  g_object_set (src->getGstreamerElement(), "audio", TRUE, NULL);
+  g_object_set (sink->getGstreamerElement(), "audio", TRUE, NULL);
+
+  src->connect (sink, std::shared_ptr <MediaType> (new MediaType (
+                  MediaType::AUDIO) ) );
+
+  topology = getTopology (pipe);
+
+  const Json::Value *srcNode = findTopologyElement (topology,
+                               src->getGstreamerElement() );
+  const Json::Value *sinkNode = findTopologyElement (topology,
+                                sink->getGstreamerElement() );
+  bool linked = false;
+
+  BOOST_REQUIRE (srcNode && sinkNode);
+
+  for (const Json::Value &pad : (*srcNode) ["pads"]) {
+    if (pad["direction"].asString() == "src" &&
+        pad["peer"]["element"].asInt() == (*sinkNode) ["id"].asInt() ) {
+      linked = true;
+      BOOST_CHECK (pad.isMember ("buffers") );
+    }
+  }
+
+  BOOST_CHECK (linked);
+
+  releaseMediaObject (sink->getId() );
+  releaseMediaObject (src->getId() );
+  releaseMediaObject (mediaPipelineId);
+
+  sink.reset();
+  src.reset();
+  pipe.reset();
+}
+
+BOOST_AUTO_TEST_CASE (stats_update_delta)
+{
+  Json::Value previous, current, delta;
+
+  previous["element"]["stat"]["packetsLost"] = 1;
+  previous["element"]["stat"]["jitter"] = 0.5;
+  previous["element"]["gone"]["packetsLost"] = 0;
+  previous["removed"]["stat"]["jitter"] = 0.1;
+
+  current["element"]["stat"]["packetsLost"] = 3;
+  current["element"]["stat"]["jitter"] = 0.5;
+  current["element"]["new"]["packetsLost"] = 2;
+
+  delta = StatsPublisher::diff (previous, current);
+
+  BOOST_CHECK_EQUAL (delta["element"]["stat"]["packetsLost"].asInt(), 3);
+  BOOST_CHECK (!delta["element"]["stat"].isMember ("jitter") );
+  BOOST_CHECK_EQUAL (delta["element"]["new"]["packetsLost"].asInt(), 2);
+  BOOST_CHECK (delta["element"].isMember ("gone") &&
+               delta["element"]["gone"].isNull () );
+  BOOST_CHECK (delta.isMember ("removed") && delta["removed"].isNull () );
+
+  /* Nothing changed */
+  BOOST_CHECK (StatsPublisher::diff (current, current).empty () );
+}
+
+BOOST_AUTO_TEST_CASE (stats_update_full_after_resubscribe)
+{
+  std::string mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+  std::shared_ptr <MediaPipelineImpl> pipe = std::dynamic_pointer_cast
+      <MediaPipelineImpl> (MediaSet::getMediaSet()->getMediaObject (
+                             mediaPipelineId) );
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<bool> events;
+  sigc::connection conn;
+
+  auto handler = [&] (StatsUpdate event) {
+    std::unique_lock<std::mutex> lock (mtx);
+
+    events.push_back (event.getFull () );
+    cv.notify_all ();
+  };
+
+  auto waitEvent = [&] (size_t count, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock (mtx);
+
+    return cv.wait_for (lock, timeout, [&] () {
+      return events.size () >= count;
+    });
+  };
+
+  conn = pipe->signalStatsUpdate.connect (handler);
+  pipe->setStatsUpdateInterval (200);
+
+  BOOST_REQUIRE (waitEvent (1, std::chrono::seconds (5) ) );
+  BOOST_CHECK (events[0]);
+
+  /* Nobody listens for a while, previous values are forgotten */
+  conn.disconnect ();
+  std::this_thread::sleep_for (std::chrono::milliseconds (500) );
+
+  /* Otherwise the next complete event would come after 10 updates */
+  conn = pipe->signalStatsUpdate.connect (handler);
+  BOOST_REQUIRE (waitEvent (2, std::chrono::milliseconds (1000) ) );
+  BOOST_CHECK (events[1]);
+
+  conn.disconnect ();
+  pipe->setStatsUpdateInterval (0);
+
+  releaseMediaObject (mediaPipelineId);
+  pipe.reset();
+}
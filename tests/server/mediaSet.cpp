@@ -28,9 +28,19 @@
 #include <ServerType.hpp>
 #include <ObjectCreated.hpp>
 #include <ObjectDestroyed.hpp>
+#include <PipelineResourceUsage.hpp>
+#include <PipelinesResourceUsage.hpp>
 
 #include <config.h>
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include "kmsmetrics.h"
+
 using namespace kurento;
 
 std::shared_ptr <ModuleManager> moduleManager;
@@ -69,7 +79,8 @@ struct F {
   std::shared_ptr<ServerManagerImpl> serverManager;
 };
 
-F::F ()
+static std::shared_ptr<ServerInfo>
+createServerInfo ()
 {
   std::vector<std::shared_ptr<ModuleInfo>> modules;
 
@@ -89,9 +100,13 @@ F::F ()
   std::vector<std::string> capabilities;
   capabilities.push_back ("transactions");
 
-  std::shared_ptr<ServerInfo> serverInfo = std::shared_ptr <ServerInfo>
-      (new ServerInfo ("", modules,
-                       type, capabilities) );
+  return std::shared_ptr <ServerInfo> (new ServerInfo ("", modules, type,
+                                       capabilities) );
+}
+
+F::F ()
+{
+  std::shared_ptr<ServerInfo> serverInfo = createServerInfo ();
 
   serverManager =  std::dynamic_pointer_cast <ServerManagerImpl>
                    (MediaSet::getMediaSet ()->ref (new ServerManagerImpl (
@@ -106,6 +121,25 @@ F::~F ()
   MediaSet::deleteMediaSet();
 }
 
+struct FastCollector {
+  FastCollector();
+  ~FastCollector();
+};
+
+FastCollector::FastCollector ()
+{
+  MediaSet::deleteMediaSet();
+  MediaSet::setCollectorInterval (std::chrono::seconds (1) );
+}
+
+FastCollector::~FastCollector ()
+{
+  MediaSet::setCollectorInterval (std::chrono::seconds (240) );
+}
+
+struct FastCollectorF : FastCollector, F {
+};
+
 BOOST_FIXTURE_TEST_CASE (release_elements, F)
 {
   std::mutex mtx;
@@ -217,6 +251,99 @@ BOOST_FIXTURE_TEST_CASE (release_elements, F)
 }) ) {
     BOOST_FAIL ("Timeout waiting for " + watched_object + " destruction event");
   }
+
+}
+
+static gint64
+getTeardownMetricCount ()
+{
+  const char *count_name = "kms_pipeline_teardown_seconds_count ";
+  gchar *text = kms_metrics_render ();
+  const char *count = strstr (text, count_name);
+  gint64 ret = -1;
+
+  if (count != NULL) {
+    ret = g_ascii_strtoll (count + strlen (count_name), NULL, 10);
+  }
+
+  g_free (text);
+
+  return ret;
+}
+
+#define LARGE_PIPELINE_ELEMENTS 20
+
+BOOST_FIXTURE_TEST_CASE (release_large_pipeline, F)
+{
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<std::string> destroyed;
+  std::vector<std::string> elements;
+  std::string mediaPipelineId;
+  Json::Value params;
+  TeardownStats before, after;
+  gint64 metricBefore;
+
+  sigc::connection destroyedConn =
+  serverManager->signalObjectDestroyed.connect ([&] (ObjectDestroyed event) {
+    std::unique_lock<std::mutex> lck (mtx);
+
+    destroyed.push_back (event.getObjectId() );
+    cv.notify_one();
+  });
+
+  before = MediaSet::getMediaSet()->getTeardownStats ();
+  metricBefore = getTeardownMetricCount ();
+  BOOST_REQUIRE (metricBefore >= 0);
+
+  mediaPipelineId = moduleManager->getFactory ("MediaPipeline")->createObject (
+                      boost::property_tree::ptree(), "session1", Json::Value() )->getId();
+  params["mediaPipeline"] = mediaPipelineId;
+
+  for (int i = 0; i < LARGE_PIPELINE_ELEMENTS; i++) {
+    elements.push_back (moduleManager->getFactory ("PassThrough")->createObject (
+                          boost::property_tree::ptree(), "session1", params)->getId() );
+  }
+
+  MediaSet::getMediaSet()->release (mediaPipelineId);
+
+  std::unique_lock<std::mutex> lck (mtx);
+
+  if (!cv.wait_for (lck, std::chrono::seconds (5), [&] () {
+  return destroyed.size() == elements.size() + 1;
+}) ) {
+    BOOST_FAIL ("Timeout waiting for destruction events");
+  }
+
+  // Elements keep the pipeline alive, so it is always destroyed the last one
+  BOOST_CHECK_EQUAL (destroyed.back(), mediaPipelineId);
+
+  for (auto id : elements) {
+    BOOST_CHECK (std::find (destroyed.begin(), destroyed.end(), id) !=
+                 destroyed.end() );
+  }
+
+  lck.unlock();
+  destroyedConn.disconnect();
+
+  // Events are emitted once the objects have been deleted in the workers
+  after = MediaSet::getMediaSet()->getTeardownStats ();
+
+  BOOST_CHECK_EQUAL (after.pipelines, before.pipelines + 1);
+  BOOST_CHECK (after.total > before.total);
+  BOOST_CHECK (after.max >= before.max);
+  BOOST_CHECK (after.max <= after.total);
+  BOOST_CHECK_EQUAL (getTeardownMetricCount (), metricBefore + 1);
+
+  // Released objects cannot be referenced any more
+  for (auto id : elements) {
+    try {
+      MediaSet::getMediaSet()->ref ("session3", id);
+      BOOST_FAIL ("This code should not be reached");
+    } catch (KurentoException e) {
+      BOOST_CHECK (e.getCode() == MEDIA_OBJECT_NOT_FOUND);
+    }
+  }
 }
 
 BOOST_FIXTURE_TEST_CASE (get_pipelines, F)
@@ -237,9 +364,101 @@ BOOST_FIXTURE_TEST_CASE (get_pipelines, F)
   auto pipes = kurento::MediaSet::getMediaSet()->getPipelines ("session3");
   BOOST_CHECK (pipes.size() == 3);
 
+  auto usage = serverManager->getPipelinesResourceUsage ();
+  BOOST_CHECK (usage.size() == 3);
+
+  for (auto pipeUsage : usage) {
+    BOOST_CHECK (pipeUsage->getPipeline () );
+    BOOST_CHECK (pipeUsage->getElements () == 0);
+  }
+
   for (auto pipe : pipes) {
     kurento::MediaSet::getMediaSet()->release (pipe->getId() );
   }
 
   pipes.clear();
 }
+
+BOOST_FIXTURE_TEST_CASE (session_keepalive_timeout, FastCollectorF)
+{
+  std::shared_ptr<kurento::Factory> mediaPipelineFactory;
+  std::string mediaPipelineId;
+
+  mediaPipelineFactory = moduleManager->getFactory ("MediaPipeline");
+
+  mediaPipelineId = mediaPipelineFactory->createObject (
+                      boost::property_tree::ptree(), "session1", Json::Value() )->getId();
+  MediaSet::getMediaSet()->ref ("session2", mediaPipelineId);
+
+  for (int i = 0; i < 4; i++) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (500) );
+    MediaSet::getMediaSet()->keepAliveSession ("session1");
+  }
+
+  // session2 did not send keepalives for longer than the collector interval
+  try {
+    MediaSet::getMediaSet()->keepAliveSession ("session2");
+    BOOST_FAIL ("This code should not be reached");
+  } catch (KurentoException e) {
+    BOOST_CHECK (e.getCode() == INVALID_SESSION);
+  }
+
+  // Pipeline is still referenced by session1
+  MediaSet::getMediaSet()->ref ("session3", mediaPipelineId);
+
+  MediaSet::getMediaSet()->release (mediaPipelineId);
+}
+
+BOOST_AUTO_TEST_CASE (destroy_while_reporting_usage)
+{
+  boost::property_tree::ptree config;
+  std::shared_ptr<ServerManagerImpl> manager;
+  std::weak_ptr<ServerManagerImpl> weak;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool reporting = false;
+  bool released = false;
+
+  config.put ("modules.kurento.ServerManager.resourceUsageInterval", 1);
+
+  /* Not managed by the MediaSet, the last reference deletes it at once */
+  manager = std::shared_ptr<ServerManagerImpl> (new ServerManagerImpl (
+              createServerInfo (), config, *moduleManager.get() ) );
+  weak = manager;
+
+  manager->signalPipelinesResourceUsage.connect ([&] (
+  PipelinesResourceUsage event) {
+    std::unique_lock<std::mutex> lck (mtx);
+
+    reporting = true;
+    cv.notify_all();
+    cv.wait (lck, [&released] () {
+      return released;
+    });
+  });
+
+  std::unique_lock<std::mutex> lck (mtx);
+
+  if (!cv.wait_for (lck, std::chrono::seconds (5), [&reporting] () {
+  return reporting;
+}) ) {
+    BOOST_FAIL ("Timeout waiting for resource usage report");
+  }
+
+  /* The report holds the last reference now */
+  manager.reset();
+  released = true;
+  cv.notify_all();
+  lck.unlock();
+
+  for (int i = 0; i < 500 && !weak.expired(); i++) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (10) );
+  }
+
+  BOOST_CHECK (weak.expired() );
+
+  /* Give the detached thread time to finish after the deletion */
+  std::this_thread::sleep_for (std::chrono::milliseconds (100) );
+
+  MediaSet::deleteMediaSet();
+}
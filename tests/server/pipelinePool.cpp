@@ -0,0 +1,182 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE PipelinePool
+#include <boost/test/unit_test.hpp>
+#include <PipelinePool.hpp>
+
+#include <gst/gst.h>
+#include <chrono>
+#include <thread>
+
+using namespace kurento;
+
+struct GF {
+  GF();
+};
+
+BOOST_GLOBAL_FIXTURE (GF)
+
+GF::GF()
+{
+  gst_init (NULL, NULL);
+}
+
+/* The pool is process wide, test cases run in order and share it */
+
+static GstElement *
+createCleanPipeline ()
+{
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstClock *clock = gst_system_clock_obtain ();
+
+  gst_pipeline_use_clock (GST_PIPELINE (pipeline), clock);
+  g_object_unref (clock);
+
+  BOOST_REQUIRE (gst_element_set_state (pipeline, GST_STATE_PLAYING) ==
+                 GST_STATE_CHANGE_SUCCESS);
+
+  return pipeline;
+}
+
+static void
+destroyPipeline (GstElement *pipeline)
+{
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  g_object_unref (pipeline);
+}
+
+static void
+checkReady (GstElement *pipeline)
+{
+  GstClock *clock = gst_pipeline_get_clock (GST_PIPELINE (pipeline) );
+  GstClock *systemClock = gst_system_clock_obtain ();
+  GstState state;
+
+  BOOST_REQUIRE (pipeline != NULL);
+  BOOST_CHECK (gst_element_get_state (pipeline, &state, NULL, 0) ==
+               GST_STATE_CHANGE_SUCCESS);
+  BOOST_CHECK (state == GST_STATE_PLAYING);
+  BOOST_CHECK (clock == systemClock);
+  BOOST_CHECK_EQUAL (GST_OBJECT_REFCOUNT_VALUE (pipeline), 1);
+
+  g_object_unref (clock);
+  g_object_unref (systemClock);
+}
+
+BOOST_AUTO_TEST_CASE (disabled_pool)
+{
+  GstElement *pipeline;
+
+  PipelinePool::configure (0, 1);
+
+  pipeline = PipelinePool::acquire ();
+  checkReady (pipeline);
+
+  /* Nothing is kept, the caller destroys it */
+  BOOST_CHECK (!PipelinePool::release (pipeline) );
+  destroyPipeline (pipeline);
+}
+
+BOOST_AUTO_TEST_CASE (release_and_reuse)
+{
+  GstElement *released = createCleanPipeline ();
+  GstElement *pooled, *reused;
+
+  /* One pipeline is created at once, the next one a second later */
+  PipelinePool::configure (2, 1);
+  std::this_thread::sleep_for (std::chrono::milliseconds (200) );
+
+  BOOST_CHECK (PipelinePool::release (released) );
+
+  pooled = PipelinePool::acquire ();
+  checkReady (pooled);
+  BOOST_CHECK (pooled != released);
+
+  /* Released pipelines are reused in order */
+  reused = PipelinePool::acquire ();
+  BOOST_CHECK (reused == released);
+  checkReady (reused);
+
+  destroyPipeline (pooled);
+  destroyPipeline (reused);
+}
+
+BOOST_AUTO_TEST_CASE (release_limits)
+{
+  GstElement *pipeline, *child;
+
+  /* Room for every pipeline released below */
+  PipelinePool::configure (100, 1);
+
+  pipeline = createCleanPipeline ();
+  child = gst_element_factory_make ("fakesink", NULL);
+  gst_bin_add (GST_BIN (pipeline), child);
+  BOOST_CHECK (!PipelinePool::release (pipeline) );
+  destroyPipeline (pipeline);
+
+  pipeline = createCleanPipeline ();
+  g_object_ref (pipeline);
+  BOOST_CHECK (!PipelinePool::release (pipeline) );
+  g_object_unref (pipeline);
+  destroyPipeline (pipeline);
+
+  pipeline = createCleanPipeline ();
+  gst_element_set_state (pipeline, GST_STATE_PAUSED);
+  BOOST_CHECK (!PipelinePool::release (pipeline) );
+  destroyPipeline (pipeline);
+
+  pipeline = createCleanPipeline ();
+  BOOST_CHECK (PipelinePool::release (pipeline) );
+
+  /* Shrinking drops the idle pipelines over the new size */
+  PipelinePool::configure (1, 1000);
+
+  pipeline = createCleanPipeline ();
+  BOOST_CHECK (!PipelinePool::release (pipeline) );
+  destroyPipeline (pipeline);
+
+  PipelinePool::configure (0, 1);
+
+  pipeline = createCleanPipeline ();
+  BOOST_CHECK (!PipelinePool::release (pipeline) );
+  destroyPipeline (pipeline);
+
+  pipeline = PipelinePool::acquire ();
+  checkReady (pipeline);
+  destroyPipeline (pipeline);
+}
+
+BOOST_AUTO_TEST_CASE (refill)
+{
+  GstElement *pipeline;
+
+  PipelinePool::configure (1, 1000);
+  std::this_thread::sleep_for (std::chrono::milliseconds (200) );
+
+  /* The refill thread has already filled the pool */
+  pipeline = createCleanPipeline ();
+  BOOST_CHECK (!PipelinePool::release (pipeline) );
+  destroyPipeline (pipeline);
+
+  pipeline = PipelinePool::acquire ();
+  checkReady (pipeline);
+  destroyPipeline (pipeline);
+
+  PipelinePool::configure (0, 1);
+}
@@ -24,6 +24,9 @@
 #include <MediaType.hpp>
 #include <KurentoException.hpp>
 #include <objects/BaseRtpEndpointImpl.hpp>
+#include <JitterBufferParams.hpp>
+#include <ProtectionParams.hpp>
+#include <StatsType.hpp>
 #include <MediaSet.hpp>
 #include <ModuleManager.hpp>
 
@@ -94,3 +97,136 @@ BOOST_AUTO_TEST_CASE (port_range)
   rtpEndpoint.reset ();
   pipe.reset();
 }
+
+BOOST_AUTO_TEST_CASE (jitter_buffer_params)
+{
+  mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+
+  std::shared_ptr <MediaObjectImpl> pipe =
+    MediaSet::getMediaSet()->getMediaObject (
+      mediaPipelineId);
+
+  auto mediaObject = MediaSet::getMediaSet()->ref (new  BaseRtpEndpointImpl (
+                       boost::property_tree::ptree(), pipe, "dummyrtp") );
+  std::shared_ptr <BaseRtpEndpointImpl> rtpEndpoint = std::dynamic_pointer_cast
+      <BaseRtpEndpointImpl> (mediaObject);
+  MediaSet::getMediaSet()->ref ("", mediaObject);
+
+  std::shared_ptr <JitterBufferParams> params (new JitterBufferParams () );
+  params->setAdaptive (false);
+  params->setMinLatency (50);
+  params->setMaxLatency (300);
+
+  rtpEndpoint->setJitterBufferParams (params);
+  params = rtpEndpoint->getJitterBufferParams ();
+
+  BOOST_CHECK (!params->getAdaptive () );
+  BOOST_CHECK_EQUAL (50, params->getMinLatency () );
+  BOOST_CHECK_EQUAL (300, params->getMaxLatency () );
+
+  /* Invalid ranges are ignored */
+  params.reset (new JitterBufferParams () );
+  params->setMinLatency (400);
+  rtpEndpoint->setJitterBufferParams (params);
+
+  params = rtpEndpoint->getJitterBufferParams ();
+  BOOST_CHECK_EQUAL (50, params->getMinLatency () );
+
+  releaseMediaObject (rtpEndpoint->getId() );
+  releaseMediaObject (mediaPipelineId);
+
+  rtpEndpoint.reset ();
+  pipe.reset();
+}
+
+BOOST_AUTO_TEST_CASE (protection_params)
+{
+  mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+
+  std::shared_ptr <MediaObjectImpl> pipe =
+    MediaSet::getMediaSet()->getMediaObject (
+      mediaPipelineId);
+
+  auto mediaObject = MediaSet::getMediaSet()->ref (new  BaseRtpEndpointImpl (
+                       boost::property_tree::ptree(), pipe, "dummyrtp") );
+  std::shared_ptr <BaseRtpEndpointImpl> rtpEndpoint = std::dynamic_pointer_cast
+      <BaseRtpEndpointImpl> (mediaObject);
+  MediaSet::getMediaSet()->ref ("", mediaObject);
+
+  std::shared_ptr <ProtectionParams> params = rtpEndpoint->getProtectionParams ();
+
+  BOOST_CHECK (params->getAdaptive () );
+  BOOST_CHECK_EQUAL (50, params->getMaxFecPercentage () );
+  BOOST_CHECK_EQUAL (150, params->getRtxMaxRtt () );
+
+  params.reset (new ProtectionParams () );
+  params->setAdaptive (false);
+  params->setMaxFecPercentage (20);
+  params->setRtxMaxRtt (300);
+
+  rtpEndpoint->setProtectionParams (params);
+  params = rtpEndpoint->getProtectionParams ();
+
+  BOOST_CHECK (!params->getAdaptive () );
+  BOOST_CHECK_EQUAL (20, params->getMaxFecPercentage () );
+  BOOST_CHECK_EQUAL (300, params->getRtxMaxRtt () );
+
+  /* Invalid percentages are ignored */
+  params.reset (new ProtectionParams () );
+  params->setMaxFecPercentage (150);
+  rtpEndpoint->setProtectionParams (params);
+
+  params = rtpEndpoint->getProtectionParams ();
+  BOOST_CHECK_EQUAL (20, params->getMaxFecPercentage () );
+
+  releaseMediaObject (rtpEndpoint->getId() );
+  releaseMediaObject (mediaPipelineId);
+
+  rtpEndpoint.reset ();
+  pipe.reset();
+}
+
+BOOST_AUTO_TEST_CASE (rtp_stats_snapshot)
+{
+  mediaPipelineId =
+    moduleManager.getFactory ("MediaPipeline")->createObject (
+      config, "",
+      Json::Value() )->getId();
+
+  std::shared_ptr <MediaObjectImpl> pipe =
+    MediaSet::getMediaSet()->getMediaObject (
+      mediaPipelineId);
+
+  auto mediaObject = MediaSet::getMediaSet()->ref (new  BaseRtpEndpointImpl (
+                       boost::property_tree::ptree(), pipe, "dummyrtp") );
+  std::shared_ptr <BaseRtpEndpointImpl> rtpEndpoint = std::dynamic_pointer_cast
+      <BaseRtpEndpointImpl> (mediaObject);
+  MediaSet::getMediaSet()->ref ("", mediaObject);
+
+  gboolean structure;
+
+  /* RTC stats are not serialized in the stats signal any more */
+  g_object_get (rtpEndpoint->getGstreamerElement (), "rtc-stats-structure",
+                &structure, NULL);
+  BOOST_CHECK (!structure);
+
+  /* No session negotiated, so no RTP stats are reported */
+  for (auto it : rtpEndpoint->getStats () ) {
+    auto type = it.second->getType ()->getValue ();
+
+    BOOST_CHECK (type != StatsType::inboundrtp);
+    BOOST_CHECK (type != StatsType::outboundrtp);
+  }
+
+  releaseMediaObject (rtpEndpoint->getId() );
+  releaseMediaObject (mediaPipelineId);
+
+  rtpEndpoint.reset ();
+  pipe.reset();
+}
@@ -0,0 +1,109 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE WorkerPool
+#include <boost/test/unit_test.hpp>
+#include <WorkerPool.hpp>
+
+#include <gst/gst.h>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "kmsmetrics.h"
+
+using namespace kurento;
+
+static KmsMetric *
+getQueuedTasks ()
+{
+  return kms_metrics_get_gauge ("kms_worker_pool_queued_tasks",
+                                "Tasks waiting or running in the worker pools");
+}
+
+BOOST_AUTO_TEST_CASE (queued_tasks_gauge)
+{
+  gst_init (NULL, NULL);
+
+  WorkerPool pool (1);
+  gint64 initial = kms_metric_get (getQueuedTasks () );
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool release = false;
+  std::promise<gint64> running;
+  std::promise<void> done;
+
+  pool.post ([&] () {
+    std::unique_lock<std::mutex> lock (mutex);
+
+    running.set_value (kms_metric_get (getQueuedTasks () ) );
+    cond.wait (lock, [&release] () {
+      return release;
+    });
+  });
+  pool.post ([&] () {
+    done.set_value ();
+  });
+
+  /* Tasks are counted until they finish running */
+  BOOST_CHECK_EQUAL (running.get_future ().get (), initial + 2);
+
+  std::unique_lock<std::mutex> lock (mutex);
+  release = true;
+  cond.notify_all ();
+  lock.unlock ();
+
+  auto future = done.get_future ();
+  BOOST_REQUIRE (future.wait_for (std::chrono::seconds (5) ) ==
+                 std::future_status::ready);
+
+  for (int i = 0; i < 100 && kms_metric_get (getQueuedTasks () ) != initial;
+       i++) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (10) );
+  }
+
+  BOOST_CHECK_EQUAL (kms_metric_get (getQueuedTasks () ), initial);
+}
+
+BOOST_AUTO_TEST_CASE (failed_task)
+{
+  WorkerPool pool (1);
+  gint64 initial = kms_metric_get (getQueuedTasks () );
+  std::promise<void> done;
+
+  /* The failed task is not counted anymore once the worker recovers */
+  pool.post ([] () {
+    throw std::runtime_error ("Task failed");
+  });
+  pool.post ([&] () {
+    done.set_value ();
+  });
+
+  auto future = done.get_future ();
+  BOOST_REQUIRE (future.wait_for (std::chrono::seconds (5) ) ==
+                 std::future_status::ready);
+
+  for (int i = 0; i < 100 && kms_metric_get (getQueuedTasks () ) != initial;
+       i++) {
+    std::this_thread::sleep_for (std::chrono::milliseconds (10) );
+  }
+
+  BOOST_CHECK_EQUAL (kms_metric_get (getQueuedTasks () ), initial);
+}